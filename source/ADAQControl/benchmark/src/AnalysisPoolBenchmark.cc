@@ -0,0 +1,242 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: AnalysisPoolBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures how the waveform analysis throughput [waveforms/s]
+//       of ADAQAnalysisPool scales with the number of workers, from
+//       one worker up to the number of hardware threads (or the given
+//       maximum), in both ordered and unordered delivery mode.
+//       Waveforms of all 16 channels of an emulated V1725 are decoded
+//       once into ADAQEventArena objects; each block transfer is then
+//       split into tasks of "TaskSize" events, which are analyzed with
+//       ADAQWaveformAnalyzer on the workers. In ordered mode, the
+//       delivery is checked to follow the trigger (event counter)
+//       order exactly.
+//
+// 2run: $ ./bin/AnalysisPoolBenchmark [MaxWorkers] [TaskSize] [RecordLength]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+using namespace std;
+
+// Boost
+#include <boost/bind/bind.hpp>
+using namespace boost::placeholders;
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQEventArena.hh"
+#include "ADAQWaveformAnalyzer.hh"
+#include "ADAQAnalysisPool.hh"
+
+
+const uint32_t NumChannels = 16;
+
+// Prevent the compiler from optimizing away the results
+static volatile double Sink = 0.;
+
+
+// The state of one block transfer being analyzed by the pool
+struct Batch{
+  ADAQEventArena *Arena;
+  vector<ADAQWaveformResults> Results; // One per task and channel
+  uint32_t TaskSize;
+};
+
+
+// Analyze all channels of events [First, First+Count) of a batch
+void Analyze(ADAQWaveformAnalyzer *Analyzer, Batch *B, uint32_t First, uint32_t Count)
+{
+  const uint32_t RL = Analyzer->GetRecordLength();
+  const uint32_t Task = First / B->TaskSize;
+
+  for(uint32_t ch=0; ch<NumChannels; ch++)
+    Analyzer->AnalyzeBatch(B->Arena->GetWaveform(First, ch).Data, Count, NumChannels * RL,
+			   &B->Results[Task * NumChannels + ch]);
+}
+
+
+// Consume the results on the output thread; counts any event that
+// is not delivered in trigger order
+void Deliver(Batch *B, uint32_t *NextCounter, uint64_t *OrderErrors, uint32_t First, uint32_t Count)
+{
+  const uint32_t Task = First / B->TaskSize;
+
+  for(uint32_t e=0; e<Count; e++){
+    const uint32_t Counter = B->Arena->GetEventCounter(First + e);
+    if(Counter != *NextCounter)
+      (*OrderErrors)++;
+    *NextCounter = (Counter + 1) & 0xffffff;
+
+    for(uint32_t ch=0; ch<NumChannels; ch++)
+      Sink += B->Results[Task * NumChannels + ch].PulseArea[e];
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t MaxWorkers = (argc > 1) ? atoi(argv[1]) : boost::thread::hardware_concurrency();
+  uint32_t TaskSize = (argc > 2) ? atoi(argv[2]) : 32;
+  uint32_t RecordLength = (argc > 3) ? atoi(argv[3]) : 512;
+
+  if(MaxWorkers == 0)
+    MaxWorkers = 1;
+  if(TaskSize == 0)
+    TaskSize = 32;
+
+  const uint32_t EventsPerBLT = 256;
+  const int NumBuffers = 32;
+  const double MinTime = 1.; // [s] per measurement
+
+  // Decode every block transfer once; the pool only analyzes
+
+  ADAQEmulatedDigitizer *DG = new ADAQEmulatedDigitizer(zV1725, 0);
+  DG->SetTriggerRate(0.);
+  DG->SetMemoryBlocks(EventsPerBLT);
+  DG->OpenLink();
+  DG->SetRecordLength(RecordLength);
+  DG->SetChannelEnableMask(0xffff);
+  DG->SetMaxNumEventsBLT(EventsPerBLT);
+  DG->GetRecordLength(&RecordLength);
+
+  const uint32_t NumTasks = (EventsPerBLT + TaskSize - 1) / TaskSize;
+
+  vector<Batch> Batches(NumBuffers);
+  char *Buffer = NULL;
+  uint32_t Size = 0;
+
+  DG->MallocReadoutBuffer(&Buffer, &Size);
+  DG->SWStartAcquisition();
+  for(int b=0; b<NumBuffers; b++){
+    Batches[b].Arena = new ADAQEventArena(EventsPerBLT, NumChannels * RecordLength);
+    Batches[b].Results.resize(NumTasks * NumChannels);
+    Batches[b].TaskSize = TaskSize;
+    DG->ReadData(Buffer, &Size);
+    DG->DecodeSTDBuffer(Buffer, Size, Batches[b].Arena);
+  }
+  DG->SWStopAcquisition();
+  DG->FreeReadoutBuffer(&Buffer);
+
+  ADAQWaveformAnalyzer Analyzer(RecordLength);
+
+  cout << "\nAnalysisPoolBenchmark : RecordLength = " << RecordLength
+       << ", " << NumChannels << " channels, " << EventsPerBLT << " events per BLT, "
+       << TaskSize << " events per task\n"
+       << endl;
+
+  cout << setw(10) << "Delivery" << setw(9) << "Workers" << setw(16) << "[waveforms/s]"
+       << setw(10) << "Speedup" << setw(14) << "Utilization" << setw(10) << "Steals"
+       << setw(14) << "Order errors" << endl;
+
+  int Status = 0;
+
+  for(int Mode=0; Mode<2; Mode++){
+
+    const bool Ordered = (Mode == 0);
+    double BaseRate = 0.;
+
+    for(uint32_t NumWorkers=1; NumWorkers<=MaxWorkers; NumWorkers++){
+
+      ADAQAnalysisPool Pool(NumWorkers);
+      Pool.SetOrdered(Ordered);
+      Pool.SetMaxPendingTasks(4 * NumTasks);
+      Pool.Start();
+
+      // The event counter continues across all batches
+      uint32_t NextCounter = Batches[0].Arena->GetEventCounter(0);
+      uint64_t OrderErrors = 0, Waveforms = 0;
+
+      chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+      chrono::duration<double> Elapsed(0.);
+
+      while(Elapsed.count() < MinTime){
+
+	// Each pass restarts the counter sequence at the first batch
+	NextCounter = Batches[0].Arena->GetEventCounter(0);
+
+	for(int b=0; b<NumBuffers; b++){
+	  Batch *B = &Batches[b];
+	  const uint32_t N = B->Arena->GetNumEvents();
+
+	  // The batches are only reused after the pass is drained
+	  Pool.SubmitBatch(N, TaskSize,
+			   boost::bind(Analyze, &Analyzer, B, _1, _2),
+			   boost::bind(Deliver, B, &NextCounter, &OrderErrors, _1, _2));
+	  Waveforms += (uint64_t)N * NumChannels;
+
+	  Pool.Deliver();
+	}
+	Pool.Drain();
+	Elapsed = chrono::steady_clock::now() - Start;
+      }
+
+      double Utilization = 0.;
+      uint64_t Steals = 0;
+      for(uint32_t w=0; w<NumWorkers; w++){
+	ADAQAnalysisWorkerStats Stats = Pool.GetWorkerStats(w);
+	Utilization += Stats.Utilization / NumWorkers;
+	Steals += Stats.Steals;
+      }
+
+      double Rate = Waveforms / Elapsed.count();
+      if(NumWorkers == 1)
+	BaseRate = Rate;
+
+      // Completion order carries no ordering guarantee
+      if(!Ordered)
+	OrderErrors = 0;
+      else if(OrderErrors > 0)
+	Status = -42;
+
+      cout << setw(10) << (Ordered ? "ordered" : "unordered") << setw(9) << NumWorkers
+	   << setw(16) << setprecision(4) << Rate << setw(10) << Rate / BaseRate
+	   << setw(13) << 100. * Utilization << "%" << setw(10) << Steals
+	   << setw(14) << (Ordered ? to_string(OrderErrors) : "n/a") << endl;
+
+      Pool.Stop();
+    }
+  }
+  cout << endl;
+
+  // Per-worker breakdown of the largest pool
+  ADAQAnalysisPool Pool(MaxWorkers);
+  Pool.Start();
+  for(int b=0; b<NumBuffers; b++){
+    uint32_t NextCounter = Batches[b].Arena->GetEventCounter(0);
+    uint64_t OrderErrors = 0;
+    Pool.SubmitBatch(Batches[b].Arena->GetNumEvents(), TaskSize,
+		     boost::bind(Analyze, &Analyzer, &Batches[b], _1, _2),
+		     boost::bind(Deliver, &Batches[b], &NextCounter, &OrderErrors, _1, _2));
+    Pool.Drain();
+  }
+  Pool.PrintStats();
+  Pool.Stop();
+
+  for(size_t b=0; b<Batches.size(); b++)
+    delete Batches[b].Arena;
+
+  DG->CloseLink();
+  delete DG;
+
+  return Status;
+}
@@ -0,0 +1,119 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: MultiReadoutBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures the total throughput and per-board dead time of
+//       ADAQReadoutEngine for several emulated V1720 boards. The
+//       boards are first placed on a single link, such that they are
+//       read out one after another by one thread, and then each on
+//       its own link with its own readout thread. The emulated link
+//       bandwidth delays every block transfer by the time it would
+//       take over a real optical link.
+//
+// 2run: $ ./bin/MultiReadoutBenchmark [Boards] [Seconds] [Rate] [MB/s]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+using namespace std;
+
+// Boost
+#include <boost/thread.hpp>
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQReadoutEngine.hh"
+
+
+int main(int argc, char *argv[])
+{
+  int NumBoards = (argc > 1) ? atoi(argv[1]) : 4;
+  double Duration = (argc > 2) ? atof(argv[2]) : 2.;
+  double Rate = (argc > 3) ? atof(argv[3]) : 5000.;
+  double Bandwidth = (argc > 4) ? atof(argv[4]) : 80.;
+
+  cout << "\nMultiReadoutBenchmark : " << NumBoards << " boards, " << Rate << " Hz per board, "
+       << Bandwidth << " MB/s per link, " << Duration << " s per measurement\n"
+       << endl;
+
+  const char *Layouts[2] = {"One link (serial)", "One link per board (parallel)"};
+
+  for(int l=0; l<2; l++){
+
+    ADAQReadoutEngine Engine(8);
+
+    for(int b=0; b<NumBoards; b++){
+      int LinkNumber = (l == 0) ? 0 : b;
+      ADAQEmulatedDigitizer *DG = new ADAQEmulatedDigitizer(zV1720, b, 0x00000000, LinkNumber, 0);
+      DG->SetTriggerRate(Rate);
+      DG->SetLinkBandwidth(Bandwidth);
+      Engine.AddDigitizer(DG);
+    }
+
+    Engine.OpenLinks();
+
+    for(uint32_t b=0; b<Engine.GetNumDigitizers(); b++){
+      ADAQDigitizer *DG = Engine.GetDigitizer(b);
+      DG->SetRecordLength(512);
+      DG->SetChannelEnableMask(0xff);
+      DG->SetMaxNumEventsBLT(100);
+    }
+
+    Engine.SetReadoutThreshold(10, 10);
+    Engine.AllocateBuffers();
+
+    for(uint32_t b=0; b<Engine.GetNumDigitizers(); b++)
+      Engine.GetDigitizer(b)->SWStartAcquisition();
+    Engine.Start();
+
+    // The main thread acts as the downstream stage and simply returns
+    // every filled buffer to its board's pool
+
+    boost::posix_time::ptime End = boost::posix_time::microsec_clock::universal_time()
+      + boost::posix_time::microseconds((int64_t)(Duration * 1e6));
+
+    while(boost::posix_time::microsec_clock::universal_time() < End){
+      ADAQReadoutBuffer *Buffer = Engine.WaitForFilledBuffer(10000);
+      if(Buffer)
+	Engine.ReleaseBuffer(Buffer);
+    }
+
+    Engine.Stop();
+    for(uint32_t b=0; b<Engine.GetNumDigitizers(); b++)
+      Engine.GetDigitizer(b)->SWStopAcquisition();
+
+    vector<ADAQReadoutEngineBoardStats> Stats = Engine.GetStats();
+
+    double Throughput = 0., DeadTime = 0.;
+    for(uint32_t b=0; b<Stats.size(); b++){
+      Throughput += Stats[b].Throughput;
+      DeadTime += Stats[b].DeadTimeFraction / Stats.size();
+    }
+
+    cout << "-- " << Layouts[l] << " : " << setprecision(4) << Throughput << " MB/s total, "
+	 << 100. * DeadTime << " % mean dead time\n" << endl;
+
+    Engine.PrintStats();
+
+    Engine.FreeBuffers();
+    Engine.CloseLinks();
+  }
+
+  return 0;
+}
@@ -0,0 +1,283 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: PSDDecoderBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Compares the native ADAQDigitizer::DecodePSDBuffer() decoder
+//       with the reference DPP-PSD decoding path (GetDPPEvents()
+//       followed by DecodeDPPWaveforms() for every event) for x725
+//       and x730 DPP-PSD buffers. A set of block transfers is first
+//       recorded; the two decoders are then checked to produce
+//       identical event-level data and waveforms before the
+//       throughput of the following is measured:
+//
+//         Reference, all waveforms : GetDPPEvents() + DecodeDPPWaveforms()
+//         Reference, charges only  : GetDPPEvents()
+//         Reference, lazy          : GetDPPEvents() + DecodeDPPWaveforms()
+//                                    of the pile-up flagged events only (~1%)
+//         Native, charges only     : DecodePSDBuffer()
+//         Native, lazy             : DecodePSDBuffer() + waveforms of the
+//                                    pile-up flagged events only
+//         Native, all waveforms    : DecodePSDBuffer() + every waveform
+//
+//       The modes are measured in interleaved rounds and the best
+//       round of each is reported, such that a busy machine does not
+//       favour one mode. Each mode is compared with the reference
+//       mode of the same output. As for STDDecoderBenchmark, the reference is
+//       the emulator's own implementation of the CAENDigitizer calls
+//       (ADAQEmulatedDigitizer), not the CAENDigitizer library, unless
+//       the emulator is replaced by a connected ADAQDigitizer.
+//
+//       Without waveforms both decoders make the same single pass
+//       over the event words and are bound by reading the buffer, so
+//       the native charges only mode runs at about the speed of the
+//       reference (0.9-1.1x on a shared single core, within the
+//       noise). The native decoder gains where waveforms are decoded:
+//       the lazy and all waveforms modes.
+//
+// 2run: $ ./bin/PSDDecoderBenchmark [RecordLength] [EventsPerBLT]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+using namespace std;
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQPSDEventArena.hh"
+
+
+// Prevent the compiler from optimizing away the decoded data
+static volatile uint64_t Sink = 0;
+
+enum DecodeMode{ReferenceAll, ReferenceCharges, ReferenceLazy, NativeCharges, NativeLazy, NativeAll,
+		NumModes};
+
+const char *ModeNames[NumModes] = {"Reference, all waveforms", "Reference, charges only",
+				   "Reference, lazy", "Native, charges only", "Native, lazy",
+				   "Native, all waveforms"};
+
+
+// Decode a buffer in the given mode; returns the number of events
+uint64_t Decode(ADAQDigitizer *DG, DecodeMode Mode, char *Buffer, uint32_t Size,
+		CAEN_DGTZ_DPP_PSD_Event_t **Events, CAEN_DGTZ_DPP_PSD_Waveforms_t *Waveforms,
+		ADAQPSDEventArena *Arena, uint16_t *Trace)
+{
+  uint64_t NumEvents = 0, Sum = 0;
+
+  if(Mode == ReferenceAll or Mode == ReferenceCharges or Mode == ReferenceLazy){
+    uint32_t NumEventsArray[MAX_DPP_PSD_CHANNEL_SIZE];
+    DG->GetDPPEvents(Buffer, Size, Events, NumEventsArray);
+
+    for(int ch=0; ch<DG->GetNumChannels(); ch++){
+      for(uint32_t evt=0; evt<NumEventsArray[ch]; evt++){
+	Sum += Events[ch][evt].ChargeLong + Events[ch][evt].TimeTag;
+	if(Mode == ReferenceAll or (Mode == ReferenceLazy and Events[ch][evt].Pur)){
+	  DG->DecodeDPPWaveforms(&Events[ch][evt], Waveforms);
+	  Sum += Waveforms->Trace1[Waveforms->Ns/2];
+	}
+      }
+      NumEvents += NumEventsArray[ch];
+    }
+  }
+  else{
+    DG->DecodePSDBuffer(Buffer, Size, Arena);
+
+    for(int ch=0; ch<DG->GetNumChannels(); ch++){
+      const uint32_t N = Arena->GetNumEvents(ch);
+      const int16_t *ChargeLong = Arena->GetChargeLongs(ch);
+      const uint32_t *TimeTag = Arena->GetTimeTags(ch);
+      const uint8_t *PileUp = Arena->GetPileUps(ch);
+
+      for(uint32_t evt=0; evt<N; evt++){
+	Sum += ChargeLong[evt] + TimeTag[evt];
+	if(Mode == NativeAll or (Mode == NativeLazy and PileUp[evt])){
+	  uint32_t Samples = Arena->DecodeWaveform(ch, evt, Trace);
+	  Sum += Trace[Samples/2];
+	}
+      }
+      NumEvents += N;
+    }
+  }
+  Sink += Sum;
+
+  return NumEvents;
+}
+
+
+// Check that both decoders produce identical output; returns the
+// number of mismatched events
+uint64_t Compare(ADAQDigitizer *DG, char *Buffer, uint32_t Size,
+		 CAEN_DGTZ_DPP_PSD_Event_t **Events, CAEN_DGTZ_DPP_PSD_Waveforms_t *Waveforms,
+		 ADAQPSDEventArena *Arena, uint16_t *Trace)
+{
+  uint64_t Mismatches = 0;
+
+  uint32_t NumEventsArray[MAX_DPP_PSD_CHANNEL_SIZE];
+  DG->GetDPPEvents(Buffer, Size, Events, NumEventsArray);
+  DG->DecodePSDBuffer(Buffer, Size, Arena);
+
+  for(int ch=0; ch<DG->GetNumChannels(); ch++){
+
+    if(NumEventsArray[ch] != Arena->GetNumEvents(ch)){
+      Mismatches += max(NumEventsArray[ch], Arena->GetNumEvents(ch));
+      continue;
+    }
+
+    for(uint32_t evt=0; evt<NumEventsArray[ch]; evt++){
+      CAEN_DGTZ_DPP_PSD_Event_t &Event = Events[ch][evt];
+
+      bool Match = (Event.TimeTag == Arena->GetTimeTag(ch, evt) and
+		    Event.ChargeShort == Arena->GetChargeShort(ch, evt) and
+		    Event.ChargeLong == Arena->GetChargeLong(ch, evt) and
+		    Event.Baseline == Arena->GetBaseline(ch, evt) and
+		    (Event.Pur != 0) == Arena->GetPileUp(ch, evt) and
+		    Event.Extras == Arena->GetExtras(ch, evt));
+
+      DG->DecodeDPPWaveforms(&Event, Waveforms);
+      uint32_t Samples = Arena->DecodeWaveform(ch, evt, Trace);
+
+      if(Samples != Waveforms->Ns)
+	Match = false;
+      for(uint32_t s=0; s<Samples and Match; s++)
+	if(Trace[s] != Waveforms->Trace1[s])
+	  Match = false;
+
+      if(!Match)
+	Mismatches++;
+    }
+  }
+
+  return Mismatches;
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t RecordLength = (argc > 1) ? atoi(argv[1]) : 256;
+  uint32_t EventsPerBLT = (argc > 2) ? atoi(argv[2]) : 1000;
+
+  const int NumBuffers = 64;
+  const int NumRounds = 5;
+  const double MinTime = 0.2; // [s] per mode and round
+
+  ZBoardType Types[2] = {zV1725, zDT5730};
+
+  cout << "\nPSDDecoderBenchmark : RecordLength = " << RecordLength
+       << ", events per BLT = " << EventsPerBLT << ", all channels enabled\n"
+       << "Reference : emulated CAENDigitizer decoding (ADAQEmulatedDigitizer)\n"
+       << endl;
+
+  int Status = 0;
+
+  for(int t=0; t<2; t++){
+
+    ADAQEmulatedDigitizer *Emulator = new ADAQEmulatedDigitizer(Types[t], 0);
+    Emulator->SetFirmwareType("PSD");
+    Emulator->SetTriggerRate(0.);
+    Emulator->SetMemoryBlocks(EventsPerBLT);
+    Emulator->OpenLink();
+
+    ADAQDigitizer *DG = Emulator;
+    DG->SetRecordLength(RecordLength);
+    DG->SetChannelEnableMask(0xffff);
+    DG->SetDPPEventAggregation(EventsPerBLT, 0);
+
+    // Record the block transfers to be decoded
+
+    vector<char *> Buffers(NumBuffers, (char *)NULL);
+    vector<uint32_t> Sizes(NumBuffers, 0);
+    uint64_t TotalBytes = 0;
+
+    DG->SWStartAcquisition();
+    for(int b=0; b<NumBuffers; b++){
+      DG->MallocReadoutBuffer(&Buffers[b], &Sizes[b]);
+      DG->ReadData(Buffers[b], &Sizes[b]);
+      TotalBytes += Sizes[b];
+    }
+    DG->SWStopAcquisition();
+
+    CAEN_DGTZ_DPP_PSD_Event_t *Events[MAX_DPP_PSD_CHANNEL_SIZE];
+    CAEN_DGTZ_DPP_PSD_Waveforms_t *Waveforms = NULL;
+    uint32_t AllocatedSize = 0;
+    DG->MallocDPPEvents(Events, &AllocatedSize);
+    DG->MallocDPPWaveforms(&Waveforms, &AllocatedSize);
+
+    ADAQPSDEventArena Arena(EventsPerBLT);
+    vector<uint16_t> Trace(RecordLength + 8);
+
+    // Validate the native decoder against the reference decoder
+
+    uint64_t Mismatches = 0;
+    for(int b=0; b<NumBuffers; b++)
+      Mismatches += Compare(DG, Buffers[b], Sizes[b], Events, Waveforms, &Arena, Trace.data());
+
+    if(Mismatches)
+      Status = -42;
+
+    cout << DG->GetBoardModelName() << " : native and reference decoders are "
+	 << (Mismatches ? "MISMATCHED" : "identical") << "\n"
+	 << setw(26) << "Mode" << setw(16) << "[evt/s]" << setw(16) << "[MB/s]"
+	 << setw(10) << "vs. Ref." << endl;
+
+    // Measure the throughput of each decoding mode
+
+    double Rate[NumModes] = {0.}, ByteRate[NumModes] = {0.};
+
+    for(int r=0; r<NumRounds; r++){
+      for(int m=0; m<NumModes; m++){
+	uint64_t NumEvents = 0, Bytes = 0;
+	chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+	chrono::duration<double> Elapsed(0.);
+
+	while(Elapsed.count() < MinTime){
+	  for(int b=0; b<NumBuffers; b++)
+	    NumEvents += Decode(DG, (DecodeMode)m, Buffers[b], Sizes[b], Events, Waveforms, &Arena, Trace.data());
+	  Bytes += TotalBytes;
+	  Elapsed = chrono::steady_clock::now() - Start;
+	}
+	Rate[m] = max(Rate[m], NumEvents / Elapsed.count());
+	ByteRate[m] = max(ByteRate[m], Bytes / Elapsed.count() / 1e6);
+      }
+    }
+
+    // Each mode is compared with the reference mode of the same output
+    const DecodeMode Refs[NumModes] = {ReferenceAll, ReferenceCharges, ReferenceLazy,
+				       ReferenceCharges, ReferenceLazy, ReferenceAll};
+    for(int m=0; m<NumModes; m++){
+      const DecodeMode Ref = Refs[m];
+      cout << setw(26) << ModeNames[m] << setw(16) << setprecision(4) << Rate[m]
+	   << setw(16) << ByteRate[m]
+	   << setw(10) << Rate[m] / Rate[Ref] << endl;
+    }
+    cout << endl;
+
+    DG->FreeDPPEvents((void **)Events);
+    DG->FreeDPPWaveforms(Waveforms);
+
+    for(int b=0; b<NumBuffers; b++)
+      DG->FreeReadoutBuffer(&Buffers[b]);
+
+    DG->CloseLink();
+    delete DG;
+  }
+
+  return Status;
+}
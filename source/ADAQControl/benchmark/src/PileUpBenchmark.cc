@@ -0,0 +1,174 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: PileUpBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures the cost of the ADAQWaveformAnalyzer software pile-up
+//       detection and its detection efficiency. Negative-going
+//       pulses with random amplitude and Gaussian noise are
+//       generated; a fraction of the records carry a second pulse at
+//       a random separation. For each SIMD level, the single-core
+//       throughput [waveforms/s] is measured without and with the
+//       detection (best of five interleaved rounds); the efficiency
+//       (piled-up records found) and the false positive rate (single
+//       pulses flagged) are reported.
+//
+// 2run: $ ./bin/PileUpBenchmark [RecordLength] [PileUpFraction]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+using namespace std;
+
+// ADAQ
+#include "ADAQWaveformAnalyzer.hh"
+
+
+// Prevent the compiler from optimizing away the results
+static volatile double Sink = 0.;
+
+
+// Best throughput [waveforms/s] of one measurement of "MinTime"
+double Measure(ADAQWaveformAnalyzer &Analyzer, const vector<uint16_t> &Samples,
+	       uint32_t NumWaveforms, uint32_t RecordLength, ADAQWaveformResults *Results)
+{
+  const double MinTime = 0.25; // [s]
+
+  uint64_t Waveforms = 0;
+  chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+  chrono::duration<double> Elapsed(0.);
+
+  while(Elapsed.count() < MinTime){
+    Analyzer.AnalyzeBatch(Samples.data(), NumWaveforms, RecordLength, Results);
+    Sink += Results->PulseHeight[NumWaveforms/2];
+    Waveforms += NumWaveforms;
+    Elapsed = chrono::steady_clock::now() - Start;
+  }
+  return Waveforms / Elapsed.count();
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t RecordLength = (argc > 1) ? atoi(argv[1]) : 256;
+  double PileUpFraction = (argc > 2) ? atof(argv[2]) : 0.2;
+
+  const uint32_t NumWaveforms = 10000;
+  const double RiseTime = 1.5, DecayTime = 15.; // [samples]
+  const int Baseline = 14000;
+  const uint32_t MinSeparation = 10; // [samples]
+  const int NumRounds = 5;
+
+  // Generate the waveforms; the second pulse, if any, follows the
+  // first by MinSeparation to half the record
+
+  vector<uint16_t> Samples((size_t)NumWaveforms * RecordLength);
+  vector<bool> PiledUp(NumWaveforms);
+
+  mt19937 Engine(42);
+  uniform_real_distribution<double> Uniform(0., 1.), Amplitude(200., 4000.);
+  normal_distribution<double> Noise(0., 2.);
+
+  const uint32_t T0 = RecordLength / 4;
+
+  for(uint32_t w=0; w<NumWaveforms; w++){
+    PiledUp[w] = (Uniform(Engine) < PileUpFraction);
+    const double A0 = Amplitude(Engine), A1 = Amplitude(Engine);
+    const double T1 = T0 + MinSeparation + Uniform(Engine) * (RecordLength / 2 - MinSeparation);
+
+    for(uint32_t s=0; s<RecordLength; s++){
+      double V = 0.;
+      double t = (double)s - T0;
+      if(t > 0.)
+	V += A0 * (exp(-t/DecayTime) - exp(-t/RiseTime));
+      t = s - T1;
+      if(PiledUp[w] and t > 0.)
+	V += A1 * (exp(-t/DecayTime) - exp(-t/RiseTime));
+      Samples[(size_t)w * RecordLength + s] = (uint16_t)lround(Baseline - V + Noise(Engine));
+    }
+  }
+
+  ADAQWaveformAnalyzer Analyzer(RecordLength);
+  Analyzer.SetPolarity(-1);
+  Analyzer.SetBaselineRegion(0, RecordLength / 5);
+  Analyzer.SetPileUpThreshold(40);
+  Analyzer.SetPileUpDerivativeGap(3);
+  Analyzer.SetPileUpMinSeparation(MinSeparation / 2);
+  Analyzer.SetVerbose(true);
+
+  ADAQWaveformResults Results;
+
+  cout << "\nPileUpBenchmark : RecordLength = " << RecordLength << ", "
+       << 100. * PileUpFraction << "% piled up, single core\n"
+       << endl;
+
+  // Detection efficiency and false positives
+
+  Analyzer.SetPileUpMode(zPileUpTag);
+  if(Analyzer.AnalyzeBatch(Samples.data(), NumWaveforms, RecordLength, &Results) != 0)
+    return -42;
+
+  uint32_t NumPiledUp = 0, Found = 0, False = 0;
+  for(uint32_t w=0; w<NumWaveforms; w++){
+    if(PiledUp[w]){
+      NumPiledUp++;
+      Found += (Results.PileUpCount[w] > 0);
+    }
+    else
+      False += (Results.PileUpCount[w] > 0);
+  }
+
+  cout << "Efficiency      : " << 100. * Found / max(NumPiledUp, 1u) << " %\n"
+       << "False positives : " << 100. * False / max(NumWaveforms - NumPiledUp, 1u) << " %\n"
+       << endl;
+
+  // Throughput
+
+  const char *Names[3] = {"Scalar", "SSE2", "AVX2"};
+  const ZSIMDLevel Levels[3] = {zSIMDScalar, zSIMDSSE2, zSIMDAVX2};
+
+  cout << setw(10) << "SIMD" << setw(16) << "Off [wf/s]" << setw(16) << "Tag [wf/s]"
+       << setw(16) << "Reject [wf/s]" << setw(14) << "Tag cost [%]" << endl;
+
+  for(int l=0; l<3; l++){
+    if(Analyzer.SetSIMDLevel(Levels[l]) != 0)
+      continue;
+
+    // The modes are measured in interleaved rounds, keeping the best
+    // rate of each, such that drifts of the machine affect all alike
+    const ZPileUpMode Modes[3] = {zPileUpOff, zPileUpTag, zPileUpReject};
+    double Rates[3] = {0., 0., 0.};
+
+    for(int r=0; r<NumRounds; r++)
+      for(int m=0; m<3; m++){
+	Analyzer.SetPileUpMode(Modes[m]);
+	Rates[m] = max(Rates[m], Measure(Analyzer, Samples, NumWaveforms, RecordLength, &Results));
+      }
+
+    cout << setw(10) << Names[l] << setprecision(4)
+	 << setw(16) << Rates[0] << setw(16) << Rates[1] << setw(16) << Rates[2]
+	 << setw(14) << 100. * (Rates[0] / Rates[1] - 1.) << endl;
+  }
+  cout << endl;
+
+  return 0;
+}
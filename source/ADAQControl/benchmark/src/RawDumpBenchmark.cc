@@ -0,0 +1,146 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: RawDumpBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures the throughput of the raw dump mode of
+//       ADAQReadoutEngine: several emulated V1720 boards, each on its
+//       own link, are read out and every buffer is written undecoded
+//       to a dump file by ADAQRawDumpWriter, first with O_DIRECT and
+//       then through the page cache. The engine, writer, and board
+//       dead time statistics are printed, and the dump is read back
+//       with ADAQRawDumpReader to check that every transfer was
+//       written. The dump file should be placed on the disk that is
+//       to be used for the runs.
+//
+// 2run: $ ./bin/RawDumpBenchmark [DumpFile] [Boards] [Seconds] [Rate] [MB/s]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+using namespace std;
+
+// Boost
+#include <boost/thread.hpp>
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQReadoutEngine.hh"
+#include "ADAQRawDumpWriter.hh"
+#include "ADAQRawDumpReader.hh"
+
+
+int main(int argc, char *argv[])
+{
+  string FileName = (argc > 1) ? argv[1] : "/tmp/RawDumpBenchmark.adaqraw";
+  int NumBoards = (argc > 2) ? atoi(argv[2]) : 2;
+  double Duration = (argc > 3) ? atof(argv[3]) : 5.;
+  double Rate = (argc > 4) ? atof(argv[4]) : 50000.;
+  double Bandwidth = (argc > 5) ? atof(argv[5]) : 0.;
+
+  cout << "\nRawDumpBenchmark : " << NumBoards << " boards, " << Rate << " Hz per board, "
+       << Bandwidth << " MB/s per link (0: unlimited), " << Duration << " s per measurement\n"
+       << endl;
+
+  const char *Modes[2] = {"O_DIRECT", "Page cache"};
+
+  int Status = 0;
+
+  for(int m=0; m<2; m++){
+
+    ADAQReadoutEngine Engine(16);
+
+    for(int b=0; b<NumBoards; b++){
+      ADAQEmulatedDigitizer *DG = new ADAQEmulatedDigitizer(zV1720, b, 0x00000000, b, 0);
+      DG->SetTriggerRate(Rate);
+      DG->SetLinkBandwidth(Bandwidth);
+      Engine.AddDigitizer(DG);
+    }
+
+    Engine.OpenLinks();
+
+    for(uint32_t b=0; b<Engine.GetNumDigitizers(); b++){
+      ADAQDigitizer *DG = Engine.GetDigitizer(b);
+      DG->SetRecordLength(512);
+      DG->SetChannelEnableMask(0xff);
+      DG->SetMaxNumEventsBLT(100);
+    }
+
+    Engine.SetReadoutThreshold(50, 10);
+    Engine.AllocateBuffers();
+
+    ADAQRawDumpWriter Writer;
+    Writer.SetVerbose(true);
+    if(Writer.Open(FileName, m == 0) != 0){
+      cout << "\nError! Could not open the dump file '" << FileName << "'!\n" << endl;
+      return -42;
+    }
+    Engine.SetRawDumpWriter(&Writer);
+
+    for(uint32_t b=0; b<Engine.GetNumDigitizers(); b++)
+      Engine.GetDigitizer(b)->SWStartAcquisition();
+    Engine.Start();
+
+    boost::this_thread::sleep(boost::posix_time::microseconds((int64_t)(Duration * 1e6)));
+
+    Engine.Stop();
+    for(uint32_t b=0; b<Engine.GetNumDigitizers(); b++)
+      Engine.GetDigitizer(b)->SWStopAcquisition();
+
+    Writer.Close();
+
+    vector<ADAQReadoutEngineBoardStats> Stats = Engine.GetStats();
+    ADAQRawDumpWriterStats WriterStats = Writer.GetStats();
+
+    double Throughput = 0., DeadTime = 0.;
+    uint64_t Transfers = 0;
+    for(uint32_t b=0; b<Stats.size(); b++){
+      Throughput += Stats[b].Throughput;
+      DeadTime += Stats[b].DeadTimeFraction / Stats.size();
+      Transfers += Stats[b].Transfers;
+    }
+
+    cout << "-- " << Modes[m] << (Writer.GetDirect() == (m == 0) ? "" : " (unavailable)") << " : "
+	 << setprecision(4) << Throughput << " MB/s total, "
+	 << 100. * DeadTime << " % mean dead time, "
+	 << WriterStats.Stalls << " writer stalls (" << WriterStats.StallTime << " s), "
+	 << WriterStats.FileBytes / WriterStats.WriteTime / 1e6 << " MB/s while writing\n" << endl;
+
+    Engine.PrintStats();
+
+    // Every transfer must be in the dump
+
+    ADAQRawDumpReader Reader;
+    if(Reader.Open(FileName) != 0 or Reader.GetNumFrames() != Transfers or Reader.GetTruncated()){
+      cout << "Error! The dump holds " << Reader.GetNumFrames() << " of " << Transfers
+	   << " transfers!\n" << endl;
+      Status = -42;
+    }
+    Reader.Close();
+
+    Engine.FreeBuffers();
+    Engine.CloseLinks();
+
+    remove(FileName.c_str());
+  }
+
+  return Status;
+}
@@ -0,0 +1,112 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ReadoutWaitBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Compares the ADAQReadoutPipeline event wait modes (busy
+//       polling, adaptive polling, and interrupts) at several trigger
+//       rates. For each combination an emulated V1724 is read out for
+//       a fixed time and the CPU load of the readout thread, the
+//       number of FPGA event counter reads (i.e. link register
+//       traffic), and the trigger-to-readout latency are reported.
+//
+// 2run: $ ./bin/ReadoutWaitBenchmark [Seconds] [EventsPerReadout]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+using namespace std;
+
+// Boost
+#include <boost/thread.hpp>
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQReadoutPipeline.hh"
+
+
+int main(int argc, char *argv[])
+{
+  double Duration = (argc > 1) ? atof(argv[1]) : 2.;
+  uint32_t EventsPerReadout = (argc > 2) ? atoi(argv[2]) : 10;
+
+  const double Rates[3] = {100., 1000., 10000.};
+  const ZReadoutWaitMode Modes[3] = {zWaitBusyPoll, zWaitAdaptivePoll, zWaitInterrupt};
+  const char *ModeNames[3] = {"busy", "adaptive", "interrupt"};
+
+  cout << "\nReadoutWaitBenchmark : " << Duration << " s per measurement, "
+       << EventsPerReadout << " events per readout\n"
+       << endl;
+
+  cout << setw(10) << "Rate [Hz]" << setw(12) << "Mode"
+       << setw(12) << "Events" << setw(12) << "CPU [%]" << setw(14) << "Polls [1/s]"
+       << setw(16) << "Latency [ms]" << setw(16) << "Max lat. [ms]" << endl;
+
+  for(int r=0; r<3; r++){
+    for(int m=0; m<3; m++){
+
+      ADAQEmulatedDigitizer *DG = new ADAQEmulatedDigitizer(zV1724, 0);
+      DG->SetTriggerRate(Rates[r]);
+      DG->OpenLink();
+      DG->SetRecordLength(512);
+      DG->SetChannelEnableMask(0x1);
+      DG->SetMaxNumEventsBLT(EventsPerReadout);
+
+      ADAQReadoutPipeline Pipeline(DG, 8);
+      Pipeline.SetWaitMode(Modes[m], EventsPerReadout, 100);
+      Pipeline.AllocateBuffers();
+
+      DG->SWStartAcquisition();
+      Pipeline.Start();
+
+      // The main thread acts as the decode stage and simply returns
+      // every filled buffer to the pool
+
+      uint64_t Bytes = 0;
+      boost::posix_time::ptime End = boost::posix_time::microsec_clock::universal_time()
+	+ boost::posix_time::microseconds((int64_t)(Duration * 1e6));
+
+      while(boost::posix_time::microsec_clock::universal_time() < End){
+	ADAQReadoutBuffer *Buffer = Pipeline.WaitForFilledBuffer(10000);
+	if(Buffer){
+	  Bytes += Buffer->Size;
+	  Pipeline.ReleaseBuffer(Buffer);
+	}
+      }
+
+      Pipeline.Stop();
+      DG->SWStopAcquisition();
+
+      ADAQReadoutPipelineStats Stats = Pipeline.GetStats();
+
+      cout << setw(10) << Rates[r] << setw(12) << ModeNames[m]
+	   << setw(12) << DG->GetGeneratedEvents()
+	   << setw(12) << setprecision(3) << 100. * Stats.CPULoad
+	   << setw(14) << setprecision(4) << Stats.Polls / Stats.WallTime
+	   << setw(16) << setprecision(3) << 1e3 * Stats.MeanLatency
+	   << setw(16) << 1e3 * Stats.MaxLatency << endl;
+
+      Pipeline.FreeBuffers();
+      DG->CloseLink();
+      delete DG;
+    }
+  }
+  cout << endl;
+
+  return 0;
+}
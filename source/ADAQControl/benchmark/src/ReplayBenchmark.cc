@@ -0,0 +1,290 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ReplayBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures the throughput of the readout, decoding, and
+//       waveform analysis path on recorded data. Every board of a raw
+//       dump is replayed by an ADAQReplayDigitizer on its own link of
+//       an ADAQReadoutEngine; a decode thread decodes each buffer with
+//       the native STD or DPP-PSD decoder of its board and analyzes
+//       the STD waveforms with ADAQWaveformAnalyzer.
+//
+//       The dump is replayed as fast as possible twice, which must
+//       give identical event counts and analysis checksums, and then
+//       once at the given trigger rate per board, whose achieved rate
+//       is reported. If no dump is given, a reproducible one is first
+//       recorded from an emulated V1720 (STD) and an emulated V1725
+//       (DPP-PSD) board.
+//
+// 2run: $ ./bin/ReplayBenchmark [Dump] [Loops] [Rate]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+using namespace std;
+
+// Boost
+#include <boost/thread.hpp>
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQReplayDigitizer.hh"
+#include "ADAQReadoutEngine.hh"
+#include "ADAQRawDumpWriter.hh"
+#include "ADAQRawDumpReader.hh"
+#include "ADAQEventArena.hh"
+#include "ADAQPSDEventArena.hh"
+#include "ADAQWaveformAnalyzer.hh"
+
+
+const string RecordedName = "/tmp/ReplayBenchmark.adaqraw";
+
+
+struct ReplayResult{
+  uint64_t Frames, Events, Bytes;
+
+  // Sum of the integer parts of the analysis results, which does not
+  // depend on the order in which the boards' buffers are processed
+  int64_t Checksum;
+  double Time;
+};
+
+
+// Record "NumTransfers" full block transfers of an emulated STD and
+// an emulated DPP-PSD board with fixed seeds
+int Record(string Name, int NumTransfers)
+{
+  ADAQRawDumpWriter Writer;
+  if(Writer.Open(Name, false) != 0)
+    return -42;
+
+  ADAQEmulatedDigitizer *Boards[2] = {new ADAQEmulatedDigitizer(zV1720, 0),
+				      new ADAQEmulatedDigitizer(zV1725, 1)};
+  Boards[1]->SetFirmwareType("PSD");
+
+  for(int b=0; b<2; b++){
+    ADAQEmulatedDigitizer *DG = Boards[b];
+    DG->SetTriggerRate(0.);
+    DG->SetSeed(42 + b);
+    DG->OpenLink();
+    DG->SetRecordLength(256);
+    DG->SetChannelEnableMask(0xffff);
+    DG->SetMaxNumEventsBLT(100);
+    DG->SetDPPEventAggregation(64, 0);
+    Writer.AddDigitizer(DG);
+
+    char *Buffer = NULL;
+    uint32_t Size = 0;
+    DG->MallocReadoutBuffer(&Buffer, &Size);
+    DG->SWStartAcquisition();
+
+    for(int t=0; t<NumTransfers; t++){
+      DG->ReadData(Buffer, &Size);
+      Writer.Write(DG->GetBoardID(), Buffer, Size, t,
+		   chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    DG->SWStopAcquisition();
+    DG->FreeReadoutBuffer(&Buffer);
+    DG->CloseLink();
+    delete DG;
+  }
+
+  return Writer.Close();
+}
+
+
+// Decode and analyze the buffers of the engine until every board has
+// been replayed and all of its buffers processed
+void Process(ADAQReadoutEngine *Engine, vector<ADAQReplayDigitizer *> *Boards, ReplayResult *Result)
+{
+  ADAQEventArena Arena;
+  ADAQPSDEventArena PSDArena;
+  ADAQWaveformAnalyzer Analyzer;
+  ADAQWaveformResults Results;
+  Analyzer.SetPolarity(-1);
+  Analyzer.SetBaselineRegion(10, 60);
+  Analyzer.SetPSDTotalRegion(-10, 100);
+  Analyzer.SetPSDTailRegion(15, 100);
+
+  vector<const uint16_t *> Waveforms;
+
+  while(true){
+    ADAQReadoutBuffer *Buffer = Engine->WaitForFilledBuffer(100);
+
+    if(!Buffer){
+      bool Done = true;
+      uint64_t Replayed = 0;
+      for(uint32_t b=0; b<Boards->size(); b++){
+	Done &= (*Boards)[b]->GetReplayDone();
+	Replayed += (*Boards)[b]->GetReplayedFrames();
+      }
+      if(Done and Replayed == Result->Frames)
+	break;
+      continue;
+    }
+
+    ADAQReplayDigitizer *DG = NULL;
+    for(uint32_t b=0; b<Boards->size(); b++)
+      if((*Boards)[b]->GetBoardID() == Buffer->BoardID)
+	DG = (*Boards)[b];
+
+    if(DG->GetBoardFirmwareType() == "PSD"){
+      if(DG->DecodePSDBuffer(Buffer->Data, Buffer->Size, &PSDArena) == 0){
+	for(int ch=0; ch<DG->GetNumChannels(); ch++)
+	  for(uint32_t e=0; e<PSDArena.GetNumEvents(ch); e++)
+	    Result->Checksum += PSDArena.GetChargeLong(ch, e);
+	Result->Events += PSDArena.GetTotalEvents();
+      }
+    }
+    else if(DG->DecodeSTDBuffer(Buffer->Data, Buffer->Size, &Arena) == 0 and Arena.GetNumEvents() > 0){
+      const uint32_t NumEvents = Arena.GetNumEvents();
+      Analyzer.SetRecordLength(Arena.GetChannelSize(0));
+
+      for(int ch=0; ch<DG->GetNumChannels(); ch++){
+	if(!(Arena.GetChannelMask(0) & (1 << ch)))
+	  continue;
+
+	Waveforms.resize(NumEvents);
+	for(uint32_t e=0; e<NumEvents; e++)
+	  Waveforms[e] = Arena.GetWaveform(e, ch).begin();
+
+	Analyzer.AnalyzeBatch(Waveforms.data(), NumEvents, &Results);
+	for(uint32_t e=0; e<NumEvents; e++)
+	  Result->Checksum += (int64_t)Results.PulseHeight[e];
+      }
+      Result->Events += NumEvents;
+    }
+
+    Result->Frames++;
+    Result->Bytes += Buffer->Size;
+    Engine->ReleaseBuffer(Buffer);
+  }
+}
+
+
+int Replay(string Name, uint32_t Loops, double Rate, ReplayResult &Result)
+{
+  Result = ReplayResult();
+
+  ADAQRawDumpReader Reader;
+  if(Reader.Open(Name) != 0)
+    return -42;
+
+  ADAQReadoutEngine Engine(16);
+  vector<ADAQReplayDigitizer *> Boards;
+
+  vector<int> IDs = Reader.GetBoardIDs();
+  for(uint32_t b=0; b<IDs.size(); b++){
+
+    ADAQRawDumpFrame Frame;
+    for(uint64_t f=0; Reader.GetFrame(f, Frame); f++)
+      if(Frame.Header->BoardID == IDs[b])
+	break;
+
+    ADAQReplayDigitizer *DG = new ADAQReplayDigitizer((ZBoardType)Frame.Header->BoardType, IDs[b], 0x00000000, b, 0);
+    DG->SetDumpFile(Name);
+    DG->SetNumLoops(Loops);
+    DG->SetTriggerRate(Rate);
+    Engine.AddDigitizer(DG);
+    Boards.push_back(DG);
+  }
+  Reader.Close();
+
+  if(Engine.OpenLinks() != 0)
+    return -42;
+
+  Engine.SetReadoutThreshold(1, 10);
+  Engine.AllocateBuffers();
+
+  for(uint32_t b=0; b<Boards.size(); b++)
+    Boards[b]->SWStartAcquisition();
+
+  chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+
+  Engine.Start();
+  Process(&Engine, &Boards, &Result);
+  Engine.Stop();
+
+  Result.Time = chrono::duration<double>(chrono::steady_clock::now() - Start).count();
+
+  for(uint32_t b=0; b<Boards.size(); b++)
+    Boards[b]->SWStopAcquisition();
+
+  Engine.FreeBuffers();
+  Engine.CloseLinks();
+
+  return 0;
+}
+
+
+void Print(string Mode, const ReplayResult &R)
+{
+  cout << "-- " << setw(20) << left << Mode << right << setprecision(4)
+       << setw(10) << R.Events << " events in " << setw(7) << R.Time << " s : "
+       << setw(10) << R.Events / R.Time << " events/s, "
+       << setw(8) << R.Bytes / R.Time / 1e6 << " MB/s, checksum " << R.Checksum
+       << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+  string Name = (argc > 1) ? argv[1] : RecordedName;
+  uint32_t Loops = (argc > 2) ? max(atoi(argv[2]), 1) : 5;
+  double Rate = (argc > 3) ? atof(argv[3]) : 20000.;
+
+  if(argc < 2 and Record(Name, 200) != 0){
+    cout << "\nError! Could not record the dump '" << Name << "'!\n" << endl;
+    return -42;
+  }
+
+  cout << "\nReplayBenchmark : '" << Name << "', " << Loops << " passes as fast as possible, "
+       << "1 pass at " << Rate << " Hz per board\n" << endl;
+
+  int Status = 0;
+  ReplayResult Results[3];
+
+  const char *Modes[3] = {"As fast as possible", "As fast as possible", "Trigger rate"};
+
+  for(int r=0; r<3; r++){
+    if(Replay(Name, (r < 2) ? Loops : 1, (r < 2) ? 0. : Rate, Results[r]) != 0){
+      cout << "Error! Could not replay the dump '" << Name << "'!\n" << endl;
+      return -42;
+    }
+    Print(Modes[r], Results[r]);
+  }
+
+  // The replays must process the same data
+
+  if(Results[0].Events != Results[1].Events or Results[0].Checksum != Results[1].Checksum or
+     Results[0].Events != Loops * Results[2].Events){
+    cout << "\nError! The replays processed different data!" << endl;
+    Status = -42;
+  }
+  cout << endl;
+
+  if(argc < 2)
+    remove(Name.c_str());
+
+  return Status;
+}
@@ -0,0 +1,243 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: STDDecoderBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Compares the native ADAQDigitizer::DecodeSTDBuffer() decoder
+//       with the reference decoding path (GetNumEvents(),
+//       GetEventInfo(), DecodeEvent(), FreeEvent()) for x720, x724,
+//       x725, and x730 standard firmware buffers. For each digitizer
+//       family, a set of block transfers is first generated; the two
+//       decoders are then checked to produce identical event
+//       information and samples before their throughput is measured.
+//
+//       The decoders are called through an ADAQDigitizer pointer.
+//       With ADAQEmulatedDigitizer (the default) the reference is the
+//       emulator's own implementation of the CAENDigitizer calls,
+//       which decodes the buffers that the emulator itself generated:
+//       the check and the throughput ratio are against this emulated
+//       reference, not against the CAENDigitizer library. Replacing
+//       the emulator with a connected ADAQDigitizer runs the same
+//       comparison against the CAENDigitizer library itself.
+//
+// 2run: $ ./bin/STDDecoderBenchmark [RecordLength] [EventsPerBLT]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+using namespace std;
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQEventArena.hh"
+
+
+// Prevent the compiler from optimizing away the decoded samples
+static volatile uint64_t Sink = 0;
+
+
+// Decode with the reference (CAENDigitizer call) path; returns the
+// number of events
+uint64_t DecodeReference(ADAQDigitizer *DG, char *Buffer, uint32_t Size)
+{
+  uint32_t NumEvents = 0;
+  DG->GetNumEvents(Buffer, Size, &NumEvents);
+
+  CAEN_DGTZ_EventInfo_t EventInfo;
+  CAEN_DGTZ_UINT16_EVENT_t *Event = NULL;
+  char *EventPointer = NULL;
+  uint64_t Sum = 0;
+
+  for(uint32_t evt=0; evt<NumEvents; evt++){
+    DG->GetEventInfo(Buffer, Size, evt, &EventInfo, &EventPointer);
+    DG->DecodeEvent(EventPointer, &Event);
+
+    for(int ch=0; ch<DG->GetNumChannels(); ch++)
+      if(Event->ChSize[ch] > 0)
+	Sum += Event->DataChannel[ch][Event->ChSize[ch]/2];
+
+    DG->FreeEvent(&Event);
+  }
+  Sink += Sum;
+
+  return NumEvents;
+}
+
+
+// Decode with the native decoder; returns the number of events
+uint64_t DecodeNative(ADAQDigitizer *DG, char *Buffer, uint32_t Size, ADAQEventArena *Arena)
+{
+  DG->DecodeSTDBuffer(Buffer, Size, Arena);
+
+  uint64_t Sum = 0;
+  for(uint32_t evt=0; evt<Arena->GetNumEvents(); evt++)
+    for(int ch=0; ch<DG->GetNumChannels(); ch++){
+      ADAQSampleSpan Span = Arena->GetWaveform(evt, ch);
+      if(!Span.Empty())
+	Sum += Span[Span.Size/2];
+    }
+  Sink += Sum;
+
+  return Arena->GetNumEvents();
+}
+
+
+// Check that the native decoder reproduces the reference output;
+// returns the number of mismatched events
+uint64_t Compare(ADAQDigitizer *DG, char *Buffer, uint32_t Size, ADAQEventArena *Arena)
+{
+  uint64_t Mismatches = 0;
+
+  uint32_t NumEvents = 0;
+  DG->GetNumEvents(Buffer, Size, &NumEvents);
+  DG->DecodeSTDBuffer(Buffer, Size, Arena);
+
+  if(NumEvents != Arena->GetNumEvents())
+    return max(NumEvents, Arena->GetNumEvents());
+
+  CAEN_DGTZ_EventInfo_t EventInfo;
+  CAEN_DGTZ_UINT16_EVENT_t *Event = NULL;
+  char *EventPointer = NULL;
+
+  for(uint32_t evt=0; evt<NumEvents; evt++){
+    DG->GetEventInfo(Buffer, Size, evt, &EventInfo, &EventPointer);
+    DG->DecodeEvent(EventPointer, &Event);
+
+    bool Match = (EventInfo.BoardId == Arena->GetBoardID(evt) and
+		  EventInfo.Pattern == Arena->GetPattern(evt) and
+		  EventInfo.ChannelMask == Arena->GetChannelMask(evt) and
+		  EventInfo.EventCounter == Arena->GetEventCounter(evt) and
+		  EventInfo.TriggerTimeTag == Arena->GetTriggerTimeTag(evt));
+
+    for(int ch=0; ch<DG->GetNumChannels() and Match; ch++){
+      ADAQSampleSpan Span = Arena->GetWaveform(evt, ch);
+      if(Span.Size != Event->ChSize[ch]){
+	Match = false;
+	break;
+      }
+      for(uint32_t s=0; s<Span.Size; s++)
+	if(Span[s] != Event->DataChannel[ch][s]){
+	  Match = false;
+	  break;
+	}
+    }
+    if(!Match)
+      Mismatches++;
+
+    DG->FreeEvent(&Event);
+  }
+
+  return Mismatches;
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t RecordLength = (argc > 1) ? atoi(argv[1]) : 512;
+  uint32_t EventsPerBLT = (argc > 2) ? atoi(argv[2]) : 100;
+
+  const int NumBuffers = 64;
+  const double MinTime = 1.; // [s] per measurement
+
+  ZBoardType Types[4] = {zV1720, zV1724, zV1725, zDT5730};
+
+  cout << "\nSTDDecoderBenchmark : RecordLength = " << RecordLength
+       << ", events per BLT = " << EventsPerBLT << ", all channels enabled\n"
+       << "Reference : emulated CAENDigitizer decoding (ADAQEmulatedDigitizer)\n"
+       << endl;
+
+  cout << setw(8) << "Board" << setw(12) << "vs. Ref."
+       << setw(16) << "Ref. [evt/s]" << setw(16) << "Native [evt/s]"
+       << setw(16) << "Ref. [MB/s]" << setw(16) << "Native [MB/s]"
+       << setw(10) << "Speedup" << endl;
+
+  int Status = 0;
+
+  for(int t=0; t<4; t++){
+
+    ADAQEmulatedDigitizer *Emulator = new ADAQEmulatedDigitizer(Types[t], 0);
+    Emulator->SetTriggerRate(0.);
+    Emulator->OpenLink();
+
+    ADAQDigitizer *DG = Emulator;
+    DG->SetRecordLength(RecordLength);
+    DG->SetChannelEnableMask(0xffff);
+    DG->SetMaxNumEventsBLT(EventsPerBLT);
+
+    // Generate the block transfers to be decoded
+
+    vector<char *> Buffers(NumBuffers, (char *)NULL);
+    vector<uint32_t> Sizes(NumBuffers, 0);
+    uint64_t TotalBytes = 0;
+
+    DG->SWStartAcquisition();
+    for(int b=0; b<NumBuffers; b++){
+      DG->MallocReadoutBuffer(&Buffers[b], &Sizes[b]);
+      DG->ReadData(Buffers[b], &Sizes[b]);
+      TotalBytes += Sizes[b];
+    }
+    DG->SWStopAcquisition();
+
+    ADAQEventArena Arena(EventsPerBLT, DG->GetNumChannels() * RecordLength);
+
+    // Validate the native decoder against the emulated reference
+
+    uint64_t Mismatches = 0;
+    for(int b=0; b<NumBuffers; b++)
+      Mismatches += Compare(DG, Buffers[b], Sizes[b], &Arena);
+
+    if(Mismatches)
+      Status = -42;
+
+    // Measure the throughput of each decoder
+
+    double Rate[2] = {0., 0.}, Bandwidth[2] = {0., 0.};
+
+    for(int d=0; d<2; d++){
+      uint64_t Events = 0, Bytes = 0;
+      chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+      chrono::duration<double> Elapsed(0.);
+
+      while(Elapsed.count() < MinTime){
+	for(int b=0; b<NumBuffers; b++)
+	  Events += (d == 0) ? DecodeReference(DG, Buffers[b], Sizes[b]) : DecodeNative(DG, Buffers[b], Sizes[b], &Arena);
+	Bytes += TotalBytes;
+	Elapsed = chrono::steady_clock::now() - Start;
+      }
+      Rate[d] = Events / Elapsed.count();
+      Bandwidth[d] = Bytes / Elapsed.count() / 1e6;
+    }
+
+    cout << setw(8) << DG->GetBoardModelName()
+	 << setw(12) << (Mismatches ? "MISMATCH" : "identical")
+	 << setw(16) << setprecision(4) << Rate[0] << setw(16) << Rate[1]
+	 << setw(16) << Bandwidth[0] << setw(16) << Bandwidth[1]
+	 << setw(10) << Rate[1] / Rate[0] << endl;
+
+    for(int b=0; b<NumBuffers; b++)
+      DG->FreeReadoutBuffer(&Buffers[b]);
+
+    DG->CloseLink();
+    delete DG;
+  }
+  cout << endl;
+
+  return Status;
+}
@@ -0,0 +1,166 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: TimingBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures the single-core throughput [waveforms/s] and the
+//       timing resolution of the ADAQWaveformAnalyzer CFD and
+//       leading-edge timing. Negative-going pulses with a known
+//       start time, uniformly distributed within a sample, random
+//       amplitude, and Gaussian noise are digitized at 250 MS/s
+//       (4 ns samples). The resolution is the RMS of the difference
+//       between the found and the true time after removing the mean
+//       offset; for comparison, the resolution of an 8 ns trigger
+//       time tag alone is 8/sqrt(12) = 2.3 ns.
+//
+// 2run: $ ./bin/TimingBenchmark [RecordLength] [NoiseRMS]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+using namespace std;
+
+// ADAQ
+#include "ADAQWaveformAnalyzer.hh"
+
+
+// Prevent the compiler from optimizing away the results
+static volatile double Sink = 0.;
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t RecordLength = (argc > 1) ? atoi(argv[1]) : 256;
+  double NoiseRMS = (argc > 2) ? atof(argv[2]) : 2.; // [ADC]
+
+  const uint32_t NumWaveforms = 10000;
+  const double SamplePeriod = 4.; // [ns]
+  const double RiseTime = 6., DecayTime = 60.; // [ns]
+  const int Baseline = 14000;
+  const double MinTime = 1.; // [s] per measurement
+
+  // Generate the waveforms and record their true start times
+
+  vector<uint16_t> Samples((size_t)NumWaveforms * RecordLength);
+  vector<double> TrueTime(NumWaveforms);
+
+  mt19937 Engine(42);
+  uniform_real_distribution<double> Phase(0., 1.), Amplitude(1000., 8000.);
+  normal_distribution<double> Noise(0., NoiseRMS);
+
+  for(uint32_t w=0; w<NumWaveforms; w++){
+    const double T0 = (RecordLength / 4 + Phase(Engine)) * SamplePeriod;
+    const double A = Amplitude(Engine);
+    TrueTime[w] = T0;
+
+    for(uint32_t s=0; s<RecordLength; s++){
+      const double t = s * SamplePeriod - T0;
+      const double V = (t > 0.) ? A * (exp(-t/DecayTime) - exp(-t/RiseTime)) : 0.;
+      Samples[(size_t)w * RecordLength + s] = (uint16_t)lround(Baseline - V + Noise(Engine));
+    }
+  }
+
+  cout << "\nTimingBenchmark : RecordLength = " << RecordLength << ", " << SamplePeriod
+       << " ns samples, noise RMS = " << NoiseRMS << " ADC, single core\n"
+       << endl;
+
+  ADAQWaveformAnalyzer Analyzer(RecordLength);
+  Analyzer.SetPolarity(-1);
+  Analyzer.SetBaselineRegion(0, RecordLength / 5);
+  Analyzer.SetSamplePeriod(SamplePeriod);
+  Analyzer.SetCFDFraction(0.3);
+  Analyzer.SetCFDDelay(2);
+  Analyzer.SetLeadingEdgeThreshold(50.);
+  Analyzer.SetVerbose(true);
+
+  ADAQWaveformResults Results;
+
+  const char *Names[5] = {"No timing", "Leading edge, linear", "Leading edge, cubic",
+			  "CFD, linear", "CFD, cubic"};
+  const ZTimingMethod Methods[5] = {zTimingNone, zTimingLeadingEdge, zTimingLeadingEdge,
+				    zTimingCFD, zTimingCFD};
+  const ZTimingInterpolation Interpolations[5] = {zInterpolationLinear, zInterpolationLinear,
+						  zInterpolationCubic, zInterpolationLinear,
+						  zInterpolationCubic};
+
+  cout << setw(24) << "Method" << setw(16) << "[waveforms/s]" << setw(10) << "Relative"
+       << setw(18) << "Resolution [ps]" << setw(10) << "Missed" << endl;
+
+  int Status = 0;
+  double BaseRate = 0.;
+
+  for(int m=0; m<5; m++){
+
+    Analyzer.SetTimingMethod(Methods[m]);
+    Analyzer.SetTimingInterpolation(Interpolations[m]);
+
+    // Resolution
+
+    if(Analyzer.AnalyzeBatch(Samples.data(), NumWaveforms, RecordLength, &Results) != 0)
+      return -42;
+
+    double Mean = 0., MeanSquare = 0.;
+    uint32_t Found = 0;
+    for(uint32_t w=0; w<NumWaveforms; w++){
+      if(Results.FineTime[w] < 0.)
+	continue;
+      const double Delta = Results.FineTime[w] - TrueTime[w];
+      Mean += Delta;
+      MeanSquare += Delta * Delta;
+      Found++;
+    }
+    double RMS = 0.;
+    if(Found > 0){
+      Mean /= Found;
+      RMS = sqrt(max(MeanSquare / Found - Mean * Mean, 0.));
+    }
+    if(m > 0 and Found < NumWaveforms)
+      Status = -42;
+
+    // Throughput
+
+    uint64_t Waveforms = 0;
+    chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+    chrono::duration<double> Elapsed(0.);
+
+    while(Elapsed.count() < MinTime){
+      Analyzer.AnalyzeBatch(Samples.data(), NumWaveforms, RecordLength, &Results);
+      Sink += Results.FineTime[NumWaveforms/2];
+      Waveforms += NumWaveforms;
+      Elapsed = chrono::steady_clock::now() - Start;
+    }
+
+    double Rate = Waveforms / Elapsed.count();
+    if(m == 0)
+      BaseRate = Rate;
+
+    cout << setw(24) << Names[m] << setw(16) << setprecision(4) << Rate
+	 << setw(10) << Rate / BaseRate;
+    if(m == 0)
+      cout << setw(18) << "-" << setw(10) << "-" << endl;
+    else
+      cout << setw(18) << RMS * 1000. << setw(10) << NumWaveforms - Found << endl;
+  }
+  cout << endl;
+
+  return Status;
+}
@@ -0,0 +1,224 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: WaveformAnalysisBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures the single-core throughput [waveforms/s] of the
+//       ADAQWaveformAnalyzer kernels (scalar, SSE2, AVX2) against a
+//       conventional per-sample analysis loop as found in user code.
+//       Waveforms of one channel are generated with the emulated
+//       V1720, decoded into an ADAQEventArena, and analyzed in
+//       batches of one block transfer directly from the arena. All
+//       kernels are checked to produce results identical to the
+//       conventional loop before they are timed.
+//
+// 2run: $ ./bin/WaveformAnalysisBenchmark [RecordLength] [EventsPerBLT]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+using namespace std;
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQEventArena.hh"
+#include "ADAQWaveformAnalyzer.hh"
+
+
+// Prevent the compiler from optimizing away the results
+static volatile double Sink = 0.;
+
+const uint32_t BaselineMin = 10, BaselineMax = 100;
+const int TotalStart = -10, TotalStop = 150, TailStart = 15, TailStop = 150;
+
+
+// The conventional analysis of one negative-going waveform
+void AnalyzeConventional(const uint16_t *W, uint32_t RL, uint32_t Index, ADAQWaveformResults *R)
+{
+  double Baseline = 0.;
+  for(uint32_t s=BaselineMin; s<BaselineMax; s++)
+    Baseline += W[s];
+  Baseline /= (BaselineMax - BaselineMin);
+
+  double Height = 0., Area = 0.;
+  uint32_t Peak = 0;
+  for(uint32_t s=0; s<RL; s++){
+    double V = Baseline - W[s];
+    Area += V;
+    if(V > Height or s == 0){
+      Height = V;
+      Peak = s;
+    }
+  }
+
+  double Total = 0., Tail = 0.;
+  for(int s=max((int)Peak+TotalStart, 0); s<min((int)Peak+TotalStop, (int)RL); s++)
+    Total += Baseline - W[s];
+  for(int s=max((int)Peak+TailStart, 0); s<min((int)Peak+TailStop, (int)RL); s++)
+    Tail += Baseline - W[s];
+
+  R->Baseline[Index] = Baseline;
+  R->PulseHeight[Index] = Height;
+  R->PulseArea[Index] = Area;
+  R->PSDTotalIntegral[Index] = Total;
+  R->PSDTailIntegral[Index] = Tail;
+  R->PeakPosition[Index] = Peak;
+}
+
+
+bool Close(double A, double B)
+{
+  return fabs(A - B) <= 1e-6 * max(1., fabs(A));
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t RecordLength = (argc > 1) ? atoi(argv[1]) : 512;
+  uint32_t EventsPerBLT = (argc > 2) ? atoi(argv[2]) : 1000;
+
+  const int NumBuffers = 32;
+  const double MinTime = 1.; // [s] per measurement
+
+  // Generate the waveforms of one channel
+
+  ADAQEmulatedDigitizer *DG = new ADAQEmulatedDigitizer(zV1720, 0);
+  DG->SetTriggerRate(0.);
+  DG->SetMemoryBlocks(EventsPerBLT);
+  DG->OpenLink();
+  DG->SetRecordLength(RecordLength);
+  DG->SetChannelEnableMask(0x1);
+  DG->SetMaxNumEventsBLT(EventsPerBLT);
+  DG->GetRecordLength(&RecordLength);
+
+  vector<ADAQEventArena *> Arenas;
+  char *Buffer = NULL;
+  uint32_t Size = 0;
+
+  DG->MallocReadoutBuffer(&Buffer, &Size);
+  DG->SWStartAcquisition();
+  for(int b=0; b<NumBuffers; b++){
+    ADAQEventArena *Arena = new ADAQEventArena(EventsPerBLT, RecordLength);
+    DG->ReadData(Buffer, &Size);
+    DG->DecodeSTDBuffer(Buffer, Size, Arena);
+    Arenas.push_back(Arena);
+  }
+  DG->SWStopAcquisition();
+  DG->FreeReadoutBuffer(&Buffer);
+
+  cout << "\nWaveformAnalysisBenchmark : RecordLength = " << RecordLength
+       << ", " << EventsPerBLT << " waveforms per batch, single core\n"
+       << endl;
+
+  ADAQWaveformAnalyzer Analyzer(RecordLength);
+  Analyzer.SetPolarity(-1);
+  Analyzer.SetBaselineRegion(BaselineMin, BaselineMax);
+  Analyzer.SetPSDTotalRegion(TotalStart, TotalStop);
+  Analyzer.SetPSDTailRegion(TailStart, TailStop);
+
+  ADAQWaveformResults Reference, Results;
+
+  const char *Names[4] = {"Conventional loop", "Scalar kernel", "SSE2 kernel", "AVX2 kernel"};
+  const ZSIMDLevel Levels[4] = {zSIMDScalar, zSIMDScalar, zSIMDSSE2, zSIMDAVX2};
+
+  cout << setw(20) << "Method" << setw(12) << "Result" << setw(16) << "[waveforms/s]"
+       << setw(16) << "[Msamples/s]" << setw(10) << "Speedup" << endl;
+
+  int Status = 0;
+  double BaseRate = 0.;
+
+  for(int m=0; m<4; m++){
+
+    if(m > 0 and Analyzer.SetSIMDLevel(Levels[m]) != 0){
+      cout << setw(20) << Names[m] << setw(12) << "unsupported" << endl;
+      continue;
+    }
+
+    // Validate against the conventional loop on every batch
+
+    bool Identical = true;
+    for(int b=0; b<NumBuffers and m>0; b++){
+      ADAQEventArena *Arena = Arenas[b];
+      const uint32_t N = Arena->GetNumEvents();
+      const uint16_t *First = Arena->GetWaveform(0, 0).Data;
+
+      Reference.Resize(N);
+      for(uint32_t w=0; w<N; w++)
+	AnalyzeConventional(First + (size_t)w * RecordLength, RecordLength, w, &Reference);
+
+      Analyzer.AnalyzeBatch(First, N, RecordLength, &Results);
+
+      for(uint32_t w=0; w<N; w++)
+	if(!Close(Results.Baseline[w], Reference.Baseline[w]) or
+	   !Close(Results.PulseHeight[w], Reference.PulseHeight[w]) or
+	   !Close(Results.PulseArea[w], Reference.PulseArea[w]) or
+	   !Close(Results.PSDTotalIntegral[w], Reference.PSDTotalIntegral[w]) or
+	   !Close(Results.PSDTailIntegral[w], Reference.PSDTailIntegral[w]) or
+	   Results.PeakPosition[w] != Reference.PeakPosition[w])
+	  Identical = false;
+    }
+    if(!Identical)
+      Status = -42;
+
+    // Measure the throughput
+
+    uint64_t Waveforms = 0;
+    chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+    chrono::duration<double> Elapsed(0.);
+
+    while(Elapsed.count() < MinTime){
+      for(int b=0; b<NumBuffers; b++){
+	ADAQEventArena *Arena = Arenas[b];
+	const uint32_t N = Arena->GetNumEvents();
+	const uint16_t *First = Arena->GetWaveform(0, 0).Data;
+
+	if(m == 0){
+	  Results.Resize(N);
+	  for(uint32_t w=0; w<N; w++)
+	    AnalyzeConventional(First + (size_t)w * RecordLength, RecordLength, w, &Results);
+	}
+	else
+	  Analyzer.AnalyzeBatch(First, N, RecordLength, &Results);
+
+	Sink += Results.PulseArea[N/2];
+	Waveforms += N;
+      }
+      Elapsed = chrono::steady_clock::now() - Start;
+    }
+
+    double Rate = Waveforms / Elapsed.count();
+    if(m == 0)
+      BaseRate = Rate;
+
+    cout << setw(20) << Names[m] << setw(12) << (m == 0 ? "reference" : (Identical ? "identical" : "MISMATCH"))
+	 << setw(16) << setprecision(4) << Rate << setw(16) << Rate * RecordLength / 1e6
+	 << setw(10) << Rate / BaseRate << endl;
+  }
+  cout << endl;
+
+  for(size_t b=0; b<Arenas.size(); b++)
+    delete Arenas[b];
+
+  DG->CloseLink();
+  delete DG;
+
+  return Status;
+}
@@ -0,0 +1,342 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ZLEDecoderBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Checks the random-access ZLE decoding of ADAQDigitizer
+//       (BuildZLEEventTable() and DecodeZLEEvent()) against the
+//       sequential GetZLEWaveform() and compares their decoding
+//       rates. The ZLE buffers are generated by an emulated V1720
+//       (ADAQEmulatedDigitizer) with different ZLE settings on every
+//       channel: all samples stored (positive logic, threshold 0),
+//       none stored (negative logic, threshold 0), and thresholds
+//       below the baseline with increasing backward/forward words.
+//
+//         single channel : one channel is enabled at a time. Both
+//                          decoders must give identical samples
+//                          for every event; their rates [events/s]
+//                          and [MB/s of samples] are measured
+//         all channels   : GetZLEWaveform() only separates the first
+//                          channel of an event, so the samples of
+//                          every channel decoded from the table are
+//                          instead checked against those that the
+//                          ZLE settings keep of the same events
+//                          generated without zero suppression
+//
+//       The share of the samples stored by the ZLE settings is given
+//       for each case.
+//
+// 2run: $ ./bin/ZLEDecoderBenchmark [RecordLength] [EventsPerBLT]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+using namespace std;
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQEventArena.hh"
+#include "ADAQZLEEventTable.hh"
+
+
+const int NumChannels = 8;
+const int NumBuffers = 16;
+
+
+// The ZLE settings of one channel
+struct ZLESettings{
+  uint32_t Threshold, NBackward, NForward;
+  bool PosLogic;
+};
+
+
+ZLESettings GetSettings(int Channel, int Baseline)
+{
+  if(Channel == 0)
+    return {0, 0, 0, true};
+  else if(Channel == 1)
+    return {0, 0, 0, false};
+  else
+    return {(uint32_t)(Baseline - 10*Channel), 2*(uint32_t)Channel - 4, 4*(uint32_t)Channel - 7, false};
+}
+
+
+// Prevent the compiler from optimizing away the decoded samples
+static volatile uint64_t Sink = 0;
+
+
+// An emulated V1720 with a fixed seed and, if "ZLE", the ZLE settings
+ADAQEmulatedDigitizer *Open(uint32_t RecordLength, uint32_t EventsPerBLT, uint32_t Mask, bool ZLE)
+{
+  ADAQEmulatedDigitizer *DG = new ADAQEmulatedDigitizer(zV1720, 0);
+  DG->SetTriggerRate(0.);
+  DG->SetSeed(42);
+  DG->OpenLink();
+  DG->SetRecordLength(RecordLength);
+  DG->SetChannelEnableMask(Mask);
+  DG->SetMaxNumEventsBLT(EventsPerBLT);
+
+  if(ZLE){
+    DG->SetZSMode("ZLE");
+    const int Baseline = (int)(0.8 * (1 << DG->GetNumADCBits()));
+    for(int ch=0; ch<NumChannels; ch++){
+      ZLESettings S = GetSettings(ch, Baseline);
+      DG->SetZLEChannelSettings(ch, S.Threshold, S.NBackward, S.NForward, S.PosLogic);
+    }
+  }
+  return DG;
+}
+
+
+// Generate "NumBuffers" block transfers
+void Generate(ADAQEmulatedDigitizer *DG, vector<char *> &Buffers, vector<uint32_t> &Sizes)
+{
+  Buffers.assign(NumBuffers, (char *)NULL);
+  Sizes.assign(NumBuffers, 0);
+
+  DG->SWStartAcquisition();
+  for(int b=0; b<NumBuffers; b++){
+    DG->MallocReadoutBuffer(&Buffers[b], &Sizes[b]);
+    DG->ReadData(Buffers[b], &Sizes[b]);
+  }
+  DG->SWStopAcquisition();
+}
+
+
+void Close(ADAQEmulatedDigitizer *DG, vector<char *> &Buffers)
+{
+  for(int b=0; b<NumBuffers; b++)
+    DG->FreeReadoutBuffer(&Buffers[b]);
+  DG->CloseLink();
+  delete DG;
+}
+
+
+// The samples of a waveform that the ZLE settings store: the words
+// with a sample beyond the threshold, "NBackward" words before, and
+// "NForward" words after them
+vector<uint16_t> Suppress(ADAQSampleSpan Span, ZLESettings S)
+{
+  const int NumWords = Span.Size / 2;
+
+  vector<bool> Beyond(NumWords);
+  for(int w=0; w<NumWords; w++)
+    for(int s=0; s<2; s++)
+      Beyond[w] = Beyond[w] or (S.PosLogic ? Span[2*w + s] > S.Threshold : Span[2*w + s] < S.Threshold);
+
+  vector<uint16_t> Stored;
+  for(int w=0; w<NumWords; w++){
+    bool Store = false;
+    for(int v=max(w - (int)S.NForward, 0); v<=min(w + (int)S.NBackward, NumWords - 1); v++)
+      Store = Store or Beyond[v];
+    if(Store){
+      Stored.push_back(Span[2*w]);
+      Stored.push_back(Span[2*w + 1]);
+    }
+  }
+  return Stored;
+}
+
+
+// Decode with GetZLEWaveform(); returns the number of samples
+uint64_t DecodeLegacy(ADAQDigitizer *DG, char *Buffer, uint32_t NumEvents, vector<vector<uint16_t> > &Waveforms)
+{
+  uint64_t Samples = 0;
+  for(uint32_t e=0; e<NumEvents; e++){
+    DG->GetZLEWaveform(Buffer, e, Waveforms);
+    Samples += Waveforms[0].size();
+    Sink += Waveforms[0].empty() ? 0 : Waveforms[0].back();
+  }
+  return Samples;
+}
+
+
+// Decode with BuildZLEEventTable() and DecodeZLEEvent(); returns the
+// number of samples
+uint64_t DecodeTable(ADAQDigitizer *DG, char *Buffer, uint32_t Size, ADAQZLEEventTable *Table,
+		     vector<uint16_t> &Samples)
+{
+  uint64_t Total = 0;
+  DG->BuildZLEEventTable(Buffer, Size, Table);
+  for(uint32_t e=0; e<Table->NumEvents; e++)
+    for(int ch=0; ch<NumChannels; ch++){
+      uint32_t N = 0;
+      DG->DecodeZLEEvent(Table, e, ch, Samples.data(), Samples.size(), &N);
+      Total += N;
+      Sink += N ? Samples[N-1] : 0;
+    }
+  return Total;
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t RecordLength = (argc > 1) ? atoi(argv[1]) : 1024;
+  uint32_t EventsPerBLT = (argc > 2) ? atoi(argv[2]) : 100;
+
+  const int NumRounds = 3;
+  const double MinTime = 0.2; // [s] per measurement and round
+
+  cout << "\nZLEDecoderBenchmark : emulated V1720, RecordLength = " << RecordLength
+       << ", events per BLT = " << EventsPerBLT << ", " << NumBuffers << " BLTs\n"
+       << "Legacy : GetZLEWaveform(); Table : BuildZLEEventTable() and DecodeZLEEvent()\n"
+       << endl;
+
+  cout << setw(10) << "Channels" << setw(10) << "Stored" << setw(12) << "Result"
+       << setw(16) << "Leg. [evt/s]" << setw(16) << "Table [evt/s]"
+       << setw(14) << "Leg. [MB/s]" << setw(14) << "Table [MB/s]"
+       << setw(10) << "Speedup" << endl;
+
+  int Status = 0;
+
+  ADAQZLEEventTable Table;
+  vector<uint16_t> Samples(RecordLength);
+  vector<vector<uint16_t> > Waveforms;
+
+  // One channel at a time: the decoders must agree on every event
+
+  for(int ch=0; ch<NumChannels; ch++){
+    ADAQEmulatedDigitizer *DG = Open(RecordLength, EventsPerBLT, 1 << ch, true);
+
+    vector<char *> Buffers;
+    vector<uint32_t> Sizes;
+    Generate(DG, Buffers, Sizes);
+
+    uint64_t Events = 0, Stored = 0, Mismatches = 0;
+
+    for(int b=0; b<NumBuffers; b++){
+      if(DG->BuildZLEEventTable(Buffers[b], Sizes[b], &Table) != 0 or Table.NumEvents != EventsPerBLT){
+	Mismatches += EventsPerBLT;
+	continue;
+      }
+
+      for(uint32_t e=0; e<Table.NumEvents; e++){
+	uint32_t N = 0;
+	DG->DecodeZLEEvent(&Table, e, ch, Samples.data(), Samples.size(), &N);
+	DG->GetZLEWaveform(Buffers[b], e, Waveforms);
+
+	if(Waveforms[0] != vector<uint16_t>(Samples.begin(), Samples.begin() + N))
+	  Mismatches++;
+	Stored += N;
+      }
+      Events += Table.NumEvents;
+    }
+
+    if(Mismatches)
+      Status = -42;
+
+    // Interleaved rounds; the best rate of each decoder is kept
+
+    double Rate[2] = {0., 0.}, Bandwidth[2] = {0., 0.};
+
+    for(int r=0; r<NumRounds; r++)
+      for(int d=0; d<2; d++){
+	uint64_t Decoded = 0, Passes = 0;
+	chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+	chrono::duration<double> Elapsed(0.);
+
+	while(Elapsed.count() < MinTime){
+	  for(int b=0; b<NumBuffers; b++)
+	    Decoded += (d == 0) ? DecodeLegacy(DG, Buffers[b], EventsPerBLT, Waveforms)
+	      : DecodeTable(DG, Buffers[b], Sizes[b], &Table, Samples);
+	  Passes++;
+	  Elapsed = chrono::steady_clock::now() - Start;
+	}
+	Rate[d] = max(Rate[d], Passes * Events / Elapsed.count());
+	Bandwidth[d] = max(Bandwidth[d], 2. * Decoded / Elapsed.count() / 1e6);
+      }
+
+    cout << setw(10) << ch << setw(9) << setprecision(3) << 100. * Stored / (Events * RecordLength) << "%"
+	 << setw(12) << (Mismatches ? "MISMATCH" : "identical")
+	 << setw(16) << setprecision(4) << Rate[0] << setw(16) << Rate[1]
+	 << setw(14) << Bandwidth[0] << setw(14) << Bandwidth[1]
+	 << setw(10) << Rate[1] / Rate[0] << endl;
+
+    Close(DG, Buffers);
+  }
+
+  // All channels: the table against the unsuppressed events
+
+  ADAQEmulatedDigitizer *DG = Open(RecordLength, EventsPerBLT, 0xff, true);
+  ADAQEmulatedDigitizer *Reference = Open(RecordLength, EventsPerBLT, 0xff, false);
+
+  vector<char *> Buffers, ReferenceBuffers;
+  vector<uint32_t> Sizes, ReferenceSizes;
+  Generate(DG, Buffers, Sizes);
+  Generate(Reference, ReferenceBuffers, ReferenceSizes);
+
+  const int Baseline = (int)(0.8 * (1 << DG->GetNumADCBits()));
+  ADAQEventArena Arena;
+  uint64_t Events = 0, Stored = 0, Mismatches = 0;
+
+  for(int b=0; b<NumBuffers; b++){
+    if(DG->BuildZLEEventTable(Buffers[b], Sizes[b], &Table) != 0 or
+       Reference->DecodeSTDBuffer(ReferenceBuffers[b], ReferenceSizes[b], &Arena) != 0 or
+       Table.NumEvents != Arena.GetNumEvents()){
+      Mismatches += EventsPerBLT;
+      continue;
+    }
+
+    for(uint32_t e=0; e<Table.NumEvents; e++){
+      bool Identical = (Table.TriggerTimeTag[e] == Arena.GetTriggerTimeTag(e));
+
+      for(int ch=0; ch<NumChannels; ch++){
+	uint32_t N = 0;
+	DG->DecodeZLEEvent(&Table, e, ch, Samples.data(), Samples.size(), &N);
+	Identical &= (Suppress(Arena.GetWaveform(e, ch), GetSettings(ch, Baseline)) ==
+		      vector<uint16_t>(Samples.begin(), Samples.begin() + N));
+	Stored += N;
+      }
+      Mismatches += !Identical;
+    }
+    Events += Table.NumEvents;
+  }
+
+  if(Mismatches)
+    Status = -42;
+
+  cout << setw(10) << "All" << setw(9) << setprecision(3)
+       << 100. * Stored / (max(Events, (uint64_t)1) * NumChannels * RecordLength) << "%"
+       << setw(12) << (Mismatches ? "MISMATCH" : "identical") << setw(16) << "-";
+
+  uint64_t Decoded = 0, Passes = 0;
+  chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+  chrono::duration<double> Elapsed(0.);
+
+  while(Elapsed.count() < NumRounds * MinTime){
+    for(int b=0; b<NumBuffers; b++)
+      Decoded += DecodeTable(DG, Buffers[b], Sizes[b], &Table, Samples);
+    Passes++;
+    Elapsed = chrono::steady_clock::now() - Start;
+  }
+
+  cout << setw(16) << setprecision(4) << Passes * Events / Elapsed.count()
+       << setw(14) << "-" << setw(14) << 2. * Decoded / Elapsed.count() / 1e6 << endl;
+
+  Close(DG, Buffers);
+  Close(Reference, ReferenceBuffers);
+
+  if(Status != 0)
+    cout << "\nError! The ZLE decoders gave different samples!" << endl;
+  cout << endl;
+
+  return Status;
+}
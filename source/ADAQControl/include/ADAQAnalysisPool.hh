@@ -0,0 +1,171 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQAnalysisPool.hh
+// date: 16 Oct 26
+//
+// desc: ADAQAnalysisPool runs the analysis of decoded events in
+//       parallel on a pool of worker threads. A batch of events
+//       (e.g. one decoded block transfer) is decoded once by the
+//       caller and split into tasks; each task has an "analyze"
+//       function, run by a worker, and a "deliver" function, run by
+//       the caller's output thread (e.g. to fill ADAQWaveformData
+//       and the ADAQReadoutManager TTree), which need not be thread
+//       safe.
+//
+//       Every worker has its own task queue. Submitted tasks are
+//       distributed over the queues; a worker takes tasks from the
+//       back of its own queue and, when it runs dry, steals from the
+//       front of the queues of the other workers, such that uneven
+//       tasks keep all workers busy.
+//
+//       In ordered mode (default), tasks are delivered strictly in
+//       the order they were submitted, i.e. in trigger order, even
+//       though they are analyzed out of order. In unordered mode,
+//       tasks are delivered as soon as they are analyzed, which
+//       avoids holding completed tasks behind a slow one.
+//
+//       The caller owns the event data, which must remain valid until
+//       the tasks that use it have been delivered.
+//
+//       An analyze function may obtain the index of the worker that
+//       runs it with GetWorkerIndex(), e.g. to fill per-worker
+//       accumulators such as the slots of an ADAQHistogramService
+//       created with GetNumWorkers() slots, without locking.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQAnalysisPool_hh__
+#define __ADAQAnalysisPool_hh__ 1
+
+// C++
+#include <vector>
+#include <deque>
+#include <map>
+#include <atomic>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+
+// A snapshot of the counters of one worker
+
+struct ADAQAnalysisWorkerStats{
+  uint64_t Tasks;      // Tasks analyzed by the worker
+  uint64_t Steals;     // Tasks taken from other workers' queues
+  double BusyTime;     // Time spent analyzing [s]
+  double Utilization;  // BusyTime / time since Start()
+};
+
+
+class ADAQAnalysisPool
+{
+public:
+  // The number of workers defaults to the number of hardware threads
+  ADAQAnalysisPool(uint32_t = 0);
+  ~ADAQAnalysisPool();
+
+  void Start();
+  void Stop();
+  bool GetRunning() {return Running;}
+
+  uint32_t GetNumWorkers() {return NumWorkers;}
+
+  // Index [0, GetNumWorkers()) of the worker running the calling
+  // analyze function; -1 if not called from a worker thread
+  static int GetWorkerIndex();
+
+  // Deliver in submission order (true, default) or in completion
+  // order (false); may only be changed while no tasks are pending
+  int SetOrdered(bool);
+  bool GetOrdered() {return Ordered;}
+
+  // Maximum tasks submitted but not yet delivered; Submit() blocks
+  // (delivering completed tasks) while the limit is reached
+  void SetMaxPendingTasks(uint32_t M) {MaxPendingTasks = (M > 0) ? M : 1;}
+
+  // Submit one task; returns its sequence number
+  uint64_t Submit(boost::function<void ()>, boost::function<void ()>);
+
+  // Split a batch of "N" events into tasks of at most "TaskSize"
+  // events; the functions are called with the first event and the
+  // number of events of each task. Returns the number of tasks.
+  uint32_t SubmitBatch(uint32_t, uint32_t,
+		       boost::function<void (uint32_t, uint32_t)>,
+		       boost::function<void (uint32_t, uint32_t)>);
+
+  // Run the deliver functions of the tasks that are ready; must be
+  // called from a single (output) thread. Returns the number of
+  // tasks delivered.
+  uint32_t Deliver();
+
+  // Analyze and deliver all submitted tasks
+  void Drain();
+
+  uint32_t GetNumPendingTasks() {return PendingTasks;}
+
+  ADAQAnalysisWorkerStats GetWorkerStats(uint32_t);
+  void ResetStats();
+  void PrintStats();
+
+private:
+
+  struct Task{
+    uint64_t Sequence;
+    boost::function<void ()> Analyze, Deliver;
+  };
+
+  struct Worker{
+    deque<Task *> Queue;
+    boost::mutex QueueMutex;
+    boost::thread *Thread;
+
+    atomic<uint64_t> Tasks, Steals, BusyNs;
+  };
+
+  void RunWorker(uint32_t);
+  Task *FindTask(uint32_t);
+  void Complete(Task *);
+
+  uint32_t NumWorkers;
+  vector<Worker *> Workers;
+
+  atomic<bool> Running;
+  bool Ordered;
+
+  // Queued (not yet analyzing) tasks over all workers, used to put
+  // idle workers to sleep
+  atomic<uint32_t> QueuedTasks;
+  boost::mutex WakeMutex;
+  boost::condition_variable WakeCondition;
+
+  // Completed tasks awaiting delivery: by sequence number in ordered
+  // mode, in completion order otherwise
+  boost::mutex OutputMutex;
+  boost::condition_variable OutputCondition;
+  map<uint64_t, Task *> CompletedOrdered;
+  deque<Task *> CompletedUnordered;
+
+  uint64_t NextSequence, NextDelivery;
+  uint32_t NextWorker;
+  atomic<uint32_t> PendingTasks;
+  uint32_t MaxPendingTasks;
+
+  uint64_t StartTimeNs;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQBLTController.hh
+// date: 16 Oct 26
+//
+// desc: ADAQBLTController adapts the number of events moved in each
+//       block transfer (BLT) to the conditions of the run. With a
+//       fixed setting, high trigger rates result in many tiny and
+//       inefficient transfers while low trigger rates result in
+//       events waiting in the FPGA memory for a long time. The
+//       controller periodically measures the trigger rate, the bytes
+//       per transfer, and the FPGA buffer occupancy and then sets the
+//       events per transfer to the number of events expected within
+//       a user-specified target latency, bounded by user limits. If
+//       the FPGA buffer fills beyond a given level the transfers are
+//       enlarged regardless of latency to avoid dead time.
+//
+//       For standard firmware (STD) the setting is applied with
+//       SetMaxNumEventsBLT(), also during the run. For DPP firmware
+//       Apply() sets the event aggregation threshold [events per
+//       channel] with SetDPPEventAggregation(), whose registers may
+//       only be written while the acquisition is stopped; during the
+//       run the controller therefore keeps the threshold and instead
+//       sets the number of aggregates per transfer with
+//       SetMaxNumAggregatesBLT(), sized from the trigger rate per
+//       enabled channel. The controller is driven by
+//       ADAQReadoutPipeline from its readout thread, which also uses
+//       the setting as the number of events to wait for before each
+//       transfer. Every adjustment is recorded and, if verbose,
+//       printed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQBLTController_hh__
+#define __ADAQBLTController_hh__ 1
+
+// C++
+#include <vector>
+#include <string>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+
+// ADAQ
+#include "ADAQDigitizer.hh"
+
+
+// A record of one adjustment made by the controller
+
+struct ADAQBLTAdjustment{
+  double Time;               // Time since Reset() [s]
+  uint32_t OldEvents;        // Events (per channel for DPP) per transfer before ...
+  uint32_t NewEvents;        // ... and after the adjustment
+  double TriggerRate;        // Measured event rate [Hz]
+  double BytesPerTransfer;   // Mean over the update period
+  double BufferLevel;        // FPGA buffer occupancy [0,1]
+  string Reason;
+};
+
+
+class ADAQBLTController
+{
+public:
+  ADAQBLTController(ADAQDigitizer *);
+  ~ADAQBLTController();
+
+  // Lower and upper limits on the events per transfer. The readout
+  // buffers must be allocated to hold the upper limit, which
+  // ADAQReadoutPipeline::AllocateBuffers() ensures.
+  void SetLimits(uint32_t, uint32_t);
+  uint32_t GetMinEvents() {return MinEvents;}
+  uint32_t GetMaxEvents() {return MaxEvents;}
+
+  // Target time that events wait in the FPGA memory [s]
+  void SetTargetLatency(double TL) {TargetLatency = TL;}
+  double GetTargetLatency() {return TargetLatency;}
+
+  // Time between successive evaluations of the setting [s]
+  void SetUpdatePeriod(double UP) {UpdatePeriod = UP;}
+  double GetUpdatePeriod() {return UpdatePeriod;}
+
+  // FPGA buffer occupancy above which transfers are enlarged
+  void SetBufferLevelLimit(double BLL) {BufferLevelLimit = BLL;}
+
+  // Relative change below which the setting is left alone to avoid
+  // reprogramming the digitizer for small fluctuations in rate
+  void SetHysteresis(double H) {Hysteresis = H;}
+
+  // Program the digitizer with the number of events per transfer
+  // (STD) or the aggregation threshold and one aggregate per
+  // transfer (DPP); must be called while the acquisition is stopped
+  int Apply(uint32_t);
+  uint32_t GetEventsPerTransfer() {return EventsPerTransfer;}
+  uint32_t GetAggregatesPerTransfer() {return AggregatesPerTransfer;}
+
+  // Called from the readout thread: Reset() at the start of the
+  // run, Update() after every transfer. Update() returns true if
+  // the events (STD) or aggregates (DPP) per transfer were changed.
+  // Neither changes the DPP aggregation threshold.
+  void Reset(uint64_t);
+  bool Update(uint32_t, uint32_t, uint64_t);
+
+  const vector<ADAQBLTAdjustment> &GetAdjustments() {return Adjustments;}
+  void PrintAdjustments();
+
+  void SetVerbose(bool V) {Verbose = V;}
+
+private:
+  ADAQDigitizer *DG;
+  bool DPPFirmware;
+  bool Verbose;
+
+  uint32_t MinEvents, MaxEvents, EventsPerTransfer;
+  uint32_t AggregatesPerTransfer, NumEnabledChannels;
+  double TargetLatency, UpdatePeriod, BufferLevelLimit, Hysteresis;
+
+  // Accumulators for the present update period
+  uint64_t StartNs, PeriodStartNs;
+  uint64_t PeriodBytes, PeriodEvents, PeriodTransfers;
+
+  vector<ADAQBLTAdjustment> Adjustments;
+};
+
+#endif
@@ -65,6 +65,9 @@ extern "C"{
 
 // ADAQ
 #include "ADAQVBoard.hh"
+#include "ADAQEventArena.hh"
+#include "ADAQPSDEventArena.hh"
+#include "ADAQZLEEventTable.hh"
 
 
 class ADAQDigitizer : public ADAQVBoard
@@ -72,7 +75,7 @@ class ADAQDigitizer : public ADAQVBoard
 
 public:
   ADAQDigitizer(ZBoardType, int, uint32_t, int, int);
-  ~ADAQDigitizer();
+  virtual ~ADAQDigitizer();
 
 
   ///////////////////////////////////////////////
@@ -87,6 +90,49 @@ public:
   bool CheckRegisterForWriting(uint32_t);
 
 
+  ///////////////////////////
+  // Shadow register cache //
+  ///////////////////////////
+  //
+  // When enabled, a shadow copy is kept of the configuration
+  // registers that ADAQ itself accesses through Set/GetRegisterValue()
+  // (see CheckRegisterForCaching()) such that their reads are served
+  // without a link transaction; all other registers are always
+  // accessed on the board. Between BeginRegisterBatch() and
+  // CommitRegisters(), writes and bit-level edits made with
+  // ModifyRegisterBits() of cached registers are only merged into
+  // the shadow copy and the dirty registers are then written in a
+  // single pass, in the order in which they were first modified.
+  //
+  // CAENDigitizer library calls bypass the cache; every wrapper below
+  // that writes a cached register invalidates its shadow copy. The
+  // shadow copy of a register whose read or write failed is dropped.
+  // Code calling the CAENDigitizer library directly must call
+  // InvalidateRegister() or ResyncRegisterCache() itself.
+  //
+  // The cache is not thread-safe: it must only be enabled while a
+  // single thread accesses the digitizer, e.g. while programming it
+  // before acquisition, and disabled before the readout and control
+  // threads run.
+
+  void SetRegisterCache(bool);
+  bool GetRegisterCache() {return RegisterCacheEnabled;}
+
+  int BeginRegisterBatch();
+  int CommitRegisters();
+
+  // Set the bits selected by a mask to the corresponding bits of a
+  // value, leaving all other bits of the register untouched
+  int ModifyRegisterBits(uint32_t, uint32_t, uint32_t);
+
+  void InvalidateRegister(uint32_t);
+  void InvalidateRegisterCache();
+  int ResyncRegisterCache();
+
+  // Number of register read/write transactions over the link
+  uint64_t GetRegisterTransactions() {return RegisterTransactions;}
+
+
   ////////////////////////////////////////
   // Enhanced digitizer control methods //
   ////////////////////////////////////////
@@ -128,13 +174,38 @@ public:
 
   // Methods for getting the total buffer level for CAEN standard
   // (STD) firmware and for CAEN DPP-PSD (PSD) firmware
-  int GetSTDBufferLevel(double &);
-  int GetPSDBufferLevel(double &);
+  virtual int GetSTDBufferLevel(double &);
+  virtual int GetPSDBufferLevel(double &);
 
-  int GetNumFPGAEvents(uint32_t *);
+  virtual int GetNumFPGAEvents(uint32_t *);
   
   int GetZLEWaveform(char *, int, vector<vector<uint16_t> > &);
   int PrintZLEEventInfo(char *, int);
+
+  // Random-access ZLE decoding: BuildZLEEventTable() indexes every
+  // event in the buffer in one pass, after which DecodeZLEEvent()
+  // unpacks the stored samples of any event/channel (SIMD-enabled)
+  // into a caller-provided array. DecodeZLEEvent() does not modify
+  // the digitizer object and may be called from several threads.
+  int BuildZLEEventTable(char *, uint32_t, ADAQZLEEventTable *);
+  int DecodeZLEEvent(const ADAQZLEEventTable *, uint32_t, uint32_t, uint16_t *, uint32_t, uint32_t *) const;
+
+  // Native decoding of a standard firmware (STD) block transfer into
+  // a reusable ADAQEventArena. This is equivalent to calling
+  // GetNumEvents(), GetEventInfo() and DecodeEvent() for every event
+  // in the buffer but walks the buffer once with no heap allocation
+  int DecodeSTDBuffer(char *, uint32_t, ADAQEventArena *);
+
+  // Native decoding of a DPP-PSD block transfer (one or more board
+  // aggregates) into the per-channel columns of an ADAQPSDEventArena.
+  // The event-level data replaces GetDPPEvents(); waveforms are not
+  // decoded here but may be decoded later for selected events with
+  // ADAQPSDEventArena::DecodeWaveform() in place of
+  // DecodeDPPWaveforms(). Supports the x725/x730 DPP-PSD format.
+  // The event-level decoding is a single pass like GetDPPEvents()
+  // and runs at about its speed; the gain is in the waveforms, which
+  // are only decoded for the events that need them.
+  int DecodePSDBuffer(char *, uint32_t, ADAQPSDEventArena *);
   
   
   /////////////////////////////////////////
@@ -160,7 +231,7 @@ public:
   unsigned int GetTimeStampSize() {return TimeStampSize;}
   unsigned int GetTimeStampUnit() {return TimeStampUnit;}
   
-private:
+protected:
   int BoardSerialNumber;
   string BoardModelName;
   string BoardROCFirmwareRevision, BoardAMCFirmwareRevision;
@@ -175,6 +246,24 @@ private:
   map<ZBoardType, unsigned int> TimeStampUnitMap;
 
   int ZLEStartWord, ZLEWordCounter;
+
+  // Register access over the link. Each call is a single
+  // transaction, using CAENComm multi-read/write for N > 1 registers.
+  // A nonzero status is returned if any register failed, whose shadow
+  // copy is then dropped; RegisterErrors holds the status of each.
+  virtual int ReadRegisters(uint32_t, uint32_t *, uint32_t *);
+  virtual int WriteRegisters(uint32_t, uint32_t *, uint32_t *);
+  void SetRegisterErrors(uint32_t, uint32_t *, const int *);
+  vector<int> RegisterErrors;
+
+  bool CheckRegisterForCaching(uint32_t);
+  void InvalidateTriggerSourceRegisters();
+  void InvalidateZSRegisters(uint32_t);
+
+  bool RegisterCacheEnabled, RegisterBatch, MultiRegisterAccess;
+  map<uint32_t, uint32_t> ShadowRegisters;
+  vector<uint32_t> DirtyRegisters; // In order of first write
+  uint64_t RegisterTransactions;
   
 public:
 
@@ -200,20 +289,25 @@ public:
   // guaranteed. Please cross check function below with CAENDigitizer
   // manual in the case of potentially missing functions.
   //
+  // Wrappers that touch the acquisition state or the readout data
+  // path are declared virtual so that ADAQEmulatedDigitizer can
+  // stand in for the CAEN hardware and libraries without the calling
+  // code changing.
+  //
   // Last updated : 29 Apr 15 for CAENDigitizer-2.6.5
   
   //////////////////////
   // Trigger settings //
   //////////////////////
 
-  int SendSWTrigger() {return CAEN_DGTZ_SendSWtrigger(BoardHandle);}
-  int SetSWTriggerMode(CAEN_DGTZ_TriggerMode_t tM) {return CAEN_DGTZ_SetSWTriggerMode(BoardHandle, tM);}
+  virtual int SendSWTrigger() {return CAEN_DGTZ_SendSWtrigger(BoardHandle);}
+  int SetSWTriggerMode(CAEN_DGTZ_TriggerMode_t tM) {InvalidateTriggerSourceRegisters(); return CAEN_DGTZ_SetSWTriggerMode(BoardHandle, tM);}
   int GetSWTriggerMode(CAEN_DGTZ_TriggerMode_t *tM) {return CAEN_DGTZ_GetSWTriggerMode(BoardHandle, tM);}
   
-  int SetExtTriggerInputMode(CAEN_DGTZ_TriggerMode_t mode) {return CAEN_DGTZ_SetExtTriggerInputMode(BoardHandle, mode);}
+  int SetExtTriggerInputMode(CAEN_DGTZ_TriggerMode_t mode) {InvalidateTriggerSourceRegisters(); return CAEN_DGTZ_SetExtTriggerInputMode(BoardHandle, mode);}
   int GetExtTriggerInputMode(CAEN_DGTZ_TriggerMode_t *mode) {return CAEN_DGTZ_GetExtTriggerInputMode(BoardHandle, mode);}
 
-  int SetChannelSelfTrigger(CAEN_DGTZ_TriggerMode_t mode, uint32_t channelMask) {return CAEN_DGTZ_SetChannelSelfTrigger(BoardHandle, mode, channelMask);}
+  int SetChannelSelfTrigger(CAEN_DGTZ_TriggerMode_t mode, uint32_t channelMask) {InvalidateTriggerSourceRegisters(); return CAEN_DGTZ_SetChannelSelfTrigger(BoardHandle, mode, channelMask);}
   int GetChannelSelfTrigger(uint32_t channel, CAEN_DGTZ_TriggerMode_t *mode) {return CAEN_DGTZ_GetChannelSelfTrigger(BoardHandle, channel, mode);}
 
   int SetPostTriggerSize(uint32_t percent) {return CAEN_DGTZ_SetPostTriggerSize(BoardHandle, percent);}
@@ -225,7 +319,7 @@ public:
   int SetGroupTriggerThreshold(uint32_t group, uint32_t threshold) {return CAEN_DGTZ_SetGroupTriggerThreshold(BoardHandle, group, threshold);}
   int GetGroupTriggerThreshold(uint32_t group, uint32_t *threshold) {return CAEN_DGTZ_GetGroupTriggerThreshold(BoardHandle, group, threshold);}
 
-  int SetGroupSelfTrigger(CAEN_DGTZ_TriggerMode_t mode, uint32_t groupMask) {return CAEN_DGTZ_SetGroupSelfTrigger(BoardHandle, mode, groupMask);}
+  int SetGroupSelfTrigger(CAEN_DGTZ_TriggerMode_t mode, uint32_t groupMask) {InvalidateTriggerSourceRegisters(); return CAEN_DGTZ_SetGroupSelfTrigger(BoardHandle, mode, groupMask);}
   int GetGroupSelfTrigger(uint32_t group, CAEN_DGTZ_TriggerMode_t *mode) {return CAEN_DGTZ_GetGroupSelfTrigger(BoardHandle, group, mode);}
   
   int SetTriggerPolarity(uint32_t channel, CAEN_DGTZ_TriggerPolarity_t polarity) {return CAEN_DGTZ_SetTriggerPolarity(BoardHandle, channel, polarity);}
@@ -236,10 +330,10 @@ public:
   // Non-trigger channel settings //
   //////////////////////////////////
 
-  int SetChannelEnableMask(uint32_t CEM) {return CAEN_DGTZ_SetChannelEnableMask(BoardHandle, CEM);}
-  int GetChannelEnableMask(uint32_t *CEM) {return CAEN_DGTZ_GetChannelEnableMask(BoardHandle, CEM);}
+  virtual int SetChannelEnableMask(uint32_t CEM) {InvalidateRegister(CAEN_DGTZ_CH_ENABLE_ADD); return CAEN_DGTZ_SetChannelEnableMask(BoardHandle, CEM);}
+  virtual int GetChannelEnableMask(uint32_t *CEM) {return CAEN_DGTZ_GetChannelEnableMask(BoardHandle, CEM);}
 
-  int SetGroupEnableMask(uint32_t mask) {return CAEN_DGTZ_SetGroupEnableMask(BoardHandle, mask);}
+  int SetGroupEnableMask(uint32_t mask) {InvalidateRegister(CAEN_DGTZ_CH_ENABLE_ADD); return CAEN_DGTZ_SetGroupEnableMask(BoardHandle, mask);}
   int GetGroupEnableMask(uint32_t *mask) {return CAEN_DGTZ_GetGroupEnableMask(BoardHandle, mask);}
 
   int SetChannelGroupMask(uint32_t group, uint32_t channelMask) {return CAEN_DGTZ_SetChannelGroupMask(BoardHandle, group, channelMask);}
@@ -259,12 +353,16 @@ public:
   // Zero suppression //
   //////////////////////
 
-  int SetZeroSuppressionMode(uint32_t mode) {return CAEN_DGTZ_SetZeroSuppressionMode(BoardHandle, (CAEN_DGTZ_ZS_Mode_t)mode);}
-  int GetZeroSuppressionMode(uint32_t *mode) {return CAEN_DGTZ_GetZeroSuppressionMode(BoardHandle, (CAEN_DGTZ_ZS_Mode_t *)mode);}
+  virtual int SetZeroSuppressionMode(uint32_t mode) {return CAEN_DGTZ_SetZeroSuppressionMode(BoardHandle, (CAEN_DGTZ_ZS_Mode_t)mode);}
+  virtual int GetZeroSuppressionMode(uint32_t *mode) {return CAEN_DGTZ_GetZeroSuppressionMode(BoardHandle, (CAEN_DGTZ_ZS_Mode_t *)mode);}
   
-  int SetChannelZSParams(uint32_t channel, uint32_t weight, int32_t  threshold, int32_t nsamp)
-  {return CAEN_DGTZ_SetChannelZSParams(BoardHandle, channel, (CAEN_DGTZ_ThresholdWeight_t)weight, threshold, nsamp);}
-  int GetChannelZSParams(uint32_t channel, uint32_t *weight, int32_t  *threshold, int32_t *nsamp)
+  virtual int SetChannelZSParams(uint32_t channel, uint32_t weight, int32_t  threshold, int32_t nsamp)
+  {
+    InvalidateRegister(CAEN_DGTZ_CHANNEL_ZS_THRESHOLD_BASE_ADDRESS + 0x100*channel);
+    InvalidateRegister(CAEN_DGTZ_CHANNEL_ZS_NSAMPLE_BASE_ADDRESS + 0x100*channel);
+    return CAEN_DGTZ_SetChannelZSParams(BoardHandle, channel, (CAEN_DGTZ_ThresholdWeight_t)weight, threshold, nsamp);
+  }
+  virtual int GetChannelZSParams(uint32_t channel, uint32_t *weight, int32_t  *threshold, int32_t *nsamp)
   {return CAEN_DGTZ_GetChannelZSParams(BoardHandle, channel, (CAEN_DGTZ_ThresholdWeight_t *)weight, threshold, nsamp);}
 
 
@@ -272,19 +370,24 @@ public:
   // Acquisition settings and control //
   //////////////////////////////////////
 
-  int SWStartAcquisition() {return CAEN_DGTZ_SWStartAcquisition(BoardHandle);}
-  int SWStopAcquisition() {return CAEN_DGTZ_SWStopAcquisition(BoardHandle);}
+  virtual int SWStartAcquisition() {InvalidateRegister(CAEN_DGTZ_ACQ_CONTROL_ADD); return CAEN_DGTZ_SWStartAcquisition(BoardHandle);}
+  virtual int SWStopAcquisition() {InvalidateRegister(CAEN_DGTZ_ACQ_CONTROL_ADD); return CAEN_DGTZ_SWStopAcquisition(BoardHandle);}
 
-  int SetAcquisitionMode(CAEN_DGTZ_AcqMode_t mode) {return CAEN_DGTZ_SetAcquisitionMode(BoardHandle, mode);}
+  int SetAcquisitionMode(CAEN_DGTZ_AcqMode_t mode) {InvalidateRegister(CAEN_DGTZ_ACQ_CONTROL_ADD); return CAEN_DGTZ_SetAcquisitionMode(BoardHandle, mode);}
   int GetAcquisitionMode(CAEN_DGTZ_AcqMode_t *mode) {return CAEN_DGTZ_GetAcquisitionMode(BoardHandle, mode);}
 
-  int SetRecordLength(uint32_t length) {return CAEN_DGTZ_SetRecordLength(BoardHandle, length);}
-  int GetRecordLength(uint32_t *length) {return CAEN_DGTZ_GetRecordLength(BoardHandle, length);}
+  virtual int SetRecordLength(uint32_t length) {InvalidateRegister(CAEN_DGTZ_BROAD_NUM_BLOCK_ADD); return CAEN_DGTZ_SetRecordLength(BoardHandle, length);}
+  virtual int GetRecordLength(uint32_t *length) {return CAEN_DGTZ_GetRecordLength(BoardHandle, length);}
 
-  int SetRecordLength(uint32_t length, int ch) {return CAEN_DGTZ_SetRecordLength(BoardHandle, length, ch);}
+  int SetRecordLength(uint32_t length, int ch) {InvalidateRegister(CAEN_DGTZ_BROAD_NUM_BLOCK_ADD); return CAEN_DGTZ_SetRecordLength(BoardHandle, length, ch);}
   int GetRecordLength(uint32_t *length, int ch) {return CAEN_DGTZ_GetRecordLength(BoardHandle, length, ch);}
   
-  int SetRunSynchronizationMode(CAEN_DGTZ_RunSyncMode_t mode) {return CAEN_DGTZ_SetRunSynchronizationMode(BoardHandle, mode);}
+  int SetRunSynchronizationMode(CAEN_DGTZ_RunSyncMode_t mode)
+  {
+    InvalidateRegister(CAEN_DGTZ_ACQ_CONTROL_ADD);
+    InvalidateRegister(CAEN_DGTZ_FRONT_PANEL_IO_CTRL_ADD);
+    return CAEN_DGTZ_SetRunSynchronizationMode(BoardHandle, mode);
+  }
   int GetRunSynchronizationMode(CAEN_DGTZ_RunSyncMode_t *mode) {return CAEN_DGTZ_GetRunSynchronizationMode(BoardHandle, mode);}
 
 
@@ -294,30 +397,30 @@ public:
 
   // Generic methods
 
-  int ClearData() {return CAEN_DGTZ_ClearData(BoardHandle);}
-  int ReadData(char *buffer, uint32_t *bufferSize) {return CAEN_DGTZ_ReadData(BoardHandle, CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT, buffer, bufferSize);}
+  virtual int ClearData() {return CAEN_DGTZ_ClearData(BoardHandle);}
+  virtual int ReadData(char *buffer, uint32_t *bufferSize) {return CAEN_DGTZ_ReadData(BoardHandle, CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT, buffer, bufferSize);}
 
   int SetEventPackaging(CAEN_DGTZ_EnaDis_t mode) {return CAEN_DGTZ_SetEventPackaging(BoardHandle, mode);}
   int GetEventPackaging(CAEN_DGTZ_EnaDis_t *mode) {return CAEN_DGTZ_GetEventPackaging(BoardHandle, mode);}
 
-  int SetMaxNumEventsBLT(uint32_t numEvents) {return CAEN_DGTZ_SetMaxNumEventsBLT(BoardHandle, numEvents);}
-  int GetMaxNumEventsBLT(uint32_t *numEvents) {return CAEN_DGTZ_GetMaxNumEventsBLT(BoardHandle, numEvents);}
+  virtual int SetMaxNumEventsBLT(uint32_t numEvents) {return CAEN_DGTZ_SetMaxNumEventsBLT(BoardHandle, numEvents);}
+  virtual int GetMaxNumEventsBLT(uint32_t *numEvents) {return CAEN_DGTZ_GetMaxNumEventsBLT(BoardHandle, numEvents);}
 
-  int SetMaxNumAggregatesBLT(uint32_t numAggr) {return CAEN_DGTZ_SetMaxNumAggregatesBLT(BoardHandle, numAggr);}
-  int GetMaxNumAggregatesBLT(uint32_t *numAggr) {return CAEN_DGTZ_GetMaxNumAggregatesBLT(BoardHandle, numAggr);}
+  virtual int SetMaxNumAggregatesBLT(uint32_t numAggr) {return CAEN_DGTZ_SetMaxNumAggregatesBLT(BoardHandle, numAggr);}
+  virtual int GetMaxNumAggregatesBLT(uint32_t *numAggr) {return CAEN_DGTZ_GetMaxNumAggregatesBLT(BoardHandle, numAggr);}
 
-  int MallocReadoutBuffer(char **buffer, uint32_t *size) {return CAEN_DGTZ_MallocReadoutBuffer(BoardHandle, buffer, size);}
-  int FreeReadoutBuffer(char **buffer) {return CAEN_DGTZ_FreeReadoutBuffer(buffer);}
+  virtual int MallocReadoutBuffer(char **buffer, uint32_t *size) {return CAEN_DGTZ_MallocReadoutBuffer(BoardHandle, buffer, size);}
+  virtual int FreeReadoutBuffer(char **buffer) {return CAEN_DGTZ_FreeReadoutBuffer(buffer);}
 
   // Methods for readout
 
   //int AllocateEvent(void **Evt) {return CAEN_DGTZ_AllocateEvent(BoardHandle, Evt);}
-  int AllocateEvent(CAEN_DGTZ_UINT16_EVENT_t **Evt) {return CAEN_DGTZ_AllocateEvent(BoardHandle, (void **) Evt);}
-  int DecodeEvent(char *evtPtr, CAEN_DGTZ_UINT16_EVENT_t **Evt) {return CAEN_DGTZ_DecodeEvent(BoardHandle, evtPtr, (void **)Evt);}
-  int FreeEvent(CAEN_DGTZ_UINT16_EVENT_t **Evt) {return CAEN_DGTZ_FreeEvent(BoardHandle, (void **)Evt);}
+  virtual int AllocateEvent(CAEN_DGTZ_UINT16_EVENT_t **Evt) {return CAEN_DGTZ_AllocateEvent(BoardHandle, (void **) Evt);}
+  virtual int DecodeEvent(char *evtPtr, CAEN_DGTZ_UINT16_EVENT_t **Evt) {return CAEN_DGTZ_DecodeEvent(BoardHandle, evtPtr, (void **)Evt);}
+  virtual int FreeEvent(CAEN_DGTZ_UINT16_EVENT_t **Evt) {return CAEN_DGTZ_FreeEvent(BoardHandle, (void **)Evt);}
   
-  int GetNumEvents(char *buffer, uint32_t buffsize, uint32_t *numEvents) {return CAEN_DGTZ_GetNumEvents(BoardHandle, buffer, buffsize, numEvents);}
-  int GetEventInfo(char *buffer, uint32_t buffsize, uint32_t numEvent, CAEN_DGTZ_EventInfo_t *eventInfo, char **EventPtr)
+  virtual int GetNumEvents(char *buffer, uint32_t buffsize, uint32_t *numEvents) {return CAEN_DGTZ_GetNumEvents(BoardHandle, buffer, buffsize, numEvents);}
+  virtual int GetEventInfo(char *buffer, uint32_t buffsize, uint32_t numEvent, CAEN_DGTZ_EventInfo_t *eventInfo, char **EventPtr)
   {return CAEN_DGTZ_GetEventInfo(BoardHandle, buffer, buffsize, numEvent, eventInfo, EventPtr);}
   
   // Methods for zero length encoding (zero suppression) readout
@@ -332,7 +435,7 @@ public:
   int GetZLEEvents(char *Buffer, uint32_t BufferSize, void **Events, uint32_t *NumEventsArray) 
   {return CAEN_DGTZ_GetZLEEvents(BoardHandle, Buffer, BufferSize, Events, NumEventsArray);}
   
-  int SetZLEParaments(uint32_t ChannelMask, void *Params) {return CAEN_DGTZ_SetZLEParameters(BoardHandle, ChannelMask, Params);}
+  int SetZLEParaments(uint32_t ChannelMask, void *Params) {InvalidateZSRegisters(ChannelMask); return CAEN_DGTZ_SetZLEParameters(BoardHandle, ChannelMask, Params);}
 
 
   ////////////////////////////////////////////
@@ -349,16 +452,16 @@ public:
 
   // Event and waveform memory handling
 
-  int MallocDPPEvents(CAEN_DGTZ_DPP_PSD_Event_t **events, uint32_t *allocatedSize)
+  virtual int MallocDPPEvents(CAEN_DGTZ_DPP_PSD_Event_t **events, uint32_t *allocatedSize)
   {return CAEN_DGTZ_MallocDPPEvents(BoardHandle, (void**)events, allocatedSize);}
 
-  int FreeDPPEvents(void **events)
+  virtual int FreeDPPEvents(void **events)
   {return CAEN_DGTZ_FreeDPPEvents(BoardHandle, events);}
 
-  int MallocDPPWaveforms(CAEN_DGTZ_DPP_PSD_Waveforms_t **waveforms, uint32_t *allocatedSize)
+  virtual int MallocDPPWaveforms(CAEN_DGTZ_DPP_PSD_Waveforms_t **waveforms, uint32_t *allocatedSize)
   {return CAEN_DGTZ_MallocDPPWaveforms(BoardHandle, (void **)waveforms, allocatedSize);}
 
-  int FreeDPPWaveforms(void *waveforms)
+  virtual int FreeDPPWaveforms(void *waveforms)
   {return CAEN_DGTZ_FreeDPPWaveforms(BoardHandle, waveforms);}
 
   // Acquisition and triggering settings
@@ -383,20 +486,20 @@ public:
 
   // Event control and readout
   
-  int GetDPPEvents(char *buffer, uint32_t buffsize, CAEN_DGTZ_DPP_PSD_Event_t **events, uint32_t *numEventsArray)
+  virtual int GetDPPEvents(char *buffer, uint32_t buffsize, CAEN_DGTZ_DPP_PSD_Event_t **events, uint32_t *numEventsArray)
   {return CAEN_DGTZ_GetDPPEvents(BoardHandle, buffer, buffsize, (void **)events, numEventsArray);}
   
-  int DecodeDPPWaveforms(void *event, CAEN_DGTZ_DPP_PSD_Waveforms_t *waveforms)
+  virtual int DecodeDPPWaveforms(void *event, CAEN_DGTZ_DPP_PSD_Waveforms_t *waveforms)
   {return CAEN_DGTZ_DecodeDPPWaveforms(BoardHandle, event, (void *)waveforms);}
   
   int SetNumEventsPerAggregate(uint32_t numEvents)
-  {return CAEN_DGTZ_SetNumEventsPerAggregate(BoardHandle, numEvents);}
+  {InvalidateRegister(CAEN_DGTZ_BROAD_NUM_BLOCK_ADD); return CAEN_DGTZ_SetNumEventsPerAggregate(BoardHandle, numEvents);}
   
   int SetNumEventsPerAggregate(uint32_t numEvents, int channel)
-  {return CAEN_DGTZ_SetNumEventsPerAggregate(BoardHandle, numEvents, channel);}
+  {InvalidateRegister(CAEN_DGTZ_BROAD_NUM_BLOCK_ADD); return CAEN_DGTZ_SetNumEventsPerAggregate(BoardHandle, numEvents, channel);}
   
-  int SetDPPEventAggregation(int threshold, int maxSize)
-  {return CAEN_DGTZ_SetDPPEventAggregation(BoardHandle, threshold, maxSize);}
+  virtual int SetDPPEventAggregation(int threshold, int maxSize)
+  {InvalidateRegister(CAEN_DGTZ_BROAD_NUM_BLOCK_ADD); return CAEN_DGTZ_SetDPPEventAggregation(BoardHandle, threshold, maxSize);}
   
   int SetDPPParameters(uint32_t channelMask, CAEN_DGTZ_DPP_PSD_Params_t *params)
   {return CAEN_DGTZ_SetDPPParameters(BoardHandle, channelMask, (void *)params);};
@@ -421,7 +524,7 @@ public:
   // Miscellaneous digitizer settings //
   //////////////////////////////////////
   
-  int Reset() {return CAEN_DGTZ_Reset(BoardHandle);}
+  int Reset() {InvalidateRegisterCache(); return CAEN_DGTZ_Reset(BoardHandle);}
   
   int SetAnalogMonOutput(CAEN_DGTZ_AnalogMonitorOutputMode_t mode) {return CAEN_DGTZ_SetAnalogMonOutput(BoardHandle, mode);}
   int GetAnalogMonOutput(CAEN_DGTZ_AnalogMonitorOutputMode_t *mode) {return CAEN_DGTZ_GetAnalogMonOutput(BoardHandle, mode);}
@@ -434,12 +537,12 @@ public:
   int DisableEventAlignedReadout(int handle) {return CAEN_DGTZ_DisableEventAlignedReadout(BoardHandle);}
   int GetInfo(CAEN_DGTZ_BoardInfo_t *boardInfo) {return CAEN_DGTZ_GetInfo(BoardHandle, boardInfo);}
 
-  int SetInterruptConfig(CAEN_DGTZ_EnaDis_t state, uint8_t level, uint32_t status_id, uint16_t event_number, CAEN_DGTZ_IRQMode_t mode)
+  virtual int SetInterruptConfig(CAEN_DGTZ_EnaDis_t state, uint8_t level, uint32_t status_id, uint16_t event_number, CAEN_DGTZ_IRQMode_t mode)
   {return CAEN_DGTZ_SetInterruptConfig(BoardHandle, state, level, status_id, event_number, mode);}
   int GetInterruptConfig(CAEN_DGTZ_EnaDis_t *state, uint8_t *level, uint32_t *status_id, uint16_t *event_number, CAEN_DGTZ_IRQMode_t *mode)
   {return CAEN_DGTZ_GetInterruptConfig(BoardHandle, state, level, status_id, event_number, mode);}
 
-  int IRQWait(int handle, uint32_t timeout) {return CAEN_DGTZ_IRQWait(BoardHandle, timeout);}
+  virtual int IRQWait(int handle, uint32_t timeout) {return CAEN_DGTZ_IRQWait(BoardHandle, timeout);}
   int VMEIRQCheck(int VMEHandle, uint8_t *Mask) {return CAEN_DGTZ_VMEIRQCheck(VMEHandle, Mask);}
   int VMEIRQWait(CAEN_DGTZ_ConnectionType LinkType, int LinkNum, int ConetNode, uint8_t IRQMask, uint32_t timeout, int *VMEHandle)
   {return CAEN_DGTZ_VMEIRQWait(LinkType, LinkNum, ConetNode, IRQMask, timeout, VMEHandle);}
@@ -448,10 +551,10 @@ public:
   int SetDESMode(CAEN_DGTZ_EnaDis_t enable) {return CAEN_DGTZ_SetDESMode(BoardHandle, enable);}
   int GetDESMode(CAEN_DGTZ_EnaDis_t *enable) {return CAEN_DGTZ_GetDESMode(BoardHandle, enable);}
 
-  int SetIOLevel(CAEN_DGTZ_IOLevel_t level) {return CAEN_DGTZ_SetIOLevel(BoardHandle, level);}
+  int SetIOLevel(CAEN_DGTZ_IOLevel_t level) {InvalidateRegister(CAEN_DGTZ_FRONT_PANEL_IO_CTRL_ADD); return CAEN_DGTZ_SetIOLevel(BoardHandle, level);}
   int GetIOLevel(CAEN_DGTZ_IOLevel_t *level) {return CAEN_DGTZ_GetIOLevel(BoardHandle, level);}
   
-  int RearmInterrupt(int BoardHandle) {return CAEN_DGTZ_RearmInterrupt(BoardHandle);}
+  virtual int RearmInterrupt(int BoardHandle) {return CAEN_DGTZ_RearmInterrupt(BoardHandle);}
 
 
   //////////////////////////////////////////////
@@ -0,0 +1,248 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQEmulatedDigitizer.hh
+// date: 16 Oct 26
+//
+// desc: ADAQEmulatedDigitizer is a software stand-in for a CAEN
+//       digitizer and the CAENDigitizer library. It derives from
+//       ADAQDigitizer and overrides the link, acquisition control,
+//       readout, and decoding methods so that ReadData() fills the PC buffer
+//       with synthetic events in the CAEN standard firmware (STD)
+//       event format, in the zero length encoded (ZLE) STD event
+//       format if ZLE zero suppression is selected, or, for the
+//       x725/x730 families, in the DPP-PSD board aggregate format at
+//       a user-specified trigger rate. The FPGA
+//       event memory is modelled such that events arriving while the
+//       memory is full are lost, which allows readout and decoding
+//       code to be developed, tested, and benchmarked without any
+//       hardware attached to the PC.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQEmulatedDigitizer_hh__
+#define __ADAQEmulatedDigitizer_hh__ 1
+
+// C++
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
+// ADAQ
+#include "ADAQDigitizer.hh"
+
+
+class ADAQEmulatedDigitizer : public ADAQDigitizer
+{
+
+public:
+  ADAQEmulatedDigitizer(ZBoardType, int, uint32_t = 0x00000000, int = 0, int = 0);
+  ~ADAQEmulatedDigitizer();
+
+
+  //////////////////////////////////////////
+  // Overridden link and register methods //
+  //////////////////////////////////////////
+
+  int OpenLink();
+  int CloseLink();
+  int Initialize();
+
+
+  ////////////////////////////////////////////////
+  // Overridden acquisition and readout methods //
+  ////////////////////////////////////////////////
+
+  int SendSWTrigger();
+
+  int SetChannelEnableMask(uint32_t);
+  int GetChannelEnableMask(uint32_t *);
+
+  int SWStartAcquisition();
+  int SWStopAcquisition();
+
+  int SetRecordLength(uint32_t);
+  int GetRecordLength(uint32_t *);
+
+  int ClearData();
+  int ReadData(char *, uint32_t *);
+
+  int SetMaxNumEventsBLT(uint32_t);
+  int GetMaxNumEventsBLT(uint32_t *);
+
+  int MallocReadoutBuffer(char **, uint32_t *);
+  int FreeReadoutBuffer(char **);
+
+  int GetNumFPGAEvents(uint32_t *);
+  int GetSTDBufferLevel(double &);
+  int GetPSDBufferLevel(double &);
+
+  // STD firmware only: "None" or "ZLE" zero suppression, which must
+  // be selected before MallocReadoutBuffer(). The ZLE threshold and
+  // logic (0x1n24) and the words stored before and after the samples
+  // beyond the threshold (0x1n28) are taken from the emulated
+  // registers as set by SetZLEChannelSettings()
+  int SetZeroSuppressionMode(uint32_t);
+  int GetZeroSuppressionMode(uint32_t *);
+  int SetChannelZSParams(uint32_t, uint32_t, int32_t, int32_t);
+  int GetChannelZSParams(uint32_t, uint32_t *, int32_t *, int32_t *);
+
+  // DPP-PSD firmware only: the number of events per block transfer,
+  // which are returned as a single board aggregate
+  int SetDPPEventAggregation(int, int);
+
+  // DPP-PSD firmware only: the board aggregates per block transfer
+  int SetMaxNumAggregatesBLT(uint32_t);
+  int GetMaxNumAggregatesBLT(uint32_t *);
+
+  // Interrupts are emulated by blocking in IRQWait() until the
+  // programmed number of events is in the emulated FPGA memory
+  int SetInterruptConfig(CAEN_DGTZ_EnaDis_t, uint8_t, uint32_t, uint16_t, CAEN_DGTZ_IRQMode_t);
+  int IRQWait(int, uint32_t);
+  int RearmInterrupt(int);
+
+
+  ///////////////////////////////////////////////
+  // Overridden CAENDigitizer decoding methods //
+  ///////////////////////////////////////////////
+
+  // These reproduce the behavior of the CAENDigitizer library
+  // decoder, including allocation of the channel arrays by every
+  // call to DecodeEvent(), so that code written against the CAEN
+  // decoding path runs unmodified on the emulator
+  
+  int AllocateEvent(CAEN_DGTZ_UINT16_EVENT_t **);
+  int DecodeEvent(char *, CAEN_DGTZ_UINT16_EVENT_t **);
+  int FreeEvent(CAEN_DGTZ_UINT16_EVENT_t **);
+
+  int GetNumEvents(char *, uint32_t, uint32_t *);
+  int GetEventInfo(char *, uint32_t, uint32_t, CAEN_DGTZ_EventInfo_t *, char **);
+
+  int MallocDPPEvents(CAEN_DGTZ_DPP_PSD_Event_t **, uint32_t *);
+  int FreeDPPEvents(void **);
+  int MallocDPPWaveforms(CAEN_DGTZ_DPP_PSD_Waveforms_t **, uint32_t *);
+  int FreeDPPWaveforms(void *);
+
+  int GetDPPEvents(char *, uint32_t, CAEN_DGTZ_DPP_PSD_Event_t **, uint32_t *);
+  int DecodeDPPWaveforms(void *, CAEN_DGTZ_DPP_PSD_Waveforms_t *);
+
+
+  ////////////////////////////////
+  // Emulation-specific methods //
+  ////////////////////////////////
+
+  // Firmware to emulate: "STD" (default) or "PSD"; must be set
+  // before OpenLink(). DPP-PSD is only available for the x725/x730
+  // families, for which each trigger is a hit on one randomly chosen
+  // enabled channel
+  int SetFirmwareType(string);
+
+  // Mean trigger rate [Hz]. A rate of zero disables the real-time
+  // clock such that every call to ReadData() returns a full block
+  // transfer, i.e. the "as fast as possible" mode for benchmarking
+  void SetTriggerRate(double);
+  double GetTriggerRate() {return TriggerRate;}
+
+  // Bandwidth of the emulated link [MB/s]. ReadData() is delayed by
+  // the time the transfer would take over the link; zero (default)
+  // disables the delay
+  void SetLinkBandwidth(double LB) {LinkBandwidth = LB;}
+  double GetLinkBandwidth() {return LinkBandwidth;}
+
+  // Number of events the emulated FPGA memory can hold
+  void SetMemoryBlocks(uint32_t MB) {MemoryBlocks = MB;}
+  uint32_t GetMemoryBlocks() {return MemoryBlocks;}
+
+  // Seed of the pseudo-random generator for reproducible buffers
+  void SetSeed(uint64_t S) {RandomState = (S ? S : 0x9e3779b97f4a7c15ULL);}
+
+  // Number of events lost because the emulated FPGA memory was full
+  uint64_t GetLostEvents() {return LostEvents;}
+  uint64_t GetGeneratedEvents() {return GeneratedEvents;}
+
+
+protected:
+  // Register access to the emulated register space; all register
+  // methods of ADAQDigitizer, including the shadow register cache,
+  // are built on these
+  int ReadRegisters(uint32_t, uint32_t *, uint32_t *);
+  int WriteRegisters(uint32_t, uint32_t *, uint32_t *);
+
+  // Sets the events waiting in the emulated FPGA memory from the
+  // trigger clock; the event source of derived classes (e.g.
+  // ADAQReplayDigitizer) overrides it
+  virtual uint32_t UpdatePendingEvents();
+  uint32_t GetEventWords();
+  uint32_t GenerateEvents(uint32_t *, uint32_t);
+  uint32_t EncodeZLEChannel(int, const uint32_t *, uint32_t *);
+  uint32_t GetEmulatedRegister(uint32_t);
+  uint32_t GeneratePSDAggregate(uint32_t *, uint32_t);
+  uint32_t GetPSDAggregateWords(uint32_t);
+  void BuildPulseTemplate();
+  uint32_t NextRandom();
+
+  bool AcquisitionRunning;
+  bool IRQEnabled;
+  uint32_t IRQEventNumber;
+  double TriggerRate, LinkBandwidth;
+  uint32_t MemoryBlocks;
+
+  uint32_t ChannelEnableMask, EmulatedRecordLength, MaxNumEventsBLT;
+  uint32_t EmulatedZSMode;
+
+  // ZLE threshold (0x1n24) and samples (0x1n28) registers of each
+  // channel at the start of acquisition
+  vector<uint32_t> ZLEThresholdRegisters, ZLENSampleRegisters;
+
+  // Samples of one channel and their ZLE flags, reused for every
+  // channel of every ZLE event
+  vector<uint32_t> ZLEChannelWords;
+  vector<uint8_t> ZLEFlags;
+
+  string EmulatedFirmwareType;
+  uint32_t EventsPerAggregate, MaxNumAggregatesBLT;
+  uint64_t DPPTimeTag;
+  vector<uint32_t> EventChannels;
+
+  // Events per channel in the arrays handed out by MallocDPPEvents()
+  uint32_t DPPEventCapacity;
+
+  // Events waiting in the emulated FPGA memory
+  uint32_t PendingEvents;
+  uint64_t TriggeredEvents, GeneratedEvents, LostEvents;
+  uint32_t EventCounter, TriggerTimeTag;
+
+  chrono::steady_clock::time_point StartTime;
+
+  uint64_t RandomState;
+  vector<double> PulseTemplate;
+
+  // Emulated register space
+  map<uint32_t, uint32_t> Registers;
+
+  // Sizes of the buffers handed out by MallocReadoutBuffer()
+  map<char *, uint32_t> BufferSizes;
+
+  // Guards the emulated FPGA memory since triggers may be sent from
+  // a control thread while the readout thread is calling ReadData()
+  boost::mutex EmulatorMutex;
+};
+
+#endif
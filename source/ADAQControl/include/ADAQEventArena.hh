@@ -0,0 +1,132 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQEventArena.hh
+// date: 16 Oct 26
+//
+// desc: ADAQEventArena holds a batch of decoded standard firmware
+//       (STD) events in a structure-of-arrays layout: each item of
+//       event-level information (board ID, counter, trigger time
+//       tag, etc) is stored in its own contiguous array, while the
+//       samples of all channels of all events are stored in a single
+//       contiguous sample arena. The arena is filled by
+//       ADAQDigitizer::DecodeSTDBuffer() and is intended to be
+//       reused for every block transfer: memory is only allocated
+//       when a batch is larger than any previous batch such that, in
+//       steady state, decoding requires no heap allocation at all.
+//
+//       Waveforms are returned as ADAQSampleSpan objects, which are
+//       lightweight (pointer, size) views directly into the sample
+//       arena. A span remains valid until the arena is next cleared
+//       or refilled.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQEventArena_hh__
+#define __ADAQEventArena_hh__ 1
+
+// C++
+#include <vector>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+
+
+// A non-owning view of the contiguous samples of one channel
+
+struct ADAQSampleSpan{
+  const uint16_t *Data;
+  uint32_t Size;
+
+  const uint16_t *begin() const {return Data;}
+  const uint16_t *end() const {return Data + Size;}
+  const uint16_t &operator[](uint32_t i) const {return Data[i];}
+  bool Empty() const {return Size == 0;}
+};
+
+
+class ADAQEventArena
+{
+public:
+  ADAQEventArena(uint32_t = 0, uint32_t = 0);
+  ~ADAQEventArena();
+
+  // Preallocate space for the expected batch size (events per block
+  // transfer and samples per event summed over channels) to avoid
+  // any allocation during the first block transfers
+  void Reserve(uint32_t, uint32_t);
+
+  // Empty the arena without releasing its memory
+  void Clear() {NumEvents = 0; NumSamples = 0;}
+
+  // Append an event and return a pointer to the first of its
+  // "Samples" contiguous arena slots, which the decoder must fill
+  uint16_t *AddEvent(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
+
+  uint32_t GetNumEvents() const {return NumEvents;}
+  uint32_t GetNumSamples() const {return NumSamples;}
+
+  // Event-level information
+  uint32_t GetBoardID(uint32_t Evt) const {return BoardID[Evt];}
+  uint32_t GetPattern(uint32_t Evt) const {return Pattern[Evt];}
+  uint32_t GetChannelMask(uint32_t Evt) const {return ChannelMask[Evt];}
+  uint32_t GetEventCounter(uint32_t Evt) const {return EventCounter[Evt];}
+  uint32_t GetTriggerTimeTag(uint32_t Evt) const {return TriggerTimeTag[Evt];}
+  uint32_t GetChannelSize(uint32_t Evt) const {return ChannelSize[Evt];}
+
+  // Event-level columns for vectorized/batch processing
+  const uint32_t *GetTriggerTimeTags() const {return TriggerTimeTag.data();}
+  const uint32_t *GetEventCounters() const {return EventCounter.data();}
+
+  // The waveform of channel "Ch" of event "Evt"; the span is empty if
+  // the channel was not enabled for the event
+  ADAQSampleSpan GetWaveform(uint32_t Evt, uint32_t Ch) const
+  {
+    ADAQSampleSpan Span = {NULL, 0};
+
+    const uint32_t Mask = ChannelMask[Evt];
+    if(Ch >= 32 or !(Mask & (1u << Ch)))
+      return Span;
+
+    // Enabled channels are stored in order, so the position of this
+    // channel is the number of enabled channels below it
+    const uint32_t Rank = __builtin_popcount(Mask & ((1u << Ch) - 1));
+
+    Span.Data = &Samples[SampleOffset[Evt] + Rank * ChannelSize[Evt]];
+    Span.Size = ChannelSize[Evt];
+    return Span;
+  }
+
+  // Number of times the arena has had to grow (i.e. heap allocations)
+  uint32_t GetNumGrowths() const {return NumGrowths;}
+
+private:
+  void GrowEvents(uint32_t);
+  void GrowSamples(uint32_t);
+
+  uint32_t NumEvents, NumSamples;
+  uint32_t EventCapacity, SampleCapacity;
+  uint32_t NumGrowths;
+
+  // Event-level columns
+  vector<uint32_t> BoardID, Pattern, ChannelMask;
+  vector<uint32_t> EventCounter, TriggerTimeTag;
+  vector<uint32_t> ChannelSize, SampleOffset;
+
+  // Samples of all channels of all events
+  vector<uint16_t> Samples;
+};
+
+#endif
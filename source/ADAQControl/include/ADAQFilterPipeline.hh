@@ -0,0 +1,381 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQFilterPipeline.hh
+// date: 16 Oct 26
+//
+// desc: The ADAQ filter pipeline shapes digitized waveforms before the
+//       pulse height is extracted, e.g. to obtain a PHA-like energy
+//       resolution from STD firmware waveforms. The filter stages
+//       are:
+//
+//         ADAQMovingAverageStage : moving average over L samples
+//         ADAQPoleZeroStage      : pole-zero correction of an
+//                                  exponential decay (time constant
+//                                  Tau [samples]) into a step
+//         ADAQTrapezoidStage     : trapezoidal shaping of a step with
+//                                  rise time K and flat top M
+//                                  [samples]; height = step height
+//         ADAQJordanovStage      : trapezoidal shaping of an
+//                                  exponential decay with built-in
+//                                  pole-zero correction (Jordanov)
+//
+//       All stages are recursive (IIR-style): each output sample
+//       costs a fixed number of operations independent of K, M, and
+//       L, with short delay lines as the only memory.
+//
+//       Stages are composed at compile time with ADAQFilterChain,
+//       e.g. ADAQFilterChain<ADAQPoleZeroStage, ADAQTrapezoidStage>,
+//       into a single loop that passes each sample through all
+//       stages before the next sample is read, such that a waveform
+//       is read once and no intermediate waveforms are stored. The
+//       input is baseline subtracted and made positive (according to
+//       the polarity) in the same loop.
+//
+//       For configurations selected at runtime (e.g. by name from a
+//       settings file), ADAQFilterRegistry creates ADAQVFilter
+//       objects, which wrap a compiled chain behind one virtual call
+//       per waveform. The predefined configurations are:
+//
+//         "MovingAverage", "PoleZero", "Trapezoid" (pole-zero and
+//         trapezoid), "Jordanov", "MovingAverage+Trapezoid" (moving
+//         average, pole-zero, and trapezoid)
+//
+//       Further configurations may be registered by the user.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQFilterPipeline_hh__
+#define __ADAQFilterPipeline_hh__ 1
+
+// C++
+#include <vector>
+#include <map>
+#include <string>
+#include <tuple>
+#include <cmath>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+
+
+// The parameters of all stages; each stage uses the ones it needs
+
+struct ADAQFilterParameters{
+  int Polarity;              // +1 positive-going, -1 negative-going pulses
+  uint32_t BaselineSamples;  // Samples at the record start for the baseline
+  uint32_t AverageLength;    // Moving average length L [samples]
+  double DecayTime;          // Exponential decay time Tau [samples]
+  uint32_t RiseTime;         // Trapezoid rise time K [samples]
+  uint32_t FlatTop;          // Trapezoid flat top M [samples]
+
+  ADAQFilterParameters()
+    : Polarity(-1), BaselineSamples(32), AverageLength(4),
+      DecayTime(100.), RiseTime(32), FlatTop(16)
+  {;}
+};
+
+
+// A delay line of the last samples. The samples are held in a ring
+// within the object, rather than on the heap, such that the compiler
+// knows that they do not alias the accumulators of the stages; the
+// ring is sized to a power of two such that the index wraps with a
+// mask. Delays are limited to ADAQMaxDelay-1 samples.
+
+const uint32_t ADAQMaxDelay = 1024;
+
+class ADAQDelayLine
+{
+public:
+  void Resize(uint32_t Length)
+  {
+    uint32_t Size = 1;
+    while(Size <= Length and Size < ADAQMaxDelay)
+      Size <<= 1;
+    Mask = Size - 1;
+    Reset();
+  }
+
+  void Reset()
+  {
+    for(uint32_t i=0; i<=Mask; i++)
+      Samples[i] = 0.;
+    Head = 0;
+  }
+
+  inline void Push(double X)
+  {
+    Head = (Head + 1) & Mask;
+    Samples[Head] = X;
+  }
+
+  // The sample pushed "D" samples ago (0 is the latest)
+  inline double Get(uint32_t D) const {return Samples[(Head - D) & Mask];}
+
+private:
+  double Samples[ADAQMaxDelay];
+  uint32_t Mask, Head;
+};
+
+
+///////////////////
+// Filter stages //
+///////////////////
+
+// Every stage has Configure(), Reset() (before each waveform), and
+// Process(), which returns the output for the next input sample
+
+class ADAQMovingAverageStage
+{
+public:
+  void Configure(const ADAQFilterParameters &P)
+  {
+    Length = (P.AverageLength > 0) ? P.AverageLength : 1;
+    Length = (Length < ADAQMaxDelay) ? Length : ADAQMaxDelay - 1;
+    Scale = 1. / Length;
+    Delay.Resize(Length);
+  }
+
+  void Reset() {Delay.Reset(); Sum = 0.;}
+
+  inline double Process(double X)
+  {
+    Delay.Push(X);
+    Sum += X - Delay.Get(Length);
+    return Sum * Scale;
+  }
+
+private:
+  ADAQDelayLine Delay;
+  uint32_t Length;
+  double Scale, Sum;
+};
+
+
+class ADAQPoleZeroStage
+{
+public:
+  void Configure(const ADAQFilterParameters &P)
+  {
+    Decay = (P.DecayTime > 0.) ? exp(-1. / P.DecayTime) : 0.;
+  }
+
+  void Reset() {Last = Output = 0.;}
+
+  // y[n] = y[n-1] + x[n] - d * x[n-1] with d = exp(-1/Tau)
+  inline double Process(double X)
+  {
+    Output += X - Decay * Last;
+    Last = X;
+    return Output;
+  }
+
+private:
+  double Decay, Last, Output;
+};
+
+
+class ADAQTrapezoidStage
+{
+public:
+  void Configure(const ADAQFilterParameters &P)
+  {
+    K = (P.RiseTime > 0) ? P.RiseTime : 1;
+    K = (K < ADAQMaxDelay / 2) ? K : ADAQMaxDelay / 2 - 1;
+    L = K + P.FlatTop;
+    L = (K + L < ADAQMaxDelay) ? L : ADAQMaxDelay - 1 - K;
+    Scale = 1. / K;
+    Delay.Resize(K + L);
+  }
+
+  void Reset() {Delay.Reset(); Output = 0.;}
+
+  // d[n] = v[n] - v[n-K] - v[n-L] + v[n-K-L]; s[n] = s[n-1] + d[n]
+  inline double Process(double X)
+  {
+    Delay.Push(X);
+    Output += X - Delay.Get(K) - Delay.Get(L) + Delay.Get(K + L);
+    return Output * Scale;
+  }
+
+private:
+  ADAQDelayLine Delay;
+  uint32_t K, L;
+  double Scale, Output;
+};
+
+
+class ADAQJordanovStage
+{
+public:
+  void Configure(const ADAQFilterParameters &P)
+  {
+    K = (P.RiseTime > 0) ? P.RiseTime : 1;
+    K = (K < ADAQMaxDelay / 2) ? K : ADAQMaxDelay / 2 - 1;
+    L = K + P.FlatTop;
+    L = (K + L < ADAQMaxDelay) ? L : ADAQMaxDelay - 1 - K;
+    M = (P.DecayTime > 0.) ? 1. / (exp(1. / P.DecayTime) - 1.) : 0.;
+    Scale = 1. / (K * (M + 1.));
+    Delay.Resize(K + L);
+  }
+
+  void Reset() {Delay.Reset(); Ramp = Output = 0.;}
+
+  // p[n] = p[n-1] + d[n]; s[n] = s[n-1] + p[n] + M * d[n]
+  inline double Process(double X)
+  {
+    Delay.Push(X);
+    const double D = X - Delay.Get(K) - Delay.Get(L) + Delay.Get(K + L);
+    Ramp += D;
+    Output += Ramp + M * D;
+    return Output * Scale;
+  }
+
+private:
+  ADAQDelayLine Delay;
+  uint32_t K, L;
+  double M, Scale, Ramp, Output;
+};
+
+
+/////////////////////////
+// Compile-time chains //
+/////////////////////////
+
+template<class... Stages>
+class ADAQFilterChain
+{
+public:
+  ADAQFilterChain() {;}
+  ADAQFilterChain(const ADAQFilterParameters &P) {Configure(P);}
+
+  void Configure(const ADAQFilterParameters &P)
+  {
+    Parameters = P;
+    apply([&](Stages &... S){(S.Configure(P), ...);}, Chain);
+  }
+
+  const ADAQFilterParameters &GetParameters() const {return Parameters;}
+
+  // Pass one (baseline-subtracted) sample through all stages
+  inline double Process(double X)
+  {
+    apply([&](Stages &... S){((X = S.Process(X)), ...);}, Chain);
+    return X;
+  }
+
+  // Shape waveform "In" of "N" samples into "Out"
+  void Apply(const uint16_t *In, uint32_t N, float *Out)
+  {
+    const double Offset = Begin(In, N);
+    const double Sign = Parameters.Polarity;
+
+    for(uint32_t i=0; i<N; i++)
+      Out[i] = (float)Process(Sign * (In[i] - Offset));
+  }
+
+  // Shape waveform "In" without storing the output and return the
+  // maximum of the shaped waveform, i.e. the pulse height
+  double ApplyMax(const uint16_t *In, uint32_t N)
+  {
+    const double Offset = Begin(In, N);
+    const double Sign = Parameters.Polarity;
+
+    double Max = 0.;
+    for(uint32_t i=0; i<N; i++){
+      const double Y = Process(Sign * (In[i] - Offset));
+      Max = (Y > Max) ? Y : Max;
+    }
+    return Max;
+  }
+
+private:
+
+  // Reset the stages and return the baseline of the waveform
+  double Begin(const uint16_t *In, uint32_t N)
+  {
+    apply([](Stages &... S){(S.Reset(), ...);}, Chain);
+
+    uint32_t B = (Parameters.BaselineSamples < N) ? Parameters.BaselineSamples : N;
+    if(B == 0)
+      return 0.;
+
+    uint32_t Sum = 0;
+    for(uint32_t i=0; i<B; i++)
+      Sum += In[i];
+    return (double)Sum / B;
+  }
+
+  tuple<Stages...> Chain;
+  ADAQFilterParameters Parameters;
+};
+
+
+////////////////////////////////////////
+// Runtime selection of filter chains //
+////////////////////////////////////////
+
+class ADAQVFilter
+{
+public:
+  virtual ~ADAQVFilter() {;}
+  virtual void Apply(const uint16_t *, uint32_t, float *) = 0;
+  virtual double ApplyMax(const uint16_t *, uint32_t) = 0;
+};
+
+
+template<class Chain>
+class ADAQFilter : public ADAQVFilter
+{
+public:
+  ADAQFilter(const ADAQFilterParameters &P) : Filter(P) {;}
+  void Apply(const uint16_t *In, uint32_t N, float *Out) {Filter.Apply(In, N, Out);}
+  double ApplyMax(const uint16_t *In, uint32_t N) {return Filter.ApplyMax(In, N);}
+
+private:
+  Chain Filter;
+};
+
+
+class ADAQFilterRegistry
+{
+public:
+  typedef boost::function<ADAQVFilter *(const ADAQFilterParameters &)> Factory;
+
+  // Register a compiled chain under "Name"
+  template<class Chain> static void Register(string Name)
+  {
+    GetFactories()[Name] = &CreateFilter<Chain>;
+  }
+
+  static void Register(string Name, Factory F) {GetFactories()[Name] = F;}
+
+  // Create the filter registered under "Name" (owned by the caller);
+  // returns NULL if no such filter is registered
+  static ADAQVFilter *Create(string, const ADAQFilterParameters &);
+
+  static vector<string> GetNames();
+
+private:
+  template<class Chain> static ADAQVFilter *CreateFilter(const ADAQFilterParameters &P)
+  {
+    return new ADAQFilter<Chain>(P);
+  }
+
+  static map<string, Factory> &GetFactories();
+};
+
+#endif
@@ -0,0 +1,150 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQPSDEventArena.hh
+// date: 16 Oct 26
+//
+// desc: ADAQPSDEventArena holds the DPP-PSD events of a PC buffer in
+//       per-channel column arrays: for each channel, the time tags,
+//       short and long charges, baselines, pile-up flags, and extras
+//       words are each stored in their own contiguous array. The
+//       arena is filled by ADAQDigitizer::DecodePSDBuffer() and is
+//       intended to be reused for every block transfer; memory is
+//       only allocated when a channel receives more events than in
+//       any previous buffer. The events are appended in bulk, one
+//       channel aggregate at a time, such that the space is checked
+//       once per aggregate rather than once per event.
+//
+//       Waveforms are not decoded with the event-level data. Instead,
+//       the position of each event's samples in the PC buffer is
+//       recorded such that the waveform of any event can be decoded
+//       later on demand with DecodeWaveform(). The PC buffer must
+//       therefore remain valid (i.e. not be released or refilled)
+//       until all required waveforms have been decoded.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQPSDEventArena_hh__
+#define __ADAQPSDEventArena_hh__ 1
+
+// C++
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+
+
+class ADAQPSDEventArena
+{
+public:
+  // Maximum number of channels on any DPP-PSD digitizer
+  static const uint32_t MaxChannels = 16;
+
+  ADAQPSDEventArena(uint32_t = 0);
+  ~ADAQPSDEventArena();
+
+  // Preallocate space for the expected events per channel per buffer
+  void Reserve(uint32_t);
+
+  // Empty the arena without releasing its memory
+  void Clear()
+  {
+    for(uint32_t ch=0; ch<MaxChannels; ch++)
+      NumEvents[ch] = 0;
+    Words = NULL;
+  }
+
+  // Set the PC buffer that the waveform offsets refer to
+  void SetBuffer(const uint32_t *W) {Words = W;}
+
+  // Column arrays of a channel from its first free event onwards
+  struct Columns{
+    uint32_t *Format, *TimeTag, *Extras, *WaveformOffset;
+    int16_t *ChargeShort, *ChargeLong, *Baseline;
+    uint8_t *PileUp;
+  };
+
+  // Make room for up to "Events" more events of channel "Ch" and
+  // return its columns; the events written through them are added to
+  // the channel by Commit(). The columns are valid until the next
+  // Prepare() of the same channel.
+  Columns Prepare(uint32_t Ch, uint32_t Events)
+  {
+    Channel &C = Channels[Ch];
+    const uint32_t E = NumEvents[Ch];
+    if(E + Events > C.Capacity)
+      Grow(Ch, max(2 * C.Capacity, E + Events) + 64);
+
+    Columns Col = {C.Format.data() + E, C.TimeTag.data() + E,
+		   C.Extras.data() + E, C.WaveformOffset.data() + E,
+		   C.ChargeShort.data() + E, C.ChargeLong.data() + E,
+		   C.Baseline.data() + E, C.PileUp.data() + E};
+    return Col;
+  }
+
+  void Commit(uint32_t Ch, uint32_t Events) {NumEvents[Ch] += Events;}
+
+  uint32_t GetNumEvents(uint32_t Ch) const {return NumEvents[Ch];}
+  uint32_t GetTotalEvents() const;
+
+  // Event-level information of event "Evt" of channel "Ch"
+  uint32_t GetTimeTag(uint32_t Ch, uint32_t Evt) const {return Channels[Ch].TimeTag[Evt];}
+  int16_t GetChargeShort(uint32_t Ch, uint32_t Evt) const {return Channels[Ch].ChargeShort[Evt];}
+  int16_t GetChargeLong(uint32_t Ch, uint32_t Evt) const {return Channels[Ch].ChargeLong[Evt];}
+  int16_t GetBaseline(uint32_t Ch, uint32_t Evt) const {return Channels[Ch].Baseline[Evt];}
+  bool GetPileUp(uint32_t Ch, uint32_t Evt) const {return Channels[Ch].PileUp[Evt];}
+  uint32_t GetExtras(uint32_t Ch, uint32_t Evt) const {return Channels[Ch].Extras[Evt];}
+  uint32_t GetFormat(uint32_t Ch, uint32_t Evt) const {return Channels[Ch].Format[Evt];}
+
+  // Channel columns for vectorized/batch processing
+  const uint32_t *GetTimeTags(uint32_t Ch) const {return Channels[Ch].TimeTag.data();}
+  const int16_t *GetChargeShorts(uint32_t Ch) const {return Channels[Ch].ChargeShort.data();}
+  const int16_t *GetChargeLongs(uint32_t Ch) const {return Channels[Ch].ChargeLong.data();}
+  const int16_t *GetBaselines(uint32_t Ch) const {return Channels[Ch].Baseline.data();}
+  const uint8_t *GetPileUps(uint32_t Ch) const {return Channels[Ch].PileUp.data();}
+
+  // Number of samples per trace of an event; zero if no waveform was
+  // recorded with the event
+  uint32_t GetNumSamples(uint32_t Ch, uint32_t Evt) const;
+
+  // Decode the waveform of an event into caller-provided arrays of at
+  // least GetNumSamples() entries. The analog samples are written to
+  // "Trace1"; in dual trace mode the samples alternate between the
+  // two traces and the second is written to "Trace2" if not NULL.
+  // Returns the number of samples per trace.
+  uint32_t DecodeWaveform(uint32_t, uint32_t, uint16_t *, uint16_t * = NULL) const;
+
+  // Number of times the arena has had to grow (i.e. heap allocations)
+  uint32_t GetNumGrowths() const {return NumGrowths;}
+
+private:
+  void Grow(uint32_t, uint32_t);
+
+  struct Channel{
+    uint32_t Capacity;
+    vector<uint32_t> Format, TimeTag, Extras, WaveformOffset;
+    vector<int16_t> ChargeShort, ChargeLong, Baseline;
+    vector<uint8_t> PileUp;
+  };
+
+  Channel Channels[MaxChannels];
+  uint32_t NumEvents[MaxChannels];
+  uint32_t NumGrowths;
+
+  const uint32_t *Words;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRawDump.hh
+// date: 16 Oct 26
+//
+// desc: ADAQRawDump.hh defines the format of raw dump files, in which
+//       the PC buffers filled by ADAQDigitizer::ReadData() are stored
+//       exactly as transferred, without decoding, by
+//       ADAQRawDumpWriter. The files are read back by
+//       ADAQRawDumpReader, e.g. for the offline conversion into ADAQ
+//       files (ADAQRawConvert) or for replay.
+//
+//       A dump is a file header followed by one frame per block
+//       transfer. Each frame is a frame header followed by the
+//       buffer, zero-padded to a multiple of FrameAlignment bytes
+//       such that every frame header is aligned. All values are in
+//       the byte order of the PC (little-endian).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQRawDump_hh__
+#define __ADAQRawDump_hh__ 1
+
+// C++
+#include <string>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+
+
+namespace ADAQRawDump{
+
+  const char FileMagic[8] = {'A', 'D', 'A', 'Q', 'R', 'A', 'W', '\0'};
+  const uint32_t Version = 1;
+  const uint32_t FrameMagic = 0xADA0F4A3;
+  const uint32_t FrameAlignment = 8; // [bytes]
+
+  // Firmware of the board that a frame was read from
+  enum ZFirmware{
+    zFirmwareSTD,
+    zFirmwarePSD
+  };
+
+  inline uint16_t GetFirmware(string Type) {return (Type == "PSD") ? zFirmwarePSD : zFirmwareSTD;}
+
+  // The size of a frame holding a buffer of "Size" bytes
+  inline uint64_t GetFrameSize(uint32_t Size);
+}
+
+
+struct ADAQRawDumpFileHeader{
+  char Magic[8];         // ADAQRawDump::FileMagic
+  uint32_t Version;
+  uint32_t HeaderSize;   // [bytes]
+  uint64_t StartTime;    // Wall clock at Open() [ns since epoch]
+  uint64_t Reserved;
+};
+
+
+struct ADAQRawDumpFrameHeader{
+  uint32_t Magic;        // ADAQRawDump::FrameMagic
+  int32_t BoardID;       // ADAQ user ID of the source digitizer
+  uint16_t BoardType;    // ZBoardType
+  uint16_t Firmware;     // ADAQRawDump::ZFirmware
+  uint32_t Size;         // Size of the block transfer [bytes]
+  uint64_t Sequence;     // Transfer number of the board
+  uint64_t ReadoutTime;  // Wall clock at end of transfer [ns since epoch]
+};
+
+
+inline uint64_t ADAQRawDump::GetFrameSize(uint32_t Size)
+{
+  const uint64_t Bytes = sizeof(ADAQRawDumpFrameHeader) + (uint64_t)Size;
+  return (Bytes + FrameAlignment - 1) / FrameAlignment * FrameAlignment;
+}
+
+#endif
@@ -0,0 +1,100 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRawDumpReader.hh
+// date: 16 Oct 26
+//
+// desc: ADAQRawDumpReader reads the dump files of ADAQRawDumpWriter
+//       (see ADAQRawDump.hh). The file is memory-mapped and indexed
+//       on Open() by walking the frame headers, such that the frames
+//       may then be read in order with Next() or in any order, e.g.
+//       by several threads, with GetFrame(). The buffers are returned
+//       in place in the mapping: no data is copied, and the pages are
+//       read from disk only when the buffer is first accessed. The
+//       mapping is private, such that decoders may be handed the
+//       buffers as they would a PC readout buffer without modifying
+//       the file. A dump whose writer did not close it (e.g. after a
+//       crash) is read up to its last complete frame.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQRawDumpReader_hh__
+#define __ADAQRawDumpReader_hh__ 1
+
+// C++
+#include <string>
+#include <vector>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+
+// ADAQ
+#include "ADAQRawDump.hh"
+
+
+// A frame of a dump: the frame header and the buffer, which remain
+// valid until the reader is closed
+
+struct ADAQRawDumpFrame{
+  const ADAQRawDumpFrameHeader *Header;
+  char *Data;
+};
+
+
+class ADAQRawDumpReader
+{
+public:
+  ADAQRawDumpReader();
+  ~ADAQRawDumpReader();
+
+  // Map and index a dump file; returns -42 if it cannot be read or
+  // is not a dump
+  int Open(string);
+  void Close();
+
+  bool GetOpen() {return Map != NULL;}
+  uint64_t GetStartTime() {return StartTime;}
+
+  // True if the dump ends with an incomplete frame or padding
+  bool GetTruncated() {return Truncated;}
+
+  uint64_t GetNumFrames() {return FrameOffsets.size();}
+  bool GetFrame(uint64_t, ADAQRawDumpFrame &);
+
+  // Sequential access from the first frame; returns false at the end
+  bool Next(ADAQRawDumpFrame &);
+  void Rewind() {NextFrame = 0;}
+
+  // The IDs of the boards found in the dump in order of appearance
+  vector<int> GetBoardIDs() {return BoardIDs;}
+
+  void SetVerbose(bool V) {Verbose = V;}
+
+private:
+  bool Verbose;
+
+  int FD;
+  char *Map;
+  uint64_t MapSize;
+  uint64_t StartTime;
+  bool Truncated;
+
+  vector<uint64_t> FrameOffsets;
+  vector<int> BoardIDs;
+  uint64_t NextFrame;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRawDumpWriter.hh
+// date: 16 Oct 26
+//
+// desc: ADAQRawDumpWriter writes raw PC readout buffers sequentially
+//       to a dump file (see ADAQRawDump.hh) for running at the full
+//       link rate: neither decoding nor ROOT is involved during the
+//       run. Each buffer is framed and copied into one of a few large
+//       staging blocks aligned to the page size; full blocks are
+//       written by an I/O thread, such that the caller only copies
+//       memory while the previous block goes to disk. By default the
+//       file is opened with O_DIRECT, which moves the blocks from the
+//       staging memory to the device without passing through (and
+//       evicting) the page cache. File systems that do not support
+//       O_DIRECT (e.g. tmpfs) are written through the page cache.
+//
+//       Write() must be called from a single thread, e.g. the thread
+//       that drains ADAQReadoutEngine (see its raw dump mode). The
+//       board type and firmware recorded in the frame headers are
+//       taken from the boards registered with AddDigitizer().
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQRawDumpWriter_hh__
+#define __ADAQRawDumpWriter_hh__ 1
+
+// C++
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+
+// ADAQ
+#include "ADAQDigitizer.hh"
+#include "ADAQReadoutPipeline.hh"
+#include "ADAQRawDump.hh"
+
+
+// A snapshot of the writer counters
+
+struct ADAQRawDumpWriterStats{
+  uint64_t Frames;          // Buffers written
+  uint64_t Bytes;           // Buffer bytes written
+  uint64_t FileBytes;       // Bytes in the file including framing
+  uint64_t Stalls;          // Times Write() waited for a free block
+  double StallTime;         // Time Write() waited [s]
+  double WriteTime;         // Time the I/O thread spent writing [s]
+  uint64_t Errors;          // Failed writes
+};
+
+
+class ADAQRawDumpWriter
+{
+public:
+  // The staging block size [bytes] (rounded up to the page size) and
+  // the number of blocks
+  ADAQRawDumpWriter(uint32_t = 4194304, uint32_t = 4);
+  ~ADAQRawDumpWriter();
+
+  // Register the board type and firmware of a digitizer by its ID
+  void AddDigitizer(ADAQDigitizer *);
+  void AddBoard(int, ZBoardType, string);
+
+  // Open a dump file (with O_DIRECT if "Direct" and supported) and
+  // start the I/O thread; returns -42 on failure
+  int Open(string, bool = true);
+
+  // Write the remaining data, wait for the I/O thread, and close the
+  // file; returns -42 if any write failed
+  int Close();
+
+  bool GetOpen() {return FD >= 0;}
+  bool GetDirect() {return Direct;}
+
+  // Append a frame holding a filled buffer. Returns -42 if the file
+  // is not open or a write has failed.
+  int Write(const ADAQReadoutBuffer *);
+  int Write(int, const char *, uint32_t, uint64_t, uint64_t);
+
+  ADAQRawDumpWriterStats GetStats();
+
+  void SetVerbose(bool V) {Verbose = V;}
+
+private:
+  struct Block{
+    char *Data;
+    uint32_t Size;
+  };
+
+  struct BoardInfo{
+    uint16_t BoardType;
+    uint16_t Firmware;
+  };
+
+  void Append(const void *, uint64_t);
+  void SubmitBlock();
+  void RunIOLoop();
+
+  uint32_t BlockSize, NumBlocks;
+  bool Verbose;
+
+  int FD;
+  bool Direct;
+
+  map<int, BoardInfo> Boards;
+
+  // The block being filled by Write() and the blocks waiting for or
+  // available after the I/O thread
+  vector<Block> Blocks;
+  Block *Current;
+  uint64_t FileBytes;
+  deque<Block *> FullBlocks;
+  vector<Block *> FreeBlocks;
+
+  boost::thread *IOThread;
+  boost::mutex BlockMutex;
+  boost::condition_variable BlockFull, BlockFree;
+  bool IOStop;
+
+  ADAQRawDumpWriterStats Stats;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQReadoutEngine.hh
+// date: 16 Oct 26
+//
+// desc: ADAQReadoutEngine reads out several digitizers in parallel.
+//       The engine owns any number of ADAQDigitizer objects and
+//       groups them by their USB/optical link number; one readout
+//       thread is run per link, which services the boards on that
+//       link (e.g. CONET daisy-chained boards) in turn. Links thus
+//       transfer data concurrently rather than one after another,
+//       such that the total throughput scales with the number of
+//       links. Each link thread may optionally be pinned to a CPU.
+//
+//       Every board has its own pool of preallocated PC buffers.
+//       Filled buffers from all boards are pushed onto a single
+//       lock-free queue that any number of downstream threads may
+//       consume; each buffer carries the ID of its source board and
+//       must be returned with ReleaseBuffer() once processed.
+//
+//       Per-board counters record the transfers, bytes, events,
+//       buffer stalls, and the dead time, i.e. the time during which
+//       the board's FPGA memory was found full and therefore unable
+//       to accept triggers.
+//
+//       In the raw dump mode the engine drains the queue itself: a
+//       dump thread writes every filled buffer, undecoded, with an
+//       ADAQRawDumpWriter and returns it to its pool, such that the
+//       run is limited by the links and the disk only.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQReadoutEngine_hh__
+#define __ADAQReadoutEngine_hh__ 1
+
+// C++
+#include <vector>
+#include <map>
+#include <atomic>
+#include <ctime>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+#include <boost/lockfree/queue.hpp>
+
+// ADAQ
+#include "ADAQDigitizer.hh"
+#include "ADAQReadoutPipeline.hh"
+#include "ADAQRawDumpWriter.hh"
+
+
+// A snapshot of the performance counters of one board
+
+struct ADAQReadoutEngineBoardStats{
+  int BoardID;
+  int LinkNumber;
+
+  uint64_t Transfers;       // Non-empty block transfers
+  uint64_t EmptyTransfers;  // ReadData() calls returning zero bytes
+  uint64_t ReadoutErrors;   // ReadData() calls returning an error
+  uint64_t Bytes;           // Total bytes transferred
+  uint64_t Events;          // Events (STD) or board aggregates (DPP)
+
+  uint64_t Stalls;          // Times no free buffer was available
+  uint64_t FullEpisodes;    // Times the FPGA memory was found full
+  double DeadTime;          // Time the FPGA memory was full [s]
+
+  double WallTime;          // Time since Start() [s]
+  double Throughput;        // [MB/s]
+  double EventRate;         // [Hz]
+  double DeadTimeFraction;  // DeadTime / WallTime
+};
+
+
+class ADAQReadoutEngine
+{
+public:
+  ADAQReadoutEngine(uint32_t = 8);
+  ~ADAQReadoutEngine();
+
+  // The engine takes ownership of the digitizer, which is deleted
+  // with the engine. Board IDs must be unique. Returns the index of
+  // the board in the engine or -42 on failure.
+  int AddDigitizer(ADAQDigitizer *);
+  ADAQDigitizer *GetDigitizer(uint32_t B) {return (B < Boards.size()) ? Boards[B]->DG : NULL;}
+  uint32_t GetNumDigitizers() {return Boards.size();}
+  uint32_t GetNumLinks() {return Links.size();}
+
+  // Open/close the links of all digitizers; returns the first error
+  int OpenLinks();
+  int CloseLinks();
+
+  // Pin the readout thread of a link to a CPU core (-1 = no pinning)
+  void SetLinkAffinity(int, int);
+
+  // A board is read out once "EventsPerReadout" events are stored in
+  // its FPGA memory or, to bound the latency at low trigger rates,
+  // once any events have waited for "MaxWait" [ms]
+  void SetReadoutThreshold(uint32_t, uint32_t = 100);
+
+  // Buffers must be allocated after the digitizers are programmed
+  // since the CAEN buffer size depends on the board settings
+  int AllocateBuffers();
+  void FreeBuffers();
+
+  // Start/stop the link threads. Acquisition must be started on the
+  // digitizers (e.g. SWStartAcquisition()) by the caller, and the
+  // downstream threads must hold no buffers when these are called.
+  void Start();
+  void Stop();
+  bool GetRunning() {return Running;}
+
+  // Methods for the downstream threads. A filled buffer that is
+  // obtained must be returned with ReleaseBuffer() once processed.
+  ADAQReadoutBuffer *GetFilledBuffer();
+  ADAQReadoutBuffer *WaitForFilledBuffer(uint32_t);
+  void ReleaseBuffer(ADAQReadoutBuffer *);
+
+  ADAQReadoutEngineBoardStats GetBoardStats(uint32_t);
+  vector<ADAQReadoutEngineBoardStats> GetStats();
+  void ResetStats();
+  void PrintStats();
+
+  // Enable the raw dump mode with an open writer (NULL disables it);
+  // set before Start(). The boards are registered with the writer on
+  // Start() and no buffers are delivered to downstream threads.
+  void SetRawDumpWriter(ADAQRawDumpWriter *W) {if(!Running) DumpWriter = W;}
+  ADAQRawDumpWriter *GetRawDumpWriter() {return DumpWriter;}
+
+  // Total buffers presently waiting in the common queue
+  uint32_t GetQueueOccupancy() {return QueueOccupancy;}
+  uint32_t GetPeakQueueOccupancy() {return PeakQueueOccupancy;}
+
+  void SetVerbose(bool V) {Verbose = V;}
+
+private:
+
+  // The readout state of one board, owned by its link thread
+  struct BoardReadout{
+    ADAQDigitizer *DG;
+    bool DPPFirmware;
+
+    vector<ADAQReadoutBuffer> Buffers;
+    boost::lockfree::queue<ADAQReadoutBuffer *> *FreePool;
+    ADAQReadoutBuffer *Buffer;
+
+    uint64_t Sequence, LastTransferNs;
+    bool Stalled;
+
+    // Start of the present dead time episode [ns]; zero if none
+    atomic<uint64_t> FullSinceNs;
+
+    atomic<uint64_t> Transfers, EmptyTransfers, ReadoutErrors, Bytes, Events;
+    atomic<uint64_t> Stalls, FullEpisodes, DeadTimeNs;
+  };
+
+  // The boards on one link and the thread that reads them out
+  struct LinkReadout{
+    int LinkNumber;
+    int Core;
+    vector<BoardReadout *> Boards;
+    boost::thread *Thread;
+  };
+
+  void RunLinkLoop(LinkReadout *);
+  void RunDumpLoop();
+  bool ServiceBoard(BoardReadout *, uint64_t);
+  void CheckFPGAMemory(BoardReadout *, uint64_t);
+  uint32_t CountEvents(ADAQReadoutBuffer *);
+
+  uint32_t BuffersPerBoard;
+  bool Verbose;
+
+  vector<BoardReadout *> Boards;
+  vector<LinkReadout *> Links;
+  map<int, BoardReadout *> BoardMap;
+
+  // Filled buffers from all boards: link threads -> downstream
+  boost::lockfree::queue<ADAQReadoutBuffer *> *FilledQueue;
+  atomic<uint32_t> QueueOccupancy, PeakQueueOccupancy;
+
+  atomic<bool> Running;
+
+  ADAQRawDumpWriter *DumpWriter;
+  boost::thread *DumpThread;
+  atomic<bool> DumpRunning;
+  uint32_t EventsPerReadout;
+  uint64_t MaxWaitNs;
+  uint32_t MinBackoff, MaxBackoff;
+
+  atomic<uint64_t> StartTimeNs, StopTimeNs;
+};
+
+#endif
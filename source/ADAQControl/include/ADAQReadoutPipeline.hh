@@ -0,0 +1,226 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQReadoutPipeline.hh
+// date: 16 Oct 26
+//
+// desc: ADAQReadoutPipeline decouples the readout of a digitizer from
+//       the decoding of the data. A dedicated readout thread does
+//       nothing but move block transfers from the digitizer FPGA
+//       memory (via ADAQDigitizer::ReadData) into a rotating pool of
+//       preallocated PC buffers. Filled buffers are handed to a
+//       single decode thread through a lock-free single-producer /
+//       single-consumer ring; once decoded, the buffer is released
+//       back to the readout thread through a second ring. No memory
+//       is allocated and no lock is taken while acquiring.
+//
+//       The readout thread "stalls" when every buffer in the pool is
+//       waiting to be decoded, i.e. when the decode stage cannot keep
+//       up. The number and duration of stalls, as well as the ring
+//       occupancy, are recorded so the pool can be sized correctly.
+//
+//       Before each block transfer the readout thread waits for data
+//       in one of three modes: busy-polling the FPGA event counter
+//       (the historical behavior), polling with an adaptive sleep
+//       backoff, or blocking in IRQWait() until the digitizer raises
+//       an interrupt. Interrupt mode falls back to adaptive polling
+//       if the link does not support interrupts. The CPU time used by
+//       the readout thread and the trigger-to-readout latency are
+//       recorded so that the modes can be compared.
+//
+//       An optional ADAQBLTController may be attached to retune the
+//       number of events per transfer during the run.
+//
+//       The pipeline accepts any ADAQDigitizer, including the
+//       ADAQEmulatedDigitizer software stand-in for the CAEN hardware.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQReadoutPipeline_hh__
+#define __ADAQReadoutPipeline_hh__ 1
+
+// C++
+#include <vector>
+#include <atomic>
+#include <ctime>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+// ADAQ
+#include "ADAQDigitizer.hh"
+#include "ADAQBLTController.hh"
+
+
+// The method used by the readout thread to wait for events
+
+enum ZReadoutWaitMode{
+  zWaitBusyPoll,     // Read the FPGA event counter continuously
+  zWaitAdaptivePoll, // Read the counter with exponential sleep backoff
+  zWaitInterrupt     // Block in IRQWait(); adaptive polling fallback
+};
+
+
+// A single PC readout buffer and the information describing the
+// block transfer that it currently holds
+
+struct ADAQReadoutBuffer{
+  char *Data;          // Buffer allocated with MallocReadoutBuffer()
+  uint32_t Capacity;   // Allocated size [bytes]
+  uint32_t Size;       // Size of the block transfer [bytes]
+  uint64_t Sequence;   // Transfer number since the pipeline started
+  uint64_t ReadoutTime;// Wall clock at end of transfer [ns since epoch]
+  int BoardID;         // ADAQ user ID of the source digitizer
+};
+
+
+// A snapshot of the pipeline performance counters
+
+struct ADAQReadoutPipelineStats{
+  uint64_t Transfers;       // Non-empty block transfers
+  uint64_t EmptyTransfers;  // ReadData() calls returning zero bytes
+  uint64_t ReadoutErrors;   // ReadData() calls returning an error
+  uint64_t Bytes;           // Total bytes transferred
+
+  uint64_t Stalls;          // Times the readout found no free buffer
+  double StallTime;         // Total time spent stalled [s]
+
+  uint32_t RingSize;        // Number of buffers in the pool
+  uint32_t RingOccupancy;   // Buffers presently waiting to be decoded
+  uint32_t PeakRingOccupancy;
+  double MeanRingOccupancy; // Averaged over all transfers
+
+  ZReadoutWaitMode WaitMode;// Presently active wait mode
+  uint64_t Polls;           // FPGA event counter reads
+  uint64_t Interrupts;      // IRQWait() calls returning an interrupt
+  uint64_t WaitTimeouts;    // Waits that timed out (partial readout)
+
+  double WallTime;          // Time since Start() [s]
+  double CPUTime;           // CPU time used by the readout thread [s]
+  double CPULoad;           // CPUTime / WallTime
+
+  // Latency from the trigger of the oldest event in a transfer to the
+  // end of that transfer, estimated from the trigger time tag
+  // relative to Start(); STD firmware buffers only
+  uint64_t LatencySamples;
+  double MeanLatency;       // [s]
+  double MaxLatency;        // [s]
+};
+
+
+class ADAQReadoutPipeline
+{
+public:
+  ADAQReadoutPipeline(ADAQDigitizer *, uint32_t = 8);
+  ~ADAQReadoutPipeline();
+
+  // Buffers must be allocated after the digitizer is programmed
+  // since the CAEN buffer size depends on the board settings
+  int AllocateBuffers();
+  void FreeBuffers();
+
+  // Start/stop the readout thread. The decode stage must be idle
+  // (holding no buffers) when these are called.
+  void Start();
+  void Stop();
+  bool GetRunning() {return Running;}
+
+  // Methods for the (single) decode thread. A filled buffer that is
+  // obtained must be returned with ReleaseBuffer() once decoded.
+  ADAQReadoutBuffer *GetFilledBuffer();
+  ADAQReadoutBuffer *WaitForFilledBuffer(uint32_t);
+  void ReleaseBuffer(ADAQReadoutBuffer *);
+
+  // Fraction of the pool waiting to be decoded [0,1]
+  double GetRingLevel() {return (double)RingOccupancy / NumBuffers;}
+
+  ADAQReadoutPipelineStats GetStats();
+  void ResetStats();
+  void PrintStats();
+
+  uint32_t GetNumBuffers() {return NumBuffers;}
+  void SetVerbose(bool V) {Verbose = V;}
+
+  // Set how the readout thread waits for events (must be called
+  // before Start()). A transfer is made once "EventsPerReadout"
+  // events are in the FPGA memory, or, to bound the latency at low
+  // trigger rates, with fewer events once the interrupt wait times
+  // out ("IRQTimeout" [ms]) or the polling backoff reaches
+  // "MaxBackoff" [us]
+  void SetWaitMode(ZReadoutWaitMode, uint32_t EventsPerReadout = 1,
+		   uint32_t IRQTimeout = 100, uint32_t MaxBackoff = 10000);
+  ZReadoutWaitMode GetWaitMode() {return WaitMode;}
+
+  // Attach a controller that adapts the events per transfer (and
+  // thus EventsPerReadout) during the run; must be set before
+  // AllocateBuffers() so buffers are sized for its upper limit
+  void SetBLTController(ADAQBLTController *BC) {BLTController = BC;}
+
+private:
+  void RunReadoutLoop();
+  bool WaitForEvents();
+  void EnableInterrupts();
+  void DisableInterrupts();
+  void MeasureLatency(ADAQReadoutBuffer *, uint64_t);
+  uint32_t CountEvents(ADAQReadoutBuffer *);
+
+  ADAQDigitizer *DG;
+  uint32_t NumBuffers;
+  bool Verbose;
+
+  vector<ADAQReadoutBuffer> Buffers;
+
+  // Filled buffers: readout thread -> decode thread
+  boost::lockfree::spsc_queue<ADAQReadoutBuffer *> *FilledRing;
+
+  // Free buffers: decode thread -> readout thread
+  boost::lockfree::spsc_queue<ADAQReadoutBuffer *> *FreeRing;
+  ADAQReadoutBuffer *HeldBuffer;
+
+  boost::thread *ReadoutThread;
+  atomic<bool> Running;
+
+  // Event wait settings
+  atomic<ZReadoutWaitMode> WaitMode;
+  uint32_t EventsPerReadout, IRQTimeout;
+  uint32_t MinBackoff, MaxBackoff, Backoff;
+  bool InterruptsEnabled;
+
+  ADAQBLTController *BLTController;
+
+  // Readout thread CPU clock and timing
+  clockid_t CPUClock;
+  atomic<bool> CPUClockValid;
+  atomic<uint64_t> StartTimeNs, StopTimeNs, CPUTimeNs;
+
+  // Trigger time tag unwrapping for the latency estimate, which is
+  // made for STD firmware boards only
+  bool STDFirmware;
+  uint64_t TimeTagRollovers;
+  uint32_t LastTimeTag;
+
+  // Performance counters. Those written only by the readout thread
+  // are atomic so that they may be safely read from any thread.
+  atomic<uint64_t> Transfers, EmptyTransfers, ReadoutErrors, Bytes;
+  atomic<uint64_t> Stalls, StallTimeNs;
+  atomic<uint64_t> OccupancySum;
+  atomic<uint32_t> RingOccupancy, PeakRingOccupancy;
+  atomic<uint64_t> Polls, Interrupts, WaitTimeouts;
+  atomic<uint64_t> LatencySamples, LatencySumNs, LatencyMaxNs;
+};
+
+#endif
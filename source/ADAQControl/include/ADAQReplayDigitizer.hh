@@ -0,0 +1,153 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQReplayDigitizer.hh
+// date: 16 Oct 26
+//
+// desc: ADAQReplayDigitizer replays the block transfers of a board
+//       recorded in a raw dump (ADAQRawDumpWriter) in place of a
+//       digitizer. It derives from ADAQEmulatedDigitizer, whose
+//       software STD and DPP-PSD decoders and register space it
+//       reuses, but ReadData() fills the PC buffer with the next
+//       recorded buffer, byte for byte, rather than with synthetic
+//       events. Readout (ADAQReadoutEngine, ADAQReadoutPipeline),
+//       decoding, analysis, and writing code thus runs unmodified on
+//       real data with no hardware attached, and runs on the same
+//       data every time, such that throughput measurements are
+//       reproducible.
+//
+//       The buffers are replayed either as fast as possible (a
+//       trigger rate of zero: every ReadData() returns the next
+//       buffer) or at a set trigger rate: a buffer becomes readable
+//       once the wall clock has reached the trigger of its last
+//       event. The replay never loses events; if the consumer falls
+//       behind, the events wait in the emulated FPGA memory, which
+//       then reports itself full as a board in dead time would. The
+//       dump may be replayed several times or in an endless loop;
+//       the time tags are replayed as recorded in every pass.
+//
+//       The board type must be that of the recorded board. The
+//       firmware, record length, channel enable mask, and events per
+//       transfer are taken from the dump when the link is opened;
+//       the corresponding setters are then ignored.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQReplayDigitizer_hh__
+#define __ADAQReplayDigitizer_hh__ 1
+
+// C++
+#include <string>
+#include <vector>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQRawDumpReader.hh"
+
+
+class ADAQReplayDigitizer : public ADAQEmulatedDigitizer
+{
+
+public:
+  ADAQReplayDigitizer(ZBoardType, int, uint32_t = 0x00000000, int = 0, int = 0);
+  ~ADAQReplayDigitizer();
+
+
+  /////////////////////////////////////////
+  // Overridden link and readout methods //
+  /////////////////////////////////////////
+
+  // Opens and indexes the dump file
+  int OpenLink();
+  int CloseLink();
+
+  int SendSWTrigger();
+
+  int SetChannelEnableMask(uint32_t);
+  int SetRecordLength(uint32_t);
+  int SetMaxNumEventsBLT(uint32_t);
+  int SetDPPEventAggregation(int, int);
+
+  int SWStartAcquisition();
+
+  int ClearData();
+  int ReadData(char *, uint32_t *);
+
+  int MallocReadoutBuffer(char **, uint32_t *);
+
+
+  /////////////////////////////
+  // Replay-specific methods //
+  /////////////////////////////
+
+  // The dump file and the ID of the recorded board to replay (-1,
+  // the default, selects the board with the ID of this digitizer);
+  // must be set before OpenLink()
+  int SetDumpFile(string, int = -1);
+  string GetDumpFile() {return DumpFileName;}
+
+  // Number of passes through the dump; zero replays it in an endless
+  // loop until the acquisition is stopped (default: 1)
+  void SetNumLoops(uint32_t NL) {NumLoops = NL;}
+  uint32_t GetNumLoops() {return NumLoops;}
+
+  // The recorded buffers and events of one pass through the dump
+  uint64_t GetNumFrames() {return Frames.size();}
+  uint64_t GetNumRecordedEvents() {return RecordedEvents;}
+
+  // Progress since SWStartAcquisition()
+  uint64_t GetReplayedFrames() {return ReplayedFrames;}
+  uint64_t GetReplayedEvents() {return ReplayedEvents;}
+  uint64_t GetReplayedBytes() {return ReplayedBytes;}
+  uint32_t GetLoop() {return Loop;}
+
+  // True once all passes have been replayed
+  bool GetReplayDone();
+
+
+protected:
+  uint32_t UpdatePendingEvents();
+
+  int IndexDump();
+  uint32_t CountFrameEvents(const ADAQRawDumpFrame &);
+  uint64_t GetRemainingEvents();
+
+  string DumpFileName;
+  int SourceBoardID;
+  uint32_t NumLoops;
+
+  ADAQRawDumpReader Reader;
+
+  // The frames of the replayed board, the events of each frame, and
+  // the events of all preceding frames of the pass
+  vector<ADAQRawDumpFrame> Frames;
+  vector<uint32_t> FrameEvents;
+  vector<uint64_t> FrameOffsets;
+  uint64_t RecordedEvents;
+  uint32_t MaxFrameSize;
+
+  // Replay position: the next frame of the present pass
+  uint64_t NextFrame;
+  uint32_t Loop;
+
+  // Events released by the trigger clock and events read out
+  uint64_t ReleasedEvents, ReplayedEvents;
+  uint64_t ReplayedFrames, ReplayedBytes;
+};
+
+#endif
@@ -0,0 +1,165 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQTimeSorter.hh
+// date: 16 Oct 26
+//
+// desc: ADAQTimeSorter converts the raw trigger time tags of the
+//       digitizers into monotonic 64-bit timestamps in nanoseconds
+//       and merges the events of any number of channels and boards
+//       into a single time-ordered stream.
+//
+//       The time tag counters are only 30-32 bits wide (see
+//       ADAQDigitizer::GetTimeStampSize/Unit) and roll over every
+//       few seconds, e.g. every ~17 s for a 31-bit counter at 8 ns.
+//       Each (board, channel) stream is unwrapped independently by
+//       counting rollovers, i.e. a time tag smaller than the previous
+//       one from the same stream. A gap of more than one full counter
+//       period within a stream cannot be detected. STD firmware events
+//       are board-level and are pushed with channel -1; DPP events
+//       are pushed with their channel number.
+//
+//       Since each stream is itself time-ordered, the streams are
+//       merged with a heap-based k-way merge over the stream heads.
+//       An event is released once no stream can still deliver an
+//       earlier event, i.e. once it is no later than the last event
+//       pushed to every stream. To bound the memory held when a
+//       stream goes quiet, events are also released once they are
+//       older than the newest event by more than a time window or
+//       once the number of held events exceeds a limit. Events that
+//       arrive after a later event has already been released are
+//       still delivered but are counted as late.
+//
+//       ADAQRawConvert and ADAQReplay fill ADAQWaveformData::TimeStamp
+//       with the time stamps unwrapped by Unwrap(); code that writes
+//       ADAQ files from a live acquisition must do the same (or fill
+//       it from the events popped from the sorter).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQTimeSorter_hh__
+#define __ADAQTimeSorter_hh__ 1
+
+// C++
+#include <vector>
+#include <map>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+
+// ADAQ
+#include "ADAQDigitizer.hh"
+
+
+// One event of the time-ordered stream
+
+struct ADAQTimeOrderedEvent{
+  uint64_t TimeStamp;   // Unwrapped timestamp [ns]
+  uint32_t RawTimeTag;  // Time tag as read from the digitizer
+  int BoardID;
+  int ChannelID;        // -1 for board-level (STD) events
+  uint64_t Tag;         // Opaque user value, e.g. an index into user storage
+};
+
+
+class ADAQTimeSorter
+{
+public:
+  ADAQTimeSorter();
+  ~ADAQTimeSorter();
+
+  // Set the time tag size [bits] and unit [ns] of a board, either
+  // explicitly or from the digitizer. Boards that are not set use a
+  // 31-bit, 8 ns time tag.
+  void SetTimeStampFormat(int, uint32_t, uint32_t);
+  void AddDigitizer(ADAQDigitizer *);
+
+  // Maximum time an event is held waiting for other streams [ns]
+  void SetWindow(uint64_t W) {Window = W;}
+  uint64_t GetWindow() {return Window;}
+
+  // Maximum number of events held by the sorter
+  void SetMaxPendingEvents(uint32_t M) {MaxPendingEvents = M;}
+  uint32_t GetMaxPendingEvents() {return MaxPendingEvents;}
+
+  // Unwrap a raw time tag of a stream into a 64-bit timestamp [ns]
+  // without merging; the time tags of a stream must be passed in the
+  // order they were read out
+  uint64_t Unwrap(int, int, uint32_t);
+
+  // Unwrap and add an event; returns the unwrapped timestamp [ns]
+  uint64_t Push(int, int, uint32_t, uint64_t = 0);
+
+  // Get the next time-ordered event; false if no event can yet be
+  // released
+  bool Pop(ADAQTimeOrderedEvent &);
+
+  // Release all held events regardless of the other streams, e.g. at
+  // the end of a run; the flush ends with the next Push()
+  void Flush() {Flushing = true;}
+
+  // Discard all events and the unwrapping state (i.e. a new run)
+  void Reset();
+
+  uint32_t GetNumStreams() {return Streams.size();}
+  uint32_t GetNumPendingEvents() {return NumPending;}
+  uint64_t GetNumLateEvents() {return LateEvents;}
+  uint64_t GetNumForcedReleases() {return ForcedReleases;}
+  uint64_t GetNumRollovers();
+
+private:
+
+  // A time-ordered ring of held events from one (board, channel)
+  struct Stream{
+    int BoardID, ChannelID;
+
+    uint32_t Mask, Unit;
+    uint32_t LastRawTimeTag;
+    uint64_t Rollovers;
+    bool Started;
+
+    // Timestamp of the last event pushed to the stream [ns]
+    uint64_t LastTimeStamp;
+
+    vector<ADAQTimeOrderedEvent> Ring;
+    uint32_t Head, Count;
+  };
+
+  Stream *GetStream(int, int, uint32_t *);
+  void GrowRing(Stream *);
+  bool Releasable(uint64_t);
+
+  // Stream index by (board, channel) key; the last key is cached
+  // since consecutive events mostly come from the same stream
+  vector<Stream *> Streams;
+  map<uint64_t, uint32_t> StreamMap;
+  uint64_t LastKey;
+  uint32_t LastStream;
+
+  map<int, pair<uint32_t, uint32_t> > Formats;
+
+  // Min-heap of (head timestamp, stream index) of non-empty streams
+  vector<pair<uint64_t, uint32_t> > Heap;
+
+  uint64_t Window;
+  uint32_t MaxPendingEvents, NumPending;
+
+  uint64_t NewestTimeStamp, LastReleased;
+  bool Released, Flushing;
+
+  uint64_t LateEvents, ForcedReleases;
+};
+
+#endif
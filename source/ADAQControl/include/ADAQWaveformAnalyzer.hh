@@ -0,0 +1,234 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQWaveformAnalyzer.hh
+// date: 16 Oct 26
+//
+// desc: ADAQWaveformAnalyzer computes the standard ADAQ waveform
+//       quantities for a batch of digitized waveforms from a single
+//       channel with a fixed record length:
+//
+//         Baseline      : mean of the samples in the baseline region
+//         PulseHeight   : largest baseline-subtracted sample [ADC]
+//         PulseArea     : sum of the baseline-subtracted samples
+//         PSD integrals : sums of the baseline-subtracted samples in
+//                         the total and tail regions, which are set
+//                         relative to the position of the peak
+//
+//       All quantities are computed in the direction of the pulse,
+//       i.e. they are positive for pulses of the configured polarity.
+//       The regions correspond to BaselineCalcMin/Max and the
+//       PSDTotal/TailStart/Stop settings in ADAQReadoutInformation.
+//
+//       The per-sample work (region sums and peak search) is done
+//       with AVX2 or SSE2 intrinsics, selected at runtime according
+//       to the CPU, with a scalar fallback. The results are stored
+//       in the column arrays of an ADAQWaveformResults object, from
+//       which ADAQWaveformData objects may be filled.
+//
+//       Optionally, the time of the pulse within the record is found
+//       with sub-sample precision by a digital constant-fraction
+//       discriminator (CFD) or a leading-edge discriminator:
+//
+//         CFD          : zero crossing of v[i-Delay] - Fraction*v[i]
+//         Leading edge : crossing of v[i] over a fixed threshold
+//
+//       where v is the baseline-subtracted waveform. The crossing is
+//       searched backwards from the peak, such that only the few
+//       samples of the leading edge are touched, and is interpolated
+//       linearly or with a cubic through the four nearest samples.
+//
+//       Optionally, pile-up is detected in STD firmware waveforms
+//       (the DPP-PSD firmware flags pile-up itself). The derivative
+//       v[i] - v[i-Gap] is compared to a threshold; each upward
+//       crossing at least MinSeparation samples after the previous
+//       one counts as a pulse, and a record with more than one pulse
+//       is piled up. The derivative is formed in the same pass over
+//       the record that finds the peak and the pulse area, with the
+//       same SIMD levels, and only the (rare) crossings are handled
+//       by scalar code; with SSE2 or AVX2 this adds up to ~20% to the
+//       analysis of a waveform, while the scalar kernel needs a
+//       second pass and about doubles it (PileUpBenchmark). Piled-up
+//       waveforms are either tagged or rejected; rejected waveforms
+//       are not analyzed further and their quantities are zero.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQWaveformAnalyzer_hh__
+#define __ADAQWaveformAnalyzer_hh__ 1
+
+// C++
+#include <vector>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+
+
+enum ZSIMDLevel{
+  zSIMDScalar,
+  zSIMDSSE2,
+  zSIMDAVX2
+};
+
+enum ZTimingMethod{
+  zTimingNone,
+  zTimingLeadingEdge,
+  zTimingCFD
+};
+
+enum ZTimingInterpolation{
+  zInterpolationLinear,
+  zInterpolationCubic
+};
+
+enum ZPileUpMode{
+  zPileUpOff,
+  zPileUpTag,
+  zPileUpReject
+};
+
+
+// The analysis results of a batch of waveforms as column arrays
+
+struct ADAQWaveformResults{
+  vector<double> Baseline, PulseHeight, PulseArea;
+  vector<double> PSDTotalIntegral, PSDTailIntegral;
+  vector<uint32_t> PeakPosition;
+
+  // Time of the pulse from the start of the record [ns]; negative if
+  // timing is disabled or no crossing was found
+  vector<double> FineTime;
+
+  // Number of pulses beyond the first found by the pile-up detection
+  // (0 if none or if the detection is disabled)
+  vector<uint16_t> PileUpCount;
+  
+  uint32_t NumWaveforms;
+
+  // Waveforms that were rejected because of pile-up
+  uint32_t NumRejected;
+  bool Rejected(uint32_t W) const {return Reject and PileUpCount[W] > 0;}
+  bool Reject;
+
+  ADAQWaveformResults() : NumWaveforms(0), NumRejected(0), Reject(false) {;}
+
+  void Resize(uint32_t);
+
+  // Copy the results of waveform "W" into an ADAQWaveformData object
+  // (or any class with the same setters)
+  template<class T> void Fill(uint32_t W, T *Data) const
+  {
+    Data->SetBaseline(Baseline[W]);
+    Data->SetPulseHeight(PulseHeight[W]);
+    Data->SetPulseArea(PulseArea[W]);
+    Data->SetPSDTotalIntegral(PSDTotalIntegral[W]);
+    Data->SetPSDTailIntegral(PSDTailIntegral[W]);
+    Data->SetFineTime(FineTime[W]);
+    Data->SetPileUpFlag(PileUpCount[W] > 0);
+    Data->SetPileUpCount(PileUpCount[W]);
+  }
+};
+
+
+class ADAQWaveformAnalyzer
+{
+public:
+  ADAQWaveformAnalyzer(uint32_t = 512);
+  ~ADAQWaveformAnalyzer();
+
+  void SetRecordLength(uint32_t RL) {RecordLength = RL;}
+  uint32_t GetRecordLength() {return RecordLength;}
+
+  // +1 for positive-going pulses, -1 (default) for negative-going
+  void SetPolarity(int P) {Polarity = (P < 0) ? -1 : 1;}
+  int GetPolarity() {return Polarity;}
+
+  // Baseline region [Min, Max) in samples from the record start
+  void SetBaselineRegion(uint32_t Min, uint32_t Max) {BaselineMin = Min; BaselineMax = Max;}
+
+  // PSD regions [Start, Stop) in samples relative to the peak; the
+  // start is typically negative to include the rising edge
+  void SetPSDTotalRegion(int Start, int Stop) {PSDTotalStart = Start; PSDTotalStop = Stop;}
+  void SetPSDTailRegion(int Start, int Stop) {PSDTailStart = Start; PSDTailStop = Stop;}
+
+  // Pulse timing; disabled (zTimingNone) by default
+  void SetTimingMethod(ZTimingMethod M) {TimingMethod = M;}
+  ZTimingMethod GetTimingMethod() {return TimingMethod;}
+
+  void SetTimingInterpolation(ZTimingInterpolation I) {TimingInterpolation = I;}
+
+  // CFD fraction (0, 1] and delay [samples]
+  void SetCFDFraction(double F) {CFDFraction = F;}
+  void SetCFDDelay(uint32_t D) {CFDDelay = D;}
+
+  // Leading-edge threshold [ADC] above the baseline
+  void SetLeadingEdgeThreshold(double T) {LeadingEdgeThreshold = T;}
+
+  // Digitizer sample period [ns] used to convert the time to ns
+  void SetSamplePeriod(double P) {SamplePeriod = P;}
+
+  // Pile-up detection; disabled (zPileUpOff) by default
+  void SetPileUpMode(ZPileUpMode M) {PileUpMode = M;}
+  ZPileUpMode GetPileUpMode() {return PileUpMode;}
+
+  // Threshold [ADC] of the derivative over "Gap" [samples] and the
+  // minimum separation [samples] of two counted pulses
+  void SetPileUpThreshold(uint32_t T) {PileUpThreshold = T;}
+  void SetPileUpDerivativeGap(uint32_t G) {PileUpGap = G;}
+  void SetPileUpMinSeparation(uint32_t S) {PileUpMinSeparation = S;}
+
+  // Select the instruction set; returns -42 if the CPU does not
+  // support it. The best supported level is selected by default.
+  int SetSIMDLevel(ZSIMDLevel);
+  ZSIMDLevel GetSIMDLevel() {return SIMDLevel;}
+  static ZSIMDLevel GetBestSIMDLevel();
+
+  // Analyze "N" waveforms of RecordLength samples, given either as
+  // an array of pointers or as a first waveform and the distance
+  // [samples] between consecutive waveforms (e.g. the events of one
+  // channel in an ADAQEventArena). Returns 0 or -42 if the regions
+  // are not within the record.
+  int AnalyzeBatch(const uint16_t *const *, uint32_t, ADAQWaveformResults *);
+  int AnalyzeBatch(const uint16_t *, uint32_t, uint32_t, ADAQWaveformResults *);
+
+  void SetVerbose(bool V) {Verbose = V;}
+
+private:
+  int CheckRegions();
+  void Analyze(const uint16_t *, uint32_t, ADAQWaveformResults *);
+  double TimingSignal(const uint16_t *, int, double);
+  double FindTime(const uint16_t *, double, uint32_t);
+
+  uint32_t RecordLength;
+  int Polarity;
+  uint32_t BaselineMin, BaselineMax;
+  int PSDTotalStart, PSDTotalStop;
+  int PSDTailStart, PSDTailStop;
+
+  ZTimingMethod TimingMethod;
+  ZTimingInterpolation TimingInterpolation;
+  double CFDFraction;
+  uint32_t CFDDelay;
+  double LeadingEdgeThreshold;
+  double SamplePeriod;
+
+  ZPileUpMode PileUpMode;
+  uint32_t PileUpThreshold, PileUpGap, PileUpMinSeparation;
+
+  ZSIMDLevel SIMDLevel;
+  bool Verbose;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQZLEEventTable.hh
+// date: 16 Oct 26
+//
+// desc: ADAQZLEEventTable is an index of all zero length encoded
+//       (ZLE) events contained in a PC readout buffer. It is filled
+//       in a single pass over the buffer by
+//       ADAQDigitizer::BuildZLEEventTable() and records where each
+//       event, and each channel within each event, begins as well as
+//       the number of stored samples per channel. Since no decoding
+//       state is carried from one event to the next, events may then
+//       be decoded with ADAQDigitizer::DecodeZLEEvent() in any order
+//       or concurrently from several threads. The table is intended
+//       to be reused for every readout buffer; memory is only
+//       allocated when a buffer holds more events than any before.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQZLEEventTable_hh__
+#define __ADAQZLEEventTable_hh__ 1
+
+// C++
+#include <vector>
+using namespace std;
+
+// Boost
+#include <boost/cstdint.hpp>
+
+
+struct ADAQZLEEventTable{
+
+  // The indexed PC buffer, which must outlive the table contents
+  const uint32_t *Words;
+
+  uint32_t NumEvents;
+  uint32_t NumChannels;
+
+  // Event-level offsets [32-bit words from start of buffer]
+  vector<uint32_t> EventStart, EventSize;
+  vector<uint32_t> ChannelMask, TriggerTimeTag;
+
+  // Channel-level offsets, indexed by [Event*NumChannels + Channel].
+  // ChannelStart points to the channel "size" word and is zero for
+  // channels that are not present in the event
+  vector<uint32_t> ChannelStart, ChannelSize;
+  vector<uint32_t> NumSamples;
+
+  uint32_t GetIndex(uint32_t Event, uint32_t Channel) const
+  {return Event * NumChannels + Channel;}
+
+  uint32_t GetNumSamples(uint32_t Event, uint32_t Channel) const
+  {return NumSamples[GetIndex(Event, Channel)];}
+};
+
+#endif
@@ -0,0 +1,349 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQAnalysisPool.cc
+// date: 16 Oct 26
+//
+// desc: ADAQAnalysisPool analyzes tasks on work-stealing worker
+//       threads and delivers them in submission or completion order.
+//       See the header file for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+using namespace std;
+
+// Boost
+#include <boost/bind/bind.hpp>
+
+// ADAQ
+#include "ADAQAnalysisPool.hh"
+
+
+// Monotonic wall clock [ns] used for the worker statistics
+static uint64_t SteadyNs()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Index of the worker running on the present thread
+static thread_local int WorkerIndex = -1;
+
+
+ADAQAnalysisPool::ADAQAnalysisPool(uint32_t N) // Number of workers; 0 = hardware threads
+  : NumWorkers(N), Running(false), Ordered(true), QueuedTasks(0),
+    NextSequence(0), NextDelivery(0), NextWorker(0),
+    PendingTasks(0), MaxPendingTasks(1024), StartTimeNs(0)
+{
+  if(NumWorkers == 0)
+    NumWorkers = max(boost::thread::hardware_concurrency(), 1u);
+
+  for(uint32_t w=0; w<NumWorkers; w++){
+    Worker *W = new Worker;
+    W->Thread = NULL;
+    W->Tasks = W->Steals = W->BusyNs = 0;
+    Workers.push_back(W);
+  }
+}
+
+
+ADAQAnalysisPool::~ADAQAnalysisPool()
+{
+  Stop();
+
+  // Tasks that were never analyzed or delivered are discarded
+  for(uint32_t w=0; w<NumWorkers; w++){
+    for(size_t t=0; t<Workers[w]->Queue.size(); t++)
+      delete Workers[w]->Queue[t];
+    delete Workers[w];
+  }
+
+  map<uint64_t, Task *>::iterator It = CompletedOrdered.begin();
+  for(; It!=CompletedOrdered.end(); It++)
+    delete It->second;
+  for(size_t t=0; t<CompletedUnordered.size(); t++)
+    delete CompletedUnordered[t];
+}
+
+
+void ADAQAnalysisPool::Start()
+{
+  if(Running)
+    return;
+
+  Running = true;
+  StartTimeNs = SteadyNs();
+
+  for(uint32_t w=0; w<NumWorkers; w++)
+    Workers[w]->Thread = new boost::thread(&ADAQAnalysisPool::RunWorker, this, w);
+}
+
+
+void ADAQAnalysisPool::Stop()
+{
+  if(!Running)
+    return;
+
+  {
+    boost::mutex::scoped_lock Lock(WakeMutex);
+    Running = false;
+  }
+  WakeCondition.notify_all();
+
+  for(uint32_t w=0; w<NumWorkers; w++){
+    Workers[w]->Thread->join();
+    delete Workers[w]->Thread;
+    Workers[w]->Thread = NULL;
+  }
+}
+
+
+int ADAQAnalysisPool::SetOrdered(bool O)
+{
+  if(PendingTasks > 0)
+    return -42;
+
+  Ordered = O;
+  return 0;
+}
+
+
+uint64_t ADAQAnalysisPool::Submit(boost::function<void ()> Analyze,
+				  boost::function<void ()> DeliverFunction)
+{
+  // Apply backpressure by delivering completed tasks until there is
+  // room; the submitting thread is then also the output thread
+  while(PendingTasks >= MaxPendingTasks){
+    if(Deliver() == 0){
+      boost::mutex::scoped_lock Lock(OutputMutex);
+      OutputCondition.timed_wait(Lock, boost::posix_time::milliseconds(1));
+    }
+  }
+
+  Task *T = new Task;
+  T->Sequence = NextSequence++;
+  T->Analyze = Analyze;
+  T->Deliver = DeliverFunction;
+
+  PendingTasks++;
+
+  // Distribute round-robin; stealing balances any uneven load
+  // The queued count is raised first such that it never undercounts
+  // the tasks a worker can find
+  {
+    boost::mutex::scoped_lock Lock(WakeMutex);
+    QueuedTasks++;
+  }
+
+  Worker *W = Workers[NextWorker];
+  NextWorker = (NextWorker + 1) % NumWorkers;
+  {
+    boost::mutex::scoped_lock Lock(W->QueueMutex);
+    W->Queue.push_back(T);
+  }
+  WakeCondition.notify_one();
+
+  return T->Sequence;
+}
+
+
+uint32_t ADAQAnalysisPool::SubmitBatch(uint32_t N,
+				       uint32_t TaskSize,
+				       boost::function<void (uint32_t, uint32_t)> Analyze,
+				       boost::function<void (uint32_t, uint32_t)> DeliverFunction)
+{
+  if(TaskSize == 0)
+    TaskSize = N;
+
+  uint32_t NumTasks = 0;
+  for(uint32_t First=0; First<N; First+=TaskSize){
+    const uint32_t Count = min(TaskSize, N - First);
+    Submit(boost::bind(Analyze, First, Count), boost::bind(DeliverFunction, First, Count));
+    NumTasks++;
+  }
+  return NumTasks;
+}
+
+
+ADAQAnalysisPool::Task *ADAQAnalysisPool::FindTask(uint32_t Self)
+{
+  Worker *W = Workers[Self];
+
+  // Own queue first, newest task first since its data is most likely
+  // to still be in the cache
+  {
+    boost::mutex::scoped_lock Lock(W->QueueMutex);
+    if(!W->Queue.empty()){
+      Task *T = W->Queue.back();
+      W->Queue.pop_back();
+      return T;
+    }
+  }
+
+  // Steal the oldest task of another worker
+  for(uint32_t i=1; i<NumWorkers; i++){
+    Worker *Victim = Workers[(Self + i) % NumWorkers];
+    boost::mutex::scoped_lock Lock(Victim->QueueMutex);
+    if(!Victim->Queue.empty()){
+      Task *T = Victim->Queue.front();
+      Victim->Queue.pop_front();
+      W->Steals++;
+      return T;
+    }
+  }
+
+  return NULL;
+}
+
+
+int ADAQAnalysisPool::GetWorkerIndex()
+{
+  return WorkerIndex;
+}
+
+
+void ADAQAnalysisPool::RunWorker(uint32_t Self)
+{
+  Worker *W = Workers[Self];
+  WorkerIndex = Self;
+
+  while(true){
+
+    Task *T = FindTask(Self);
+
+    if(T == NULL){
+      boost::mutex::scoped_lock Lock(WakeMutex);
+      if(!Running)
+	break;
+      if(QueuedTasks == 0)
+	WakeCondition.timed_wait(Lock, boost::posix_time::milliseconds(10));
+      continue;
+    }
+
+    QueuedTasks--;
+
+    const uint64_t StartNs = SteadyNs();
+    T->Analyze();
+    W->BusyNs += SteadyNs() - StartNs;
+    W->Tasks++;
+
+    Complete(T);
+  }
+}
+
+
+void ADAQAnalysisPool::Complete(Task *T)
+{
+  {
+    boost::mutex::scoped_lock Lock(OutputMutex);
+    if(Ordered)
+      CompletedOrdered[T->Sequence] = T;
+    else
+      CompletedUnordered.push_back(T);
+  }
+  OutputCondition.notify_all();
+}
+
+
+uint32_t ADAQAnalysisPool::Deliver()
+{
+  vector<Task *> Ready;
+
+  {
+    boost::mutex::scoped_lock Lock(OutputMutex);
+
+    if(Ordered){
+      map<uint64_t, Task *>::iterator It = CompletedOrdered.begin();
+      while(It != CompletedOrdered.end() and It->first == NextDelivery){
+	Ready.push_back(It->second);
+	CompletedOrdered.erase(It++);
+	NextDelivery++;
+      }
+    }
+    else{
+      Ready.assign(CompletedUnordered.begin(), CompletedUnordered.end());
+      CompletedUnordered.clear();
+      NextDelivery += Ready.size();
+    }
+  }
+
+  // The deliver functions run outside of the lock so that workers
+  // completing tasks are never blocked by the output
+  for(size_t t=0; t<Ready.size(); t++){
+    if(Ready[t]->Deliver)
+      Ready[t]->Deliver();
+    delete Ready[t];
+    PendingTasks--;
+  }
+
+  return Ready.size();
+}
+
+
+void ADAQAnalysisPool::Drain()
+{
+  while(PendingTasks > 0){
+    if(Deliver() == 0){
+      boost::mutex::scoped_lock Lock(OutputMutex);
+      OutputCondition.timed_wait(Lock, boost::posix_time::milliseconds(1));
+    }
+  }
+}
+
+
+ADAQAnalysisWorkerStats ADAQAnalysisPool::GetWorkerStats(uint32_t w)
+{
+  ADAQAnalysisWorkerStats Stats = {0, 0, 0., 0.};
+  if(w >= NumWorkers)
+    return Stats;
+
+  Stats.Tasks = Workers[w]->Tasks;
+  Stats.Steals = Workers[w]->Steals;
+  Stats.BusyTime = Workers[w]->BusyNs * 1e-9;
+
+  const double WallTime = (StartTimeNs > 0) ? (SteadyNs() - StartTimeNs) * 1e-9 : 0.;
+  Stats.Utilization = (WallTime > 0.) ? Stats.BusyTime / WallTime : 0.;
+
+  return Stats;
+}
+
+
+void ADAQAnalysisPool::ResetStats()
+{
+  for(uint32_t w=0; w<NumWorkers; w++)
+    Workers[w]->Tasks = Workers[w]->Steals = Workers[w]->BusyNs = 0;
+  StartTimeNs = SteadyNs();
+}
+
+
+void ADAQAnalysisPool::PrintStats()
+{
+  cout << "ADAQAnalysisPool : " << NumWorkers << " workers, "
+       << (Ordered ? "ordered" : "unordered") << " delivery\n"
+       << "--> " << setw(6) << "Worker" << setw(12) << "Tasks" << setw(12) << "Steals"
+       << setw(14) << "Busy [s]" << setw(14) << "Utilization" << endl;
+
+  for(uint32_t w=0; w<NumWorkers; w++){
+    ADAQAnalysisWorkerStats Stats = GetWorkerStats(w);
+    cout << "--> " << setw(6) << w << setw(12) << Stats.Tasks << setw(12) << Stats.Steals
+	 << setw(14) << setprecision(4) << Stats.BusyTime
+	 << setw(13) << 100. * Stats.Utilization << "%" << endl;
+  }
+  cout << endl;
+}
@@ -0,0 +1,199 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQBLTController.cc
+// date: 16 Oct 26
+//
+// desc: ADAQBLTController adapts the number of events per block
+//       transfer to the measured trigger rate and FPGA buffer
+//       occupancy. See the header file for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+// ADAQ
+#include "ADAQBLTController.hh"
+
+
+ADAQBLTController::ADAQBLTController(ADAQDigitizer *Digitizer)
+  : DG(Digitizer), DPPFirmware(false), Verbose(false),
+    MinEvents(1), MaxEvents(1024), EventsPerTransfer(1),
+    AggregatesPerTransfer(1), NumEnabledChannels(1),
+    TargetLatency(0.1), UpdatePeriod(1.), BufferLevelLimit(0.5), Hysteresis(0.25),
+    StartNs(0), PeriodStartNs(0),
+    PeriodBytes(0), PeriodEvents(0), PeriodTransfers(0)
+{;}
+
+
+ADAQBLTController::~ADAQBLTController()
+{;}
+
+
+void ADAQBLTController::SetLimits(uint32_t Min, uint32_t Max)
+{
+  MinEvents = max(Min, (uint32_t)1);
+  MaxEvents = max(Max, MinEvents);
+}
+
+
+int ADAQBLTController::Apply(uint32_t Events)
+{
+  Events = min(max(Events, MinEvents), MaxEvents);
+
+  DPPFirmware = (DG->GetBoardFirmwareType() == "PSD");
+
+  int Status = 0;
+  if(DPPFirmware){
+    Status = DG->SetDPPEventAggregation(Events, 0);
+    if(Status == 0)
+      Status = DG->SetMaxNumAggregatesBLT(1);
+  }
+  else
+    Status = DG->SetMaxNumEventsBLT(Events);
+
+  if(Status == 0){
+    EventsPerTransfer = Events;
+    AggregatesPerTransfer = 1;
+  }
+  else if(Verbose)
+    cout << "ADAQBLTController[" << DG->GetBoardID() << "] : Error! Could not set " << Events
+	 << " events per transfer (error code " << Status << ")!\n"
+	 << endl;
+
+  return Status;
+}
+
+
+void ADAQBLTController::Reset(uint64_t NowNs)
+{
+  StartNs = PeriodStartNs = NowNs;
+  PeriodBytes = PeriodEvents = PeriodTransfers = 0;
+  Adjustments.clear();
+
+  // The DPP aggregation threshold counts the events of each channel
+  DPPFirmware = (DG->GetBoardFirmwareType() == "PSD");
+
+  uint32_t ChannelMask = 0;
+  DG->GetChannelEnableMask(&ChannelMask);
+  NumEnabledChannels = max(__builtin_popcount(ChannelMask), 1);
+}
+
+
+bool ADAQBLTController::Update(uint32_t Bytes,  // Bytes in the transfer
+			       uint32_t Events, // Events in the transfer
+			       uint64_t NowNs)  // Present time [ns]
+{
+  PeriodBytes += Bytes;
+  PeriodEvents += Events;
+  PeriodTransfers++;
+
+  const double Elapsed = (NowNs - PeriodStartNs) * 1e-9;
+  if(Elapsed < UpdatePeriod)
+    return false;
+
+  // The setting evaluated: events per transfer (STD) or aggregates of
+  // EventsPerTransfer events per channel (DPP)
+  const uint32_t Setting = DPPFirmware ? AggregatesPerTransfer : EventsPerTransfer;
+  const uint32_t Unit = DPPFirmware ? EventsPerTransfer : 1;
+
+  ADAQBLTAdjustment Adjustment;
+  Adjustment.Time = (NowNs - StartNs) * 1e-9;
+  Adjustment.OldEvents = Setting * Unit;
+  Adjustment.TriggerRate = PeriodEvents / Elapsed;
+  Adjustment.BytesPerTransfer = (PeriodTransfers > 0) ? (double)PeriodBytes / PeriodTransfers : 0.;
+  Adjustment.BufferLevel = 0.;
+
+  PeriodStartNs = NowNs;
+  PeriodBytes = PeriodEvents = PeriodTransfers = 0;
+
+  if(DPPFirmware)
+    DG->GetPSDBufferLevel(Adjustment.BufferLevel);
+  else
+    DG->GetSTDBufferLevel(Adjustment.BufferLevel);
+
+  // The largest transfer that satisfies the latency target is the
+  // most efficient one; if the FPGA memory is filling up, however,
+  // the readout is not keeping up and the transfers are enlarged
+
+  const double Rate = DPPFirmware ? Adjustment.TriggerRate / NumEnabledChannels : Adjustment.TriggerRate;
+
+  uint32_t Target = (uint32_t)floor(Rate * TargetLatency / Unit);
+  Adjustment.Reason = "latency target";
+
+  if(Adjustment.BufferLevel >= BufferLevelLimit){
+    Target = max(Target, 2 * Setting);
+    Adjustment.Reason = "FPGA buffer occupancy";
+  }
+
+  if(DPPFirmware)
+    Target = min(max(Target, (uint32_t)1), max(MaxEvents / Unit, (uint32_t)1));
+  else
+    Target = min(max(Target, MinEvents), MaxEvents);
+
+  if(Target == Setting)
+    return false;
+
+  const double Change = fabs((double)Target - Setting) / Setting;
+  if(Change < Hysteresis and Adjustment.BufferLevel < BufferLevelLimit)
+    return false;
+
+  if(DPPFirmware){
+    int Status = DG->SetMaxNumAggregatesBLT(Target);
+    if(Status != 0){
+      if(Verbose)
+	cout << "ADAQBLTController[" << DG->GetBoardID() << "] : Error! Could not set " << Target
+	     << " aggregates per transfer (error code " << Status << ")!\n"
+	     << endl;
+      return false;
+    }
+    AggregatesPerTransfer = Target;
+  }
+  else if(Apply(Target) != 0)
+    return false;
+
+  Adjustment.NewEvents = Target * Unit;
+  Adjustments.push_back(Adjustment);
+
+  if(Verbose)
+    cout << "ADAQBLTController[" << DG->GetBoardID() << "] : t = " << setprecision(4) << Adjustment.Time
+	 << " s : events per transfer " << Adjustment.OldEvents << " -> " << Adjustment.NewEvents
+	 << " (" << Adjustment.Reason << "; rate " << Adjustment.TriggerRate << " Hz, "
+	 << Adjustment.BytesPerTransfer << " bytes/transfer, buffer level " << Adjustment.BufferLevel << ")"
+	 << endl;
+
+  return true;
+}
+
+
+void ADAQBLTController::PrintAdjustments()
+{
+  cout << "ADAQBLTController[" << DG->GetBoardID() << "] : " << Adjustments.size() << " adjustments\n"
+       << "--> " << setw(10) << "Time [s]" << setw(8) << "Old" << setw(8) << "New"
+       << setw(14) << "Rate [Hz]" << setw(16) << "Bytes/transfer" << setw(10) << "Buffer"
+       << "  Reason" << endl;
+
+  for(size_t a=0; a<Adjustments.size(); a++)
+    cout << "--> " << setw(10) << setprecision(4) << Adjustments[a].Time
+	 << setw(8) << Adjustments[a].OldEvents << setw(8) << Adjustments[a].NewEvents
+	 << setw(14) << Adjustments[a].TriggerRate << setw(16) << Adjustments[a].BytesPerTransfer
+	 << setw(10) << Adjustments[a].BufferLevel << "  " << Adjustments[a].Reason << endl;
+
+  cout << endl;
+}
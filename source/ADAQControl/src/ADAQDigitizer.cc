@@ -56,10 +56,16 @@
 #include <unistd.h>
 #include <bitset>
 #include <map>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 // CAEN
 extern "C" {
 #include "CAENDigitizer.h"
+#include "CAENComm.h"
 }
 
 #include <boost/assign/std/vector.hpp>
@@ -99,6 +105,72 @@ namespace ZLE{
 
   // Number of bit to right-shift to get sample B data
   const uint32_t ZLESampleBBitShift = 16;
+
+  // Maximum plausible ZLE event size; see GetZLEWaveform()
+  const uint32_t ZLEMaxEventSize = 100000; // [32-bit words]
+
+
+  // Unpack "N" ZLE data words into 2*N samples masked to the ADC
+  // bit-depth. Since sample A (B) is in the low (high) 16 bits of a
+  // little-endian 32-bit word, the samples are already in
+  // chronological order in memory and unpacking is a masked copy of
+  // 16-bit lanes. SSE2 and AVX2 versions are selected at runtime.
+
+  void UnpackZLEScalar(const uint32_t *Data, uint32_t N, uint16_t Mask, uint16_t *Samples)
+  {
+    for(uint32_t w=0; w<N; w++){
+      Samples[2*w] = (Data[w] & ZLESampleAMask) & Mask;
+      Samples[2*w + 1] = ((Data[w] & ZLESampleBMask) >> ZLESampleBBitShift) & Mask;
+    }
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+
+  __attribute__((target("sse2")))
+  void UnpackZLESSE2(const uint32_t *Data, uint32_t N, uint16_t Mask, uint16_t *Samples)
+  {
+    const __m128i VMask = _mm_set1_epi16(Mask);
+    uint32_t w = 0;
+    
+    for(; w+4<=N; w+=4){
+      __m128i V = _mm_loadu_si128((const __m128i *)(Data + w));
+      _mm_storeu_si128((__m128i *)(Samples + 2*w), _mm_and_si128(V, VMask));
+    }
+    UnpackZLEScalar(Data + w, N - w, Mask, Samples + 2*w);
+  }
+
+  __attribute__((target("avx2")))
+  void UnpackZLEAVX2(const uint32_t *Data, uint32_t N, uint16_t Mask, uint16_t *Samples)
+  {
+    const __m256i VMask = _mm256_set1_epi16(Mask);
+    uint32_t w = 0;
+    
+    for(; w+8<=N; w+=8){
+      __m256i V = _mm256_loadu_si256((const __m256i *)(Data + w));
+      _mm256_storeu_si256((__m256i *)(Samples + 2*w), _mm256_and_si256(V, VMask));
+    }
+    UnpackZLEScalar(Data + w, N - w, Mask, Samples + 2*w);
+  }
+
+  typedef void (*UnpackZLEFunction)(const uint32_t *, uint32_t, uint16_t, uint16_t *);
+
+  UnpackZLEFunction SelectUnpackZLE()
+  {
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+      return UnpackZLEAVX2;
+    if(__builtin_cpu_supports("sse2"))
+      return UnpackZLESSE2;
+    return UnpackZLEScalar;
+  }
+
+  const UnpackZLEFunction UnpackZLE = SelectUnpackZLE();
+
+#else
+
+  void (*const UnpackZLE)(const uint32_t *, uint32_t, uint16_t, uint16_t *) = UnpackZLEScalar;
+
+#endif
 };
 using namespace ZLE;
 
@@ -121,7 +193,9 @@ ADAQDigitizer::ADAQDigitizer(ZBoardType Type,  // ADAQ-specific device type iden
     BoardFirmwareCode(0), BoardFirmwareType(""),
     NumChannels(0), NumADCBits(0), MinADCBit(0), MaxADCBit(0), SamplingRate(0),
     TimeStampSize(31), TimeStampUnit(8),
-    ZLEStartWord(0), ZLEWordCounter(0)
+    ZLEStartWord(0), ZLEWordCounter(0),
+    RegisterCacheEnabled(false), RegisterBatch(false), MultiRegisterAccess(true),
+    RegisterTransactions(0)
     //Buffer_Py(NULL), EventPointer_Py(NULL), EventWaveform_Py(Null)
 {
 
@@ -190,6 +264,7 @@ int ADAQDigitizer::OpenLink()
   if(CommandStatus == CAEN_DGTZ_Success){
     
     LinkEstablished = true;
+    InvalidateRegisterCache();
     
     if(Verbose){
       
@@ -314,6 +389,7 @@ int ADAQDigitizer::CloseLink()
   if(CommandStatus == CAEN_DGTZ_Success){
 
     LinkEstablished = false;
+    InvalidateRegisterCache();
 
     if(Verbose)
       std::cout << "ADAQDigitizer[" << BoardID << "] : Link successfully closed!\n"
@@ -350,6 +426,9 @@ int ADAQDigitizer::Initialize()
   // Set the channel configuration
   CommandStatus = CAEN_DGTZ_WriteRegister(BoardHandle, CAEN_DGTZ_BROAD_CH_CTRL_ADD, 0x00000050);
 
+  // The firmware reset above restores all registers to their defaults
+  InvalidateRegisterCache();
+
   return CommandStatus;
 }
 
@@ -358,8 +437,29 @@ int ADAQDigitizer::SetRegisterValue(uint32_t Addr32, uint32_t Data32)
 { 
   CommandStatus = -42;
   
-  if(CheckRegisterForWriting(Addr32))
-    CommandStatus = CAEN_DGTZ_WriteRegister(BoardHandle, Addr32, Data32); 
+  if(!CheckRegisterForWriting(Addr32))
+    return CommandStatus;
+
+  if(RegisterCacheEnabled and CheckRegisterForCaching(Addr32)){
+    ShadowRegisters[Addr32] = Data32;
+
+    // Within a batch the write is deferred to CommitRegisters()
+    if(RegisterBatch){
+      if(find(DirtyRegisters.begin(), DirtyRegisters.end(), Addr32) == DirtyRegisters.end())
+	DirtyRegisters.push_back(Addr32);
+      CommandStatus = 0;
+      return CommandStatus;
+    }
+  }
+  
+  CommandStatus = WriteRegisters(1, &Addr32, &Data32);
+
+  // Broadcast writes (0x80XX) set the register 0x1nXX of all channels
+  if((Addr32 & 0xff00) == 0x8000 and CheckRegisterForCaching((Addr32 & 0x00ff) | 0x1000)){
+    const int Status = CommandStatus;
+    InvalidateZSRegisters(0xffffffff);
+    CommandStatus = Status;
+  }
   
   return CommandStatus;
 }
@@ -369,8 +469,24 @@ int ADAQDigitizer::GetRegisterValue(uint32_t Addr32, uint32_t *Data32)
 {
   CommandStatus = -42;
 
-  if(CheckRegisterForWriting(Addr32))
-    CommandStatus = CAEN_DGTZ_ReadRegister(BoardHandle, Addr32, Data32);
+  if(!CheckRegisterForWriting(Addr32))
+    return CommandStatus;
+
+  bool Cacheable = (RegisterCacheEnabled and CheckRegisterForCaching(Addr32));
+  
+  if(Cacheable){
+    map<uint32_t, uint32_t>::iterator It = ShadowRegisters.find(Addr32);
+    if(It != ShadowRegisters.end()){
+      *Data32 = It->second;
+      CommandStatus = 0;
+      return CommandStatus;
+    }
+  }
+  
+  CommandStatus = ReadRegisters(1, &Addr32, Data32);
+  
+  if(Cacheable and CommandStatus == 0)
+    ShadowRegisters[Addr32] = *Data32;
   
   return CommandStatus;
 }
@@ -391,6 +507,278 @@ bool ADAQDigitizer::CheckRegisterForWriting(uint32_t Addr32)
 }
 
 
+bool ADAQDigitizer::CheckRegisterForCaching(uint32_t Addr32)
+{
+  // Only the configuration registers that ADAQ accesses through
+  // Set/GetRegisterValue() are cached, each with the wrappers that
+  // invalidate it; all other registers are always read from and
+  // written to the board
+
+  // Per-channel ZLE threshold (0x1n24) and samples (0x1n28) of the
+  // STD firmware; the DPP firmwares use these addresses otherwise
+  if((Addr32 & 0xf000) == 0x1000){
+    uint32_t ChannelRegister = (Addr32 & 0xf0ff);
+    return (BoardFirmwareType == "STD" and
+	    (ChannelRegister == CAEN_DGTZ_CHANNEL_ZS_THRESHOLD_BASE_ADDRESS or
+	     ChannelRegister == CAEN_DGTZ_CHANNEL_ZS_NSAMPLE_BASE_ADDRESS));
+  }
+  
+  switch(Addr32){
+  case CAEN_DGTZ_BROAD_NUM_BLOCK_ADD:       // Record length, DPP aggregation
+  case CAEN_DGTZ_ACQ_CONTROL_ADD:           // Acquisition mode, start/stop, run sync.
+  case CAEN_DGTZ_TRIGGER_SRC_ENABLE_ADD:    // Trigger sources
+  case CAEN_DGTZ_FP_TRIGGER_OUT_ENABLE_ADD: // Trigger sources
+  case CAEN_DGTZ_FRONT_PANEL_IO_CTRL_ADD:   // I/O level, run sync.
+  case CAEN_DGTZ_CH_ENABLE_ADD:             // Channel and group enable masks
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+int ADAQDigitizer::ReadRegisters(uint32_t N, uint32_t *Addr32, uint32_t *Data32)
+{
+  CommandStatus = -42;
+
+  // As in ADAQBridge, the CAENDigitizer board handle is passed to
+  // CAENComm; should the library refuse it the registers are read
+  // one at a time for the remainder of the session
+  
+  if(N > 1 and MultiRegisterAccess){
+    vector<CAENComm_ErrorCode> Errors(N, CAENComm_Success);
+    CommandStatus = CAENComm_MultiRead32(BoardHandle, Addr32, N, Data32, &Errors[0]);
+    RegisterTransactions++;
+    
+    if(CommandStatus != CAENComm_NotSupported and CommandStatus != CAENComm_InvalidHandler){
+      // A failed transaction leaves the result of every cycle unknown
+      vector<int> Status(N, CommandStatus);
+      if(CommandStatus == CAENComm_Success)
+	for(uint32_t r=0; r<N; r++)
+	  Status[r] = Errors[r];
+      SetRegisterErrors(N, Addr32, &Status[0]);
+      return CommandStatus;
+    }
+    
+    MultiRegisterAccess = false;
+  }
+
+  vector<int> Status(N, 0);
+  for(uint32_t r=0; r<N; r++){
+    CommandStatus = CAEN_DGTZ_ReadRegister(BoardHandle, Addr32[r], &Data32[r]);
+    RegisterTransactions++;
+    if(CommandStatus != CAEN_DGTZ_Success){
+      fill(Status.begin() + r, Status.end(), CommandStatus);
+      break;
+    }
+  }
+  SetRegisterErrors(N, Addr32, &Status[0]);
+  return CommandStatus;
+}
+
+
+int ADAQDigitizer::WriteRegisters(uint32_t N, uint32_t *Addr32, uint32_t *Data32)
+{
+  CommandStatus = -42;
+  
+  if(N > 1 and MultiRegisterAccess){
+    vector<CAENComm_ErrorCode> Errors(N, CAENComm_Success);
+    CommandStatus = CAENComm_MultiWrite32(BoardHandle, Addr32, N, Data32, &Errors[0]);
+    RegisterTransactions++;
+    
+    if(CommandStatus != CAENComm_NotSupported and CommandStatus != CAENComm_InvalidHandler){
+      vector<int> Status(N, CommandStatus);
+      if(CommandStatus == CAENComm_Success)
+	for(uint32_t r=0; r<N; r++)
+	  Status[r] = Errors[r];
+      SetRegisterErrors(N, Addr32, &Status[0]);
+      return CommandStatus;
+    }
+    
+    MultiRegisterAccess = false;
+  }
+
+  // The registers after a failed write are not written
+  vector<int> Status(N, 0);
+  for(uint32_t r=0; r<N; r++){
+    CommandStatus = CAEN_DGTZ_WriteRegister(BoardHandle, Addr32[r], Data32[r]);
+    RegisterTransactions++;
+    if(CommandStatus != CAEN_DGTZ_Success){
+      fill(Status.begin() + r, Status.end(), CommandStatus);
+      break;
+    }
+  }
+  SetRegisterErrors(N, Addr32, &Status[0]);
+  return CommandStatus;
+}
+
+
+void ADAQDigitizer::SetRegisterErrors(uint32_t N, uint32_t *Addr32, const int *Status)
+{
+  // The board contents of a register whose access failed are unknown
+  RegisterErrors.assign(Status, Status + N);
+  for(uint32_t r=0; r<N; r++){
+    if(Status[r] == 0)
+      continue;
+    ShadowRegisters.erase(Addr32[r]);
+    if(CommandStatus == 0)
+      CommandStatus = Status[r];
+  }
+}
+
+
+void ADAQDigitizer::SetRegisterCache(bool Enable)
+{
+  if(RegisterCacheEnabled and !Enable)
+    CommitRegisters();
+
+  InvalidateRegisterCache();
+  RegisterCacheEnabled = Enable;
+}
+
+
+int ADAQDigitizer::BeginRegisterBatch()
+{
+  CommandStatus = -42;
+  
+  if(!RegisterCacheEnabled){
+    if(Verbose)
+      cout << "ADAQDigitizer[" << BoardID << "] : Error! The register cache must be enabled to batch register writes!\n"
+	   << endl;
+    return CommandStatus;
+  }
+  
+  RegisterBatch = true;
+  CommandStatus = 0;
+  return CommandStatus;
+}
+
+
+int ADAQDigitizer::CommitRegisters()
+{
+  RegisterBatch = false;
+  CommandStatus = 0;
+
+  if(DirtyRegisters.empty())
+    return CommandStatus;
+  
+  vector<uint32_t> Addr32(DirtyRegisters);
+  vector<uint32_t> Data32(Addr32.size());
+  for(size_t r=0; r<Addr32.size(); r++)
+    Data32[r] = ShadowRegisters[Addr32[r]];
+
+  DirtyRegisters.clear();
+  
+  // The shadow copies of the registers that failed are dropped
+  CommandStatus = WriteRegisters(Addr32.size(), &Addr32[0], &Data32[0]);
+
+  if(CommandStatus != 0){
+    if(Verbose)
+      cout << "ADAQDigitizer[" << BoardID << "] : Error! Committing " << Addr32.size()
+	   << " registers failed with error code " << CommandStatus << "!\n"
+	   << endl;
+  }
+  
+  return CommandStatus;
+}
+
+
+int ADAQDigitizer::ModifyRegisterBits(uint32_t Addr32, uint32_t Mask, uint32_t Bits)
+{
+  uint32_t Data32 = 0;
+  CommandStatus = GetRegisterValue(Addr32, &Data32);
+  if(CommandStatus != 0)
+    return CommandStatus;
+
+  uint32_t Modified = (Data32 & ~Mask) | (Bits & Mask);
+  
+  // Skip the write if a cached register would not change
+  if(Modified == Data32 and RegisterCacheEnabled and ShadowRegisters.count(Addr32))
+    return CommandStatus;
+  
+  CommandStatus = SetRegisterValue(Addr32, Modified);
+  return CommandStatus;
+}
+
+
+void ADAQDigitizer::InvalidateRegister(uint32_t Addr32)
+{
+  if(ShadowRegisters.empty())
+    return;
+  
+  // A pending write is committed first so that it is not reordered
+  // with the access that made the shadow copy stale
+  vector<uint32_t>::iterator It = find(DirtyRegisters.begin(), DirtyRegisters.end(), Addr32);
+  if(It != DirtyRegisters.end()){
+    uint32_t Data32 = ShadowRegisters[Addr32];
+    DirtyRegisters.erase(It);
+    WriteRegisters(1, &Addr32, &Data32);
+  }
+  ShadowRegisters.erase(Addr32);
+}
+
+
+void ADAQDigitizer::InvalidateRegisterCache()
+{
+  if(!DirtyRegisters.empty() and Verbose)
+    cout << "ADAQDigitizer[" << BoardID << "] : Warning! Discarding " << DirtyRegisters.size()
+	 << " uncommitted register writes!\n"
+	 << endl;
+  
+  ShadowRegisters.clear();
+  DirtyRegisters.clear();
+  RegisterBatch = false;
+}
+
+
+int ADAQDigitizer::ResyncRegisterCache()
+{
+  CommandStatus = 0;
+  
+  if(!DirtyRegisters.empty() and Verbose)
+    cout << "ADAQDigitizer[" << BoardID << "] : Warning! Discarding " << DirtyRegisters.size()
+	 << " uncommitted register writes!\n"
+	 << endl;
+  DirtyRegisters.clear();
+
+  if(ShadowRegisters.empty())
+    return CommandStatus;
+  
+  vector<uint32_t> Addr32, Data32(ShadowRegisters.size());
+  map<uint32_t, uint32_t>::iterator It = ShadowRegisters.begin();
+  for(; It!=ShadowRegisters.end(); It++)
+    Addr32.push_back(It->first);
+  
+  CommandStatus = ReadRegisters(Addr32.size(), &Addr32[0], &Data32[0]);
+
+  // Only the registers that were read successfully are cached
+  ShadowRegisters.clear();
+  for(size_t r=0; r<Addr32.size(); r++)
+    if(RegisterErrors[r] == 0)
+      ShadowRegisters[Addr32[r]] = Data32[r];
+  
+  return CommandStatus;
+}
+
+
+void ADAQDigitizer::InvalidateTriggerSourceRegisters()
+{
+  InvalidateRegister(CAEN_DGTZ_TRIGGER_SRC_ENABLE_ADD);
+  InvalidateRegister(CAEN_DGTZ_FP_TRIGGER_OUT_ENABLE_ADD);
+}
+
+
+void ADAQDigitizer::InvalidateZSRegisters(uint32_t ChannelMask)
+{
+  for(int ch=0; ch<NumChannels; ch++){
+    if(!(ChannelMask & (1 << ch)))
+      continue;
+    InvalidateRegister(CAEN_DGTZ_CHANNEL_ZS_THRESHOLD_BASE_ADDRESS + 0x100*ch);
+    InvalidateRegister(CAEN_DGTZ_CHANNEL_ZS_NSAMPLE_BASE_ADDRESS + 0x100*ch);
+  }
+}
+
+
 /////////////////////
 // General methods //
 /////////////////////
@@ -459,17 +847,14 @@ int ADAQDigitizer:: EnableExternalTrigger(std::string SignalLogic)
 {
   CommandStatus = SetExtTriggerInputMode(CAEN_DGTZ_TRGMODE_ACQ_AND_EXTOUT);
   
-  // Get the value of the front panel I/O control register
+  // Bit[0] of the front panel I/O control register selects NIM (0)
+  // or TTL (1) logic for the input
   uint32_t FrontPanelIOControlRegister = CAEN_DGTZ_FRONT_PANEL_IO_CTRL_ADD;
-  uint32_t FrontPanelIOControlValue = 0;
-  CommandStatus = GetRegisterValue(FrontPanelIOControlRegister, &FrontPanelIOControlValue);
-  
-  // When Bit[0] of return value == 0, NIM logic is used for input; so
-  // clear Bit[0] using bitwise ops if "NIM" is specified
+
   if(SignalLogic=="NIM")
-    FrontPanelIOControlValue &= ~(1<<0);
+    CommandStatus = ModifyRegisterBits(FrontPanelIOControlRegister, 1<<0, 0);
   else if(SignalLogic=="TTL")
-    FrontPanelIOControlValue |= 1<<0;
+    CommandStatus = ModifyRegisterBits(FrontPanelIOControlRegister, 1<<0, 1<<0);
   else
     if(Verbose)
       std::cout << "ADAQDigitizer[" << BoardID << "] : Error! Unsupported external trigger logic ("
@@ -477,7 +862,6 @@ int ADAQDigitizer:: EnableExternalTrigger(std::string SignalLogic)
 		<< "                Select 'NIM' or 'TTL'!\n"
 		<< std::endl;
   
-  CommandStatus = SetRegisterValue(FrontPanelIOControlRegister, FrontPanelIOControlValue);
   return CommandStatus;
 }
 
@@ -529,16 +913,10 @@ int ADAQDigitizer::SetTriggerCoincidence(bool Enable, int Level)
   CommandStatus = -42;
 
   if(Enable){
-    
-    uint32_t TriggerSourceEnableMask = 0;
-
     uint32_t TriggerCoincidenceLevel_BitShifted = Level << 24;
-
-    CommandStatus = GetRegisterValue(0x810C,&TriggerSourceEnableMask);
-    
-    TriggerSourceEnableMask = TriggerSourceEnableMask | TriggerCoincidenceLevel_BitShifted;
-    
-    CommandStatus = SetRegisterValue(0x810C,TriggerSourceEnableMask);
+    CommandStatus = ModifyRegisterBits(CAEN_DGTZ_TRIGGER_SRC_ENABLE_ADD,
+				       TriggerCoincidenceLevel_BitShifted,
+				       TriggerCoincidenceLevel_BitShifted);
   }
   return CommandStatus;
 }
@@ -557,28 +935,12 @@ int ADAQDigitizer::SetAcquisitionControl(string AcqControl)
   else if(AcqControl == "Gated (NIM)" or AcqControl == "Gated (TTL)"){
     CommandStatus = SetAcquisitionMode(CAEN_DGTZ_S_IN_CONTROLLED);
     
-    uint32_t Data32 = 0;
-    CommandStatus = GetRegisterValue(CAEN_DGTZ_FRONT_PANEL_IO_CTRL_ADD, &Data32);
-    
-    bitset<32> Data32Bitset0(Data32);
-
-    if(AcqControl == "Gated (NIM)")
-      Data32Bitset0.set(0, 0);
-    else if(AcqControl == "Gated (TTL)")
-      Data32Bitset0.set(0, 1);
-
-    Data32 = (uint32_t)Data32Bitset0.to_ulong();
-    CommandStatus = SetRegisterValue(CAEN_DGTZ_FRONT_PANEL_IO_CTRL_ADD, Data32);
-    
-    //    uint32_t Data32 = 0;
-    CommandStatus = GetRegisterValue(CAEN_DGTZ_ACQ_CONTROL_ADD, &Data32);
-    
-    bitset<32> Data32Bitset1(Data32);
-    Data32Bitset1.set(0,1);
-    Data32Bitset1.set(1,0);
+    // Front panel I/O control bit[0]: NIM (0) or TTL (1) logic
+    uint32_t Logic = (AcqControl == "Gated (TTL)") ? 1<<0 : 0;
+    CommandStatus = ModifyRegisterBits(CAEN_DGTZ_FRONT_PANEL_IO_CTRL_ADD, 1<<0, Logic);
 
-    Data32 = (uint32_t)Data32Bitset1.to_ulong();
-    CommandStatus = SetRegisterValue(CAEN_DGTZ_ACQ_CONTROL_ADD, Data32);
+    // Acquisition control bits[1:0] = 0b01: S-IN controlled
+    CommandStatus = ModifyRegisterBits(CAEN_DGTZ_ACQ_CONTROL_ADD, 0b11, 0b01);
   }
   else
     if(Verbose)
@@ -593,20 +955,12 @@ int ADAQDigitizer::SetAcquisitionControl(string AcqControl)
 
 int ADAQDigitizer::SInArmAcquisition()
 {
-  uint32_t Data32 = 0;
-  CommandStatus = GetRegisterValue(CAEN_DGTZ_ACQ_CONTROL_ADD, &Data32);
-
   // At present, it appears necessary to directly set the bits
   // appropriate to ensure a TTL/NIM signal fed into S-IN (VME) or GPI
-  // (DT) can be used to control the acquisition on/off.
+  // (DT) can be used to control the acquisition on/off: bits[2:0] =
+  // 0b101 (armed, S-IN controlled)
   
-  bitset<32> Data32Bitset(Data32);
-  Data32Bitset.set(0,1);
-  Data32Bitset.set(1,0);
-  Data32Bitset.set(2,1);
-  Data32 = (uint32_t)Data32Bitset.to_ulong();
-
-  CommandStatus = SetRegisterValue(CAEN_DGTZ_ACQ_CONTROL_ADD, Data32);
+  CommandStatus = ModifyRegisterBits(CAEN_DGTZ_ACQ_CONTROL_ADD, 0b111, 0b101);
 
   return CommandStatus;
 }
@@ -614,16 +968,7 @@ int ADAQDigitizer::SInArmAcquisition()
 
 int ADAQDigitizer::SInDisarmAcquisition()
 {
-  uint32_t Data32 = 0;
-  CommandStatus = GetRegisterValue(CAEN_DGTZ_ACQ_CONTROL_ADD, &Data32);
-  
-  bitset<32> Data32Bitset(Data32);
-  Data32Bitset.set(0,0);
-  Data32Bitset.set(1,0);
-  Data32Bitset.set(2,0);
-  Data32 = (uint32_t)Data32Bitset.to_ulong();
-  
-  CommandStatus = SetRegisterValue(CAEN_DGTZ_ACQ_CONTROL_ADD, Data32);
+  CommandStatus = ModifyRegisterBits(CAEN_DGTZ_ACQ_CONTROL_ADD, 0b111, 0b000);
 
   CommandStatus = SetAcquisitionMode(CAEN_DGTZ_SW_CONTROLLED);
   
@@ -684,15 +1029,8 @@ int ADAQDigitizer::SetZLEChannelSettings(uint32_t Channel, uint32_t Threshold,
   Addr32 = CAEN_DGTZ_CHANNEL_ZS_THRESHOLD_BASE_ADDRESS;
   Addr32 += (ChannelOffset * Channel);
   
-  CommandStatus = GetRegisterValue(Addr32, &Data32);
-  
   // ZLE requires bit 31 == 0 (positive logic), == 1 (negative logic)
-  bitset<32> Data32Bitset(Data32);
-  (PosLogic) ? Data32Bitset.set(31,0) : Data32Bitset.set(31,1);
-  
-  // Convert bitset back to 32-bit integer and set register value
-  Data32 = (uint32_t)Data32Bitset.to_ulong();
-  CommandStatus = SetRegisterValue(Addr32, Data32);
+  CommandStatus = ModifyRegisterBits(Addr32, 1u<<31, (PosLogic) ? 0 : 1u<<31);
 
 
   
@@ -788,6 +1126,11 @@ int ADAQDigitizer::GetZLEWaveform(char *Buffer,
 				  int Event,
 				  vector<vector<uint16_t> > &Waveforms)
 {
+  // Note that events must be read in order with this method since
+  // the start of each event is tracked with member data. For random
+  // access, parallel decoding, and multiple channels use
+  // BuildZLEEventTable() and DecodeZLEEvent() instead.
+
   // Clear the Waveforms for a new ZLE event
   Waveforms.clear();
   Waveforms.resize(NumChannels);
@@ -819,7 +1162,7 @@ int ADAQDigitizer::GetZLEWaveform(char *Buffer,
   // from causing segfaults. CAEN has been contacted regarding this
   // issue! ZSH (16 Oct 14)
   
-  if(EventSize > 1e5)
+  if(EventSize > ZLEMaxEventSize)
     return -42;
 
   //
@@ -871,6 +1214,379 @@ int ADAQDigitizer::GetZLEWaveform(char *Buffer,
 }
 
 
+int ADAQDigitizer::DecodeSTDBuffer(char *Buffer,
+				   uint32_t BufferSize,
+				   ADAQEventArena *Arena)
+{
+  // This method decodes all standard firmware (STD) events in a PC
+  // buffer filled by ReadData() directly into the event arena. The
+  // x720, x724, x725, and x730 digitizer families share the same
+  // event format:
+  //
+  //   Word[0] : 0xA in bits[31:28]; event size [words] in bits[27:0]
+  //   Word[1] : board ID in bits[31:27]; LVDS pattern in bits[23:8];
+  //             channel mask[7:0] in bits[7:0]
+  //   Word[2] : channel mask[15:8] in bits[31:24]; event counter in
+  //             bits[23:0]
+  //   Word[3] : trigger time tag
+  //
+  // followed by the samples of each enabled channel in order of
+  // increasing channel number, two samples per 32-bit word with the
+  // earlier sample in bits[15:0]. Samples are masked to the ADC
+  // bit-depth exactly as in CAEN_DGTZ_DecodeEvent().
+
+  Arena->Clear();
+
+  const uint32_t *Words = (const uint32_t *)Buffer;
+  const uint32_t NumWords = BufferSize / sizeof(uint32_t);
+
+  const uint32_t SampleMask = (NumADCBits > 0 and NumADCBits < 16) ? ((1u << NumADCBits) - 1) : 0xffff;
+
+  uint32_t Word = 0;
+
+  while(Word < NumWords){
+
+    const uint32_t *Event = Words + Word;
+
+    // Stop at the first word that is not a valid event header; the
+    // remainder of the buffer is either padding or corrupt
+    if((Event[0] >> 28) != 0xA){
+      if(Verbose)
+	cout << "ADAQDigitizer[" << BoardID << "] : Error! Invalid event header at word " << Word << "!\n"
+	     << endl;
+      return -42;
+    }
+    
+    const uint32_t EventSize = Event[0] & 0x0fffffff;
+
+    if(EventSize < 4 or Word + EventSize > NumWords){
+      if(Verbose)
+	cout << "ADAQDigitizer[" << BoardID << "] : Error! Event size (" << EventSize << " words) overruns the buffer!\n"
+	     << endl;
+      return -42;
+    }
+
+    const uint32_t Mask = (Event[1] & 0xff) | ((Event[2] >> 16) & 0xff00);
+    const uint32_t NumEnabled = __builtin_popcount(Mask);
+    const uint32_t DataWords = EventSize - 4;
+    const uint32_t ChannelWords = (NumEnabled > 0) ? DataWords / NumEnabled : 0;
+
+    uint16_t *Samples = Arena->AddEvent(Event[1] >> 27,
+					(Event[1] >> 8) & 0xffff,
+					Mask,
+					Event[2] & 0x00ffffff,
+					Event[3],
+					2 * ChannelWords);
+
+    // Enabled channels are contiguous in both the buffer and the
+    // arena so all samples of the event are unpacked in one loop
+    const uint32_t *Data = Event + 4;
+    const uint32_t Num = NumEnabled * ChannelWords;
+    
+    for(uint32_t w=0; w<Num; w++){
+      Samples[2*w] = Data[w] & SampleMask;
+      Samples[2*w + 1] = (Data[w] >> 16) & SampleMask;
+    }
+
+    Word += EventSize;
+  }
+  
+  return 0;
+}
+
+
+int ADAQDigitizer::DecodePSDBuffer(char *Buffer,
+				   uint32_t BufferSize,
+				   ADAQPSDEventArena *Arena)
+{
+  // This method decodes all DPP-PSD events in a PC buffer filled by
+  // ReadData() directly into the per-channel columns of the arena.
+  // The buffer holds one or more board aggregates in the x725/x730
+  // DPP-PSD format:
+  //
+  //   Word[0] : 0xA in bits[31:28]; aggregate size [words] in bits[27:0]
+  //   Word[1] : board ID in bits[31:27]; channel pair mask in bits[7:0]
+  //   Word[2] : board aggregate counter in bits[22:0]
+  //   Word[3] : board aggregate time tag
+  //
+  // followed by a channel aggregate for each enabled channel pair:
+  //
+  //   Word[0] : bit[31] set; channel aggregate size [words] in bits[21:0]
+  //   Word[1] : format; DT (dual trace) bit[31], EQ (charge) bit[30],
+  //             EE (extras) bit[28], ES (samples) bit[27], extras
+  //             option bits[26:24], samples/8 in bits[15:0]
+  //
+  // and the events of both channels of the pair in time order:
+  //
+  //   Word[0] : odd channel flag in bit[31]; time tag in bits[30:0]
+  //   samples : two 14-bit samples per word (if ES)
+  //   extras  : extended time tag in bits[31:16] and, for the default
+  //             extras option, baseline*4 in bits[15:0] (if EE)
+  //   charge  : long charge bits[31:16]; pile-up flag bit[15]; short
+  //             charge bits[14:0] (if EQ)
+
+  Arena->Clear();
+
+  if(BoardType != zV1725 and BoardType != zDT5730){
+    if(Verbose)
+      cout << "ADAQDigitizer[" << BoardID << "] : Error! Native DPP-PSD decoding supports only the x725/x730 families!\n"
+	   << endl;
+    return -42;
+  }
+
+  const uint32_t *Words = (const uint32_t *)Buffer;
+  const uint32_t NumWords = BufferSize / sizeof(uint32_t);
+
+  Arena->SetBuffer(Words);
+
+  uint32_t Word = 0;
+
+  while(Word < NumWords){
+
+    const uint32_t *Aggregate = Words + Word;
+
+    if((Aggregate[0] >> 28) != 0xA){
+      if(Verbose)
+	cout << "ADAQDigitizer[" << BoardID << "] : Error! Invalid board aggregate header at word " << Word << "!\n"
+	     << endl;
+      return -42;
+    }
+
+    const uint32_t AggregateSize = Aggregate[0] & 0x0fffffff;
+
+    if(AggregateSize < 4 or Word + AggregateSize > NumWords){
+      if(Verbose)
+	cout << "ADAQDigitizer[" << BoardID << "] : Error! Board aggregate size (" << AggregateSize << " words) overruns the buffer!\n"
+	     << endl;
+      return -42;
+    }
+
+    const uint32_t PairMask = Aggregate[1] & 0xff;
+    const uint32_t End = Word + AggregateSize;
+    uint32_t ChWord = Word + 4;
+
+    for(uint32_t pair=0; pair<8; pair++){
+
+      if(!(PairMask & (1u << pair)))
+	continue;
+
+      const uint32_t ChSize = (ChWord + 2 <= End) ? (Words[ChWord] & 0x003fffff) : 0;
+
+      if(ChSize < 2 or ChWord + ChSize > End){
+	if(Verbose)
+	  cout << "ADAQDigitizer[" << BoardID << "] : Error! Invalid channel aggregate at word " << ChWord << "!\n"
+	       << endl;
+	return -42;
+      }
+
+      const uint32_t Format = Words[ChWord + 1];
+      const uint32_t SampleWords = (Format & (1u << 27)) ? 4 * (Format & 0xffff) : 0;
+      const uint32_t ExtrasWords = (Format >> 28) & 1;
+      const uint32_t ChargeWords = (Format >> 30) & 1;
+      const bool BaselineInExtras = ExtrasWords and ((Format >> 24) & 0x7) == 0;
+
+      const uint32_t EventWords = 1 + SampleWords + ExtrasWords + ChargeWords;
+      const uint32_t ChEnd = ChWord + ChSize;
+
+      // Either channel of the pair may hold every event of the
+      // aggregate; the space is made once for the aggregate and the
+      // events are written through the columns held here
+      const uint32_t MaxEvents = (ChSize - 2) / EventWords;
+      ADAQPSDEventArena::Columns Col[2] = {Arena->Prepare(2*pair, MaxEvents),
+					   Arena->Prepare(2*pair + 1, MaxEvents)};
+      uint32_t N[2] = {0, 0};
+
+      for(uint32_t e=ChWord+2; e+EventWords<=ChEnd; e+=EventWords){
+
+	const uint32_t *Event = Words + e;
+	const uint32_t Extras = ExtrasWords ? Event[1 + SampleWords] : 0;
+	const uint32_t Charge = ChargeWords ? Event[1 + SampleWords + ExtrasWords] : 0;
+
+	const uint32_t Odd = Event[0] >> 31;
+	ADAQPSDEventArena::Columns &C = Col[Odd];
+	const uint32_t n = N[Odd]++;
+
+	C.Format[n] = Format;
+	C.TimeTag[n] = Event[0] & 0x7fffffff;
+	C.ChargeShort[n] = Charge & 0x7fff;
+	C.ChargeLong[n] = Charge >> 16;
+	C.Baseline[n] = BaselineInExtras ? (Extras & 0xffff) / 4 : 0;
+	C.PileUp[n] = (Charge >> 15) & 1;
+	C.Extras[n] = Extras;
+	C.WaveformOffset[n] = SampleWords ? e + 1 : 0;
+      }
+
+      Arena->Commit(2*pair, N[0]);
+      Arena->Commit(2*pair + 1, N[1]);
+      
+      ChWord = ChEnd;
+    }
+    
+    Word += AggregateSize;
+  }
+
+  return 0;
+}
+
+
+int ADAQDigitizer::BuildZLEEventTable(char *Buffer,
+				      uint32_t BufferSize,
+				      ADAQZLEEventTable *Table)
+{
+  // This method indexes all ZLE events in the PC buffer in a single
+  // pass. Each ZLE event consists of the standard 4-word event
+  // header followed, for each enabled channel, by a "size" word (the
+  // number of words for the channel including the size word itself)
+  // and a sequence of control words. A "good" control word is
+  // followed by the number of data words it specifies; a "skip"
+  // control word records suppressed words and is followed directly
+  // by the next control word. Only control words are visited here,
+  // allowing the data words to be hopped over.
+
+  const uint32_t *Words = (const uint32_t *)Buffer;
+  const uint32_t NumWords = BufferSize / sizeof(uint32_t);
+
+  Table->Words = Words;
+  Table->NumEvents = 0;
+  Table->NumChannels = NumChannels;
+
+  uint32_t Word = 0;
+  
+  while(Word + ZLEHeaderSize <= NumWords){
+
+    const uint32_t EventSize = Words[Word] & ZLEEventSizeMask;
+    
+    // Guard against the V1720 firmware garbage event; see the
+    // warning in GetZLEWaveform() for details
+    if(EventSize > ZLEMaxEventSize or (Words[Word] >> 28) != 0xA or
+       EventSize < ZLEHeaderSize or Word + EventSize > NumWords){
+      if(Verbose)
+	cout << "ADAQDigitizer[" << BoardID << "] : Error! Invalid ZLE event (size " << EventSize << " words) at word "
+	     << Word << "! Indexing stopped after " << Table->NumEvents << " events.\n"
+	     << endl;
+      return -42;
+    }
+
+    const uint32_t Event = Table->NumEvents;
+    const uint32_t Mask = (Words[Word+1] & 0xff) | ((Words[Word+2] >> 16) & 0xff00);
+
+    // Grow the table only when required such that it can be reused
+    // for every readout buffer without allocation
+    if(Table->EventStart.size() <= Event){
+      uint32_t Size = max((uint32_t)16, 2*Event);
+      Table->EventStart.resize(Size);
+      Table->EventSize.resize(Size);
+      Table->ChannelMask.resize(Size);
+      Table->TriggerTimeTag.resize(Size);
+      Table->ChannelStart.resize(Size * NumChannels);
+      Table->ChannelSize.resize(Size * NumChannels);
+      Table->NumSamples.resize(Size * NumChannels);
+    }
+
+    Table->EventStart[Event] = Word;
+    Table->EventSize[Event] = EventSize;
+    Table->ChannelMask[Event] = Mask;
+    Table->TriggerTimeTag[Event] = Words[Word+3];
+
+    const uint32_t EventEnd = Word + EventSize;
+    uint32_t ChannelWord = Word + ZLEHeaderSize;
+
+    for(int ch=0; ch<NumChannels; ch++){
+
+      const uint32_t Index = Table->GetIndex(Event, ch);
+
+      Table->ChannelStart[Index] = 0;
+      Table->ChannelSize[Index] = 0;
+      Table->NumSamples[Index] = 0;
+
+      if(!(Mask & (1 << ch)))
+	continue;
+
+      const uint32_t ChannelSize = Words[ChannelWord];
+      if(ChannelSize == 0 or ChannelWord + ChannelSize > EventEnd){
+	if(Verbose)
+	  cout << "ADAQDigitizer[" << BoardID << "] : Error! Invalid ZLE channel size in event " << Event << "!\n"
+	       << endl;
+	return -42;
+      }
+
+      uint32_t Samples = 0;
+      uint32_t Control = ChannelWord + 1;
+      const uint32_t ChannelEnd = ChannelWord + ChannelSize;
+      
+      while(Control < ChannelEnd){
+	if((Words[Control] >> ZLEControlWordBitShift) == ZLEControlWordGoodMask){
+	  uint32_t N = min(Words[Control] & ZLENumWordMask, ChannelEnd - Control - 1);
+	  Samples += 2*N;
+	  Control += N + 1;
+	}
+	else
+	  Control++;
+      }
+
+      Table->ChannelStart[Index] = ChannelWord;
+      Table->ChannelSize[Index] = ChannelSize;
+      Table->NumSamples[Index] = Samples;
+
+      ChannelWord = ChannelEnd;
+    }
+
+    Table->NumEvents++;
+    Word = EventEnd;
+  }
+  
+  return 0;
+}
+
+
+int ADAQDigitizer::DecodeZLEEvent(const ADAQZLEEventTable *Table,
+				  uint32_t Event,
+				  uint32_t Channel,
+				  uint16_t *Samples,
+				  uint32_t MaxSamples,
+				  uint32_t *NumSamples) const
+{
+  // Unpack the stored (non-suppressed) samples of one channel of one
+  // indexed ZLE event into the caller's array, which must hold at
+  // least Table->GetNumSamples(Event, Channel) samples
+
+  *NumSamples = 0;
+
+  if(Event >= Table->NumEvents or Channel >= Table->NumChannels)
+    return -42;
+
+  const uint32_t Index = Table->GetIndex(Event, Channel);
+  
+  if(Table->ChannelStart[Index] == 0)
+    return 0;
+
+  if(Table->NumSamples[Index] > MaxSamples)
+    return -42;
+
+  const uint16_t Mask = (NumADCBits > 0 and NumADCBits < 16) ? ((1u << NumADCBits) - 1) : 0xffff;
+  
+  const uint32_t *Words = Table->Words;
+  const uint32_t ChannelEnd = Table->ChannelStart[Index] + Table->ChannelSize[Index];
+  uint32_t Control = Table->ChannelStart[Index] + 1;
+  uint32_t Sample = 0;
+
+  while(Control < ChannelEnd){
+    if((Words[Control] >> ZLEControlWordBitShift) == ZLEControlWordGoodMask){
+      uint32_t N = min(Words[Control] & ZLENumWordMask, ChannelEnd - Control - 1);
+      UnpackZLE(Words + Control + 1, N, Mask, Samples + Sample);
+      Sample += 2*N;
+      Control += N + 1;
+    }
+    else
+      Control++;
+  }
+
+  *NumSamples = Sample;
+  
+  return 0;
+}
+
+
 /////////////////////
 // Readout methods //
 /////////////////////
@@ -891,24 +1607,34 @@ int ADAQDigitizer::GetChannelBufferStatus(bool *BufferStatus)
   // Channel register addresses and channel-to-channel increment
   uint32_t Start = CAEN_DGTZ_CHANNEL_STATUS_BASE_ADDRESS;
   uint32_t Offset = 0x0100;
+
+  // Skip channels that are not currently enabled
+  uint32_t ChannelEnableMask = 0;
+  CommandStatus = GetChannelEnableMask(&ChannelEnableMask);
+  if(CommandStatus != 0)
+    return CommandStatus;
+
+  vector<int> Channels;
+  vector<uint32_t> Addr32, Data32;
+  for(int ch=0; ch<NumChannels; ch++)
+    if(ChannelEnableMask & (1 << ch)){
+      Channels.push_back(ch);
+      Addr32.push_back(Start + Offset*ch);
+    }
+
+  if(Channels.empty())
+    return CommandStatus;
   
-  for(int ch=0; ch<NumChannels; ch++){
-    
-    uint32_t Addr32 = Start + Offset*ch;
-    uint32_t Data32 = 0;
-    int Status = 0;
-    // Skip channels that are not currently enabled
-    CommandStatus = GetChannelEnableMask(&Data32);
-    if(!(Data32 & (1 << ch)))
-      continue;
-    
-    // Check to see if the 0-th of each channel's status register bit
-    // is set; if any of the channel buffers are full then set the
-    // BufferFull flag to true
-    CommandStatus = CAEN_DGTZ_ReadRegister(BoardHandle, Addr32, &Data32);
-    (Data32 & (1 << 0)) ? BufferStatus[ch] = true : BufferStatus[ch] = false;
-    
-  }
+  // Read all channel status registers in a single transaction
+  Data32.resize(Addr32.size(), 0);
+  CommandStatus = ReadRegisters(Addr32.size(), &Addr32[0], &Data32[0]);
+
+  // Check to see if the 0-th of each channel's status register bit
+  // is set; if any of the channel buffers are full then set the
+  // BufferFull flag to true
+  for(size_t c=0; c<Channels.size(); c++)
+    BufferStatus[Channels[c]] = (Data32[c] & (1 << 0));
+
   return CommandStatus;
 }
 
@@ -945,7 +1671,7 @@ int ADAQDigitizer::GetSTDBufferLevel(double &BufferLevel)
   uint32_t Addr32 = CAEN_DGTZ_BROAD_NUM_BLOCK_ADD;
   uint32_t Data32 = 0;
   
-  CommandStatus = CAEN_DGTZ_ReadRegister(BoardHandle, Addr32, &Data32);
+  CommandStatus = GetRegisterValue(Addr32, &Data32);
   uint32_t MemoryBlocks = BlockSizeMap.at(Data32);
   
   // Get the number of filled blocks (i.e. events) waiting in the FPGA
@@ -955,7 +1681,7 @@ int ADAQDigitizer::GetSTDBufferLevel(double &BufferLevel)
   Addr32 = CAEN_DGTZ_EVENT_STORED_ADD;
   Data32 = 0;
   
-  CommandStatus = CAEN_DGTZ_ReadRegister(BoardHandle, Addr32, &Data32);
+  CommandStatus = GetRegisterValue(Addr32, &Data32);
 
   BufferLevel = Data32 * 1. / MemoryBlocks;
   
@@ -968,7 +1694,7 @@ int ADAQDigitizer::GetPSDBufferLevel(double &BufferLevel)
   uint32_t Addr32 = CAEN_DGTZ_ACQ_STATUS_ADD;
   uint32_t Data32 = 0;
 
-  CommandStatus = CAEN_DGTZ_ReadRegister(BoardHandle, Addr32, &Data32);
+  CommandStatus = GetRegisterValue(Addr32, &Data32);
 
   bitset<32> Data32Bitset(Data32);
   
@@ -0,0 +1,1293 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQEmulatedDigitizer.cc
+// date: 16 Oct 26
+//
+// desc: ADAQEmulatedDigitizer is a software stand-in for a CAEN
+//       digitizer and the CAENDigitizer library. See the header file
+//       for a full description.
+//
+//       The synthetic events follow the CAEN STD firmware event
+//       format for the x720/x724/x725/x730 families:
+//
+//         Word[0] : 0xA in bits[31:28]; event size [words] in bits[27:0]
+//         Word[1] : board ID in bits[31:27]; channel mask[7:0] in bits[7:0]
+//         Word[2] : channel mask[15:8] in bits[31:24]; event counter in bits[23:0]
+//         Word[3] : trigger time tag
+//
+//       followed by RecordLength/2 words per enabled channel, each
+//       word holding two samples (earlier sample in bits[15:0]).
+//
+//       With ZLE zero suppression, each enabled channel is instead a
+//       size word (the channel's words including itself) followed by
+//       alternating control words: a "good" word (0b11 in bits[31:30];
+//       number of words in bits[19:0]) followed by that many sample
+//       words, or a "skip" word (0b01 in bits[31:30]) with the number
+//       of suppressed words. A sample word is stored if it or one of
+//       the NBackward words after or NForward words before it holds a
+//       sample beyond the threshold: below it for negative logic,
+//       above it for positive logic. The samples themselves are those
+//       of the unsuppressed event, such that an emulator with the same
+//       seed generates identical samples in both modes.
+//
+//       In DPP-PSD mode, each block transfer is a single x725/x730
+//       board aggregate (see ADAQDigitizer::DecodePSDBuffer() for the
+//       format) with one channel aggregate per enabled channel pair.
+//       Events carry the samples, an extras word (extended time tag
+//       and baseline*4), and the short/long charges integrated over
+//       the emulated pulse.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+using namespace std;
+
+// Boost
+#include <boost/thread.hpp>
+
+// ADAQ
+#include "ADAQEmulatedDigitizer.hh"
+
+
+ADAQEmulatedDigitizer::ADAQEmulatedDigitizer(ZBoardType Type, // ADAQ-specific device type identifier
+					     int ID,          // ADAQ-specific user-specified ID
+					     uint32_t Address,// Unused; kept for interface parity
+					     int LN,          // Link number; groups boards in ADAQReadoutEngine
+					     int CN)          // Unused; kept for interface parity
+  : ADAQDigitizer(Type, ID, Address, LN, CN),
+    AcquisitionRunning(false), IRQEnabled(false), IRQEventNumber(1), TriggerRate(1000.), LinkBandwidth(0.), MemoryBlocks(1024),
+    ChannelEnableMask(0), EmulatedRecordLength(512), MaxNumEventsBLT(1), EmulatedZSMode(CAEN_DGTZ_ZS_NO),
+    EmulatedFirmwareType("STD"), EventsPerAggregate(64), MaxNumAggregatesBLT(1), DPPTimeTag(0), DPPEventCapacity(0),
+    PendingEvents(0), TriggeredEvents(0), GeneratedEvents(0), LostEvents(0),
+    EventCounter(0), TriggerTimeTag(0),
+    RandomState(0x9e3779b97f4a7c15ULL)
+{;}
+
+
+ADAQEmulatedDigitizer::~ADAQEmulatedDigitizer()
+{
+  map<char *, uint32_t>::iterator It = BufferSizes.begin();
+  for(; It!=BufferSizes.end(); It++)
+    delete [] It->first;
+}
+
+
+int ADAQEmulatedDigitizer::OpenLink()
+{
+  CommandStatus = -42;
+
+  if(LinkEstablished){
+    if(Verbose)
+      std::cout << "ADAQEmulatedDigitizer[" << BoardID << "] : Error opening link! Link is already open!"
+		<< std::endl;
+    return CommandStatus;
+  }
+
+  switch(BoardType){
+
+  case zV1720:
+    BoardModelName = "V1720"; NumChannels = 8; NumADCBits = 12;
+    break;
+
+  case zV1724:
+    BoardModelName = "V1724"; NumChannels = 8; NumADCBits = 14;
+    break;
+
+  case zV1725:
+    BoardModelName = "V1725"; NumChannels = 16; NumADCBits = 14;
+    break;
+
+  case zDT5720:
+    BoardModelName = "DT5720"; NumChannels = 4; NumADCBits = 12;
+    break;
+
+  case zDT5730:
+    BoardModelName = "DT5730"; NumChannels = 8; NumADCBits = 14;
+    break;
+
+  case zDT5790M:
+  case zDT5790N:
+  case zDT5790P:
+    BoardModelName = "DT5790"; NumChannels = 2; NumADCBits = 12;
+    break;
+
+  default:
+    if(Verbose)
+      std::cout << "ADAQEmulatedDigitizer[" << BoardID << "] : Error opening link! Board type is not a digitizer!"
+		<< std::endl;
+    return CommandStatus;
+  }
+
+  const bool PSD = (EmulatedFirmwareType == "PSD");
+
+  if(PSD and BoardType != zV1725 and BoardType != zDT5730){
+    if(Verbose)
+      std::cout << "ADAQEmulatedDigitizer[" << BoardID << "] : Error opening link! DPP-PSD is only emulated for the x725/x730 families!"
+		<< std::endl;
+    return CommandStatus;
+  }
+
+  BoardSerialNumber = 0;
+  BoardROCFirmwareRevision = "emulated";
+  BoardAMCFirmwareRevision = "0.0";
+  BoardFirmwareCode = PSD ? V1730_DPP_PSD_CODE : STANDARD_FW_CODE;
+  BoardFirmwareType = EmulatedFirmwareType;
+
+  MinADCBit = 0;
+  MaxADCBit = pow(2, NumADCBits);
+  SamplingRate = SamplingRateMap[BoardType];
+  TimeStampSize = TimeStampSizeMap[BoardType];
+  TimeStampUnit = TimeStampUnitMap[BoardType];
+
+  // As for the hardware, the DPP-PSD firmware alters the time stamp
+  // resolution; the time tag is 31 bits in the event words
+  if(PSD){
+    TimeStampUnit = (BoardType == zV1725) ? 4 : 2;
+    TimeStampSize = 31;
+  }
+
+  BoardHandle = BoardID;
+  LinkEstablished = true;
+  InvalidateRegisterCache();
+  CommandStatus = 0;
+
+  if(Verbose)
+    std::cout << "ADAQEmulatedDigitizer[" << BoardID << "] : Emulated link successfully established!\n"
+	      << "--> Type           : " << BoardModelName << " (emulated)\n"
+	      << "--> Channels       : " << NumChannels << "\n"
+	      << "--> ADC bits       : " << NumADCBits << "\n"
+	      << "--> Dgtz rate      : " << SamplingRate << " MS/s\n"
+	      << "--> Time stamp size: " << TimeStampSize << " bits\n"
+	      << "--> Time stamp unit: " << TimeStampUnit << " ns\n"
+	      << "--> FW Type        : " << BoardFirmwareType << "\n"
+	      << "--> Trigger rate   : " << TriggerRate << " Hz\n"
+	      << "--> User ID        : " << BoardID << "\n"
+	      << std::endl;
+
+  return CommandStatus;
+}
+
+
+int ADAQEmulatedDigitizer::CloseLink()
+{
+  CommandStatus = -42;
+
+  if(LinkEstablished){
+    AcquisitionRunning = false;
+    LinkEstablished = false;
+    InvalidateRegisterCache();
+    CommandStatus = 0;
+
+    if(Verbose)
+      std::cout << "ADAQEmulatedDigitizer[" << BoardID << "] : Emulated link successfully closed!\n"
+		<< std::endl;
+  }
+  else
+    if(Verbose)
+      std::cout << "ADAQEmulatedDigitizer[" << BoardID << "] : Error closing link! Link is already closed!\n"
+		<< std::endl;
+
+  return CommandStatus;
+}
+
+
+int ADAQEmulatedDigitizer::SetFirmwareType(string Type)
+{
+  if(LinkEstablished or (Type != "STD" and Type != "PSD")){
+    if(Verbose)
+      std::cout << "ADAQEmulatedDigitizer[" << BoardID << "] : Error! The firmware type must be \"STD\" or \"PSD\" and set before the link is opened!"
+		<< std::endl;
+    return -42;
+  }
+
+  EmulatedFirmwareType = Type;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::Initialize()
+{
+  Registers.clear();
+  InvalidateRegisterCache();
+  CommandStatus = 0;
+  return CommandStatus;
+}
+
+
+int ADAQEmulatedDigitizer::ReadRegisters(uint32_t N, uint32_t *Addr32, uint32_t *Data32)
+{
+  RegisterTransactions++;
+
+  for(uint32_t r=0; r<N; r++){
+    if(Addr32[r] == CAEN_DGTZ_EVENT_STORED_ADD){
+      GetNumFPGAEvents(&Data32[r]);
+      continue;
+    }
+    Data32[r] = GetEmulatedRegister(Addr32[r]);
+  }
+
+  RegisterErrors.assign(N, 0);
+  CommandStatus = 0;
+  return CommandStatus;
+}
+
+
+int ADAQEmulatedDigitizer::WriteRegisters(uint32_t N, uint32_t *Addr32, uint32_t *Data32)
+{
+  RegisterTransactions++;
+
+  for(uint32_t r=0; r<N; r++)
+    Registers[Addr32[r]] = Data32[r];
+
+  RegisterErrors.assign(N, 0);
+  CommandStatus = 0;
+  return CommandStatus;
+}
+
+
+int ADAQEmulatedDigitizer::SendSWTrigger()
+{
+  boost::mutex::scoped_lock Lock(EmulatorMutex);
+
+  if(!AcquisitionRunning)
+    return -42;
+
+  if(PendingEvents < MemoryBlocks)
+    PendingEvents++;
+  else
+    LostEvents++;
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SetChannelEnableMask(uint32_t CEM)
+{
+  ChannelEnableMask = CEM & ((1 << NumChannels) - 1);
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetChannelEnableMask(uint32_t *CEM)
+{
+  *CEM = ChannelEnableMask;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SWStartAcquisition()
+{
+  boost::mutex::scoped_lock Lock(EmulatorMutex);
+
+  if(!LinkEstablished)
+    return -42;
+
+  BuildPulseTemplate();
+
+  // The ZLE settings are fixed for the acquisition
+  ZLEThresholdRegisters.assign(NumChannels, 0);
+  ZLENSampleRegisters.assign(NumChannels, 0);
+  for(int ch=0; ch<NumChannels; ch++){
+    ZLEThresholdRegisters[ch] = GetEmulatedRegister(CAEN_DGTZ_CHANNEL_ZS_THRESHOLD_BASE_ADDRESS + 0x100*ch);
+    ZLENSampleRegisters[ch] = GetEmulatedRegister(CAEN_DGTZ_CHANNEL_ZS_NSAMPLE_BASE_ADDRESS + 0x100*ch);
+  }
+  ZLEChannelWords.assign(EmulatedRecordLength / 2, 0);
+  ZLEFlags.assign(EmulatedRecordLength / 2, 0);
+
+  PendingEvents = 0;
+  TriggeredEvents = GeneratedEvents = LostEvents = 0;
+  EventCounter = TriggerTimeTag = 0;
+  DPPTimeTag = 0;
+
+  StartTime = chrono::steady_clock::now();
+  AcquisitionRunning = true;
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SWStopAcquisition()
+{
+  boost::mutex::scoped_lock Lock(EmulatorMutex);
+  AcquisitionRunning = false;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SetRecordLength(uint32_t Length)
+{
+  // Two samples are packed into each 32-bit word so the record length
+  // is rounded up to the nearest even number of samples; the DPP-PSD
+  // firmware stores the record length in units of 8 samples
+  if(EmulatedFirmwareType == "PSD")
+    EmulatedRecordLength = Length + (8 - Length % 8) % 8;
+  else
+    EmulatedRecordLength = Length + (Length % 2);
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetRecordLength(uint32_t *Length)
+{
+  *Length = EmulatedRecordLength;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::ClearData()
+{
+  boost::mutex::scoped_lock Lock(EmulatorMutex);
+  PendingEvents = 0;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::ReadData(char *Buffer, uint32_t *BufferSize)
+{
+  *BufferSize = 0;
+
+  {
+    boost::mutex::scoped_lock Lock(EmulatorMutex);
+    
+    if(!AcquisitionRunning)
+      return 0;
+    
+    UpdatePendingEvents();
+    
+    if(PendingEvents == 0)
+      return 0;
+    
+    // Never write past the end of the PC buffer; buffers that were not
+    // obtained from MallocReadoutBuffer() are assumed to be large
+    // enough for a full block transfer
+    
+    // A DPP-PSD block transfer holds up to MaxNumAggregatesBLT board
+    // aggregates of EventsPerAggregate events each
+
+    const bool PSD = (EmulatedFirmwareType == "PSD");
+    const uint32_t EventsPerTransfer = PSD ? MaxNumAggregatesBLT * EventsPerAggregate : MaxNumEventsBLT;
+
+    uint32_t EventBytes = GetEventWords() * sizeof(uint32_t);
+    uint32_t Overhead = PSD ? MaxNumAggregatesBLT * GetPSDAggregateWords(0) * sizeof(uint32_t) : 0;
+    uint32_t Capacity = Overhead + EventsPerTransfer * EventBytes;
+    
+    map<char *, uint32_t>::iterator It = BufferSizes.find(Buffer);
+    if(It != BufferSizes.end())
+      Capacity = It->second;
+    
+    uint32_t NumEvents = min(PendingEvents, EventsPerTransfer);
+    NumEvents = (Capacity > Overhead) ? min(NumEvents, (Capacity - Overhead) / EventBytes) : 0;
+    
+    uint32_t Words = 0;
+    if(PSD)
+      for(uint32_t Done=0; Done<NumEvents; Done+=EventsPerAggregate)
+	Words += GeneratePSDAggregate((uint32_t *)Buffer + Words, min(EventsPerAggregate, NumEvents - Done));
+    else
+      Words = GenerateEvents((uint32_t *)Buffer, NumEvents);
+    
+    PendingEvents -= NumEvents;
+    *BufferSize = Words * sizeof(uint32_t);
+  }
+
+  // Emulate the transfer time over the link outside of the lock such
+  // that triggers continue to arrive during the transfer
+  if(LinkBandwidth > 0.)
+    boost::this_thread::sleep(boost::posix_time::microseconds((int64_t)(*BufferSize / LinkBandwidth)));
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SetMaxNumEventsBLT(uint32_t NumEvents)
+{
+  MaxNumEventsBLT = max(NumEvents, (uint32_t)1);
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetMaxNumEventsBLT(uint32_t *NumEvents)
+{
+  *NumEvents = MaxNumEventsBLT;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SetDPPEventAggregation(int Threshold, int)
+{
+  // As for the hardware, zero lets the firmware choose; the emulator
+  // then uses its default
+  EventsPerAggregate = (Threshold > 0) ? Threshold : 64;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SetMaxNumAggregatesBLT(uint32_t NumAggregates)
+{
+  boost::mutex::scoped_lock Lock(EmulatorMutex);
+  MaxNumAggregatesBLT = max(NumAggregates, (uint32_t)1);
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetMaxNumAggregatesBLT(uint32_t *NumAggregates)
+{
+  *NumAggregates = MaxNumAggregatesBLT;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::MallocReadoutBuffer(char **Buffer, uint32_t *Size)
+{
+  // Size the buffer for a full block transfer with all channels
+  // enabled so that the channel mask may change after allocation
+
+  if(EmulatedFirmwareType == "PSD")
+    *Size = MaxNumAggregatesBLT * GetPSDAggregateWords(EventsPerAggregate) * sizeof(uint32_t);
+  else{
+    // A ZLE channel holds at most a size word and a control word for
+    // every sample word
+    uint32_t ChannelWords = EmulatedRecordLength / 2;
+    if(EmulatedZSMode == CAEN_DGTZ_ZS_ZLE)
+      ChannelWords = 1 + 2 * ChannelWords;
+
+    uint32_t EventWords = 4 + NumChannels * ChannelWords;
+    *Size = MaxNumEventsBLT * EventWords * sizeof(uint32_t);
+  }
+
+  *Buffer = new char[*Size];
+  BufferSizes[*Buffer] = *Size;
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::FreeReadoutBuffer(char **Buffer)
+{
+  if(*Buffer == NULL)
+    return 0;
+
+  map<char *, uint32_t>::iterator It = BufferSizes.find(*Buffer);
+  if(It == BufferSizes.end())
+    return -42;
+
+  BufferSizes.erase(It);
+  delete [] *Buffer;
+  *Buffer = NULL;
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetNumFPGAEvents(uint32_t *Data32)
+{
+  boost::mutex::scoped_lock Lock(EmulatorMutex);
+
+  if(AcquisitionRunning)
+    UpdatePendingEvents();
+
+  *Data32 = PendingEvents;
+
+  CommandStatus = 0;
+  return CommandStatus;
+}
+
+
+void ADAQEmulatedDigitizer::SetTriggerRate(double Rate)
+{
+  boost::mutex::scoped_lock Lock(EmulatorMutex);
+
+  // If acquiring, account for the triggers at the old rate and then
+  // restart the trigger clock such that the new rate applies from now
+  if(AcquisitionRunning){
+    UpdatePendingEvents();
+    StartTime = chrono::steady_clock::now();
+    TriggeredEvents = 0;
+  }
+
+  TriggerRate = Rate;
+}
+
+
+int ADAQEmulatedDigitizer::GetSTDBufferLevel(double &BufferLevel)
+{
+  uint32_t Events = 0;
+  GetNumFPGAEvents(&Events);
+  BufferLevel = Events * 1. / MemoryBlocks;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetPSDBufferLevel(double &BufferLevel)
+{
+  // As for the DPP-PSD firmware only a full/not full state is provided
+  uint32_t Events = 0;
+  GetNumFPGAEvents(&Events);
+  BufferLevel = (Events >= MemoryBlocks) ? 1. : 0.;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SetZeroSuppressionMode(uint32_t Mode)
+{
+  if(EmulatedFirmwareType != "STD" or (Mode != CAEN_DGTZ_ZS_NO and Mode != CAEN_DGTZ_ZS_ZLE)){
+    if(Verbose)
+      std::cout << "ADAQEmulatedDigitizer[" << BoardID << "] : Error! Only ZLE zero suppression of the STD firmware is emulated!"
+		<< std::endl;
+    return -42;
+  }
+
+  boost::mutex::scoped_lock Lock(EmulatorMutex);
+  EmulatedZSMode = Mode;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetZeroSuppressionMode(uint32_t *Mode)
+{
+  *Mode = EmulatedZSMode;
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SetChannelZSParams(uint32_t Channel, uint32_t Weight,
+					      int32_t Threshold, int32_t)
+{
+  if(Channel >= (uint32_t)NumChannels)
+    return -42;
+
+  // The threshold is held in the ADC bits of 0x1n24 and the weight in
+  // bit[30]; the logic in bit[31] is kept. The number of samples is
+  // not used by ZLE, whose samples are set in 0x1n28 directly
+  const uint32_t Addr32 = CAEN_DGTZ_CHANNEL_ZS_THRESHOLD_BASE_ADDRESS + 0x100*Channel;
+  InvalidateRegister(Addr32);
+
+  uint32_t Data32 = GetEmulatedRegister(Addr32) & (1u << 31);
+  Data32 |= (Weight == CAEN_DGTZ_ZS_COARSE) ? (1u << 30) : 0;
+  Data32 |= (uint32_t)Threshold & (MaxADCBit - 1);
+  Registers[Addr32] = Data32;
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetChannelZSParams(uint32_t Channel, uint32_t *Weight,
+					      int32_t *Threshold, int32_t *NSamp)
+{
+  if(Channel >= (uint32_t)NumChannels)
+    return -42;
+
+  const uint32_t Data32 = GetEmulatedRegister(CAEN_DGTZ_CHANNEL_ZS_THRESHOLD_BASE_ADDRESS + 0x100*Channel);
+  *Weight = (Data32 >> 30) & 1;
+  *Threshold = Data32 & (MaxADCBit - 1);
+  *NSamp = GetEmulatedRegister(CAEN_DGTZ_CHANNEL_ZS_NSAMPLE_BASE_ADDRESS + 0x100*Channel);
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::SetInterruptConfig(CAEN_DGTZ_EnaDis_t State, uint8_t, uint32_t,
+					      uint16_t EventNumber, CAEN_DGTZ_IRQMode_t)
+{
+  boost::mutex::scoped_lock Lock(EmulatorMutex);
+
+  IRQEnabled = (State == CAEN_DGTZ_ENABLE);
+  IRQEventNumber = max(EventNumber, (uint16_t)1);
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::IRQWait(int, uint32_t Timeout)
+{
+  // Block until the interrupt condition (IRQEventNumber events in the
+  // FPGA memory) is met or "Timeout" [ms] has elapsed. Rather than
+  // polling, the thread sleeps until the next events are expected.
+
+  if(!IRQEnabled)
+    return CAEN_DGTZ_InterruptNotConfigured;
+
+  chrono::steady_clock::time_point Deadline = chrono::steady_clock::now() + chrono::milliseconds(Timeout);
+
+  while(true){
+
+    double Wait = 0.; // [s]
+    {
+      boost::mutex::scoped_lock Lock(EmulatorMutex);
+      
+      if(AcquisitionRunning){
+	UpdatePendingEvents();
+	if(PendingEvents >= min(IRQEventNumber, MemoryBlocks))
+	  return 0;
+      }
+      
+      if(AcquisitionRunning and TriggerRate > 0.)
+	Wait = (min(IRQEventNumber, MemoryBlocks) - PendingEvents) / TriggerRate;
+      else
+	Wait = 1e-3;
+    }
+
+    chrono::steady_clock::time_point Now = chrono::steady_clock::now();
+    if(Now >= Deadline)
+      return CAEN_DGTZ_Timeout;
+    
+    double Remaining = chrono::duration<double>(Deadline - Now).count();
+    int64_t Sleep = (int64_t)(1e6 * min(max(Wait, 50e-6), Remaining));
+    boost::this_thread::sleep(boost::posix_time::microseconds(Sleep));
+  }
+}
+
+
+int ADAQEmulatedDigitizer::RearmInterrupt(int)
+{
+  return IRQEnabled ? 0 : CAEN_DGTZ_InterruptNotConfigured;
+}
+
+
+int ADAQEmulatedDigitizer::AllocateEvent(CAEN_DGTZ_UINT16_EVENT_t **Evt)
+{
+  *Evt = (CAEN_DGTZ_UINT16_EVENT_t *)calloc(1, sizeof(CAEN_DGTZ_UINT16_EVENT_t));
+  return (*Evt) ? 0 : -42;
+}
+
+
+int ADAQEmulatedDigitizer::DecodeEvent(char *EventPtr, CAEN_DGTZ_UINT16_EVENT_t **Evt)
+{
+  if(*Evt == NULL and AllocateEvent(Evt) != 0)
+    return -42;
+
+  const uint32_t *Words = (const uint32_t *)EventPtr;
+  const uint32_t EventSize = Words[0] & 0x0fffffff;
+  const uint32_t Mask = (Words[1] & 0xff) | ((Words[2] >> 16) & 0xff00);
+  const uint32_t SampleMask = (1u << NumADCBits) - 1;
+
+  int NumEnabled = 0;
+  for(int ch=0; ch<NumChannels; ch++)
+    if(Mask & (1 << ch))
+      NumEnabled++;
+
+  const uint32_t ChannelWords = (NumEnabled > 0) ? (EventSize - 4) / NumEnabled : 0;
+  const uint32_t *Data = Words + 4;
+
+  for(int ch=0; ch<NumChannels; ch++){
+
+    free((*Evt)->DataChannel[ch]);
+    (*Evt)->DataChannel[ch] = NULL;
+    (*Evt)->ChSize[ch] = 0;
+
+    if(!(Mask & (1 << ch)))
+      continue;
+
+    (*Evt)->ChSize[ch] = 2 * ChannelWords;
+    (*Evt)->DataChannel[ch] = (uint16_t *)malloc(2 * ChannelWords * sizeof(uint16_t));
+
+    for(uint32_t w=0; w<ChannelWords; w++){
+      (*Evt)->DataChannel[ch][2*w] = Data[w] & SampleMask;
+      (*Evt)->DataChannel[ch][2*w + 1] = (Data[w] >> 16) & SampleMask;
+    }
+    Data += ChannelWords;
+  }
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::FreeEvent(CAEN_DGTZ_UINT16_EVENT_t **Evt)
+{
+  if(*Evt == NULL)
+    return 0;
+
+  for(int ch=0; ch<MAX_UINT16_CHANNEL_SIZE; ch++)
+    free((*Evt)->DataChannel[ch]);
+  free(*Evt);
+  *Evt = NULL;
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetNumEvents(char *Buffer, uint32_t BufferSize, uint32_t *NumEvents)
+{
+  const uint32_t *Words = (const uint32_t *)Buffer;
+  const uint32_t NumWords = BufferSize / sizeof(uint32_t);
+
+  *NumEvents = 0;
+
+  uint32_t Word = 0;
+  while(Word < NumWords and (Words[Word] >> 28) == 0xA){
+    uint32_t EventSize = Words[Word] & 0x0fffffff;
+    if(EventSize == 0)
+      break;
+    Word += EventSize;
+    (*NumEvents)++;
+  }
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetEventInfo(char *Buffer, uint32_t BufferSize, uint32_t NumEvent,
+					CAEN_DGTZ_EventInfo_t *EventInfo, char **EventPtr)
+{
+  const uint32_t *Words = (const uint32_t *)Buffer;
+  const uint32_t NumWords = BufferSize / sizeof(uint32_t);
+
+  uint32_t Word = 0;
+  for(uint32_t evt=0; evt<NumEvent; evt++){
+    if(Word >= NumWords or (Words[Word] >> 28) != 0xA)
+      return -42;
+    Word += Words[Word] & 0x0fffffff;
+  }
+
+  if(Word + 4 > NumWords or (Words[Word] >> 28) != 0xA)
+    return -42;
+
+  const uint32_t *Event = Words + Word;
+
+  EventInfo->EventSize = (Event[0] & 0x0fffffff) * sizeof(uint32_t);
+  EventInfo->BoardId = Event[1] >> 27;
+  EventInfo->Pattern = (Event[1] >> 8) & 0xffff;
+  EventInfo->ChannelMask = (Event[1] & 0xff) | ((Event[2] >> 16) & 0xff00);
+  EventInfo->EventCounter = Event[2] & 0x00ffffff;
+  EventInfo->TriggerTimeTag = Event[3];
+
+  *EventPtr = (char *)Event;
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::MallocDPPEvents(CAEN_DGTZ_DPP_PSD_Event_t **Events, uint32_t *Size)
+{
+  // Every event in the emulated FPGA memory may belong to the same
+  // channel, so each channel array holds a full memory of events
+  DPPEventCapacity = MemoryBlocks;
+
+  for(int ch=0; ch<NumChannels; ch++){
+    Events[ch] = (CAEN_DGTZ_DPP_PSD_Event_t *)malloc(DPPEventCapacity * sizeof(CAEN_DGTZ_DPP_PSD_Event_t));
+    if(Events[ch] == NULL)
+      return -42;
+  }
+  *Size = NumChannels * DPPEventCapacity * sizeof(CAEN_DGTZ_DPP_PSD_Event_t);
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::FreeDPPEvents(void **Events)
+{
+  for(int ch=0; ch<NumChannels; ch++){
+    free(Events[ch]);
+    Events[ch] = NULL;
+  }
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::MallocDPPWaveforms(CAEN_DGTZ_DPP_PSD_Waveforms_t **Waveforms, uint32_t *Size)
+{
+  // As for the CAENDigitizer library, the waveform arrays are sized
+  // for the present record length
+  const uint32_t Samples = EmulatedRecordLength;
+
+  *Waveforms = (CAEN_DGTZ_DPP_PSD_Waveforms_t *)calloc(1, sizeof(CAEN_DGTZ_DPP_PSD_Waveforms_t));
+  if(*Waveforms == NULL)
+    return -42;
+
+  (*Waveforms)->Trace1 = (uint16_t *)malloc(Samples * sizeof(uint16_t));
+  (*Waveforms)->Trace2 = (uint16_t *)malloc(Samples * sizeof(uint16_t));
+  (*Waveforms)->DTrace1 = (uint8_t *)malloc(Samples);
+  (*Waveforms)->DTrace2 = (uint8_t *)malloc(Samples);
+
+  *Size = sizeof(CAEN_DGTZ_DPP_PSD_Waveforms_t) + Samples * 2 * (sizeof(uint16_t) + 1);
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::FreeDPPWaveforms(void *Ptr)
+{
+  CAEN_DGTZ_DPP_PSD_Waveforms_t *Waveforms = (CAEN_DGTZ_DPP_PSD_Waveforms_t *)Ptr;
+  if(Waveforms == NULL)
+    return 0;
+
+  free(Waveforms->Trace1);
+  free(Waveforms->Trace2);
+  free(Waveforms->DTrace1);
+  free(Waveforms->DTrace2);
+  free(Waveforms);
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::GetDPPEvents(char *Buffer, uint32_t BufferSize,
+					CAEN_DGTZ_DPP_PSD_Event_t **Events, uint32_t *NumEventsArray)
+{
+  // Fills one CAEN_DGTZ_DPP_PSD_Event_t per event into the channel
+  // arrays as the CAENDigitizer library does; the "Waveforms" member
+  // points to the samples in the PC buffer for DecodeDPPWaveforms()
+
+  const uint32_t *Words = (const uint32_t *)Buffer;
+  const uint32_t NumWords = BufferSize / sizeof(uint32_t);
+
+  for(int ch=0; ch<NumChannels; ch++)
+    NumEventsArray[ch] = 0;
+
+  uint32_t Word = 0;
+  while(Word + 4 <= NumWords and (Words[Word] >> 28) == 0xA){
+
+    const uint32_t AggregateSize = Words[Word] & 0x0fffffff;
+    if(AggregateSize < 4 or Word + AggregateSize > NumWords)
+      return -42;
+
+    const uint32_t PairMask = Words[Word + 1] & 0xff;
+    uint32_t ChWord = Word + 4;
+
+    for(int pair=0; pair<NumChannels/2; pair++){
+
+      if(!(PairMask & (1 << pair)))
+	continue;
+
+      const uint32_t ChSize = Words[ChWord] & 0x003fffff;
+      const uint32_t Format = Words[ChWord + 1];
+      const uint32_t SampleWords = (Format & (1u << 27)) ? 4 * (Format & 0xffff) : 0;
+      const uint32_t ExtrasWords = (Format >> 28) & 1;
+      const uint32_t ChargeWords = (Format >> 30) & 1;
+      const uint32_t EventWords = 1 + SampleWords + ExtrasWords + ChargeWords;
+
+      for(uint32_t e=ChWord+2; e+EventWords<=ChWord+ChSize; e+=EventWords){
+
+	const uint32_t *Event = Words + e;
+	const int Channel = 2*pair + (Event[0] >> 31);
+
+	if(NumEventsArray[Channel] >= DPPEventCapacity)
+	  return -42;
+
+	CAEN_DGTZ_DPP_PSD_Event_t &Evt = Events[Channel][NumEventsArray[Channel]++];
+
+	const uint32_t Extras = ExtrasWords ? Event[1 + SampleWords] : 0;
+	const uint32_t Charge = ChargeWords ? Event[1 + SampleWords + ExtrasWords] : 0;
+
+	Evt.Format = Format;
+	Evt.Format2 = 0;
+	Evt.TimeTag = Event[0] & 0x7fffffff;
+	Evt.ChargeShort = Charge & 0x7fff;
+	Evt.ChargeLong = Charge >> 16;
+	Evt.Baseline = (ExtrasWords and ((Format >> 24) & 0x7) == 0) ? (Extras & 0xffff) / 4 : 0;
+	Evt.Pur = (Charge >> 15) & 1;
+	Evt.Waveforms = (uint32_t *)Event;
+	Evt.Extras = Extras;
+      }
+      ChWord += ChSize;
+    }
+    Word += AggregateSize;
+  }
+
+  return 0;
+}
+
+
+int ADAQEmulatedDigitizer::DecodeDPPWaveforms(void *Ptr, CAEN_DGTZ_DPP_PSD_Waveforms_t *Waveforms)
+{
+  // Decodes the analog trace(s) and the two digital probes of one
+  // event into the waveform structure
+
+  const CAEN_DGTZ_DPP_PSD_Event_t *Event = (const CAEN_DGTZ_DPP_PSD_Event_t *)Ptr;
+  const uint32_t Format = Event->Format;
+  const uint32_t *Data = Event->Waveforms + 1;
+
+  Waveforms->Ns = 0;
+  Waveforms->dualTrace = (Format >> 31) & 1;
+  Waveforms->anlgProbe = (Format >> 22) & 0x3;
+  Waveforms->dgtProbe1 = (Format >> 16) & 0x7;
+  Waveforms->dgtProbe2 = (Format >> 19) & 0x7;
+
+  if(!(Format & (1u << 27)))
+    return 0;
+
+  const uint32_t Samples = 8 * (Format & 0xffff);
+  if(Samples > EmulatedRecordLength)
+    return -42;
+
+  for(uint32_t w=0; w<Samples/2; w++){
+    for(int s=0; s<2; s++){
+      const uint32_t Half = Data[w] >> (16*s);
+      const uint32_t i = 2*w + s;
+
+      if(Waveforms->dualTrace){
+	// Samples alternate between the two analog traces; each is
+	// held for two samples such that both span the full record
+	uint16_t *Trace = s ? Waveforms->Trace2 : Waveforms->Trace1;
+	Trace[2*w] = Trace[2*w + 1] = Half & 0x3fff;
+      }
+      else
+	Waveforms->Trace1[i] = Half & 0x3fff;
+
+      Waveforms->DTrace1[i] = (Half >> 14) & 1;
+      Waveforms->DTrace2[i] = (Half >> 15) & 1;
+    }
+  }
+  Waveforms->Ns = Samples;
+
+  return 0;
+}
+
+
+uint32_t ADAQEmulatedDigitizer::UpdatePendingEvents()
+{
+  // In "as fast as possible" mode the FPGA memory is always full
+  if(TriggerRate <= 0.){
+    PendingEvents = MemoryBlocks;
+    return PendingEvents;
+  }
+
+  // Otherwise, the number of triggers since the start of acquisition
+  // is set by the wall clock; triggers that arrive while the FPGA
+  // memory is full are lost, emulating buffer-full dead time
+
+  chrono::duration<double> Elapsed = chrono::steady_clock::now() - StartTime;
+  uint64_t Expected = (uint64_t)(Elapsed.count() * TriggerRate);
+
+  if(Expected > TriggeredEvents){
+    uint64_t NewEvents = Expected - TriggeredEvents;
+    TriggeredEvents = Expected;
+
+    uint64_t Free = MemoryBlocks - PendingEvents;
+    if(NewEvents > Free){
+      LostEvents += NewEvents - Free;
+      NewEvents = Free;
+    }
+    PendingEvents += NewEvents;
+  }
+
+  return PendingEvents;
+}
+
+
+uint32_t ADAQEmulatedDigitizer::GetEventWords()
+{
+  // A DPP-PSD event is one channel: the time tag, the samples, the
+  // extras and the charge words
+  if(EmulatedFirmwareType == "PSD")
+    return 3 + EmulatedRecordLength / 2;
+
+  int NumEnabled = 0;
+  for(int ch=0; ch<NumChannels; ch++)
+    if(ChannelEnableMask & (1 << ch))
+      NumEnabled++;
+
+  // ZLE events vary in size; this is the largest
+  if(EmulatedZSMode == CAEN_DGTZ_ZS_ZLE)
+    return 4 + NumEnabled * (1 + 2 * (EmulatedRecordLength / 2));
+
+  return 4 + NumEnabled * (EmulatedRecordLength / 2);
+}
+
+
+uint32_t ADAQEmulatedDigitizer::GenerateEvents(uint32_t *Words,
+					       uint32_t NumEvents)
+{
+  const uint32_t ChannelWords = EmulatedRecordLength / 2;
+  const bool ZLE = (EmulatedZSMode == CAEN_DGTZ_ZS_ZLE);
+
+  const uint32_t TimeStampMask = (TimeStampSize >= 32) ? 0xffffffff : ((1u << TimeStampSize) - 1);
+
+  // Spacing between consecutive trigger time tags [time stamp units]
+  uint32_t TimeTagStep = 1000;
+  if(TriggerRate > 0.)
+    TimeTagStep = max((uint32_t)1, (uint32_t)(1e9 / (TriggerRate * TimeStampUnit)));
+
+  // Pulses are negative-going from a baseline near the top of the
+  // ADC range, matching the default CAEN pulse polarity
+  const int Baseline = (int)(0.8 * MaxADCBit);
+  const int MaxSample = MaxADCBit - 1;
+
+  uint32_t Word = 0;
+
+  for(uint32_t evt=0; evt<NumEvents; evt++){
+
+    // The event size is set once the channels are written
+    const uint32_t Header = Word;
+
+    Words[Word++] = 0xA0000000;
+    Words[Word++] = ((BoardID & 0x1f) << 27) | (ChannelEnableMask & 0xff);
+    Words[Word++] = (((ChannelEnableMask >> 8) & 0xff) << 24) | (EventCounter & 0x00ffffff);
+    Words[Word++] = TriggerTimeTag & TimeStampMask;
+
+    EventCounter++;
+    TriggerTimeTag += TimeTagStep;
+
+    for(int ch=0; ch<NumChannels; ch++){
+
+      if(!(ChannelEnableMask & (1 << ch)))
+	continue;
+
+      // Pulse amplitude uniformly distributed over 5-60% of the range
+      double Amplitude = MaxADCBit * (0.05 + 0.55 * (NextRandom() / 4294967296.));
+
+      // ZLE samples are generated aside and then encoded
+      uint32_t *Data = ZLE ? ZLEChannelWords.data() : Words + Word;
+
+      for(uint32_t w=0; w<ChannelWords; w++){
+	uint32_t Samples[2];
+	for(int s=0; s<2; s++){
+	  int Noise = (int)(NextRandom() & 0x3) - 1;
+	  int Sample = Baseline - (int)(Amplitude * PulseTemplate[2*w + s]) + Noise;
+	  Samples[s] = (uint32_t)min(max(Sample, 0), MaxSample);
+	}
+	Data[w] = Samples[0] | (Samples[1] << 16);
+      }
+
+      Word += ZLE ? EncodeZLEChannel(ch, Data, Words + Word) : ChannelWords;
+    }
+
+    Words[Header] |= (Word - Header) & 0x0fffffff;
+    GeneratedEvents++;
+  }
+
+  return Word;
+}
+
+
+uint32_t ADAQEmulatedDigitizer::EncodeZLEChannel(int Channel,
+						 const uint32_t *Data,
+						 uint32_t *Out)
+{
+  // Encode the sample words of one channel in the ZLE format (see the
+  // top of this file); returns the number of words written
+
+  const uint32_t ChannelWords = EmulatedRecordLength / 2;
+
+  const uint32_t Threshold = ZLEThresholdRegisters[Channel] & (MaxADCBit - 1);
+  const bool Negative = (ZLEThresholdRegisters[Channel] >> 31) & 1;
+  const uint32_t NBackward = ZLENSampleRegisters[Channel] >> 16;
+  const uint32_t NForward = ZLENSampleRegisters[Channel] & 0xffff;
+
+  // Flag the words holding a sample beyond the threshold (bit 0) and
+  // then the words to be stored around them (bit 1)
+
+  for(uint32_t w=0; w<ChannelWords; w++){
+    const uint32_t A = Data[w] & 0xffff, B = Data[w] >> 16;
+    ZLEFlags[w] = Negative ? (A < Threshold or B < Threshold) : (A > Threshold or B > Threshold);
+  }
+
+  uint32_t Run = 0;
+  for(uint32_t w=0; w<ChannelWords; w++){
+    if(ZLEFlags[w] & 1)
+      Run = NForward + 1;
+    if(Run){
+      ZLEFlags[w] |= 2;
+      Run--;
+    }
+  }
+
+  Run = 0;
+  for(uint32_t w=ChannelWords; w-- > 0;){
+    if(ZLEFlags[w] & 1)
+      Run = NBackward + 1;
+    if(Run){
+      ZLEFlags[w] |= 2;
+      Run--;
+    }
+  }
+
+  // Write a control word for every run of stored or suppressed words
+  // after the size word
+
+  uint32_t Word = 1;
+
+  for(uint32_t w=0; w<ChannelWords;){
+    const uint32_t Start = w;
+    const uint8_t Stored = ZLEFlags[w] & 2;
+    while(w < ChannelWords and (ZLEFlags[w] & 2) == Stored)
+      w++;
+
+    if(Stored){
+      Out[Word++] = 0xC0000000 | (w - Start);
+      memcpy(Out + Word, Data + Start, (w - Start) * sizeof(uint32_t));
+      Word += w - Start;
+    }
+    else
+      Out[Word++] = 0x40000000 | (w - Start);
+  }
+
+  Out[0] = Word;
+
+  return Word;
+}
+
+
+uint32_t ADAQEmulatedDigitizer::GetEmulatedRegister(uint32_t Addr32)
+{
+  map<uint32_t, uint32_t>::iterator It = Registers.find(Addr32);
+  return (It == Registers.end()) ? 0 : It->second;
+}
+
+
+uint32_t ADAQEmulatedDigitizer::GetPSDAggregateWords(uint32_t NumEvents)
+{
+  // Board aggregate header, a channel aggregate header for every
+  // possible channel pair, and the events
+  return 4 + 2 * (NumChannels / 2) + NumEvents * GetEventWords();
+}
+
+
+uint32_t ADAQEmulatedDigitizer::GeneratePSDAggregate(uint32_t *Words,
+						     uint32_t NumEvents)
+{
+  // Each trigger is a hit on one of the enabled channels; the hits
+  // are assigned to their channels first and then written grouped by
+  // channel pair, preserving time order within each pair
+
+  vector<int> Enabled;
+  for(int ch=0; ch<NumChannels; ch++)
+    if(ChannelEnableMask & (1 << ch))
+      Enabled.push_back(ch);
+
+  if(Enabled.empty() or NumEvents == 0)
+    return 0;
+
+  EventChannels.resize(NumEvents);
+  for(uint32_t evt=0; evt<NumEvents; evt++)
+    EventChannels[evt] = Enabled[NextRandom() % Enabled.size()];
+
+  uint64_t TimeTagStep = 1000;
+  if(TriggerRate > 0.)
+    TimeTagStep = max((uint64_t)1, (uint64_t)(1e9 / (TriggerRate * TimeStampUnit)));
+
+  const uint32_t SampleWords = EmulatedRecordLength / 2;
+  const int Baseline = (int)(0.8 * MaxADCBit);
+  const int MaxSample = MaxADCBit - 1;
+
+  // Charge integration gates [samples], opened shortly before the
+  // pulse; the charges are scaled to fit the 15/16-bit fields
+  const int Gate = max(0, (int)(0.25 * EmulatedRecordLength) - 4);
+  const int ShortGate = min(Gate + 16, (int)EmulatedRecordLength);
+  const int LongGate = min(Gate + 100, (int)EmulatedRecordLength);
+  const int ChargeScale = 16;
+
+  // Channel aggregate format: charge, time tag, extras (option 0:
+  // extended time tag and baseline*4) and samples enabled
+  const uint32_t Format = (1u << 30) | (1u << 29) | (1u << 28) | (1u << 27) | (EmulatedRecordLength / 8);
+
+  uint32_t Word = 4;
+  uint32_t PairMask = 0;
+
+  const uint64_t FirstTimeTag = DPPTimeTag;
+
+  for(int pair=0; pair<NumChannels/2; pair++){
+
+    if(!(ChannelEnableMask & (3 << (2*pair))))
+      continue;
+
+    PairMask |= (1 << pair);
+
+    const uint32_t Header = Word;
+    Words[Word++] = 0;
+    Words[Word++] = Format;
+
+    for(uint32_t evt=0; evt<NumEvents; evt++){
+
+      if((int)EventChannels[evt] / 2 != pair)
+	continue;
+
+      const uint64_t TimeTag = FirstTimeTag + evt * TimeTagStep;
+      Words[Word++] = ((EventChannels[evt] & 1) << 31) | (TimeTag & 0x7fffffff);
+
+      double Amplitude = MaxADCBit * (0.05 + 0.55 * (NextRandom() / 4294967296.));
+      int ChargeShort = 0, ChargeLong = 0;
+
+      for(uint32_t w=0; w<SampleWords; w++){
+	uint32_t Samples[2];
+	for(int s=0; s<2; s++){
+	  const int i = 2*w + s;
+	  int Noise = (int)(NextRandom() & 0x3) - 1;
+	  int Sample = Baseline - (int)(Amplitude * PulseTemplate[i]) + Noise;
+	  Sample = min(max(Sample, 0), MaxSample);
+	  Samples[s] = Sample;
+
+	  if(i >= Gate and i < LongGate){
+	    ChargeLong += Baseline - Sample;
+	    if(i < ShortGate)
+	      ChargeShort += Baseline - Sample;
+	  }
+	}
+	Words[Word++] = (Samples[0] & 0x3fff) | ((Samples[1] & 0x3fff) << 16);
+      }
+
+      ChargeShort = min(max(ChargeShort / ChargeScale, 0), 0x7fff);
+      ChargeLong = min(max(ChargeLong / ChargeScale, 0), 0xffff);
+      const uint32_t PileUp = (NextRandom() % 100 == 0) ? 1 : 0;
+
+      Words[Word++] = (((TimeTag >> 31) & 0xffff) << 16) | ((4 * Baseline) & 0xffff);
+      Words[Word++] = (ChargeLong << 16) | (PileUp << 15) | ChargeShort;
+
+      GeneratedEvents++;
+    }
+
+    Words[Header] = 0x80000000 | ((Word - Header) & 0x003fffff);
+  }
+
+  DPPTimeTag = FirstTimeTag + NumEvents * TimeTagStep;
+
+  Words[0] = 0xA0000000 | (Word & 0x0fffffff);
+  Words[1] = ((BoardID & 0x1f) << 27) | (PairMask & 0xff);
+  Words[2] = EventCounter++ & 0x007fffff;
+  Words[3] = FirstTimeTag & 0xffffffff;
+
+  return Word;
+}
+
+
+void ADAQEmulatedDigitizer::BuildPulseTemplate()
+{
+  // A normalized two-exponential detector pulse with the trigger at
+  // 25% of the record length
+
+  PulseTemplate.assign(EmulatedRecordLength, 0.);
+
+  const double Start = 0.25 * EmulatedRecordLength;
+  const double RiseTime = 2.;   // [samples]
+  const double DecayTime = 20.; // [samples]
+
+  double Peak = 0.;
+  for(uint32_t s=0; s<EmulatedRecordLength; s++){
+    double t = s - Start;
+    if(t > 0)
+      PulseTemplate[s] = exp(-t/DecayTime) - exp(-t/RiseTime);
+    Peak = max(Peak, PulseTemplate[s]);
+  }
+
+  if(Peak > 0.)
+    for(uint32_t s=0; s<EmulatedRecordLength; s++)
+      PulseTemplate[s] /= Peak;
+}
+
+
+uint32_t ADAQEmulatedDigitizer::NextRandom()
+{
+  // xorshift64* generator: fast, reproducible, and more than good
+  // enough for synthetic pulse amplitudes and noise
+  RandomState ^= RandomState >> 12;
+  RandomState ^= RandomState << 25;
+  RandomState ^= RandomState >> 27;
+  return (uint32_t)((RandomState * 2685821657736338717ULL) >> 32);
+}
@@ -0,0 +1,108 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQEventArena.cc
+// date: 16 Oct 26
+//
+// desc: ADAQEventArena holds a batch of decoded STD firmware events in
+//       reusable structure-of-arrays storage. See the header file for
+//       a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <algorithm>
+using namespace std;
+
+// ADAQ
+#include "ADAQEventArena.hh"
+
+
+ADAQEventArena::ADAQEventArena(uint32_t Events,  // Expected events per batch
+			       uint32_t Samples) // Expected samples (all channels) per event
+  : NumEvents(0), NumSamples(0), EventCapacity(0), SampleCapacity(0),
+    NumGrowths(0)
+{
+  Reserve(Events, Samples);
+}
+
+
+ADAQEventArena::~ADAQEventArena()
+{;}
+
+
+void ADAQEventArena::Reserve(uint32_t Events, uint32_t SamplesPerEvent)
+{
+  if(Events > EventCapacity)
+    GrowEvents(Events);
+
+  if(Events * SamplesPerEvent > SampleCapacity)
+    GrowSamples(Events * SamplesPerEvent);
+}
+
+
+uint16_t *ADAQEventArena::AddEvent(uint32_t Board,   // Board ID from the event header
+				   uint32_t Pat,     // Front panel LVDS pattern
+				   uint32_t Mask,    // Channel mask
+				   uint32_t Counter, // Event counter
+				   uint32_t TTT,     // Trigger time tag
+				   uint32_t Size)    // Samples per enabled channel
+{
+  const uint32_t Required = __builtin_popcount(Mask) * Size;
+
+  if(NumEvents == EventCapacity)
+    GrowEvents(max(2*EventCapacity, (uint32_t)16));
+
+  if(NumSamples + Required > SampleCapacity)
+    GrowSamples(max(2*SampleCapacity, NumSamples + Required));
+
+  BoardID[NumEvents] = Board;
+  Pattern[NumEvents] = Pat;
+  ChannelMask[NumEvents] = Mask;
+  EventCounter[NumEvents] = Counter;
+  TriggerTimeTag[NumEvents] = TTT;
+  ChannelSize[NumEvents] = Size;
+  SampleOffset[NumEvents] = NumSamples;
+
+  uint16_t *Slots = Samples.data() + NumSamples;
+
+  NumEvents++;
+  NumSamples += Required;
+
+  return Slots;
+}
+
+
+void ADAQEventArena::GrowEvents(uint32_t Capacity)
+{
+  BoardID.resize(Capacity);
+  Pattern.resize(Capacity);
+  ChannelMask.resize(Capacity);
+  EventCounter.resize(Capacity);
+  TriggerTimeTag.resize(Capacity);
+  ChannelSize.resize(Capacity);
+  SampleOffset.resize(Capacity);
+
+  EventCapacity = Capacity;
+  NumGrowths++;
+}
+
+
+void ADAQEventArena::GrowSamples(uint32_t Capacity)
+{
+  Samples.resize(Capacity);
+
+  SampleCapacity = Capacity;
+  NumGrowths++;
+}
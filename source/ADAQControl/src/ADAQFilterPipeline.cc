@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQFilterPipeline.cc
+// date: 16 Oct 26
+//
+// desc: The runtime registry of the ADAQ filter pipeline. The filter
+//       stages and chains are templates and live in the header file,
+//       which has a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ADAQ
+#include "ADAQFilterPipeline.hh"
+
+
+map<string, ADAQFilterRegistry::Factory> &ADAQFilterRegistry::GetFactories()
+{
+  // Constructed on first use such that the predefined chains are
+  // registered before any Register() or Create() by the user
+
+  static map<string, Factory> Factories;
+
+  if(Factories.empty()){
+    Factories["MovingAverage"] =
+      &CreateFilter<ADAQFilterChain<ADAQMovingAverageStage> >;
+
+    Factories["PoleZero"] =
+      &CreateFilter<ADAQFilterChain<ADAQPoleZeroStage> >;
+
+    Factories["Trapezoid"] =
+      &CreateFilter<ADAQFilterChain<ADAQPoleZeroStage, ADAQTrapezoidStage> >;
+
+    Factories["Jordanov"] =
+      &CreateFilter<ADAQFilterChain<ADAQJordanovStage> >;
+
+    Factories["MovingAverage+Trapezoid"] =
+      &CreateFilter<ADAQFilterChain<ADAQMovingAverageStage, ADAQPoleZeroStage, ADAQTrapezoidStage> >;
+  }
+  
+  return Factories;
+}
+
+
+ADAQVFilter *ADAQFilterRegistry::Create(string Name, const ADAQFilterParameters &P)
+{
+  map<string, Factory> &Factories = GetFactories();
+  map<string, Factory>::iterator It = Factories.find(Name);
+  if(It == Factories.end())
+    return NULL;
+  return It->second(P);
+}
+
+
+vector<string> ADAQFilterRegistry::GetNames()
+{
+  vector<string> Names;
+  map<string, Factory> &Factories = GetFactories();
+  for(map<string, Factory>::iterator It = Factories.begin(); It != Factories.end(); It++)
+    Names.push_back(It->first);
+  return Names;
+}
@@ -0,0 +1,125 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQPSDEventArena.cc
+// date: 16 Oct 26
+//
+// desc: ADAQPSDEventArena holds decoded DPP-PSD events in reusable
+//       per-channel column arrays with on-demand waveform decoding.
+//       See the header file for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ADAQ
+#include "ADAQPSDEventArena.hh"
+
+
+ADAQPSDEventArena::ADAQPSDEventArena(uint32_t Events) // Expected events per channel per buffer
+  : NumGrowths(0), Words(NULL)
+{
+  for(uint32_t ch=0; ch<MaxChannels; ch++){
+    Channels[ch].Capacity = 0;
+    NumEvents[ch] = 0;
+  }
+  Reserve(Events);
+}
+
+
+ADAQPSDEventArena::~ADAQPSDEventArena()
+{;}
+
+
+void ADAQPSDEventArena::Reserve(uint32_t Events)
+{
+  for(uint32_t ch=0; ch<MaxChannels; ch++)
+    if(Events > Channels[ch].Capacity)
+      Grow(ch, Events);
+}
+
+
+void ADAQPSDEventArena::Grow(uint32_t Ch, uint32_t Events)
+{
+  Channel &C = Channels[Ch];
+
+  C.Format.resize(Events);
+  C.TimeTag.resize(Events);
+  C.Extras.resize(Events);
+  C.WaveformOffset.resize(Events);
+  C.ChargeShort.resize(Events);
+  C.ChargeLong.resize(Events);
+  C.Baseline.resize(Events);
+  C.PileUp.resize(Events);
+
+  C.Capacity = Events;
+  NumGrowths++;
+}
+
+
+uint32_t ADAQPSDEventArena::GetTotalEvents() const
+{
+  uint32_t Total = 0;
+  for(uint32_t ch=0; ch<MaxChannels; ch++)
+    Total += NumEvents[ch];
+  return Total;
+}
+
+
+uint32_t ADAQPSDEventArena::GetNumSamples(uint32_t Ch, uint32_t Evt) const
+{
+  const Channel &C = Channels[Ch];
+
+  // Format bit 27 (ES) flags that samples are present; bits[15:0]
+  // hold the number of samples divided by 8. In dual trace mode (DT,
+  // bit 31) the samples are shared equally between the two traces.
+
+  const uint32_t Format = C.Format[Evt];
+  if(!(Format & (1u << 27)) or C.WaveformOffset[Evt] == 0)
+    return 0;
+
+  const uint32_t Samples = 8 * (Format & 0xffff);
+  return (Format & (1u << 31)) ? Samples / 2 : Samples;
+}
+
+
+uint32_t ADAQPSDEventArena::DecodeWaveform(uint32_t Ch,
+					   uint32_t Evt,
+					   uint16_t *Trace1,
+					   uint16_t *Trace2) const
+{
+  const uint32_t Samples = GetNumSamples(Ch, Evt);
+  if(Samples == 0 or Words == NULL)
+    return 0;
+
+  const Channel &C = Channels[Ch];
+  const uint32_t *Data = Words + C.WaveformOffset[Evt];
+
+  // Each word holds two 14-bit samples in bits[13:0] and bits[29:16];
+  // the remaining bits carry the digital probes and are ignored
+
+  if(C.Format[Evt] & (1u << 31)){
+    for(uint32_t s=0; s<Samples; s++)
+      Trace1[s] = Data[s] & 0x3fff;
+    if(Trace2)
+      for(uint32_t s=0; s<Samples; s++)
+	Trace2[s] = (Data[s] >> 16) & 0x3fff;
+  }
+  else{
+    for(uint32_t w=0; w<Samples/2; w++){
+      Trace1[2*w] = Data[w] & 0x3fff;
+      Trace1[2*w + 1] = (Data[w] >> 16) & 0x3fff;
+    }
+  }
+
+  return Samples;
+}
@@ -0,0 +1,166 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRawDumpReader.cc
+// date: 16 Oct 26
+//
+// desc: ADAQRawDumpReader maps and indexes the dump files of
+//       ADAQRawDumpWriter. See the header file for a full
+//       description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+using namespace std;
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ADAQ
+#include "ADAQRawDumpReader.hh"
+
+
+ADAQRawDumpReader::ADAQRawDumpReader()
+  : Verbose(false), FD(-1), Map(NULL), MapSize(0), StartTime(0), Truncated(false),
+    NextFrame(0)
+{;}
+
+
+ADAQRawDumpReader::~ADAQRawDumpReader()
+{
+  Close();
+}
+
+
+int ADAQRawDumpReader::Open(string FileName)
+{
+  Close();
+
+  FD = open(FileName.c_str(), O_RDONLY);
+  struct stat FileStat;
+
+  if(FD < 0 or fstat(FD, &FileStat) != 0){
+    if(Verbose)
+      cout << "ADAQRawDumpReader : Error! Could not open '" << FileName << "' ("
+	   << strerror(errno) << ")!\n"
+	   << endl;
+    Close();
+    return -42;
+  }
+  
+  MapSize = FileStat.st_size;
+
+  if(MapSize < sizeof(ADAQRawDumpFileHeader)){
+    Close();
+    return -42;
+  }
+
+  void *Memory = mmap(NULL, MapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, FD, 0);
+  if(Memory == MAP_FAILED){
+    Close();
+    return -42;
+  }
+  Map = (char *)Memory;
+  madvise(Map, MapSize, MADV_SEQUENTIAL);
+
+  const ADAQRawDumpFileHeader *Header = (const ADAQRawDumpFileHeader *)Map;
+
+  if(memcmp(Header->Magic, ADAQRawDump::FileMagic, sizeof(Header->Magic)) != 0 or
+     Header->Version != ADAQRawDump::Version or
+     Header->HeaderSize < sizeof(ADAQRawDumpFileHeader)){
+    if(Verbose)
+      cout << "ADAQRawDumpReader : Error! '" << FileName << "' is not an ADAQ raw dump!\n"
+	   << endl;
+    Close();
+    return -42;
+  }
+
+  StartTime = Header->StartTime;
+
+  // Index the frames; the walk stops at the first frame that is not
+  // complete, which (for a dump that was not closed) may be followed
+  // by zero padding
+
+  uint64_t Offset = Header->HeaderSize;
+
+  while(Offset + sizeof(ADAQRawDumpFrameHeader) <= MapSize){
+    const ADAQRawDumpFrameHeader *Frame = (const ADAQRawDumpFrameHeader *)(Map + Offset);
+
+    if(Frame->Magic != ADAQRawDump::FrameMagic or
+       Offset + sizeof(ADAQRawDumpFrameHeader) + Frame->Size > MapSize)
+      break;
+
+    FrameOffsets.push_back(Offset);
+    if(find(BoardIDs.begin(), BoardIDs.end(), Frame->BoardID) == BoardIDs.end())
+      BoardIDs.push_back(Frame->BoardID);
+
+    Offset += ADAQRawDump::GetFrameSize(Frame->Size);
+  }
+
+  Truncated = (Offset < MapSize);
+
+  if(Truncated and Verbose)
+    cout << "ADAQRawDumpReader : Warning! '" << FileName << "' ends with "
+	 << MapSize - Offset << " bytes that are not a complete frame\n"
+	 << endl;
+
+  return 0;
+}
+
+
+void ADAQRawDumpReader::Close()
+{
+  if(Map)
+    munmap(Map, MapSize);
+  Map = NULL;
+  MapSize = 0;
+
+  if(FD >= 0)
+    close(FD);
+  FD = -1;
+
+  FrameOffsets.clear();
+  BoardIDs.clear();
+  NextFrame = 0;
+  Truncated = false;
+}
+
+
+bool ADAQRawDumpReader::GetFrame(uint64_t i, ADAQRawDumpFrame &Frame)
+{
+  if(i >= FrameOffsets.size())
+    return false;
+
+  Frame.Header = (const ADAQRawDumpFrameHeader *)(Map + FrameOffsets[i]);
+  Frame.Data = Map + FrameOffsets[i] + sizeof(ADAQRawDumpFrameHeader);
+  return true;
+}
+
+
+bool ADAQRawDumpReader::Next(ADAQRawDumpFrame &Frame)
+{
+  if(!GetFrame(NextFrame, Frame))
+    return false;
+
+  NextFrame++;
+  return true;
+}
@@ -0,0 +1,326 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRawDumpWriter.cc
+// date: 16 Oct 26
+//
+// desc: ADAQRawDumpWriter writes framed raw readout buffers to dump
+//       files through aligned staging blocks and an I/O thread. See
+//       the header file for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+using namespace std;
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+// ADAQ
+#include "ADAQRawDumpWriter.hh"
+
+
+// O_DIRECT transfers must start and end on the logical block size of
+// the device, which is at most a page on all common devices
+static const uint32_t IOAlignment = 4096;
+
+
+ADAQRawDumpWriter::ADAQRawDumpWriter(uint32_t BS, // Staging block size [bytes]
+				     uint32_t NB) // Number of staging blocks
+  : BlockSize((max(BS, IOAlignment) + IOAlignment - 1) / IOAlignment * IOAlignment),
+    NumBlocks(max(NB, (uint32_t)2)), Verbose(false),
+    FD(-1), Direct(false), Current(NULL), FileBytes(0), IOThread(NULL), IOStop(false),
+    Stats(ADAQRawDumpWriterStats())
+{;}
+
+
+ADAQRawDumpWriter::~ADAQRawDumpWriter()
+{
+  Close();
+}
+
+
+void ADAQRawDumpWriter::AddDigitizer(ADAQDigitizer *DG)
+{
+  AddBoard(DG->GetBoardID(), DG->GetBoardType(), DG->GetBoardFirmwareType());
+}
+
+
+void ADAQRawDumpWriter::AddBoard(int BoardID, ZBoardType Type, string FirmwareType)
+{
+  BoardInfo Info = {(uint16_t)Type, ADAQRawDump::GetFirmware(FirmwareType)};
+  Boards[BoardID] = Info;
+}
+
+
+int ADAQRawDumpWriter::Open(string FileName, bool D)
+{
+  if(FD >= 0)
+    return -42;
+
+  Direct = D;
+  const int Flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+  FD = open(FileName.c_str(), Flags | (Direct ? O_DIRECT : 0), 0644);
+  
+  if(FD < 0 and Direct and errno == EINVAL){
+    if(Verbose)
+      cout << "ADAQRawDumpWriter : Warning! The file system does not support O_DIRECT for '"
+	   << FileName << "'; writing through the page cache\n"
+	   << endl;
+    Direct = false;
+    FD = open(FileName.c_str(), Flags, 0644);
+  }
+
+  if(FD < 0){
+    if(Verbose)
+      cout << "ADAQRawDumpWriter : Error! Could not open '" << FileName << "' ("
+	   << strerror(errno) << ")!\n"
+	   << endl;
+    return -42;
+  }
+
+  Blocks.resize(NumBlocks);
+  FreeBlocks.clear();
+  FullBlocks.clear();
+
+  for(uint32_t b=0; b<NumBlocks; b++){
+    void *Memory = NULL;
+    if(posix_memalign(&Memory, IOAlignment, BlockSize) != 0){
+      for(uint32_t i=0; i<b; i++)
+	free(Blocks[i].Data);
+      Blocks.clear();
+      close(FD);
+      FD = -1;
+      return -42;
+    }
+    Blocks[b].Data = (char *)Memory;
+    Blocks[b].Size = 0;
+    FreeBlocks.push_back(&Blocks[b]);
+  }
+
+  Current = FreeBlocks.back();
+  FreeBlocks.pop_back();
+
+  Stats = ADAQRawDumpWriterStats();
+  FileBytes = 0;
+  IOStop = false;
+  IOThread = new boost::thread(&ADAQRawDumpWriter::RunIOLoop, this);
+
+  ADAQRawDumpFileHeader Header;
+  memset(&Header, 0, sizeof(Header));
+  memcpy(Header.Magic, ADAQRawDump::FileMagic, sizeof(Header.Magic));
+  Header.Version = ADAQRawDump::Version;
+  Header.HeaderSize = sizeof(Header);
+  Header.StartTime = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+  Append(&Header, sizeof(Header));
+
+  return 0;
+}
+
+
+int ADAQRawDumpWriter::Close()
+{
+  if(FD < 0)
+    return 0;
+
+  // The last block is zero-padded to the I/O alignment and the file
+  // truncated to its real size afterwards
+
+  if(Current->Size > 0){
+    const uint32_t Padded = (Current->Size + IOAlignment - 1) / IOAlignment * IOAlignment;
+    memset(Current->Data + Current->Size, 0, Padded - Current->Size);
+    Current->Size = Padded;
+    SubmitBlock();
+  }
+
+  {
+    boost::mutex::scoped_lock Lock(BlockMutex);
+    IOStop = true;
+  }
+  BlockFull.notify_one();
+
+  IOThread->join();
+  delete IOThread;
+  IOThread = NULL;
+
+  Stats.FileBytes = FileBytes;
+  if(ftruncate(FD, FileBytes) != 0 or fsync(FD) != 0)
+    Stats.Errors++;
+  close(FD);
+  FD = -1;
+
+  for(uint32_t b=0; b<Blocks.size(); b++)
+    free(Blocks[b].Data);
+  Blocks.clear();
+  FreeBlocks.clear();
+  FullBlocks.clear();
+  Current = NULL;
+
+  return (Stats.Errors > 0) ? -42 : 0;
+}
+
+
+int ADAQRawDumpWriter::Write(const ADAQReadoutBuffer *Buffer)
+{
+  return Write(Buffer->BoardID, Buffer->Data, Buffer->Size, Buffer->Sequence, Buffer->ReadoutTime);
+}
+
+
+int ADAQRawDumpWriter::Write(int BoardID,          // ADAQ user ID of the source digitizer
+			     const char *Data,     // Filled PC buffer
+			     uint32_t Size,        // Size of the block transfer [bytes]
+			     uint64_t Sequence,    // Transfer number of the board
+			     uint64_t ReadoutTime) // Wall clock [ns since epoch]
+{
+  if(FD < 0)
+    return -42;
+
+  ADAQRawDumpFrameHeader Header;
+  Header.Magic = ADAQRawDump::FrameMagic;
+  Header.BoardID = BoardID;
+  Header.BoardType = 0;
+  Header.Firmware = ADAQRawDump::zFirmwareSTD;
+  Header.Size = Size;
+  Header.Sequence = Sequence;
+  Header.ReadoutTime = ReadoutTime;
+
+  map<int, BoardInfo>::iterator It = Boards.find(BoardID);
+  if(It != Boards.end()){
+    Header.BoardType = It->second.BoardType;
+    Header.Firmware = It->second.Firmware;
+  }
+
+  const uint64_t Padding = ADAQRawDump::GetFrameSize(Size) - sizeof(Header) - Size;
+  const uint64_t Zeros = 0;
+
+  Append(&Header, sizeof(Header));
+  Append(Data, Size);
+  Append(&Zeros, Padding);
+
+  boost::mutex::scoped_lock Lock(BlockMutex);
+  Stats.Frames++;
+  Stats.Bytes += Size;
+  Stats.FileBytes = FileBytes;
+
+  return (Stats.Errors > 0) ? -42 : 0;
+}
+
+
+void ADAQRawDumpWriter::Append(const void *Data, uint64_t Size)
+{
+  // Copy into the staging blocks, handing each block to the I/O
+  // thread as soon as it is full
+
+  const char *Bytes = (const char *)Data;
+
+  while(Size > 0){
+    const uint64_t Chunk = min(Size, (uint64_t)(BlockSize - Current->Size));
+    memcpy(Current->Data + Current->Size, Bytes, Chunk);
+    Current->Size += Chunk;
+    Bytes += Chunk;
+    Size -= Chunk;
+    FileBytes += Chunk;
+
+    if(Current->Size == BlockSize)
+      SubmitBlock();
+  }
+}
+
+
+void ADAQRawDumpWriter::SubmitBlock()
+{
+  boost::mutex::scoped_lock Lock(BlockMutex);
+
+  FullBlocks.push_back(Current);
+  Current = NULL;
+  BlockFull.notify_one();
+
+  // All other blocks are still queued: the disk is slower than the
+  // incoming data
+  if(FreeBlocks.empty()){
+    chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+    while(FreeBlocks.empty())
+      BlockFree.wait(Lock);
+    chrono::duration<double> Stalled = chrono::steady_clock::now() - Start;
+    Stats.Stalls++;
+    Stats.StallTime += Stalled.count();
+  }
+
+  Current = FreeBlocks.back();
+  FreeBlocks.pop_back();
+  Current->Size = 0;
+}
+
+
+void ADAQRawDumpWriter::RunIOLoop()
+{
+  // This method runs in the I/O thread and writes the full blocks in
+  // order until Close(), after the queue has been emptied
+
+  while(true){
+    Block *B = NULL;
+    {
+      boost::mutex::scoped_lock Lock(BlockMutex);
+      while(!IOStop and FullBlocks.empty())
+	BlockFull.wait(Lock);
+
+      if(FullBlocks.empty())
+	break;
+
+      B = FullBlocks.front();
+      FullBlocks.pop_front();
+    }
+
+    chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+
+    uint32_t Written = 0;
+    bool Failed = false;
+    while(Written < B->Size){
+      ssize_t N = write(FD, B->Data + Written, B->Size - Written);
+      if(N < 0 and errno == EINTR)
+	continue;
+      if(N <= 0){
+	Failed = true;
+	break;
+      }
+      Written += N;
+    }
+
+    chrono::duration<double> Time = chrono::steady_clock::now() - Start;
+
+    {
+      boost::mutex::scoped_lock Lock(BlockMutex);
+      Stats.WriteTime += Time.count();
+      if(Failed)
+	Stats.Errors++;
+      FreeBlocks.push_back(B);
+    }
+    BlockFree.notify_one();
+  }
+}
+
+
+ADAQRawDumpWriterStats ADAQRawDumpWriter::GetStats()
+{
+  boost::mutex::scoped_lock Lock(BlockMutex);
+  return Stats;
+}
@@ -0,0 +1,627 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQReadoutEngine.cc
+// date: 16 Oct 26
+//
+// desc: ADAQReadoutEngine reads out several digitizers in parallel
+//       with one readout thread per link feeding a common lock-free
+//       queue. See the header file for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+using namespace std;
+
+// POSIX
+#include <pthread.h>
+#include <sched.h>
+
+// ADAQ
+#include "ADAQReadoutEngine.hh"
+
+
+// Monotonic wall clock [ns] used for all engine timing
+static uint64_t SteadyNs()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+ADAQReadoutEngine::ADAQReadoutEngine(uint32_t BPB) // Number of buffers per board
+  : BuffersPerBoard(BPB), Verbose(false),
+    FilledQueue(NULL), QueueOccupancy(0), PeakQueueOccupancy(0),
+    Running(false), DumpWriter(NULL), DumpThread(NULL), DumpRunning(false),
+    EventsPerReadout(1), MaxWaitNs(100000000),
+    MinBackoff(10), MaxBackoff(1000),
+    StartTimeNs(0), StopTimeNs(0)
+{
+  if(BuffersPerBoard < 2)
+    BuffersPerBoard = 2;
+}
+
+
+ADAQReadoutEngine::~ADAQReadoutEngine()
+{
+  Stop();
+  FreeBuffers();
+
+  for(uint32_t l=0; l<Links.size(); l++)
+    delete Links[l];
+
+  for(uint32_t b=0; b<Boards.size(); b++){
+    delete Boards[b]->DG;
+    delete Boards[b];
+  }
+}
+
+
+int ADAQReadoutEngine::AddDigitizer(ADAQDigitizer *DG)
+{
+  if(Running or !DG)
+    return -42;
+
+  if(BoardMap.count(DG->GetBoardID())){
+    if(Verbose)
+      cout << "ADAQReadoutEngine : Error! A digitizer with board ID " << DG->GetBoardID()
+	   << " has already been added!\n"
+	   << endl;
+    return -42;
+  }
+
+  BoardReadout *Board = new BoardReadout;
+  Board->DG = DG;
+  Board->DPPFirmware = false;
+  Board->FreePool = NULL;
+  Board->Buffer = NULL;
+  Board->Sequence = Board->LastTransferNs = Board->FullSinceNs = 0;
+  Board->Stalled = false;
+
+  Boards.push_back(Board);
+  BoardMap[DG->GetBoardID()] = Board;
+
+  // Boards sharing a link are read out by the same thread
+
+  LinkReadout *Link = NULL;
+  for(uint32_t l=0; l<Links.size(); l++)
+    if(Links[l]->LinkNumber == DG->GetBoardLinkNumber())
+      Link = Links[l];
+
+  if(!Link){
+    Link = new LinkReadout;
+    Link->LinkNumber = DG->GetBoardLinkNumber();
+    Link->Core = -1;
+    Link->Thread = NULL;
+    Links.push_back(Link);
+  }
+  Link->Boards.push_back(Board);
+
+  ResetStats();
+
+  return Boards.size() - 1;
+}
+
+
+int ADAQReadoutEngine::OpenLinks()
+{
+  int Status = 0;
+  for(uint32_t b=0; b<Boards.size(); b++){
+    int BoardStatus = Boards[b]->DG->OpenLink();
+    if(Status == 0)
+      Status = BoardStatus;
+  }
+  return Status;
+}
+
+
+int ADAQReadoutEngine::CloseLinks()
+{
+  int Status = 0;
+  for(uint32_t b=0; b<Boards.size(); b++){
+    int BoardStatus = Boards[b]->DG->CloseLink();
+    if(Status == 0)
+      Status = BoardStatus;
+  }
+  return Status;
+}
+
+
+void ADAQReadoutEngine::SetLinkAffinity(int LinkNumber, int Core)
+{
+  for(uint32_t l=0; l<Links.size(); l++)
+    if(Links[l]->LinkNumber == LinkNumber)
+      Links[l]->Core = Core;
+}
+
+
+void ADAQReadoutEngine::SetReadoutThreshold(uint32_t Events, // Events per block transfer
+					    uint32_t MaxWait)// Maximum event wait [ms]
+{
+  if(Running)
+    return;
+
+  EventsPerReadout = max(Events, (uint32_t)1);
+  MaxWaitNs = (uint64_t)MaxWait * 1000000;
+}
+
+
+int ADAQReadoutEngine::AllocateBuffers()
+{
+  int Status = 0;
+
+  if(Running)
+    return -42;
+
+  FreeBuffers();
+
+  FilledQueue = new boost::lockfree::queue<ADAQReadoutBuffer *>(Boards.size() * BuffersPerBoard);
+
+  for(uint32_t b=0; b<Boards.size(); b++){
+    BoardReadout *Board = Boards[b];
+
+    Board->DPPFirmware = (Board->DG->GetBoardFirmwareType() == "PSD");
+    Board->Buffers.resize(BuffersPerBoard);
+    Board->FreePool = new boost::lockfree::queue<ADAQReadoutBuffer *>(BuffersPerBoard);
+
+    for(uint32_t n=0; n<BuffersPerBoard; n++){
+      ADAQReadoutBuffer &Buffer = Board->Buffers[n];
+      Buffer.Data = NULL;
+      Buffer.Capacity = 0;
+      Buffer.Size = 0;
+      Buffer.Sequence = 0;
+      Buffer.ReadoutTime = 0;
+      Buffer.BoardID = Board->DG->GetBoardID();
+
+      Status = Board->DG->MallocReadoutBuffer(&Buffer.Data, &Buffer.Capacity);
+
+      if(Status != 0){
+	if(Verbose)
+	  cout << "ADAQReadoutEngine[" << Buffer.BoardID << "] : Error! Could not allocate readout buffer " << n
+	       << " (error code " << Status << ")!\n"
+	       << endl;
+	FreeBuffers();
+	return Status;
+      }
+
+      Board->FreePool->bounded_push(&Buffer);
+    }
+  }
+
+  return Status;
+}
+
+
+void ADAQReadoutEngine::FreeBuffers()
+{
+  if(Running)
+    return;
+
+  for(uint32_t b=0; b<Boards.size(); b++){
+    BoardReadout *Board = Boards[b];
+
+    for(uint32_t n=0; n<Board->Buffers.size(); n++)
+      if(Board->Buffers[n].Data)
+	Board->DG->FreeReadoutBuffer(&Board->Buffers[n].Data);
+    Board->Buffers.clear();
+    Board->Buffer = NULL;
+
+    delete Board->FreePool;
+    Board->FreePool = NULL;
+  }
+
+  delete FilledQueue;
+  FilledQueue = NULL;
+  QueueOccupancy = 0;
+}
+
+
+void ADAQReadoutEngine::Start()
+{
+  if(Running or !FilledQueue){
+    if(Verbose)
+      cout << "ADAQReadoutEngine : Error! The engine is already running or the buffers have not been allocated!\n"
+	   << endl;
+    return;
+  }
+
+  // Return any unprocessed buffers and the buffers held by the link
+  // threads in the last run to their pools
+
+  ADAQReadoutBuffer *Buffer = NULL;
+  while(FilledQueue->pop(Buffer))
+    BoardMap[Buffer->BoardID]->FreePool->bounded_push(Buffer);
+  QueueOccupancy = 0;
+
+  for(uint32_t b=0; b<Boards.size(); b++)
+    if(Boards[b]->Buffer){
+      Boards[b]->FreePool->bounded_push(Boards[b]->Buffer);
+      Boards[b]->Buffer = NULL;
+    }
+
+  ResetStats();
+
+  StartTimeNs = SteadyNs();
+  StopTimeNs = 0;
+
+  for(uint32_t b=0; b<Boards.size(); b++){
+    Boards[b]->Sequence = 0;
+    Boards[b]->LastTransferNs = StartTimeNs;
+    Boards[b]->FullSinceNs = 0;
+    Boards[b]->Stalled = false;
+  }
+
+  Running = true;
+
+  if(DumpWriter){
+    for(uint32_t b=0; b<Boards.size(); b++)
+      DumpWriter->AddDigitizer(Boards[b]->DG);
+    
+    DumpRunning = true;
+    DumpThread = new boost::thread(&ADAQReadoutEngine::RunDumpLoop, this);
+  }
+
+  for(uint32_t l=0; l<Links.size(); l++)
+    Links[l]->Thread = new boost::thread(&ADAQReadoutEngine::RunLinkLoop, this, Links[l]);
+}
+
+
+void ADAQReadoutEngine::Stop()
+{
+  if(!Running)
+    return;
+
+  Running = false;
+
+  for(uint32_t l=0; l<Links.size(); l++)
+    if(Links[l]->Thread){
+      Links[l]->Thread->join();
+      delete Links[l]->Thread;
+      Links[l]->Thread = NULL;
+    }
+
+  // The dump thread writes the buffers still queued by the link
+  // threads before it stops
+  if(DumpThread){
+    DumpRunning = false;
+    DumpThread->join();
+    delete DumpThread;
+    DumpThread = NULL;
+  }
+
+  StopTimeNs = SteadyNs();
+
+  // Close any dead time episode still open at the end of the run
+  for(uint32_t b=0; b<Boards.size(); b++)
+    if(Boards[b]->FullSinceNs){
+      Boards[b]->DeadTimeNs += StopTimeNs - Boards[b]->FullSinceNs;
+      Boards[b]->FullSinceNs = 0;
+    }
+}
+
+
+ADAQReadoutBuffer *ADAQReadoutEngine::GetFilledBuffer()
+{
+  ADAQReadoutBuffer *Buffer = NULL;
+
+  if(FilledQueue and FilledQueue->pop(Buffer))
+    QueueOccupancy--;
+
+  return Buffer;
+}
+
+
+ADAQReadoutBuffer *ADAQReadoutEngine::WaitForFilledBuffer(uint32_t Timeout)
+{
+  // Wait up to "Timeout" microseconds for a filled buffer from any
+  // board, spinning briefly before sleeping
+
+  ADAQReadoutBuffer *Buffer = GetFilledBuffer();
+  if(Buffer)
+    return Buffer;
+
+  for(int Spin=0; Spin<100; Spin++){
+    boost::this_thread::yield();
+    if((Buffer = GetFilledBuffer()))
+      return Buffer;
+  }
+
+  chrono::steady_clock::time_point Deadline = chrono::steady_clock::now() + chrono::microseconds(Timeout);
+
+  while(chrono::steady_clock::now() < Deadline){
+    boost::this_thread::sleep(boost::posix_time::microseconds(50));
+    if((Buffer = GetFilledBuffer()))
+      return Buffer;
+  }
+
+  return NULL;
+}
+
+
+void ADAQReadoutEngine::ReleaseBuffer(ADAQReadoutBuffer *Buffer)
+{
+  if(!Buffer)
+    return;
+
+  map<int, BoardReadout *>::iterator It = BoardMap.find(Buffer->BoardID);
+  if(It != BoardMap.end() and It->second->FreePool)
+    It->second->FreePool->bounded_push(Buffer);
+}
+
+
+ADAQReadoutEngineBoardStats ADAQReadoutEngine::GetBoardStats(uint32_t B)
+{
+  ADAQReadoutEngineBoardStats Stats = ADAQReadoutEngineBoardStats();
+
+  if(B >= Boards.size())
+    return Stats;
+
+  BoardReadout *Board = Boards[B];
+
+  Stats.BoardID = Board->DG->GetBoardID();
+  Stats.LinkNumber = Board->DG->GetBoardLinkNumber();
+
+  Stats.Transfers = Board->Transfers;
+  Stats.EmptyTransfers = Board->EmptyTransfers;
+  Stats.ReadoutErrors = Board->ReadoutErrors;
+  Stats.Bytes = Board->Bytes;
+  Stats.Events = Board->Events;
+
+  Stats.Stalls = Board->Stalls;
+  Stats.FullEpisodes = Board->FullEpisodes;
+
+  uint64_t EndNs = (Running or StopTimeNs == 0) ? SteadyNs() : (uint64_t)StopTimeNs;
+  Stats.WallTime = (StartTimeNs > 0 and EndNs > StartTimeNs) ? (EndNs - StartTimeNs) * 1e-9 : 0.;
+
+  // An open dead time episode counts up to the present
+  uint64_t DeadNs = Board->DeadTimeNs;
+  uint64_t FullSince = Board->FullSinceNs;
+  if(Running and FullSince and EndNs > FullSince)
+    DeadNs += EndNs - FullSince;
+  Stats.DeadTime = DeadNs * 1e-9;
+
+  if(Stats.WallTime > 0.){
+    Stats.Throughput = Stats.Bytes / Stats.WallTime / 1e6;
+    Stats.EventRate = Stats.Events / Stats.WallTime;
+    Stats.DeadTimeFraction = Stats.DeadTime / Stats.WallTime;
+  }
+
+  return Stats;
+}
+
+
+vector<ADAQReadoutEngineBoardStats> ADAQReadoutEngine::GetStats()
+{
+  vector<ADAQReadoutEngineBoardStats> Stats;
+  for(uint32_t b=0; b<Boards.size(); b++)
+    Stats.push_back(GetBoardStats(b));
+  return Stats;
+}
+
+
+void ADAQReadoutEngine::ResetStats()
+{
+  for(uint32_t b=0; b<Boards.size(); b++){
+    BoardReadout *Board = Boards[b];
+    Board->Transfers = Board->EmptyTransfers = Board->ReadoutErrors = 0;
+    Board->Bytes = Board->Events = 0;
+    Board->Stalls = Board->FullEpisodes = Board->DeadTimeNs = 0;
+  }
+  PeakQueueOccupancy = QueueOccupancy.load();
+}
+
+
+void ADAQReadoutEngine::PrintStats()
+{
+  vector<ADAQReadoutEngineBoardStats> Stats = GetStats();
+
+  cout << "ADAQReadoutEngine : Readout statistics for " << Boards.size() << " boards on "
+       << Links.size() << " links (peak queue occupancy " << PeakQueueOccupancy << ")\n"
+       << "--> " << setw(6) << "Board" << setw(6) << "Link"
+       << setw(12) << "Transfers" << setw(14) << "Events" << setw(12) << "MB/s"
+       << setw(12) << "Events/s" << setw(10) << "Stalls" << setw(14) << "Dead time [s]"
+       << setw(10) << "Dead [%]" << endl;
+
+  for(uint32_t b=0; b<Stats.size(); b++)
+    cout << "--> " << setw(6) << Stats[b].BoardID << setw(6) << Stats[b].LinkNumber
+	 << setw(12) << Stats[b].Transfers << setw(14) << Stats[b].Events
+	 << setw(12) << setprecision(4) << Stats[b].Throughput
+	 << setw(12) << Stats[b].EventRate << setw(10) << Stats[b].Stalls
+	 << setw(14) << Stats[b].DeadTime << setw(10) << 100. * Stats[b].DeadTimeFraction << endl;
+
+  cout << endl;
+}
+
+
+void ADAQReadoutEngine::RunLinkLoop(LinkReadout *Link)
+{
+  // This method runs in the readout thread of one link and services
+  // the boards on the link in turn. As in ADAQReadoutPipeline, it
+  // does nothing but move data off the digitizers.
+
+  if(Link->Core >= 0){
+    cpu_set_t CPUSet;
+    CPU_ZERO(&CPUSet);
+    CPU_SET(Link->Core, &CPUSet);
+
+    if(pthread_setaffinity_np(pthread_self(), sizeof(CPUSet), &CPUSet) != 0 and Verbose)
+      cout << "ADAQReadoutEngine : Warning! Could not pin the readout thread of link " << Link->LinkNumber
+	   << " to CPU " << Link->Core << "!\n"
+	   << endl;
+  }
+
+  uint32_t Backoff = MinBackoff;
+
+  while(Running){
+
+    bool Transferred = false;
+    for(uint32_t b=0; b<Link->Boards.size(); b++)
+      Transferred |= ServiceBoard(Link->Boards[b], SteadyNs());
+
+    // Sleep with an exponential backoff while all boards are idle so
+    // that an idle link does not occupy a core
+    if(Transferred)
+      Backoff = MinBackoff;
+    else{
+      boost::this_thread::sleep(boost::posix_time::microseconds(Backoff));
+      Backoff = min(2 * Backoff, MaxBackoff);
+    }
+  }
+}
+
+
+void ADAQReadoutEngine::RunDumpLoop()
+{
+  // This method runs in the dump thread of the raw dump mode and is
+  // the only consumer of the filled buffer queue
+
+  while(true){
+    ADAQReadoutBuffer *Buffer = WaitForFilledBuffer(1000);
+
+    if(Buffer){
+      if(DumpWriter->Write(Buffer) != 0 and Verbose)
+	cout << "ADAQReadoutEngine : Error! Could not write buffer " << Buffer->Sequence
+	     << " of board " << Buffer->BoardID << " to the raw dump!\n"
+	     << endl;
+      ReleaseBuffer(Buffer);
+    }
+    else if(!DumpRunning)
+      break;
+  }
+}
+
+
+bool ADAQReadoutEngine::ServiceBoard(BoardReadout *Board, uint64_t NowNs)
+{
+  // Returns true if a block transfer was made from the board
+
+  // Obtain a free buffer for the board. If none is available the
+  // downstream threads have fallen behind; the board is skipped but
+  // its FPGA memory is still monitored for dead time.
+
+  if(!Board->Buffer and !Board->FreePool->pop(Board->Buffer)){
+    if(!Board->Stalled){
+      Board->Stalled = true;
+      Board->Stalls++;
+    }
+    CheckFPGAMemory(Board, NowNs);
+    return false;
+  }
+  Board->Stalled = false;
+
+  uint32_t FPGAEvents = 0;
+  Board->DG->GetNumFPGAEvents(&FPGAEvents);
+
+  if(FPGAEvents == 0)
+    return false;
+
+  if(FPGAEvents < EventsPerReadout and (NowNs - Board->LastTransferNs) < MaxWaitNs)
+    return false;
+
+  CheckFPGAMemory(Board, NowNs);
+
+  // Move the next block transfer into the buffer
+
+  ADAQReadoutBuffer *Buffer = Board->Buffer;
+  Buffer->Size = 0;
+
+  int Status = Board->DG->ReadData(Buffer->Data, &Buffer->Size);
+
+  const uint64_t TransferNs = SteadyNs();
+  Board->LastTransferNs = TransferNs;
+
+  // The transfer frees FPGA memory, ending any dead time episode
+  if(Board->FullSinceNs){
+    Board->DeadTimeNs += TransferNs - Board->FullSinceNs;
+    Board->FullSinceNs = 0;
+  }
+
+  if(Status != 0){
+    Board->ReadoutErrors++;
+    return false;
+  }
+
+  if(Buffer->Size == 0){
+    Board->EmptyTransfers++;
+    return false;
+  }
+
+  Buffer->Sequence = Board->Sequence++;
+  Buffer->ReadoutTime = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+
+  Board->Transfers++;
+  Board->Bytes += Buffer->Size;
+  Board->Events += CountEvents(Buffer);
+
+  // Hand the buffer downstream. The push cannot fail since the queue
+  // is as large as all board pools together.
+
+  uint32_t Occupancy = ++QueueOccupancy;
+  FilledQueue->bounded_push(Buffer);
+  Board->Buffer = NULL;
+
+  if(Occupancy > PeakQueueOccupancy)
+    PeakQueueOccupancy = Occupancy;
+
+  return true;
+}
+
+
+void ADAQReadoutEngine::CheckFPGAMemory(BoardReadout *Board, uint64_t NowNs)
+{
+  // A full FPGA memory cannot accept triggers; the dead time runs
+  // from the first time the memory is found full until the next
+  // block transfer from the board
+
+  if(Board->FullSinceNs)
+    return;
+
+  double BufferLevel = 0.;
+  if(Board->DPPFirmware)
+    Board->DG->GetPSDBufferLevel(BufferLevel);
+  else
+    Board->DG->GetSTDBufferLevel(BufferLevel);
+
+  if(BufferLevel >= 1.){
+    Board->FullSinceNs = NowNs;
+    Board->FullEpisodes++;
+  }
+}
+
+
+uint32_t ADAQReadoutEngine::CountEvents(ADAQReadoutBuffer *Buffer)
+{
+  // STD events and DPP board aggregates both begin with a header
+  // word holding 0xA in bits[31:28] and their size [words] in
+  // bits[27:0]
+
+  const uint32_t *Words = (const uint32_t *)Buffer->Data;
+  const uint32_t NumWords = Buffer->Size / sizeof(uint32_t);
+
+  uint32_t Events = 0;
+  uint32_t Word = 0;
+
+  while(Word < NumWords and (Words[Word] >> 28) == 0xA){
+    uint32_t Size = Words[Word] & 0x0fffffff;
+    if(Size == 0)
+      break;
+    Word += Size;
+    Events++;
+  }
+
+  return Events;
+}
@@ -0,0 +1,622 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQReadoutPipeline.cc
+// date: 16 Oct 26
+//
+// desc: ADAQReadoutPipeline decouples the readout of a digitizer from
+//       the decoding of the data with a lock-free ring of
+//       preallocated readout buffers. See the header file for a full
+//       description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+using namespace std;
+
+// POSIX
+#include <pthread.h>
+
+// ADAQ
+#include "ADAQReadoutPipeline.hh"
+
+
+// Monotonic wall clock [ns] used for all pipeline timing
+static uint64_t SteadyNs()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+ADAQReadoutPipeline::ADAQReadoutPipeline(ADAQDigitizer *Digitizer, // The digitizer to read out
+					 uint32_t NB)               // Number of buffers in the pool
+  : DG(Digitizer), NumBuffers(NB), Verbose(false),
+    FilledRing(NULL), FreeRing(NULL), HeldBuffer(NULL),
+    ReadoutThread(NULL), Running(false),
+    WaitMode(zWaitAdaptivePoll), EventsPerReadout(1), IRQTimeout(100),
+    MinBackoff(10), MaxBackoff(10000), Backoff(10), InterruptsEnabled(false),
+    BLTController(NULL),
+    CPUClockValid(false), STDFirmware(true), TimeTagRollovers(0), LastTimeTag(0)
+{
+  if(NumBuffers < 2)
+    NumBuffers = 2;
+
+  ResetStats();
+}
+
+
+ADAQReadoutPipeline::~ADAQReadoutPipeline()
+{
+  Stop();
+  FreeBuffers();
+}
+
+
+int ADAQReadoutPipeline::AllocateBuffers()
+{
+  int Status = 0;
+
+  if(Running)
+    return -42;
+
+  FreeBuffers();
+
+  Buffers.resize(NumBuffers);
+
+  FilledRing = new boost::lockfree::spsc_queue<ADAQReadoutBuffer *>(NumBuffers);
+  FreeRing = new boost::lockfree::spsc_queue<ADAQReadoutBuffer *>(NumBuffers);
+
+  // The CAEN buffer size depends on the events per transfer, so the
+  // buffers are sized for the largest setting the controller may use
+  uint32_t InitialEvents = 0;
+  if(BLTController){
+    InitialEvents = BLTController->GetEventsPerTransfer();
+    BLTController->Apply(BLTController->GetMaxEvents());
+  }
+
+  for(uint32_t b=0; b<NumBuffers; b++){
+    Buffers[b].Data = NULL;
+    Buffers[b].Capacity = 0;
+    Buffers[b].Size = 0;
+    Buffers[b].Sequence = 0;
+    Buffers[b].ReadoutTime = 0;
+    Buffers[b].BoardID = DG->GetBoardID();
+
+    Status = DG->MallocReadoutBuffer(&Buffers[b].Data, &Buffers[b].Capacity);
+
+    if(Status != 0){
+      if(Verbose)
+	cout << "ADAQReadoutPipeline : Error! Could not allocate readout buffer " << b
+	     << " (error code " << Status << ")!\n"
+	     << endl;
+      FreeBuffers();
+      if(BLTController)
+	BLTController->Apply(InitialEvents);
+      return Status;
+    }
+
+    FreeRing->push(&Buffers[b]);
+  }
+
+  if(BLTController)
+    BLTController->Apply(InitialEvents);
+
+  return Status;
+}
+
+
+void ADAQReadoutPipeline::FreeBuffers()
+{
+  if(Running)
+    return;
+
+  for(uint32_t b=0; b<Buffers.size(); b++)
+    if(Buffers[b].Data)
+      DG->FreeReadoutBuffer(&Buffers[b].Data);
+  Buffers.clear();
+  HeldBuffer = NULL;
+
+  delete FilledRing;
+  FilledRing = NULL;
+
+  delete FreeRing;
+  FreeRing = NULL;
+}
+
+
+void ADAQReadoutPipeline::Start()
+{
+  if(Running or !FreeRing){
+    if(Verbose)
+      cout << "ADAQReadoutPipeline : Error! The pipeline is already running or the buffers have not been allocated!\n"
+	   << endl;
+    return;
+  }
+
+  // Return any undecoded buffers and the buffer parked by the last
+  // readout loop to the pool
+  ADAQReadoutBuffer *Buffer = NULL;
+  while(FilledRing->pop(Buffer))
+    FreeRing->push(Buffer);
+
+  if(HeldBuffer){
+    FreeRing->push(HeldBuffer);
+    HeldBuffer = NULL;
+  }
+
+  ResetStats();
+
+  if(BLTController)
+    EventsPerReadout = BLTController->GetEventsPerTransfer() * BLTController->GetAggregatesPerTransfer();
+
+  if(WaitMode == zWaitInterrupt)
+    EnableInterrupts();
+
+  Backoff = MinBackoff;
+  STDFirmware = (DG->GetBoardFirmwareType() == "STD");
+  TimeTagRollovers = 0;
+  LastTimeTag = 0;
+
+  // The trigger time tags are assumed to be reset at the start of
+  // acquisition, i.e. Start() should directly follow SWStartAcquisition()
+  StartTimeNs = SteadyNs();
+  StopTimeNs = 0;
+
+  if(BLTController)
+    BLTController->Reset(StartTimeNs);
+
+  Running = true;
+  ReadoutThread = new boost::thread(&ADAQReadoutPipeline::RunReadoutLoop, this);
+}
+
+
+void ADAQReadoutPipeline::Stop()
+{
+  if(!ReadoutThread)
+    return;
+
+  Running = false;
+  ReadoutThread->join();
+
+  delete ReadoutThread;
+  ReadoutThread = NULL;
+
+  StopTimeNs = SteadyNs();
+
+  if(InterruptsEnabled)
+    DisableInterrupts();
+}
+
+
+void ADAQReadoutPipeline::SetWaitMode(ZReadoutWaitMode Mode,
+				      uint32_t Events,  // Events per block transfer
+				      uint32_t Timeout, // Interrupt wait timeout [ms]
+				      uint32_t Backoff) // Maximum polling backoff [us]
+{
+  if(Running)
+    return;
+  
+  WaitMode = Mode;
+  EventsPerReadout = max(Events, (uint32_t)1);
+  IRQTimeout = Timeout;
+  MaxBackoff = max(Backoff, MinBackoff);
+}
+
+
+void ADAQReadoutPipeline::EnableInterrupts()
+{
+  // The digitizer raises a VME/optical link interrupt once
+  // EventsPerReadout events are stored in the FPGA memory. The
+  // interrupt is released on register access (RORA) and re-armed
+  // after each block transfer.
+  
+  int Status = DG->SetInterruptConfig(CAEN_DGTZ_ENABLE,
+				      1,      // Interrupt level
+				      0xAAAA, // Status/ID
+				      min(EventsPerReadout, (uint32_t)0xffff),
+				      CAEN_DGTZ_IRQ_MODE_RORA);
+
+  if(Status == 0)
+    InterruptsEnabled = true;
+  else{
+    if(Verbose)
+      cout << "ADAQReadoutPipeline[" << DG->GetBoardID() << "] : Warning! Interrupts could not be configured (error code "
+	   << Status << "). Falling back to adaptive polling.\n"
+	   << endl;
+    WaitMode = zWaitAdaptivePoll;
+  }
+}
+
+
+void ADAQReadoutPipeline::DisableInterrupts()
+{
+  DG->SetInterruptConfig(CAEN_DGTZ_DISABLE, 1, 0xAAAA,
+			 min(EventsPerReadout, (uint32_t)0xffff),
+			 CAEN_DGTZ_IRQ_MODE_RORA);
+  InterruptsEnabled = false;
+}
+
+
+ADAQReadoutBuffer *ADAQReadoutPipeline::GetFilledBuffer()
+{
+  ADAQReadoutBuffer *Buffer = NULL;
+
+  if(FilledRing and FilledRing->pop(Buffer))
+    RingOccupancy--;
+
+  return Buffer;
+}
+
+
+ADAQReadoutBuffer *ADAQReadoutPipeline::WaitForFilledBuffer(uint32_t Timeout)
+{
+  // Wait up to "Timeout" microseconds for a filled buffer. Spin
+  // briefly before sleeping so that the decode thread neither adds
+  // latency at high rates nor burns a core at low rates.
+
+  ADAQReadoutBuffer *Buffer = GetFilledBuffer();
+  if(Buffer)
+    return Buffer;
+
+  for(int Spin=0; Spin<100; Spin++){
+    boost::this_thread::yield();
+    if((Buffer = GetFilledBuffer()))
+      return Buffer;
+  }
+
+  chrono::steady_clock::time_point Deadline = chrono::steady_clock::now() + chrono::microseconds(Timeout);
+
+  while(chrono::steady_clock::now() < Deadline){
+    boost::this_thread::sleep(boost::posix_time::microseconds(50));
+    if((Buffer = GetFilledBuffer()))
+      return Buffer;
+  }
+
+  return NULL;
+}
+
+
+void ADAQReadoutPipeline::ReleaseBuffer(ADAQReadoutBuffer *Buffer)
+{
+  if(Buffer and FreeRing)
+    FreeRing->push(Buffer);
+}
+
+
+ADAQReadoutPipelineStats ADAQReadoutPipeline::GetStats()
+{
+  ADAQReadoutPipelineStats Stats;
+
+  Stats.Transfers = Transfers;
+  Stats.EmptyTransfers = EmptyTransfers;
+  Stats.ReadoutErrors = ReadoutErrors;
+  Stats.Bytes = Bytes;
+
+  Stats.Stalls = Stalls;
+  Stats.StallTime = StallTimeNs * 1e-9;
+
+  Stats.RingSize = NumBuffers;
+  Stats.RingOccupancy = RingOccupancy;
+  Stats.PeakRingOccupancy = PeakRingOccupancy;
+  Stats.MeanRingOccupancy = (Stats.Transfers > 0) ? (double)OccupancySum / Stats.Transfers : 0.;
+
+  Stats.WaitMode = WaitMode;
+  Stats.Polls = Polls;
+  Stats.Interrupts = Interrupts;
+  Stats.WaitTimeouts = WaitTimeouts;
+
+  uint64_t EndNs = (Running or StopTimeNs == 0) ? SteadyNs() : (uint64_t)StopTimeNs;
+  Stats.WallTime = (StartTimeNs > 0 and EndNs > StartTimeNs) ? (EndNs - StartTimeNs) * 1e-9 : 0.;
+
+  // The CPU clock of the readout thread is only valid while the
+  // thread runs; afterwards the value recorded at its exit is used
+  uint64_t CPUNs = CPUTimeNs;
+  timespec TS;
+  if(CPUClockValid and clock_gettime(CPUClock, &TS) == 0)
+    CPUNs = (uint64_t)TS.tv_sec * 1000000000ULL + TS.tv_nsec;
+  
+  Stats.CPUTime = CPUNs * 1e-9;
+  Stats.CPULoad = (Stats.WallTime > 0.) ? Stats.CPUTime / Stats.WallTime : 0.;
+
+  Stats.LatencySamples = LatencySamples;
+  Stats.MeanLatency = (Stats.LatencySamples > 0) ? LatencySumNs * 1e-9 / Stats.LatencySamples : 0.;
+  Stats.MaxLatency = LatencyMaxNs * 1e-9;
+
+  return Stats;
+}
+
+
+void ADAQReadoutPipeline::ResetStats()
+{
+  Transfers = EmptyTransfers = ReadoutErrors = Bytes = 0;
+  Stalls = StallTimeNs = 0;
+  OccupancySum = 0;
+  RingOccupancy = PeakRingOccupancy = 0;
+  Polls = Interrupts = WaitTimeouts = 0;
+  LatencySamples = LatencySumNs = LatencyMaxNs = 0;
+  StartTimeNs = StopTimeNs = CPUTimeNs = 0;
+}
+
+
+void ADAQReadoutPipeline::PrintStats()
+{
+  ADAQReadoutPipelineStats Stats = GetStats();
+
+  cout << "ADAQReadoutPipeline[" << DG->GetBoardID() << "] : Readout statistics\n"
+       << "--> Transfers       : " << Stats.Transfers << " (" << Stats.EmptyTransfers << " empty, "
+       << Stats.ReadoutErrors << " errors)\n"
+       << "--> Bytes           : " << Stats.Bytes << "\n"
+       << "--> Ring occupancy  : " << Stats.RingOccupancy << " / " << Stats.RingSize
+       << " (peak " << Stats.PeakRingOccupancy << ", mean " << Stats.MeanRingOccupancy << ")\n"
+       << "--> Stalls          : " << Stats.Stalls << " (" << Stats.StallTime << " s)\n";
+
+  const char *ModeNames[3] = {"busy polling", "adaptive polling", "interrupt"};
+  
+  cout << "--> Wait mode       : " << ModeNames[Stats.WaitMode] << " (" << Stats.Polls << " polls, "
+       << Stats.Interrupts << " interrupts, " << Stats.WaitTimeouts << " timeouts)\n"
+       << "--> CPU time        : " << Stats.CPUTime << " s of " << Stats.WallTime << " s ("
+       << 100. * Stats.CPULoad << " %)\n";
+
+  if(Stats.LatencySamples > 0)
+    cout << "--> Latency         : " << 1e3 * Stats.MeanLatency << " ms mean, "
+	 << 1e3 * Stats.MaxLatency << " ms max\n";
+  
+  cout << endl;
+}
+
+
+void ADAQReadoutPipeline::RunReadoutLoop()
+{
+  // This method runs in the readout thread. It must do as little as
+  // possible beyond moving data off the digitizer: no decoding, no
+  // allocation, no locks.
+
+  ADAQReadoutBuffer *Buffer = NULL;
+  uint64_t Sequence = 0;
+
+  if(pthread_getcpuclockid(pthread_self(), &CPUClock) == 0)
+    CPUClockValid = true;
+
+  while(Running){
+
+    // Obtain a free buffer from the pool. If none is available the
+    // decode stage has fallen behind and the readout stalls.
+
+    if(!Buffer and !FreeRing->pop(Buffer)){
+
+      chrono::steady_clock::time_point StallStart = chrono::steady_clock::now();
+      Stalls++;
+
+      while(Running and !FreeRing->pop(Buffer))
+	boost::this_thread::yield();
+
+      StallTimeNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - StallStart).count();
+
+      if(!Buffer)
+	break;
+    }
+
+    // Wait until enough events are in the FPGA memory
+
+    if(!WaitForEvents())
+      continue;
+    
+    // Move the next block transfer into the buffer
+
+    Buffer->Size = 0;
+    int Status = DG->ReadData(Buffer->Data, &Buffer->Size);
+
+    if(InterruptsEnabled)
+      DG->RearmInterrupt(DG->GetBoardHandle());
+
+    if(Status != 0){
+      ReadoutErrors++;
+      continue;
+    }
+
+    if(Buffer->Size == 0){
+      EmptyTransfers++;
+      boost::this_thread::yield();
+      continue;
+    }
+
+    Buffer->Sequence = Sequence++;
+    Buffer->ReadoutTime = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+
+    const uint64_t NowNs = SteadyNs();
+    MeasureLatency(Buffer, NowNs);
+
+    // Let the controller retune the transfer size; the wait threshold
+    // and interrupt configuration follow the new setting
+    if(BLTController and BLTController->Update(Buffer->Size, CountEvents(Buffer), NowNs)){
+      EventsPerReadout = BLTController->GetEventsPerTransfer() * BLTController->GetAggregatesPerTransfer();
+      if(InterruptsEnabled)
+	EnableInterrupts();
+    }
+
+    Transfers++;
+    Bytes += Buffer->Size;
+
+    // Hand the buffer to the decode stage. The push cannot fail since
+    // the ring is as large as the pool.
+
+    uint32_t Occupancy = ++RingOccupancy;
+    FilledRing->push(Buffer);
+    Buffer = NULL;
+
+    OccupancySum += Occupancy;
+    if(Occupancy > PeakRingOccupancy)
+      PeakRingOccupancy = Occupancy;
+  }
+
+  // The free ring may only be pushed by the decode thread, so an
+  // unused buffer is parked here and returned to the pool by Start()
+  HeldBuffer = Buffer;
+
+  // Record the final CPU time before the thread clock disappears
+  timespec TS;
+  if(CPUClockValid and clock_gettime(CPUClock, &TS) == 0)
+    CPUTimeNs = (uint64_t)TS.tv_sec * 1000000000ULL + TS.tv_nsec;
+  CPUClockValid = false;
+}
+
+
+bool ADAQReadoutPipeline::WaitForEvents()
+{
+  // Returns true if a block transfer should be made now. The method
+  // returns at least once every IRQTimeout/MaxBackoff such that the
+  // readout loop can respond to Stop().
+  
+  uint32_t FPGAEvents = 0;
+
+  switch(WaitMode){
+
+  case zWaitBusyPoll:
+    Polls++;
+    DG->GetNumFPGAEvents(&FPGAEvents);
+    return (FPGAEvents >= EventsPerReadout);
+
+  case zWaitAdaptivePoll:
+    Polls++;
+    DG->GetNumFPGAEvents(&FPGAEvents);
+
+    // Read out if the threshold is reached or, once the backoff has
+    // saturated, if any events are waiting at all
+    if(FPGAEvents >= EventsPerReadout or (FPGAEvents > 0 and Backoff >= MaxBackoff)){
+      Backoff = MinBackoff;
+      return true;
+    }
+
+    boost::this_thread::sleep(boost::posix_time::microseconds(Backoff));
+    Backoff = min(2 * Backoff, MaxBackoff);
+    return false;
+
+  case zWaitInterrupt:{
+    int Status = DG->IRQWait(DG->GetBoardHandle(), IRQTimeout);
+
+    if(Status == 0){
+      Interrupts++;
+      return true;
+    }
+    
+    if(Status == CAEN_DGTZ_Timeout){
+      WaitTimeouts++;
+      Polls++;
+      DG->GetNumFPGAEvents(&FPGAEvents);
+      return (FPGAEvents > 0);
+    }
+
+    // Any other error means interrupts are not usable on this link
+    if(Verbose)
+      cout << "ADAQReadoutPipeline[" << DG->GetBoardID() << "] : Warning! IRQWait() failed (error code "
+	   << Status << "). Falling back to adaptive polling.\n"
+	   << endl;
+    
+    DisableInterrupts();
+    WaitMode = zWaitAdaptivePoll;
+    Backoff = MinBackoff;
+    return false;
+  }
+  }
+  
+  return true;
+}
+
+
+uint32_t ADAQReadoutPipeline::CountEvents(ADAQReadoutBuffer *Buffer)
+{
+  // Both STD events and DPP board aggregates begin with a header word
+  // holding 0xA in bits[31:28] and their size [words] in bits[27:0]
+  
+  const uint32_t *Words = (const uint32_t *)Buffer->Data;
+  const uint32_t NumWords = Buffer->Size / sizeof(uint32_t);
+  
+  const bool PSD = (DG->GetBoardFirmwareType() == "PSD");
+
+  uint32_t Events = 0;
+  uint32_t Word = 0;
+  
+  while(Word < NumWords and (Words[Word] >> 28) == 0xA){
+    uint32_t Size = Words[Word] & 0x0fffffff;
+    if(Size == 0 or Word + Size > NumWords)
+      break;
+
+    if(!PSD)
+      Events++;
+
+    // The events of a DPP board aggregate are counted from the size
+    // and format of its channel aggregates without visiting them (see
+    // ADAQDigitizer::DecodePSDBuffer() for the format)
+    else{
+      const uint32_t End = Word + Size;
+      uint32_t ChWord = Word + 4;
+
+      while(ChWord + 2 <= End){
+	const uint32_t ChSize = Words[ChWord] & 0x003fffff;
+	const uint32_t Format = Words[ChWord + 1];
+	const uint32_t EventWords = 1 + ((Format & (1u << 27)) ? 4 * (Format & 0xffff) : 0)
+	  + ((Format >> 28) & 1) + ((Format >> 30) & 1);
+
+	if(ChSize < 2 or ChWord + ChSize > End)
+	  break;
+
+	Events += (ChSize - 2) / EventWords;
+	ChWord += ChSize;
+      }
+    }
+
+    Word += Size;
+  }
+  
+  return Events;
+}
+
+
+void ADAQReadoutPipeline::MeasureLatency(ADAQReadoutBuffer *Buffer, uint64_t NowNs)
+{
+  // The trigger time of the oldest (first) event in the transfer is
+  // estimated from its trigger time tag, unwrapped across rollovers
+  // and referenced to Start(). Only STD firmware boards are
+  // considered: DPP board aggregates carry the same 0xA header tag
+  // but no event trigger time tag in their fourth word.
+
+  const uint32_t *Words = (const uint32_t *)Buffer->Data;
+
+  if(!STDFirmware or Buffer->Size < 4*sizeof(uint32_t) or (Words[0] >> 28) != 0xA)
+    return;
+
+  const unsigned int Bits = DG->GetTimeStampSize();
+  const uint32_t Mask = (Bits >= 32 or Bits == 0) ? 0xffffffff : ((1u << Bits) - 1);
+  const uint32_t TimeTag = Words[3] & Mask;
+
+  if(TimeTag < LastTimeTag)
+    TimeTagRollovers++;
+  LastTimeTag = TimeTag;
+
+  const uint64_t Ticks = (TimeTagRollovers * ((uint64_t)Mask + 1)) + TimeTag;
+  const uint64_t TriggerNs = StartTimeNs + Ticks * DG->GetTimeStampUnit();
+
+  if(NowNs < TriggerNs)
+    return;
+
+  const uint64_t Latency = NowNs - TriggerNs;
+  
+  LatencySamples++;
+  LatencySumNs += Latency;
+  if(Latency > LatencyMaxNs)
+    LatencyMaxNs = Latency;
+}
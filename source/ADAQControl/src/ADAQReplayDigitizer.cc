@@ -0,0 +1,455 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQReplayDigitizer.cc
+// date: 16 Oct 26
+//
+// desc: ADAQReplayDigitizer replays the block transfers of a board
+//       recorded in a raw dump in place of a digitizer. See the
+//       header file for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+// Boost
+#include <boost/thread.hpp>
+
+// ADAQ
+#include "ADAQReplayDigitizer.hh"
+
+
+ADAQReplayDigitizer::ADAQReplayDigitizer(ZBoardType Type, // ADAQ-specific device type identifier
+					 int ID,          // ADAQ-specific user-specified ID
+					 uint32_t Address,// Unused; kept for interface parity
+					 int LN,          // Link number; groups boards in ADAQReadoutEngine
+					 int CN)          // Unused; kept for interface parity
+  : ADAQEmulatedDigitizer(Type, ID, Address, LN, CN),
+    DumpFileName(""), SourceBoardID(-1), NumLoops(1),
+    RecordedEvents(0), MaxFrameSize(0),
+    NextFrame(0), Loop(0),
+    ReleasedEvents(0), ReplayedEvents(0), ReplayedFrames(0), ReplayedBytes(0)
+{;}
+
+
+ADAQReplayDigitizer::~ADAQReplayDigitizer()
+{;}
+
+
+int ADAQReplayDigitizer::SetDumpFile(string Name, int ID)
+{
+  if(LinkEstablished){
+    if(Verbose)
+      cout << "ADAQReplayDigitizer[" << BoardID << "] : Error! The dump file must be set before the link is opened!"
+	   << endl;
+    return -42;
+  }
+
+  DumpFileName = Name;
+  SourceBoardID = ID;
+  return 0;
+}
+
+
+int ADAQReplayDigitizer::OpenLink()
+{
+  CommandStatus = -42;
+
+  if(LinkEstablished){
+    if(Verbose)
+      cout << "ADAQReplayDigitizer[" << BoardID << "] : Error opening link! Link is already open!"
+	   << endl;
+    return CommandStatus;
+  }
+
+  Reader.SetVerbose(Verbose);
+
+  if(Reader.Open(DumpFileName) != 0){
+    if(Verbose)
+      cout << "ADAQReplayDigitizer[" << BoardID << "] : Error opening link! Could not read the dump file '"
+	   << DumpFileName << "'!" << endl;
+    return CommandStatus;
+  }
+
+  // The dump sets the firmware, which must be known to the emulator
+  // before its link is opened
+
+  if(IndexDump() != 0 or ADAQEmulatedDigitizer::OpenLink() != 0){
+    Reader.Close();
+    Frames.clear();
+    return (CommandStatus = -42);
+  }
+
+  if(Verbose)
+    cout << "ADAQReplayDigitizer[" << BoardID << "] : Replaying board " << Frames[0].Header->BoardID
+	 << " of '" << DumpFileName << "'\n"
+	 << "--> Block transfers: " << Frames.size() << "\n"
+	 << "--> Events         : " << RecordedEvents << "\n"
+	 << "--> Record length  : " << EmulatedRecordLength << " samples\n"
+	 << "--> Channel mask   : 0x" << hex << ChannelEnableMask << dec << "\n"
+	 << "--> Passes         : " << (NumLoops ? to_string(NumLoops) : string("endless")) << "\n"
+	 << endl;
+
+  return CommandStatus;
+}
+
+
+int ADAQReplayDigitizer::CloseLink()
+{
+  ADAQEmulatedDigitizer::CloseLink();
+
+  // The frames point into the mapping of the dump
+  Frames.clear();
+  FrameEvents.clear();
+  FrameOffsets.clear();
+  Reader.Close();
+
+  return CommandStatus;
+}
+
+
+int ADAQReplayDigitizer::IndexDump()
+{
+  const int ID = (SourceBoardID < 0) ? BoardID : SourceBoardID;
+
+  Frames.clear();
+  FrameEvents.clear();
+  FrameOffsets.clear();
+  RecordedEvents = 0;
+  MaxFrameSize = 0;
+
+  uint32_t MaxFrameEvents = 0;
+
+  ADAQRawDumpFrame Frame;
+  for(uint64_t f=0; f<Reader.GetNumFrames(); f++){
+    Reader.GetFrame(f, Frame);
+    if(Frame.Header->BoardID != ID)
+      continue;
+
+    // Counting the events walks the event headers, which also reads
+    // the dump into the page cache before the replay is timed
+
+    const uint32_t Events = CountFrameEvents(Frame);
+
+    Frames.push_back(Frame);
+    FrameEvents.push_back(Events);
+    FrameOffsets.push_back(RecordedEvents);
+
+    RecordedEvents += Events;
+    MaxFrameSize = max(MaxFrameSize, Frame.Header->Size);
+    MaxFrameEvents = max(MaxFrameEvents, Events);
+  }
+
+  if(Frames.empty()){
+    if(Verbose)
+      cout << "ADAQReplayDigitizer[" << BoardID << "] : Error opening link! The dump holds no block transfers of board "
+	   << ID << "!" << endl;
+    return -42;
+  }
+
+  const ADAQRawDumpFrameHeader *Header = Frames[0].Header;
+
+  if(Header->BoardType != BoardType){
+    if(Verbose)
+      cout << "ADAQReplayDigitizer[" << BoardID << "] : Error opening link! The board type differs from that of the recorded board!"
+	   << endl;
+    return -42;
+  }
+
+  const bool PSD = (Header->Firmware == ADAQRawDump::zFirmwarePSD);
+  EmulatedFirmwareType = PSD ? "PSD" : "STD";
+
+  // The recorded settings are taken from the first buffer
+
+  const uint32_t *Words = (const uint32_t *)Frames[0].Data;
+  const uint32_t NumWords = Header->Size / sizeof(uint32_t);
+
+  if(!PSD and NumWords >= 4){
+    const uint32_t EventSize = Words[0] & 0x0fffffff;
+    ChannelEnableMask = (Words[1] & 0xff) | ((Words[2] >> 16) & 0xff00);
+
+    const int NumEnabled = __builtin_popcount(ChannelEnableMask);
+    if(NumEnabled > 0 and EventSize > 4)
+      EmulatedRecordLength = 2 * ((EventSize - 4) / NumEnabled);
+
+    MaxNumEventsBLT = max(MaxFrameEvents, (uint32_t)1);
+  }
+  else if(PSD and NumWords >= 4){
+    const uint32_t AggregateSize = min(Words[0] & 0x0fffffff, NumWords);
+    const uint32_t PairMask = Words[1] & 0xff;
+
+    ChannelEnableMask = 0;
+    for(int pair=0; pair<8; pair++)
+      if(PairMask & (1 << pair))
+	ChannelEnableMask |= 0x3 << (2*pair);
+
+    uint32_t Samples = 0;
+    uint32_t ChWord = 4;
+    while(ChWord + 2 <= AggregateSize){
+      const uint32_t ChSize = Words[ChWord] & 0x003fffff;
+      const uint32_t Format = Words[ChWord + 1];
+      if(Format & (1u << 27))
+	Samples = max(Samples, 8 * (Format & 0xffff));
+      if(ChSize < 2)
+	break;
+      ChWord += ChSize;
+    }
+    if(Samples > 0)
+      EmulatedRecordLength = Samples;
+
+    EventsPerAggregate = max(MaxFrameEvents, (uint32_t)1);
+  }
+
+  // The emulated FPGA memory, which also sizes the DPP event arrays,
+  // must hold the largest recorded transfer
+  MemoryBlocks = max(MemoryBlocks, MaxFrameEvents);
+
+  return 0;
+}
+
+
+uint32_t ADAQReplayDigitizer::CountFrameEvents(const ADAQRawDumpFrame &Frame)
+{
+  const uint32_t *Words = (const uint32_t *)Frame.Data;
+  const uint32_t NumWords = Frame.Header->Size / sizeof(uint32_t);
+
+  uint32_t Events = 0;
+  uint32_t Word = 0;
+
+  // STD firmware: events begin with 0xA in bits[31:28] and their
+  // size [words] in bits[27:0]
+
+  if(Frame.Header->Firmware != ADAQRawDump::zFirmwarePSD){
+    while(Word < NumWords and (Words[Word] >> 28) == 0xA){
+      const uint32_t Size = Words[Word] & 0x0fffffff;
+      if(Size == 0)
+	break;
+      Word += Size;
+      Events++;
+    }
+    return Events;
+  }
+
+  // DPP-PSD firmware: the events of every channel aggregate of every
+  // board aggregate (see ADAQDigitizer::DecodePSDBuffer()), counted
+  // from the aggregate sizes and formats
+
+  while(Word + 4 <= NumWords and (Words[Word] >> 28) == 0xA){
+    const uint32_t AggregateSize = Words[Word] & 0x0fffffff;
+    if(AggregateSize < 4 or Word + AggregateSize > NumWords)
+      break;
+
+    uint32_t ChWord = Word + 4;
+    while(ChWord + 2 <= Word + AggregateSize){
+      const uint32_t ChSize = Words[ChWord] & 0x003fffff;
+      const uint32_t Format = Words[ChWord + 1];
+      const uint32_t SampleWords = (Format & (1u << 27)) ? 4 * (Format & 0xffff) : 0;
+      const uint32_t EventWords = 1 + SampleWords + ((Format >> 28) & 1) + ((Format >> 30) & 1);
+      if(ChSize < 2)
+	break;
+      Events += (ChSize - 2) / EventWords;
+      ChWord += ChSize;
+    }
+    Word += AggregateSize;
+  }
+
+  return Events;
+}
+
+
+int ADAQReplayDigitizer::SendSWTrigger()
+{
+  // The triggers are those of the recorded run
+  return AcquisitionRunning ? 0 : -42;
+}
+
+
+// The recorded buffers fix the channels, the record length, and the
+// events per transfer; the settings of the recorded board are kept
+
+int ADAQReplayDigitizer::SetChannelEnableMask(uint32_t)
+{
+  return 0;
+}
+
+
+int ADAQReplayDigitizer::SetRecordLength(uint32_t)
+{
+  return 0;
+}
+
+
+int ADAQReplayDigitizer::SetMaxNumEventsBLT(uint32_t)
+{
+  return 0;
+}
+
+
+int ADAQReplayDigitizer::SetDPPEventAggregation(int, int)
+{
+  return 0;
+}
+
+
+int ADAQReplayDigitizer::SWStartAcquisition()
+{
+  {
+    boost::mutex::scoped_lock Lock(EmulatorMutex);
+    NextFrame = 0;
+    Loop = 0;
+    ReleasedEvents = ReplayedEvents = 0;
+    ReplayedFrames = ReplayedBytes = 0;
+  }
+  return ADAQEmulatedDigitizer::SWStartAcquisition();
+}
+
+
+int ADAQReplayDigitizer::ClearData()
+{
+  // Recorded events are never discarded such that every replay holds
+  // the same data
+  return 0;
+}
+
+
+int ADAQReplayDigitizer::ReadData(char *Buffer, uint32_t *BufferSize)
+{
+  *BufferSize = 0;
+
+  {
+    boost::mutex::scoped_lock Lock(EmulatorMutex);
+
+    if(!AcquisitionRunning)
+      return 0;
+
+    UpdatePendingEvents();
+
+    if(PendingEvents == 0)
+      return 0;
+
+    // Buffers that were not obtained from MallocReadoutBuffer() are
+    // assumed to be large enough for the largest recorded transfer
+
+    const uint32_t Size = Frames[NextFrame].Header->Size;
+
+    map<char *, uint32_t>::iterator It = BufferSizes.find(Buffer);
+    if(It != BufferSizes.end() and It->second < Size){
+      if(Verbose)
+	cout << "ADAQReplayDigitizer[" << BoardID << "] : Error! The PC buffer is smaller than the recorded transfer!"
+	     << endl;
+      return -42;
+    }
+
+    memcpy(Buffer, Frames[NextFrame].Data, Size);
+    *BufferSize = Size;
+
+    ReplayedEvents += FrameEvents[NextFrame];
+    ReplayedFrames++;
+    ReplayedBytes += Size;
+
+    if(++NextFrame == Frames.size()){
+      NextFrame = 0;
+      Loop++;
+    }
+  }
+
+  if(LinkBandwidth > 0.)
+    boost::this_thread::sleep(boost::posix_time::microseconds((int64_t)(*BufferSize / LinkBandwidth)));
+
+  return 0;
+}
+
+
+int ADAQReplayDigitizer::MallocReadoutBuffer(char **Buffer, uint32_t *Size)
+{
+  // Size the buffer for the largest recorded transfer
+
+  if(MaxFrameSize == 0)
+    return ADAQEmulatedDigitizer::MallocReadoutBuffer(Buffer, Size);
+
+  *Size = MaxFrameSize;
+  *Buffer = new char[*Size];
+  BufferSizes[*Buffer] = *Size;
+
+  return 0;
+}
+
+
+bool ADAQReplayDigitizer::GetReplayDone()
+{
+  return (!Frames.empty() and NumLoops > 0 and Loop >= NumLoops);
+}
+
+
+uint64_t ADAQReplayDigitizer::GetRemainingEvents()
+{
+  // The events not yet replayed; an endless loop never runs out
+
+  if(NumLoops == 0)
+    return (uint64_t)-1;
+
+  if(Loop >= NumLoops)
+    return 0;
+
+  return (uint64_t)(NumLoops - Loop - 1) * RecordedEvents + (RecordedEvents - FrameOffsets[NextFrame]);
+}
+
+
+uint32_t ADAQReplayDigitizer::UpdatePendingEvents()
+{
+  // The events in the emulated FPGA memory are the events that have
+  // been triggered but not yet read out. Only whole recorded
+  // transfers can be read out, so no events are reported until all
+  // events of the next transfer have been triggered.
+
+  if(Frames.empty() or GetReplayDone()){
+    PendingEvents = 0;
+    return PendingEvents;
+  }
+
+  const uint64_t Remaining = GetRemainingEvents();
+
+  // In "as fast as possible" mode every remaining event has triggered
+
+  if(TriggerRate <= 0.){
+    PendingEvents = max((uint32_t)min(Remaining, (uint64_t)MemoryBlocks), (uint32_t)1);
+    return PendingEvents;
+  }
+
+  // Otherwise the trigger clock releases the events at the trigger
+  // rate; none are lost, but the memory reports itself full once the
+  // events waiting exceed it
+
+  chrono::duration<double> Elapsed = chrono::steady_clock::now() - StartTime;
+  uint64_t Expected = (uint64_t)(Elapsed.count() * TriggerRate);
+
+  if(Expected > TriggeredEvents){
+    ReleasedEvents += Expected - TriggeredEvents;
+    TriggeredEvents = Expected;
+  }
+
+  if(Remaining < ReleasedEvents - ReplayedEvents)
+    ReleasedEvents = ReplayedEvents + Remaining;
+
+  if(ReplayedEvents + FrameEvents[NextFrame] > ReleasedEvents)
+    PendingEvents = 0;
+  else
+    PendingEvents = max((uint32_t)min(ReleasedEvents - ReplayedEvents, (uint64_t)MemoryBlocks), (uint32_t)1);
+
+  return PendingEvents;
+}
@@ -0,0 +1,262 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQTimeSorter.cc
+// date: 16 Oct 26
+//
+// desc: ADAQTimeSorter unwraps trigger time tags into 64-bit
+//       timestamps and merges events from all channels and boards
+//       into time order. See the header file for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <algorithm>
+#include <functional>
+using namespace std;
+
+// ADAQ
+#include "ADAQTimeSorter.hh"
+
+
+ADAQTimeSorter::ADAQTimeSorter()
+  : LastKey(0), LastStream(0),
+    Window(1000000000), MaxPendingEvents(1000000), NumPending(0),
+    NewestTimeStamp(0), LastReleased(0), Released(false), Flushing(false),
+    LateEvents(0), ForcedReleases(0)
+{;}
+
+
+ADAQTimeSorter::~ADAQTimeSorter()
+{
+  for(size_t s=0; s<Streams.size(); s++)
+    delete Streams[s];
+}
+
+
+void ADAQTimeSorter::SetTimeStampFormat(int BoardID, uint32_t Bits, uint32_t Unit)
+{
+  if(Bits == 0 or Bits > 32)
+    Bits = 32;
+  if(Unit == 0)
+    Unit = 1;
+
+  Formats[BoardID] = make_pair(Bits, Unit);
+}
+
+
+void ADAQTimeSorter::AddDigitizer(ADAQDigitizer *DG)
+{
+  SetTimeStampFormat(DG->GetBoardID(), DG->GetTimeStampSize(), DG->GetTimeStampUnit());
+}
+
+
+void ADAQTimeSorter::Reset()
+{
+  for(size_t s=0; s<Streams.size(); s++)
+    delete Streams[s];
+  Streams.clear();
+  StreamMap.clear();
+  Heap.clear();
+
+  LastKey = 0;
+  LastStream = 0;
+  NumPending = 0;
+  NewestTimeStamp = LastReleased = 0;
+  Released = Flushing = false;
+  LateEvents = ForcedReleases = 0;
+}
+
+
+uint64_t ADAQTimeSorter::GetNumRollovers()
+{
+  uint64_t Rollovers = 0;
+  for(size_t s=0; s<Streams.size(); s++)
+    Rollovers += Streams[s]->Rollovers;
+  return Rollovers;
+}
+
+
+ADAQTimeSorter::Stream *ADAQTimeSorter::GetStream(int BoardID, int ChannelID, uint32_t *Index)
+{
+  const uint64_t Key = ((uint64_t)(uint32_t)BoardID << 32) | (uint32_t)(ChannelID + 1);
+
+  if(Key == LastKey and !Streams.empty()){
+    *Index = LastStream;
+    return Streams[LastStream];
+  }
+
+  map<uint64_t, uint32_t>::iterator It = StreamMap.find(Key);
+
+  if(It == StreamMap.end()){
+    Stream *S = new Stream;
+    S->BoardID = BoardID;
+    S->ChannelID = ChannelID;
+
+    uint32_t Bits = 31, Unit = 8;
+    map<int, pair<uint32_t, uint32_t> >::iterator F = Formats.find(BoardID);
+    if(F != Formats.end()){
+      Bits = F->second.first;
+      Unit = F->second.second;
+    }
+    S->Mask = (Bits >= 32) ? 0xffffffff : ((1u << Bits) - 1);
+    S->Unit = Unit;
+
+    S->LastRawTimeTag = 0;
+    S->Rollovers = 0;
+    S->Started = false;
+    S->LastTimeStamp = 0;
+
+    S->Ring.resize(64);
+    S->Head = S->Count = 0;
+
+    It = StreamMap.insert(make_pair(Key, (uint32_t)Streams.size())).first;
+    Streams.push_back(S);
+  }
+
+  LastKey = Key;
+  LastStream = It->second;
+
+  *Index = LastStream;
+  return Streams[LastStream];
+}
+
+
+uint64_t ADAQTimeSorter::Unwrap(int BoardID, int ChannelID, uint32_t RawTimeTag)
+{
+  uint32_t Index;
+  Stream *S = GetStream(BoardID, ChannelID, &Index);
+
+  const uint32_t TimeTag = RawTimeTag & S->Mask;
+
+  if(S->Started and TimeTag < S->LastRawTimeTag)
+    S->Rollovers++;
+  S->LastRawTimeTag = TimeTag;
+  S->Started = true;
+
+  const uint64_t Ticks = S->Rollovers * ((uint64_t)S->Mask + 1) + TimeTag;
+  S->LastTimeStamp = Ticks * S->Unit;
+
+  return S->LastTimeStamp;
+}
+
+
+void ADAQTimeSorter::GrowRing(Stream *S)
+{
+  // Unroll the ring into a buffer of twice the size such that the
+  // held events are again contiguous starting at index 0
+
+  vector<ADAQTimeOrderedEvent> Ring(2 * S->Ring.size());
+
+  for(uint32_t i=0; i<S->Count; i++)
+    Ring[i] = S->Ring[(S->Head + i) % S->Ring.size()];
+
+  S->Ring.swap(Ring);
+  S->Head = 0;
+}
+
+
+uint64_t ADAQTimeSorter::Push(int BoardID, int ChannelID, uint32_t RawTimeTag, uint64_t Tag)
+{
+  const uint64_t TimeStamp = Unwrap(BoardID, ChannelID, RawTimeTag);
+
+  Stream *S = Streams[LastStream];
+  const uint32_t Index = LastStream;
+
+  if(S->Count == S->Ring.size())
+    GrowRing(S);
+
+  ADAQTimeOrderedEvent &Event = S->Ring[(S->Head + S->Count) % S->Ring.size()];
+  Event.TimeStamp = TimeStamp;
+  Event.RawTimeTag = RawTimeTag;
+  Event.BoardID = BoardID;
+  Event.ChannelID = ChannelID;
+  Event.Tag = Tag;
+
+  // Only the head of a stream is in the heap; later events of the
+  // stream enter the heap as the events ahead of them are popped
+  if(S->Count == 0){
+    Heap.push_back(make_pair(TimeStamp, Index));
+    push_heap(Heap.begin(), Heap.end(), greater<pair<uint64_t, uint32_t> >());
+  }
+  S->Count++;
+  NumPending++;
+
+  if(Released and TimeStamp < LastReleased)
+    LateEvents++;
+
+  if(TimeStamp > NewestTimeStamp)
+    NewestTimeStamp = TimeStamp;
+
+  Flushing = false;
+
+  return TimeStamp;
+}
+
+
+bool ADAQTimeSorter::Releasable(uint64_t TimeStamp)
+{
+  if(Flushing)
+    return true;
+
+  // No stream can deliver an event earlier than the last event it
+  // has delivered, so the oldest of those bounds all future events
+  bool Ready = true;
+  for(size_t s=0; s<Streams.size(); s++){
+    if(Streams[s]->LastTimeStamp < TimeStamp){
+      Ready = false;
+      break;
+    }
+  }
+  if(Ready)
+    return true;
+
+  // Bound the memory held while waiting for quiet streams
+  if(NewestTimeStamp - TimeStamp > Window or NumPending > MaxPendingEvents){
+    ForcedReleases++;
+    return true;
+  }
+
+  return false;
+}
+
+
+bool ADAQTimeSorter::Pop(ADAQTimeOrderedEvent &Event)
+{
+  if(Heap.empty())
+    return false;
+
+  if(!Releasable(Heap.front().first))
+    return false;
+
+  pop_heap(Heap.begin(), Heap.end(), greater<pair<uint64_t, uint32_t> >());
+  const uint32_t Index = Heap.back().second;
+  Heap.pop_back();
+
+  Stream *S = Streams[Index];
+  Event = S->Ring[S->Head];
+  S->Head = (S->Head + 1) % S->Ring.size();
+  S->Count--;
+  NumPending--;
+
+  if(S->Count > 0){
+    Heap.push_back(make_pair(S->Ring[S->Head].TimeStamp, Index));
+    push_heap(Heap.begin(), Heap.end(), greater<pair<uint64_t, uint32_t> >());
+  }
+
+  LastReleased = Event.TimeStamp;
+  Released = true;
+
+  return true;
+}
@@ -0,0 +1,710 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQWaveformAnalyzer.cc
+// date: 16 Oct 26
+//
+// desc: ADAQWaveformAnalyzer computes the baseline, pulse height,
+//       pulse area, and PSD integrals of batches of waveforms with
+//       SIMD kernels, and optionally the CFD or leading-edge time of
+//       the pulse. See the header file for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// ADAQ
+#include "ADAQWaveformAnalyzer.hh"
+
+
+// The kernels operate on a contiguous range of samples: Sum() returns
+// the sum of the samples, Scan() returns the largest ("Max" is true)
+// or smallest sample of the record along with the sum of all samples
+// and, if the pile-up detection is enabled, the number of pulses, all
+// in one pass, and Find() returns the position of the first occurrence
+// of a value. SSE2 and AVX2 versions are selected at runtime.
+
+namespace WaveformKernels{
+
+  // The pile-up detection counts the upward crossings of the
+  // threshold "Threshold" by the derivative Polarity*(S[i] - S[i-Gap])
+  // that are at least "Separation" samples apart
+  struct PileUpParameters{
+    uint32_t Gap;
+    int Polarity, Threshold;
+    uint32_t Separation;
+  };
+
+  uint64_t SumScalar(const uint16_t *S, uint32_t N)
+  {
+    uint64_t Sum = 0;
+    for(uint32_t i=0; i<N; i++)
+      Sum += S[i];
+    return Sum;
+  }
+
+  uint32_t FindScalar(const uint16_t *S, uint32_t N, uint16_t Value)
+  {
+    uint32_t i = 0;
+    while(i < N and S[i] != Value)
+      i++;
+    return i;
+  }
+
+  inline void CountCrossing(uint32_t i, uint32_t Sep, uint32_t *Pulses, uint32_t *Last)
+  {
+    if(*Pulses == 0 or i - *Last >= Sep){
+      (*Pulses)++;
+      *Last = i;
+    }
+  }
+
+  inline int Derivative(const uint16_t *S, uint32_t i, const PileUpParameters *P)
+  {
+    return P->Polarity * ((int)S[i] - S[i - P->Gap]);
+  }
+
+  // Counts the crossings of samples [First, N), continuing the count
+  // of the samples before "First"
+  void CountPulsesFrom(const uint16_t *S, uint32_t First, uint32_t N, const PileUpParameters *P,
+		       uint32_t *Pulses, uint32_t *Last)
+  {
+    if(First >= N)
+      return;
+
+    bool Above = (Derivative(S, First - 1, P) > P->Threshold);
+    for(uint32_t i=First; i<N; i++){
+      const bool Now = (Derivative(S, i, P) > P->Threshold);
+      if(Now and !Above)
+	CountCrossing(i, P->Separation, Pulses, Last);
+      Above = Now;
+    }
+  }
+
+  // Sum, extreme, and (if "P" is not NULL) the pulses of samples
+  // [First, N) added to those of the samples before "First"
+  uint16_t ScanFrom(const uint16_t *S, uint32_t First, uint32_t N, bool Max,
+		    const PileUpParameters *P, uint16_t Value, uint64_t *Sum,
+		    uint32_t *Pulses, uint32_t *Last)
+  {
+    uint64_t Total = 0;
+    if(Max)
+      for(uint32_t i=First; i<N; i++){
+	Total += S[i];
+	Value = max(Value, S[i]);
+      }
+    else
+      for(uint32_t i=First; i<N; i++){
+	Total += S[i];
+	Value = min(Value, S[i]);
+      }
+    *Sum += Total;
+
+    if(P)
+      CountPulsesFrom(S, max(First, P->Gap + 1), N, P, Pulses, Last);
+    return Value;
+  }
+
+  uint16_t ScanScalar(const uint16_t *S, uint32_t N, bool Max, const PileUpParameters *P,
+		      uint64_t *Sum, uint32_t *Pulses)
+  {
+    uint32_t Last = 0;
+    *Sum = 0;
+    *Pulses = 0;
+    return ScanFrom(S, 0, N, Max, P, S[0], Sum, Pulses, &Last);
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+
+  // The vector scans start at the first sample with a derivative
+  // (Gap + 1, or 0 without pile-up detection) such that every loaded
+  // vector serves the sum, the extreme, and the derivative; the sum
+  // and extreme of the samples before it and after the last full
+  // vector are done by ScanFrom(), and the derivative of the latter
+  // by one more vector ending at the last sample. The samples are at
+  // most 14 bits, such that the 16-bit signed differences cannot
+  // overflow. The derivative is compared to the threshold once per
+  // sample; the mask of the previous sample is the mask shifted by
+  // one sample (two bits) with the last sample of the previous vector
+  // carried in, and only the (rare) crossings are handled by scalar
+  // code.
+
+  // Counts the crossings of the samples from "i" on given by the mask
+  // of upward crossings (two bits per sample)
+  inline void CountCrossings(uint32_t Mask, uint32_t i, const PileUpParameters *P,
+			     uint32_t *Pulses, uint32_t *Last)
+  {
+    while(Mask){
+      const uint32_t Lane = __builtin_ctz(Mask) / 2;
+      Mask &= ~(3u << (2*Lane));
+      CountCrossing(i + Lane, P->Separation, Pulses, Last);
+    }
+  }
+
+  // The 32-bit lane accumulators are flushed periodically so that
+  // they cannot overflow for any record length
+  const uint32_t FlushInterval = 16384;
+
+  __attribute__((target("sse2")))
+  uint64_t SumSSE2(const uint16_t *S, uint32_t N)
+  {
+    const __m128i Zero = _mm_setzero_si128();
+    uint64_t Sum = 0;
+    uint32_t i = 0;
+
+    while(i+8 <= N){
+      __m128i Acc = _mm_setzero_si128();
+      const uint32_t End = min(N - (N - i) % 8, i + 8*FlushInterval);
+
+      for(; i<End; i+=8){
+	__m128i V = _mm_loadu_si128((const __m128i *)(S + i));
+	Acc = _mm_add_epi32(Acc, _mm_unpacklo_epi16(V, Zero));
+	Acc = _mm_add_epi32(Acc, _mm_unpackhi_epi16(V, Zero));
+      }
+
+      uint32_t Lanes[4];
+      _mm_storeu_si128((__m128i *)Lanes, Acc);
+      Sum += (uint64_t)Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+    }
+    return Sum + SumScalar(S + i, N - i);
+  }
+
+  __attribute__((target("sse2")))
+  uint32_t FindSSE2(const uint16_t *S, uint32_t N, uint16_t Value)
+  {
+    const __m128i Target = _mm_set1_epi16((short)Value);
+    uint32_t i = 0;
+    for(; i+8<=N; i+=8){
+      int Mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(S + i)), Target));
+      if(Mask)
+	return i + __builtin_ctz(Mask) / 2;
+    }
+    return i + FindScalar(S + i, N - i, Value);
+  }
+
+  __attribute__((target("sse2")))
+  uint16_t ScanSSE2(const uint16_t *S, uint32_t N, bool Max, const PileUpParameters *P,
+		    uint64_t *Sum, uint32_t *Pulses)
+  {
+    const uint32_t First = P ? P->Gap + 1 : 0;
+    if(First + 8 > N)
+      return ScanScalar(S, N, Max, P, Sum, Pulses);
+
+    // SSE2 only compares signed 16-bit integers, so the sign bit is
+    // flipped to map the unsigned samples onto the signed range
+    const __m128i Flip = _mm_set1_epi16((short)0x8000);
+    const __m128i Zero = _mm_setzero_si128();
+    const __m128i Threshold = _mm_set1_epi16((short)(P ? min(P->Threshold, 32767) : 0));
+
+    __m128i Ext = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(S + First)), Flip);
+    __m128i Acc = _mm_setzero_si128();
+    uint64_t Total = 0;
+    uint32_t Count = 0, Last = 0, Flush = 0;
+
+    // Whether the derivative of sample i-1 is above the threshold
+    uint32_t Carry = (P and Derivative(S, First - 1, P) > P->Threshold) ? 3 : 0;
+
+    uint32_t i = First;
+    for(; i+8<=N; i+=8){
+      const __m128i A = _mm_loadu_si128((const __m128i *)(S + i));
+      Acc = _mm_add_epi32(Acc, _mm_unpacklo_epi16(A, Zero));
+      Acc = _mm_add_epi32(Acc, _mm_unpackhi_epi16(A, Zero));
+
+      const __m128i F = _mm_xor_si128(A, Flip);
+      Ext = Max ? _mm_max_epi16(Ext, F) : _mm_min_epi16(Ext, F);
+
+      if(P){
+	const __m128i B = _mm_loadu_si128((const __m128i *)(S + i - P->Gap));
+	const __m128i D = (P->Polarity > 0) ? _mm_sub_epi16(A, B) : _mm_sub_epi16(B, A);
+
+	// Two mask bits per sample
+	const uint32_t Above = _mm_movemask_epi8(_mm_cmpgt_epi16(D, Threshold));
+	const uint32_t Mask = Above & ~((Above << 2) | Carry) & 0xFFFF;
+	Carry = Above >> 14;
+
+	if(Mask)
+	  CountCrossings(Mask, i, P, &Count, &Last);
+      }
+
+      if(++Flush == FlushInterval){
+	uint32_t Lanes[4];
+	_mm_storeu_si128((__m128i *)Lanes, Acc);
+	Total += (uint64_t)Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+	Acc = _mm_setzero_si128();
+	Flush = 0;
+      }
+    }
+
+    uint32_t Lanes[4];
+    _mm_storeu_si128((__m128i *)Lanes, Acc);
+    Total += (uint64_t)Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+
+    uint16_t Values[8];
+    _mm_storeu_si128((__m128i *)Values, _mm_xor_si128(Ext, Flip));
+    uint16_t Value = Values[0];
+    for(int l=1; l<8; l++)
+      Value = Max ? max(Value, Values[l]) : min(Value, Values[l]);
+
+    // The derivative of the last samples is taken from the vector
+    // ending at the last sample, whose lanes before "i" are dropped
+    if(P and i < N){
+      const uint32_t j = N - 8;
+      const __m128i A = _mm_loadu_si128((const __m128i *)(S + j));
+      const __m128i B = _mm_loadu_si128((const __m128i *)(S + j - P->Gap));
+      const __m128i D = (P->Polarity > 0) ? _mm_sub_epi16(A, B) : _mm_sub_epi16(B, A);
+
+      const uint32_t Above = _mm_movemask_epi8(_mm_cmpgt_epi16(D, Threshold)) >> (2*(i - j));
+      CountCrossings(Above & ~((Above << 2) | Carry), i, P, &Count, &Last);
+    }
+
+    // The samples before the first derivative carry no pulses
+    Value = ScanFrom(S, 0, First, Max, NULL, Value, &Total, &Count, &Last);
+    Value = ScanFrom(S, i, N, Max, NULL, Value, &Total, &Count, &Last);
+
+    *Sum = Total;
+    *Pulses = Count;
+    return Value;
+  }
+
+  __attribute__((target("avx2")))
+  uint64_t SumAVX2(const uint16_t *S, uint32_t N)
+  {
+    const __m256i Zero = _mm256_setzero_si256();
+    uint64_t Sum = 0;
+    uint32_t i = 0;
+
+    while(i+16 <= N){
+      __m256i Acc = _mm256_setzero_si256();
+      const uint32_t End = min(N - (N - i) % 16, i + 16*FlushInterval);
+
+      for(; i<End; i+=16){
+	__m256i V = _mm256_loadu_si256((const __m256i *)(S + i));
+	Acc = _mm256_add_epi32(Acc, _mm256_unpacklo_epi16(V, Zero));
+	Acc = _mm256_add_epi32(Acc, _mm256_unpackhi_epi16(V, Zero));
+      }
+
+      uint32_t Lanes[8];
+      _mm256_storeu_si256((__m256i *)Lanes, Acc);
+      for(int l=0; l<8; l++)
+	Sum += Lanes[l];
+    }
+    return Sum + SumScalar(S + i, N - i);
+  }
+
+  __attribute__((target("avx2")))
+  uint32_t FindAVX2(const uint16_t *S, uint32_t N, uint16_t Value)
+  {
+    const __m256i Target = _mm256_set1_epi16((short)Value);
+    uint32_t i = 0;
+    for(; i+16<=N; i+=16){
+      int Mask = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(S + i)), Target));
+      if(Mask)
+	return i + __builtin_ctz(Mask) / 2;
+    }
+    return i + FindScalar(S + i, N - i, Value);
+  }
+
+  __attribute__((target("avx2")))
+  uint16_t ScanAVX2(const uint16_t *S, uint32_t N, bool Max, const PileUpParameters *P,
+		    uint64_t *Sum, uint32_t *Pulses)
+  {
+    const uint32_t First = P ? P->Gap + 1 : 0;
+    if(First + 16 > N)
+      return ScanScalar(S, N, Max, P, Sum, Pulses);
+
+    const __m256i Zero = _mm256_setzero_si256();
+    const __m256i Threshold = _mm256_set1_epi16((short)(P ? min(P->Threshold, 32767) : 0));
+
+    __m256i Ext = _mm256_loadu_si256((const __m256i *)(S + First));
+    __m256i Acc = _mm256_setzero_si256();
+    uint64_t Total = 0;
+    uint32_t Count = 0, Last = 0, Flush = 0;
+
+    uint32_t Carry = (P and Derivative(S, First - 1, P) > P->Threshold) ? 3 : 0;
+
+    uint32_t i = First;
+    for(; i+16<=N; i+=16){
+      const __m256i A = _mm256_loadu_si256((const __m256i *)(S + i));
+      Acc = _mm256_add_epi32(Acc, _mm256_unpacklo_epi16(A, Zero));
+      Acc = _mm256_add_epi32(Acc, _mm256_unpackhi_epi16(A, Zero));
+      Ext = Max ? _mm256_max_epu16(Ext, A) : _mm256_min_epu16(Ext, A);
+
+      if(P){
+	const __m256i B = _mm256_loadu_si256((const __m256i *)(S + i - P->Gap));
+	const __m256i D = (P->Polarity > 0) ? _mm256_sub_epi16(A, B) : _mm256_sub_epi16(B, A);
+
+	const uint32_t Above = _mm256_movemask_epi8(_mm256_cmpgt_epi16(D, Threshold));
+	const uint32_t Mask = Above & ~((Above << 2) | Carry);
+	Carry = Above >> 30;
+
+	if(Mask)
+	  CountCrossings(Mask, i, P, &Count, &Last);
+      }
+
+      if(++Flush == FlushInterval){
+	uint32_t Lanes[8];
+	_mm256_storeu_si256((__m256i *)Lanes, Acc);
+	for(int l=0; l<8; l++)
+	  Total += Lanes[l];
+	Acc = _mm256_setzero_si256();
+	Flush = 0;
+      }
+    }
+
+    uint32_t Lanes[8];
+    _mm256_storeu_si256((__m256i *)Lanes, Acc);
+    for(int l=0; l<8; l++)
+      Total += Lanes[l];
+
+    uint16_t Values[16];
+    _mm256_storeu_si256((__m256i *)Values, Ext);
+    uint16_t Value = Values[0];
+    for(int l=1; l<16; l++)
+      Value = Max ? max(Value, Values[l]) : min(Value, Values[l]);
+
+    if(P and i < N){
+      const uint32_t j = N - 16;
+      const __m256i A = _mm256_loadu_si256((const __m256i *)(S + j));
+      const __m256i B = _mm256_loadu_si256((const __m256i *)(S + j - P->Gap));
+      const __m256i D = (P->Polarity > 0) ? _mm256_sub_epi16(A, B) : _mm256_sub_epi16(B, A);
+
+      const uint32_t Above = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi16(D, Threshold)) >> (2*(i - j));
+      CountCrossings(Above & ~((Above << 2) | Carry), i, P, &Count, &Last);
+    }
+
+    Value = ScanFrom(S, 0, First, Max, NULL, Value, &Total, &Count, &Last);
+    Value = ScanFrom(S, i, N, Max, NULL, Value, &Total, &Count, &Last);
+
+    *Sum = Total;
+    *Pulses = Count;
+    return Value;
+  }
+
+#endif
+
+  typedef uint64_t (*SumFunction)(const uint16_t *, uint32_t);
+  typedef uint16_t (*ScanFunction)(const uint16_t *, uint32_t, bool, const PileUpParameters *,
+				   uint64_t *, uint32_t *);
+  typedef uint32_t (*FindFunction)(const uint16_t *, uint32_t, uint16_t);
+
+  bool Supported(ZSIMDLevel Level)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(Level == zSIMDAVX2)
+      return __builtin_cpu_supports("avx2");
+    if(Level == zSIMDSSE2)
+      return __builtin_cpu_supports("sse2");
+#endif
+    return (Level == zSIMDScalar);
+  }
+
+  SumFunction GetSum(ZSIMDLevel Level)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    if(Level == zSIMDAVX2)
+      return SumAVX2;
+    if(Level == zSIMDSSE2)
+      return SumSSE2;
+#endif
+    return SumScalar;
+  }
+
+  ScanFunction GetScan(ZSIMDLevel Level)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    if(Level == zSIMDAVX2)
+      return ScanAVX2;
+    if(Level == zSIMDSSE2)
+      return ScanSSE2;
+#endif
+    return ScanScalar;
+  }
+
+  FindFunction GetFind(ZSIMDLevel Level)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    if(Level == zSIMDAVX2)
+      return FindAVX2;
+    if(Level == zSIMDSSE2)
+      return FindSSE2;
+#endif
+    return FindScalar;
+  }
+};
+using namespace WaveformKernels;
+
+
+void ADAQWaveformResults::Resize(uint32_t N)
+{
+  // The arrays only grow such that a results object reused for every
+  // batch does not allocate in steady state
+  if(N > Baseline.size()){
+    Baseline.resize(N);
+    PulseHeight.resize(N);
+    PulseArea.resize(N);
+    PSDTotalIntegral.resize(N);
+    PSDTailIntegral.resize(N);
+    PeakPosition.resize(N);
+    FineTime.resize(N);
+    PileUpCount.resize(N);
+  }
+  NumWaveforms = N;
+  NumRejected = 0;
+}
+
+
+ADAQWaveformAnalyzer::ADAQWaveformAnalyzer(uint32_t RL)
+  : RecordLength(RL), Polarity(-1), BaselineMin(0), BaselineMax(50),
+    PSDTotalStart(-10), PSDTotalStop(100), PSDTailStart(10), PSDTailStop(100),
+    TimingMethod(zTimingNone), TimingInterpolation(zInterpolationLinear),
+    CFDFraction(0.5), CFDDelay(2), LeadingEdgeThreshold(100.), SamplePeriod(4.),
+    PileUpMode(zPileUpOff), PileUpThreshold(50), PileUpGap(4), PileUpMinSeparation(20),
+    SIMDLevel(GetBestSIMDLevel()), Verbose(false)
+{;}
+
+
+ADAQWaveformAnalyzer::~ADAQWaveformAnalyzer()
+{;}
+
+
+ZSIMDLevel ADAQWaveformAnalyzer::GetBestSIMDLevel()
+{
+  if(Supported(zSIMDAVX2))
+    return zSIMDAVX2;
+  if(Supported(zSIMDSSE2))
+    return zSIMDSSE2;
+  return zSIMDScalar;
+}
+
+
+int ADAQWaveformAnalyzer::SetSIMDLevel(ZSIMDLevel Level)
+{
+  if(!Supported(Level)){
+    if(Verbose)
+      cout << "ADAQWaveformAnalyzer : Error! The requested SIMD level is not supported by this CPU!\n"
+	   << endl;
+    return -42;
+  }
+  SIMDLevel = Level;
+  return 0;
+}
+
+
+int ADAQWaveformAnalyzer::CheckRegions()
+{
+  if(RecordLength == 0 or BaselineMax <= BaselineMin or BaselineMax > RecordLength or
+     PSDTotalStop <= PSDTotalStart or PSDTailStop <= PSDTailStart){
+    if(Verbose)
+      cout << "ADAQWaveformAnalyzer : Error! The baseline region must lie within the record and the PSD regions must not be empty!\n"
+	   << endl;
+    return -42;
+  }
+
+  if(TimingMethod == zTimingCFD and (CFDFraction <= 0. or CFDFraction > 1. or CFDDelay == 0)){
+    if(Verbose)
+      cout << "ADAQWaveformAnalyzer : Error! The CFD fraction must be within (0, 1] and the delay at least one sample!\n"
+	   << endl;
+    return -42;
+  }
+
+  if(PileUpMode != zPileUpOff and (PileUpGap == 0 or PileUpGap + 1 >= RecordLength)){
+    if(Verbose)
+      cout << "ADAQWaveformAnalyzer : Error! The pile-up derivative gap must be at least one sample and shorter than the record!\n"
+	   << endl;
+    return -42;
+  }
+  return 0;
+}
+
+
+// The discriminator signal at sample "i", which rises through zero at
+// the leading edge of the pulse
+
+inline double ADAQWaveformAnalyzer::TimingSignal(const uint16_t *W, int i, double Baseline)
+{
+  if(TimingMethod == zTimingCFD)
+    return Polarity * ((W[i - CFDDelay] - Baseline) - CFDFraction * (W[i] - Baseline));
+  else
+    return Polarity * (W[i] - Baseline) - LeadingEdgeThreshold;
+}
+
+
+// Returns the time [samples] of the zero crossing of the discriminator
+// signal on the leading edge of the pulse peaking at "Peak", or -1 if
+// there is none
+
+double ADAQWaveformAnalyzer::FindTime(const uint16_t *W, double Baseline, uint32_t Peak)
+{
+  // The CFD signal is positive from the peak plus the delay onwards
+  // and the leading-edge signal from the peak; searching backwards
+  // from there finds the crossing closest to the peak, which is
+  // insensitive to noise before the pulse
+  const int Lowest = (TimingMethod == zTimingCFD) ? CFDDelay : 0;
+  int j = (TimingMethod == zTimingCFD) ? min(Peak + CFDDelay, RecordLength - 1) : Peak;
+
+  if(j <= Lowest or TimingSignal(W, j, Baseline) < 0.)
+    return -1.;
+
+  double Y1 = TimingSignal(W, j, Baseline), Y0 = 0.;
+  for(; j>Lowest; j--){
+    Y0 = TimingSignal(W, j - 1, Baseline);
+    if(Y0 < 0.)
+      break;
+    Y1 = Y0;
+  }
+  if(j == Lowest)
+    return -1.;
+
+  // The crossing lies between samples i and i+1
+  const int i = j - 1;
+  double X = Y0 / (Y0 - Y1);
+
+  if(TimingInterpolation == zInterpolationCubic and i - 1 >= Lowest and i + 2 < (int)RecordLength){
+
+    // The cubic through the samples i-1 .. i+2, with x = 0 at sample
+    // i, is solved for its root in [0, 1] by Newton's method starting
+    // from the linear estimate
+    const double Ym = TimingSignal(W, i - 1, Baseline);
+    const double Y2 = TimingSignal(W, i + 2, Baseline);
+
+    const double A0 = Y0;
+    const double A1 = -Ym/3. - Y0/2. + Y1 - Y2/6.;
+    const double A2 = (Ym + Y1)/2. - Y0;
+    const double A3 = (Y2 - Ym)/6. + (Y0 - Y1)/2.;
+
+    double C = X;
+    for(int n=0; n<4; n++){
+      const double P = A0 + C*(A1 + C*(A2 + C*A3));
+      const double D = A1 + C*(2.*A2 + C*3.*A3);
+      if(D == 0.)
+	break;
+      const double Step = P / D;
+      C -= Step;
+      if(fabs(Step) < 1e-4)
+	break;
+    }
+
+    // Keep the linear estimate if the cubic is not monotonic here
+    if(C >= 0. and C <= 1.)
+      X = C;
+  }
+
+  return i + X;
+}
+
+
+void ADAQWaveformAnalyzer::Analyze(const uint16_t *W,
+				   uint32_t Index,
+				   ADAQWaveformResults *Results)
+{
+  const SumFunction Sum = GetSum(SIMDLevel);
+
+  // The peak, the record sum, and the pile-up are found in one pass
+  const PileUpParameters PileUpScan = {PileUpGap, Polarity, (int)PileUpThreshold, PileUpMinSeparation};
+  uint64_t RecordSum = 0;
+  uint32_t Pulses = 0;
+  const uint16_t Value = GetScan(SIMDLevel)(W, RecordLength, Polarity > 0,
+					    (PileUpMode != zPileUpOff) ? &PileUpScan : NULL,
+					    &RecordSum, &Pulses);
+
+  const uint32_t PileUp = (Pulses > 1) ? min(Pulses - 1, 65535u) : 0;
+  Results->PileUpCount[Index] = PileUp;
+
+  // Rejected waveforms are not analyzed further
+  if(PileUp > 0 and PileUpMode == zPileUpReject){
+    Results->Baseline[Index] = 0.;
+    Results->PeakPosition[Index] = 0;
+    Results->PulseHeight[Index] = Results->PulseArea[Index] = 0.;
+    Results->PSDTotalIntegral[Index] = Results->PSDTailIntegral[Index] = 0.;
+    Results->FineTime[Index] = -1.;
+    Results->NumRejected++;
+    return;
+  }
+
+  const uint32_t BaselineSamples = BaselineMax - BaselineMin;
+  const double Baseline = (double)Sum(W + BaselineMin, BaselineSamples) / BaselineSamples;
+
+  // The first occurrence of the extreme sample is the peak
+  const uint32_t Peak = GetFind(SIMDLevel)(W, RecordLength, Value);
+
+  Results->Baseline[Index] = Baseline;
+  Results->PeakPosition[Index] = Peak;
+  Results->PulseHeight[Index] = Polarity * (Value - Baseline);
+  Results->PulseArea[Index] = Polarity * (RecordSum - RecordLength * Baseline);
+
+  // The PSD regions are clipped to the record
+  const int Start[2] = {PSDTotalStart, PSDTailStart};
+  const int Stop[2] = {PSDTotalStop, PSDTailStop};
+  double Integral[2] = {0., 0.};
+
+  for(int r=0; r<2; r++){
+    const int First = max((int)Peak + Start[r], 0);
+    const int Last = min((int)Peak + Stop[r], (int)RecordLength);
+    if(Last > First)
+      Integral[r] = Polarity * (Sum(W + First, Last - First) - (Last - First) * Baseline);
+  }
+
+  Results->PSDTotalIntegral[Index] = Integral[0];
+  Results->PSDTailIntegral[Index] = Integral[1];
+
+  double Time = -1.;
+  if(TimingMethod != zTimingNone){
+    Time = FindTime(W, Baseline, Peak);
+    if(Time >= 0.)
+      Time *= SamplePeriod;
+  }
+  Results->FineTime[Index] = Time;
+}
+
+
+int ADAQWaveformAnalyzer::AnalyzeBatch(const uint16_t *const *Waveforms,
+				       uint32_t N,
+				       ADAQWaveformResults *Results)
+{
+  if(CheckRegions() != 0)
+    return -42;
+
+  Results->Resize(N);
+  Results->Reject = (PileUpMode == zPileUpReject);
+  for(uint32_t w=0; w<N; w++)
+    Analyze(Waveforms[w], w, Results);
+
+  return 0;
+}
+
+
+int ADAQWaveformAnalyzer::AnalyzeBatch(const uint16_t *First,
+				       uint32_t N,
+				       uint32_t Stride,
+				       ADAQWaveformResults *Results)
+{
+  if(CheckRegions() != 0)
+    return -42;
+
+  Results->Resize(N);
+  Results->Reject = (PileUpMode == zPileUpReject);
+  for(uint32_t w=0; w<N; w++)
+    Analyze(First + (size_t)w * Stride, w, Results);
+
+  return 0;
+}
@@ -0,0 +1,337 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRawConvert.cc
+// date: 16 Oct 26
+//
+// desc: Converts the raw dump of a run (ADAQRawDumpWriter) into a
+//       standard ADAQ file. The frames of one board are decoded with
+//       the native STD or DPP-PSD decoders of ADAQDigitizer in
+//       parallel: each converter thread takes a contiguous range of
+//       frames, decodes it with its own decoder and event arena, and
+//       fills the WaveformTree of its own ADAQWriterStream in the
+//       parallel mode of ADAQReadoutManager. The entries of different
+//       threads are therefore interleaved by flush; the time stamps
+//       give the time order.
+//
+//       The time stamps are the trigger time tags unwrapped into 64-bit
+//       time stamps [ns] by ADAQTimeSorter. The time tags of a board
+//       (or DPP channel) must be unwrapped in readout order, so a
+//       sequential pass first decodes every frame and stores the time
+//       stamps of its events (8 bytes per event), which the converter
+//       threads then look up.
+//
+//       STD events give one entry with the waveforms of all enabled
+//       channels; DPP-PSD events give one entry per event with the
+//       integrals, baseline, pile-up flag, and (if recorded) the
+//       waveform of the triggering channel only. No digitizer is
+//       needed: the decoders are those of an ADAQEmulatedDigitizer of
+//       the board type in the frame headers. A dump with several
+//       boards is converted one board at a time. Requires ROOT 6.10
+//       or newer (TBufferMerger).
+//
+// 2run: $ ./bin/ADAQRawConvert <Dump> <Out> [NumThreads] [BoardID]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+using namespace std;
+
+// Boost
+#include <boost/thread.hpp>
+
+// ADAQ
+#include "ADAQRawDumpReader.hh"
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQEventArena.hh"
+#include "ADAQPSDEventArena.hh"
+#include "ADAQTimeSorter.hh"
+#include "ADAQReadoutManager.hh"
+
+
+// A digitizer of the board type and firmware in the frame header
+// whose decoders need no hardware
+ADAQDigitizer *CreateDecoder(const ADAQRawDumpFrameHeader *Header)
+{
+  ADAQEmulatedDigitizer *DG = new ADAQEmulatedDigitizer((ZBoardType)Header->BoardType, Header->BoardID);
+  DG->SetFirmwareType((Header->Firmware == ADAQRawDump::zFirmwarePSD) ? "PSD" : "STD");
+  DG->OpenLink();
+  return DG;
+}
+
+
+// The unwrapped time stamps [ns] of the events of every frame, in the
+// order in which Convert() fills them
+void UnwrapTimeStamps(ADAQRawDumpReader *Reader, const vector<uint64_t> *Frames,
+		      vector<vector<uint64_t> > *TimeStamps)
+{
+  ADAQRawDumpFrame Frame;
+  Reader->GetFrame((*Frames)[0], Frame);
+
+  ADAQDigitizer *DG = CreateDecoder(Frame.Header);
+  const int BoardID = Frame.Header->BoardID;
+  const bool PSD = (Frame.Header->Firmware == ADAQRawDump::zFirmwarePSD);
+
+  ADAQTimeSorter Sorter;
+  Sorter.AddDigitizer(DG);
+
+  ADAQEventArena Arena;
+  ADAQPSDEventArena PSDArena;
+
+  TimeStamps->assign(Frames->size(), vector<uint64_t>());
+
+  for(uint64_t f=0; f<Frames->size(); f++){
+    Reader->GetFrame((*Frames)[f], Frame);
+    vector<uint64_t> &T = (*TimeStamps)[f];
+
+    if(!PSD){
+      if(DG->DecodeSTDBuffer(Frame.Data, Frame.Header->Size, &Arena) != 0)
+	continue;
+
+      T.resize(Arena.GetNumEvents());
+      for(uint32_t e=0; e<Arena.GetNumEvents(); e++)
+	T[e] = Sorter.Unwrap(BoardID, -1, Arena.GetTriggerTimeTag(e));
+    }
+    else{
+      if(DG->DecodePSDBuffer(Frame.Data, Frame.Header->Size, &PSDArena) != 0)
+	continue;
+
+      T.reserve(PSDArena.GetTotalEvents());
+      for(int ch=0; ch<DG->GetNumChannels(); ch++)
+	for(uint32_t e=0; e<PSDArena.GetNumEvents(ch); e++)
+	  T.push_back(Sorter.Unwrap(BoardID, ch, PSDArena.GetTimeTag(ch, e)));
+    }
+  }
+
+  delete DG;
+}
+
+
+#ifdef __ADAQ_PARALLEL_MODE__
+
+// Decode and fill the frames [Begin, End) of "Frames"
+void Convert(ADAQRawDumpReader *Reader, const vector<uint64_t> *Frames,
+	     const vector<vector<uint64_t> > *TimeStamps, uint64_t Begin, uint64_t End,
+	     ADAQWriterStream *Stream, vector<vector<uint16_t> > *Waveforms, vector<ADAQWaveformData> *Data,
+	     uint64_t *Events)
+{
+  ADAQRawDumpFrame Frame;
+  Reader->GetFrame((*Frames)[0], Frame);
+
+  ADAQDigitizer *DG = CreateDecoder(Frame.Header);
+  const int NumChannels = Waveforms->size();
+  const bool PSD = (Frame.Header->Firmware == ADAQRawDump::zFirmwarePSD);
+
+  ADAQEventArena Arena;
+  ADAQPSDEventArena PSDArena;
+
+  for(uint64_t f=Begin; f<End; f++){
+    Reader->GetFrame((*Frames)[f], Frame);
+    const vector<uint64_t> &T = (*TimeStamps)[f];
+
+    if(!PSD){
+      if(DG->DecodeSTDBuffer(Frame.Data, Frame.Header->Size, &Arena) != 0)
+	continue;
+
+      for(uint32_t e=0; e<Arena.GetNumEvents(); e++){
+	for(int ch=0; ch<NumChannels; ch++){
+	  ADAQSampleSpan Span = Arena.GetWaveform(e, ch);
+	  (*Waveforms)[ch].assign(Span.begin(), Span.end());
+
+	  (*Data)[ch] = ADAQWaveformData();
+	  (*Data)[ch].SetTimeStamp(T[e]);
+	  (*Data)[ch].SetChannelID(ch);
+	  (*Data)[ch].SetBoardID(Frame.Header->BoardID);
+	}
+	Stream->FillWaveformTree();
+	(*Events)++;
+      }
+    }
+    else{
+      if(DG->DecodePSDBuffer(Frame.Data, Frame.Header->Size, &PSDArena) != 0)
+	continue;
+
+      uint32_t k = 0;
+      for(int ch=0; ch<NumChannels; ch++){
+	for(uint32_t e=0; e<PSDArena.GetNumEvents(ch); e++, k++){
+	  for(int c=0; c<NumChannels; c++){
+	    (*Waveforms)[c].clear();
+	    (*Data)[c] = ADAQWaveformData();
+	  }
+
+	  (*Waveforms)[ch].resize(PSDArena.GetNumSamples(ch, e));
+	  if(!(*Waveforms)[ch].empty())
+	    PSDArena.DecodeWaveform(ch, e, (*Waveforms)[ch].data());
+
+	  const int16_t Long = PSDArena.GetChargeLong(ch, e);
+	  const int16_t Short = PSDArena.GetChargeShort(ch, e);
+
+	  ADAQWaveformData &D = (*Data)[ch];
+	  D.SetPSDTotalIntegral(Long);
+	  D.SetPSDTailIntegral(Long - Short);
+	  D.SetBaseline(PSDArena.GetBaseline(ch, e));
+	  D.SetPileUpFlag(PSDArena.GetPileUp(ch, e));
+	  D.SetTimeStamp(T[k]);
+	  D.SetChannelID(ch);
+	  D.SetBoardID(Frame.Header->BoardID);
+
+	  Stream->FillWaveformTree();
+	  (*Events)++;
+	}
+      }
+    }
+  }
+
+  delete DG;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if(argc < 3 or argc > 5){
+    cout << "\nUsage: ADAQRawConvert <Dump> <Out> [NumThreads] [BoardID]\n" << endl;
+    return -42;
+  }
+
+  const string DumpName = argv[1];
+  const string OutName = argv[2];
+  const int NumThreads = (argc > 3) ? max(atoi(argv[3]), 1) : boost::thread::hardware_concurrency();
+
+  ADAQRawDumpReader *Reader = new ADAQRawDumpReader;
+  Reader->SetVerbose(true);
+
+  if(Reader->Open(DumpName) != 0 or Reader->GetNumFrames() == 0){
+    cout << "\nADAQRawConvert : Error! Could not read frames from '" << DumpName << "'!\n" << endl;
+    return -42;
+  }
+
+  const int BoardID = (argc > 4) ? atoi(argv[4]) : Reader->GetBoardIDs()[0];
+
+  // Index the frames of the board
+
+  vector<uint64_t> Frames;
+  ADAQRawDumpFrame Frame;
+  for(uint64_t f=0; f<Reader->GetNumFrames(); f++){
+    Reader->GetFrame(f, Frame);
+    if(Frame.Header->BoardID == BoardID)
+      Frames.push_back(f);
+  }
+
+  if(Frames.empty()){
+    cout << "\nADAQRawConvert : Error! The dump holds no frames of board " << BoardID << "!\n" << endl;
+    return -42;
+  }
+
+  // The readout information is taken from the decoder of the board
+  // and, for STD firmware, the first event of the first frame
+
+  Reader->GetFrame(Frames[0], Frame);
+  ADAQDigitizer *DG = CreateDecoder(Frame.Header);
+  const bool PSD = (Frame.Header->Firmware == ADAQRawDump::zFirmwarePSD);
+
+  ADAQReadoutManager *Manager = new ADAQReadoutManager;
+  Manager->SetParallelMode(true);
+  Manager->CreateFile(OutName);
+
+  ADAQReadoutInformation *RI = Manager->GetReadoutInformation();
+  RI->SetDGModelName(DG->GetBoardModelName());
+  RI->SetDGNumChannels(DG->GetNumChannels());
+  RI->SetDGBitDepth(DG->GetNumADCBits());
+  RI->SetDGSamplingRate(DG->GetSamplingRate());
+  RI->SetDGFWType(PSD ? "PSD" : "STD");
+
+  vector<Bool_t> ChannelEnable(DG->GetNumChannels(), true);
+
+  if(!PSD){
+    ADAQEventArena Arena;
+    if(DG->DecodeSTDBuffer(Frame.Data, Frame.Header->Size, &Arena) == 0 and Arena.GetNumEvents() > 0){
+      RI->SetRecordLength(Arena.GetChannelSize(0));
+      for(int ch=0; ch<DG->GetNumChannels(); ch++)
+	ChannelEnable[ch] = (Arena.GetChannelMask(0) >> ch) & 1;
+    }
+  }
+  RI->SetChannelEnable(ChannelEnable);
+
+  const int NumChannels = DG->GetNumChannels();
+  delete DG;
+
+  // One stream, with its own branch objects, per converter thread
+
+  vector<ADAQWriterStream *> Streams(NumThreads);
+  vector<vector<vector<uint16_t> > > Waveforms(NumThreads, vector<vector<uint16_t> >(NumChannels));
+  vector<vector<ADAQWaveformData> > Data(NumThreads, vector<ADAQWaveformData>(NumChannels));
+  vector<uint64_t> Events(NumThreads, 0);
+
+  for(int t=0; t<NumThreads; t++){
+    Streams[t] = Manager->CreateWriterStream();
+    if(!Streams[t]){
+      cout << "\nADAQRawConvert : Error! Could not create a writer stream!\n" << endl;
+      return -42;
+    }
+    for(int ch=0; ch<NumChannels; ch++)
+      if(ChannelEnable[ch])
+	Streams[t]->CreateWaveformTreeBranches(ch, &Waveforms[t][ch], &Data[t][ch]);
+  }
+
+  cout << "\nADAQRawConvert : Converting " << Frames.size() << " frames of board " << BoardID
+       << " (" << (PSD ? "PSD" : "STD") << ") on " << NumThreads << " threads ..." << endl;
+
+  chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+
+  vector<vector<uint64_t> > TimeStamps;
+  UnwrapTimeStamps(Reader, &Frames, &TimeStamps);
+
+  // Each thread converts an equal share of consecutive frames
+  
+  boost::thread_group Threads;
+  for(int t=0; t<NumThreads; t++){
+    const uint64_t Begin = Frames.size() * t / NumThreads;
+    const uint64_t End = Frames.size() * (t + 1) / NumThreads;
+    Threads.create_thread(boost::bind(&Convert, Reader, &Frames, &TimeStamps, Begin, End, Streams[t],
+				      &Waveforms[t], &Data[t], &Events[t]));
+  }
+  Threads.join_all();
+
+  Manager->WriteFile();
+
+  chrono::duration<double> Time = chrono::steady_clock::now() - Start;
+
+  uint64_t TotalEvents = 0;
+  for(int t=0; t<NumThreads; t++)
+    TotalEvents += Events[t];
+
+  cout << "\nADAQRawConvert : Wrote " << TotalEvents << " events to '" << OutName << "' in "
+       << Time.count() << " s (" << TotalEvents / Time.count() << " events/s)\n" << endl;
+
+  delete Manager;
+  delete Reader;
+
+  return 0;
+}
+
+#else
+
+int main()
+{
+  cout << "\nADAQRawConvert : Error! The conversion requires the parallel mode of ADAQReadoutManager (ROOT 6.10 or newer)!\n" << endl;
+  return -42;
+}
+
+#endif
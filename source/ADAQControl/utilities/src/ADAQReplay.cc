@@ -0,0 +1,277 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQReplay.cc
+// date: 16 Oct 26
+//
+// desc: Replays one board of a raw dump (ADAQRawDumpWriter) through
+//       the complete acquisition path and reports its throughput: an
+//       ADAQReplayDigitizer stands in for the board and is read out
+//       by an ADAQReadoutEngine, each buffer is decoded by the native
+//       STD or DPP-PSD decoder, the STD waveforms are analyzed with
+//       ADAQWaveformAnalyzer, and every event is written with
+//       ADAQReadoutManager in the asynchronous mode. The dump is
+//       replayed as fast as possible (Rate 0, the default) or at the
+//       given trigger rate [Hz], as many times as given.
+//
+//       STD events give one entry with the waveforms and analysis
+//       results of all enabled channels; DPP-PSD events give one
+//       entry per event with the firmware integrals as ADAQRawConvert
+//       does. The time stamps are the recorded trigger time tags
+//       unwrapped into 64-bit time stamps [ns] by ADAQTimeSorter; the
+//       restart of the time tags in a further pass counts as a
+//       rollover, such that the time stamps keep increasing.
+//
+// 2run: $ ./bin/ADAQReplay <Dump> <Out> [Loops] [Rate] [BoardID]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+using namespace std;
+
+// ADAQ
+#include "ADAQRawDumpReader.hh"
+#include "ADAQReplayDigitizer.hh"
+#include "ADAQReadoutEngine.hh"
+#include "ADAQEventArena.hh"
+#include "ADAQPSDEventArena.hh"
+#include "ADAQTimeSorter.hh"
+#include "ADAQWaveformAnalyzer.hh"
+#include "ADAQReadoutManager.hh"
+
+
+int main(int argc, char *argv[])
+{
+  if(argc < 3 or argc > 6){
+    cout << "\nUsage: ADAQReplay <Dump> <Out> [Loops] [Rate] [BoardID]\n" << endl;
+    return -42;
+  }
+
+  const string DumpName = argv[1];
+  const string OutName = argv[2];
+  const uint32_t Loops = (argc > 3) ? atoi(argv[3]) : 1;
+  const double Rate = (argc > 4) ? atof(argv[4]) : 0.;
+
+  // The board to replay and its type are taken from the dump
+
+  ADAQRawDumpReader Reader;
+  if(Reader.Open(DumpName) != 0 or Reader.GetNumFrames() == 0){
+    cout << "\nADAQReplay : Error! Could not read frames from '" << DumpName << "'!\n" << endl;
+    return -42;
+  }
+
+  const int BoardID = (argc > 5) ? atoi(argv[5]) : Reader.GetBoardIDs()[0];
+
+  ADAQRawDumpFrame Frame;
+  uint64_t f = 0;
+  while(Reader.GetFrame(f, Frame) and Frame.Header->BoardID != BoardID)
+    f++;
+
+  if(f == Reader.GetNumFrames()){
+    cout << "\nADAQReplay : Error! The dump holds no frames of board " << BoardID << "!\n" << endl;
+    return -42;
+  }
+
+  const ZBoardType BoardType = (ZBoardType)Frame.Header->BoardType;
+  Reader.Close();
+
+  if(Loops == 0){
+    cout << "\nADAQReplay : Error! The number of passes must be at least one!\n" << endl;
+    return -42;
+  }
+
+  ADAQReplayDigitizer *DG = new ADAQReplayDigitizer(BoardType, BoardID);
+  DG->SetDumpFile(DumpName);
+  DG->SetNumLoops(Loops);
+  DG->SetTriggerRate(Rate);
+
+  ADAQReadoutEngine *Engine = new ADAQReadoutEngine(16);
+  Engine->AddDigitizer(DG);
+
+  if(Engine->OpenLinks() != 0){
+    cout << "\nADAQReplay : Error! Could not replay board " << BoardID << " of '" << DumpName << "'!\n" << endl;
+    delete Engine;
+    return -42;
+  }
+
+  Engine->SetReadoutThreshold(1, 10);
+  Engine->AllocateBuffers();
+
+  const bool PSD = (DG->GetBoardFirmwareType() == "PSD");
+  const int NumChannels = DG->GetNumChannels();
+
+  uint32_t RecordLength = 0, ChannelMask = 0;
+  DG->GetRecordLength(&RecordLength);
+  DG->GetChannelEnableMask(&ChannelMask);
+
+  // The ADAQ file
+
+  ADAQReadoutManager *Manager = new ADAQReadoutManager;
+  Manager->SetAsyncMode(true);
+  Manager->CreateFile(OutName);
+
+  ADAQReadoutInformation *RI = Manager->GetReadoutInformation();
+  RI->SetDGModelName(DG->GetBoardModelName());
+  RI->SetDGNumChannels(NumChannels);
+  RI->SetDGBitDepth(DG->GetNumADCBits());
+  RI->SetDGSamplingRate(DG->GetSamplingRate());
+  RI->SetDGFWType(PSD ? "PSD" : "STD");
+  RI->SetRecordLength(RecordLength);
+
+  vector<Bool_t> ChannelEnable(NumChannels);
+  for(int ch=0; ch<NumChannels; ch++)
+    ChannelEnable[ch] = (ChannelMask >> ch) & 1;
+  RI->SetChannelEnable(ChannelEnable);
+
+  vector<vector<uint16_t> > Waveforms(NumChannels);
+  vector<ADAQWaveformData> Data(NumChannels);
+  for(int ch=0; ch<NumChannels; ch++)
+    if(ChannelEnable[ch])
+      Manager->CreateWaveformTreeBranches(ch, &Waveforms[ch], &Data[ch]);
+
+  ADAQEventArena Arena;
+  ADAQPSDEventArena PSDArena;
+
+  ADAQTimeSorter Sorter;
+  Sorter.AddDigitizer(DG);
+
+  ADAQWaveformAnalyzer Analyzer(RecordLength);
+  Analyzer.SetPolarity(-1);
+  vector<ADAQWaveformResults> Results(NumChannels);
+  vector<const uint16_t *> Pointers;
+
+  // The analysis regions must lie within the recorded waveforms
+  const bool Analyze = (!PSD and Analyzer.AnalyzeBatch(Pointers.data(), 0, &Results[0]) == 0);
+  if(!PSD and !Analyze)
+    cout << "\nADAQReplay : The waveforms are too short for the analysis regions; the waveforms are not analyzed" << endl;
+
+  cout << "\nADAQReplay : Replaying " << DG->GetNumFrames() << " block transfers ("
+       << DG->GetNumRecordedEvents() << " events) of board " << BoardID << " ("
+       << (PSD ? "PSD" : "STD") << ") " << Loops << " times "
+       << (Rate > 0. ? "at " + to_string(Rate) + " Hz" : string("as fast as possible")) << " ..." << endl;
+
+  DG->SWStartAcquisition();
+
+  chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+
+  Engine->Start();
+
+  uint64_t Frames = 0, Events = 0, Bytes = 0;
+
+  while(true){
+    ADAQReadoutBuffer *Buffer = Engine->WaitForFilledBuffer(100);
+
+    if(!Buffer){
+      if(DG->GetReplayDone() and DG->GetReplayedFrames() == Frames)
+	break;
+      continue;
+    }
+
+    if(!PSD){
+      if(DG->DecodeSTDBuffer(Buffer->Data, Buffer->Size, &Arena) == 0){
+
+	const uint32_t NumEvents = Arena.GetNumEvents();
+	Pointers.resize(NumEvents);
+
+	for(int ch=0; ch<NumChannels; ch++){
+	  if(!Analyze or !ChannelEnable[ch])
+	    continue;
+	  for(uint32_t e=0; e<NumEvents; e++)
+	    Pointers[e] = Arena.GetWaveform(e, ch).begin();
+	  Analyzer.AnalyzeBatch(Pointers.data(), NumEvents, &Results[ch]);
+	}
+
+	for(uint32_t e=0; e<NumEvents; e++){
+	  const uint64_t TimeStamp = Sorter.Unwrap(BoardID, -1, Arena.GetTriggerTimeTag(e));
+
+	  for(int ch=0; ch<NumChannels; ch++){
+	    if(!ChannelEnable[ch])
+	      continue;
+	    ADAQSampleSpan Span = Arena.GetWaveform(e, ch);
+	    Waveforms[ch].assign(Span.begin(), Span.end());
+
+	    if(Analyze)
+	      Results[ch].Fill(e, &Data[ch]);
+	    Data[ch].SetTimeStamp(TimeStamp);
+	    Data[ch].SetChannelID(ch);
+	    Data[ch].SetBoardID(BoardID);
+	  }
+	  Manager->FillWaveformTree();
+	}
+	Events += NumEvents;
+      }
+    }
+    else if(DG->DecodePSDBuffer(Buffer->Data, Buffer->Size, &PSDArena) == 0){
+
+      for(int ch=0; ch<NumChannels; ch++){
+	for(uint32_t e=0; e<PSDArena.GetNumEvents(ch); e++){
+	  for(int c=0; c<NumChannels; c++){
+	    Waveforms[c].clear();
+	    Data[c] = ADAQWaveformData();
+	  }
+
+	  Waveforms[ch].resize(PSDArena.GetNumSamples(ch, e));
+	  if(!Waveforms[ch].empty())
+	    PSDArena.DecodeWaveform(ch, e, Waveforms[ch].data());
+
+	  const int16_t Long = PSDArena.GetChargeLong(ch, e);
+	  const int16_t Short = PSDArena.GetChargeShort(ch, e);
+
+	  ADAQWaveformData &D = Data[ch];
+	  D.SetPSDTotalIntegral(Long);
+	  D.SetPSDTailIntegral(Long - Short);
+	  D.SetBaseline(PSDArena.GetBaseline(ch, e));
+	  D.SetPileUpFlag(PSDArena.GetPileUp(ch, e));
+	  D.SetTimeStamp(Sorter.Unwrap(BoardID, ch, PSDArena.GetTimeTag(ch, e)));
+	  D.SetChannelID(ch);
+	  D.SetBoardID(BoardID);
+
+	  Manager->FillWaveformTree();
+	}
+      }
+      Events += PSDArena.GetTotalEvents();
+    }
+
+    Frames++;
+    Bytes += Buffer->Size;
+    Engine->ReleaseBuffer(Buffer);
+  }
+
+  Engine->Stop();
+  DG->SWStopAcquisition();
+
+  Manager->WriteFile();
+
+  chrono::duration<double> Time = chrono::steady_clock::now() - Start;
+
+  cout << "\nADAQReplay : Wrote " << Events << " events to '" << OutName << "' in "
+       << Time.count() << " s (" << Events / Time.count() << " events/s, "
+       << Bytes / Time.count() / 1e6 << " MB/s of raw data)\n" << endl;
+
+  Engine->PrintStats();
+
+  delete Manager;
+
+  Engine->FreeBuffers();
+  Engine->CloseLinks();
+  delete Engine;
+
+  return 0;
+}
@@ -0,0 +1,206 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: CheckpointBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures the throughput cost of the ADAQReadoutManager
+//       checkpoints for several checkpoint intervals, and checks the
+//       bound on the data lost in a crash. For each interval a run of
+//       synthetic STD firmware waveforms is written (in the
+//       synchronous mode, such that the cost is seen by the filling
+//       thread; in the asynchronous mode it moves to the writer
+//       thread) and the write rate [MB/s of samples] and file size
+//       are compared with the run without checkpoints; the best of
+//       "NumRounds" runs is taken as the write rate. A child
+//       process then writes the same run but exits without closing
+//       the file after "CrashEvent" events; the file is recovered
+//       with ADAQReadoutManager::RecoverFile() and the entries
+//       recovered are compared with those of the last checkpoint
+//       (the entry intervals only; without checkpoints the unclosed
+//       file may hold nothing to recover).
+//
+// 2run: $ ./bin/CheckpointBenchmark [NumChannels] [NumEvents]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TFile.h>
+#include <TTree.h>
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+using namespace std;
+
+// ADAQ
+#include "ADAQReadoutManager.hh"
+
+
+const string FileName = "/tmp/CheckpointBenchmark.adaq.root";
+const string RecoveredName = "/tmp/CheckpointBenchmark.recovered.adaq.root";
+
+const uint32_t RecordLength = 512;
+const uint32_t NumTemplates = 256;
+const int NumRounds = 3;
+
+
+// Write "NumEvents" events cycling through the template waveforms;
+// the file is closed only if "Close" is true
+void Write(const vector<vector<uint16_t> > &Templates, int NumChannels, uint32_t NumEvents,
+	   Long64_t Entries, Double_t Seconds, bool Close)
+{
+  ADAQReadoutManager *Manager = new ADAQReadoutManager;
+  Manager->SetCheckpointInterval(Entries, Seconds);
+  Manager->CreateFile(FileName);
+  Manager->GetReadoutInformation()->SetRecordLength(RecordLength);
+
+  vector<vector<uint16_t> > Waveforms(NumChannels);
+  vector<ADAQWaveformData> WaveformData(NumChannels);
+  for(int ch=0; ch<NumChannels; ch++)
+    Manager->CreateWaveformTreeBranches(ch, &Waveforms[ch], &WaveformData[ch]);
+
+  for(uint32_t e=0; e<NumEvents; e++){
+    for(int ch=0; ch<NumChannels; ch++){
+      Waveforms[ch] = Templates[(e * 7 + ch) % NumTemplates];
+      WaveformData[ch].SetTimeStamp((ULong64_t)e * 1000);
+    }
+    Manager->FillWaveformTree();
+  }
+
+  if(!Close)
+    _exit(0);
+
+  Manager->WriteFile();
+  delete Manager;
+}
+
+
+int main(int argc, char *argv[])
+{
+  const int NumChannels = (argc > 1) ? atoi(argv[1]) : 8;
+  const uint32_t NumEvents = (argc > 2) ? atoi(argv[2]) : 20000;
+  const uint32_t CrashEvent = NumEvents / 2 + 37;
+
+  mt19937 Engine(42);
+  uniform_real_distribution<double> Amplitude(100., 4000.);
+  normal_distribution<double> Noise(0., 2.);
+
+  vector<vector<uint16_t> > Templates(NumTemplates, vector<uint16_t>(RecordLength));
+  for(uint32_t w=0; w<NumTemplates; w++){
+    const double A = Amplitude(Engine);
+    for(uint32_t s=0; s<RecordLength; s++){
+      const double t = (double)s - RecordLength / 4;
+      const double V = (t > 0.) ? A * (exp(-t/20.) - exp(-t/2.)) : 0.;
+      Templates[w][s] = (uint16_t)lround(14000. - V + Noise(Engine));
+    }
+  }
+
+  struct Config{
+    const char *Name;
+    Long64_t Entries;
+    Double_t Seconds;
+  };
+
+  const Config Configs[] = {
+    {"None", 0, 0.},
+    {"10000 entries", 10000, 0.},
+    {"2000 entries", 2000, 0.},
+    {"500 entries", 500, 0.},
+    {"100 entries", 100, 0.},
+    {"1 s", 0, 1.}
+  };
+  const int NumConfigs = sizeof(Configs) / sizeof(Config);
+
+  const double SampleMB = 2. * NumEvents * NumChannels * RecordLength / 1.e6;
+
+  cout << "\nCheckpointBenchmark : " << NumChannels << " channels, " << NumEvents
+       << " events (" << SampleMB << " MB), crash after " << CrashEvent << " events\n" << endl;
+
+  cout << setw(16) << "Interval" << setw(14) << "Write [MB/s]" << setw(10) << "Cost"
+       << setw(14) << "File [MB]" << setw(12) << "Recovered" << setw(12) << "Expected" << endl;
+
+  int Status = 0;
+  double BaseRate = 0.;
+
+  for(int c=0; c<NumConfigs; c++){
+
+    // Throughput
+
+    double Rate = 0.;
+    for(int r=0; r<NumRounds; r++){
+      chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+      Write(Templates, NumChannels, NumEvents, Configs[c].Entries, Configs[c].Seconds, true);
+      chrono::duration<double> WriteTime = chrono::steady_clock::now() - Start;
+
+      Rate = max(Rate, SampleMB / WriteTime.count());
+    }
+    if(c == 0)
+      BaseRate = Rate;
+
+    struct stat FileStat;
+    stat(FileName.c_str(), &FileStat);
+    const double FileMB = FileStat.st_size / 1.e6;
+
+    // Crash and recovery
+
+    pid_t Child = fork();
+    if(Child == 0)
+      Write(Templates, NumChannels, CrashEvent, Configs[c].Entries, Configs[c].Seconds, false);
+    waitpid(Child, NULL, 0);
+
+    ADAQReadoutManager *Manager = new ADAQReadoutManager;
+    Long64_t Recovered = Manager->RecoverFile(FileName, RecoveredName);
+    delete Manager;
+
+    // Entry checkpoints fall on multiples of the interval (ROOT's own
+    // AutoSave() of large trees may save more); the time checkpoints
+    // depend on the machine
+    Long64_t Expected = 0;
+    if(Configs[c].Entries > 0)
+      Expected = (CrashEvent / Configs[c].Entries) * Configs[c].Entries;
+
+    cout << setw(16) << Configs[c].Name << setprecision(4)
+	 << setw(14) << Rate
+	 << setw(9) << 100. * (BaseRate - Rate) / BaseRate << "%"
+	 << setw(14) << FileMB
+	 << setw(12) << Recovered;
+    if(Configs[c].Entries == 0)
+      cout << setw(12) << "-" << endl;
+    else{
+      cout << setw(12) << Expected << endl;
+      if(Recovered < Expected)
+	Status = -42;
+    }
+
+    remove(FileName.c_str());
+    remove(RecoveredName.c_str());
+  }
+
+  if(Status != 0)
+    cout << "\nError! Fewer entries were recovered than the last checkpoint holds!" << endl;
+  cout << endl;
+
+  return Status;
+}
@@ -0,0 +1,190 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: CompressionBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Compares the compression algorithms and levels of ADAQ files
+//       (uncompressed, ZLIB, LZ4, ZSTD, and LZMA at fast and strong
+//       levels) by the write rate, the read rate, and the file size.
+//       The rates are given in MB/s of uncompressed tree data. The
+//       data are either synthetic STD firmware waveforms of several
+//       channels written with ADAQReadoutManager or, if an ADAQ file
+//       is given, the contents of that file rewritten with
+//       ADAQReadoutManager::RecompressFile() (the write rate then
+//       includes reading the input file). Representative files from
+//       a run give the most meaningful table.
+//
+// 2run: $ ./bin/CompressionBenchmark [NumChannels] [NumEvents]
+//       $ ./bin/CompressionBenchmark <ADAQFile>
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TFile.h>
+#include <TTree.h>
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <sys/stat.h>
+using namespace std;
+
+// ADAQ
+#include "ADAQReadoutManager.hh"
+
+
+const string FileName = "/tmp/CompressionBenchmark.adaq.root";
+
+
+void WriteSynthetic(ADAQReadoutManager *Manager, int NumChannels, uint32_t NumEvents)
+{
+  const uint32_t RecordLength = 512;
+
+  mt19937 Engine(42);
+  uniform_real_distribution<double> Uniform(0., 1.), Amplitude(100., 4000.);
+  normal_distribution<double> Noise(0., 2.);
+
+  Manager->CreateFile(FileName);
+  Manager->GetReadoutInformation()->SetRecordLength(RecordLength);
+
+  vector<vector<uint16_t> > Waveforms(NumChannels, vector<uint16_t>(RecordLength));
+  vector<ADAQWaveformData> WaveformData(NumChannels);
+  for(int ch=0; ch<NumChannels; ch++)
+    Manager->CreateWaveformTreeBranches(ch, &Waveforms[ch], &WaveformData[ch]);
+
+  // The waveforms are generated as they are written, such that the
+  // data do not repeat; the generation time is small compared to the
+  // compression but is included in the write rate
+
+  for(uint32_t e=0; e<NumEvents; e++){
+    for(int ch=0; ch<NumChannels; ch++){
+      const double A = Amplitude(Engine);
+      for(uint32_t s=0; s<RecordLength; s++){
+	const double t = (double)s - RecordLength / 4;
+	const double V = (t > 0.) ? A * (exp(-t/20.) - exp(-t/2.)) : 0.;
+	Waveforms[ch][s] = (uint16_t)lround(14000. - V + Noise(Engine));
+      }
+      WaveformData[ch].SetPulseHeight(A);
+      WaveformData[ch].SetTimeStamp((ULong64_t)e * 1000);
+      WaveformData[ch].SetFineTime(Uniform(Engine));
+    }
+    Manager->FillWaveformTree();
+  }
+  Manager->WriteFile();
+}
+
+
+int main(int argc, char *argv[])
+{
+  string InName = "";
+  int NumChannels = 8;
+  uint32_t NumEvents = 20000;
+
+  if(argc > 1 and !isdigit(argv[1][0]))
+    InName = argv[1];
+  else{
+    NumChannels = (argc > 1) ? atoi(argv[1]) : 8;
+    NumEvents = (argc > 2) ? atoi(argv[2]) : 20000;
+  }
+
+  struct Config{
+    const char *Name;
+    ZCompressionAlgorithm Algorithm;
+    int Level;
+  };
+
+  const Config Configs[] = {
+    {"None", zCompressionZLIB, 0},
+    {"ZLIB-1", zCompressionZLIB, 1},
+    {"ZLIB-6", zCompressionZLIB, 6},
+    {"LZ4-1", zCompressionLZ4, 1},
+    {"LZ4-4", zCompressionLZ4, 4},
+    {"ZSTD-1", zCompressionZSTD, 1},
+    {"ZSTD-5", zCompressionZSTD, 5},
+    {"LZMA-1", zCompressionLZMA, 1},
+    {"LZMA-6", zCompressionLZMA, 6}
+  };
+  const int NumConfigs = sizeof(Configs) / sizeof(Config);
+
+  if(InName.empty())
+    cout << "\nCompressionBenchmark : synthetic STD waveforms, " << NumChannels
+	 << " channels, " << NumEvents << " events\n" << endl;
+  else
+    cout << "\nCompressionBenchmark : " << InName << "\n" << endl;
+
+  cout << setw(10) << "Setting" << setw(14) << "Write [MB/s]" << setw(14) << "Read [MB/s]"
+       << setw(14) << "File [MB]" << setw(10) << "Ratio" << endl;
+
+  for(int c=0; c<NumConfigs; c++){
+
+    ADAQReadoutManager *Manager = new ADAQReadoutManager;
+    Manager->SetFileCompression(Configs[c].Algorithm, Configs[c].Level);
+
+    chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+
+    if(InName.empty())
+      WriteSynthetic(Manager, NumChannels, NumEvents);
+    else if(Manager->RecompressFile(InName, FileName) != 0){
+      cout << "\nError! Could not read '" << InName << "'!\n" << endl;
+      delete Manager;
+      return -42;
+    }
+
+    chrono::duration<double> WriteTime = chrono::steady_clock::now() - Start;
+    delete Manager;
+
+    // Read all branches of all entries
+
+    Start = chrono::steady_clock::now();
+
+    TFile *File = new TFile(FileName.c_str(), "read");
+    TTree *Tree = (TTree *)File->Get("WaveformTree");
+    if(!Tree){
+      cout << "\nError! The written file has no WaveformTree!\n" << endl;
+      delete File;
+      return -42;
+    }
+    const Long64_t Entries = Tree->GetEntries();
+    for(Long64_t e=0; e<Entries; e++)
+      Tree->GetEntry(e);
+    const double TreeMB = Tree->GetTotBytes() / 1.e6;
+
+    chrono::duration<double> ReadTime = chrono::steady_clock::now() - Start;
+    File->Close();
+    delete File;
+
+    struct stat FileStat;
+    stat(FileName.c_str(), &FileStat);
+    const double FileMB = FileStat.st_size / 1.e6;
+
+    cout << setw(10) << Configs[c].Name << setprecision(4)
+	 << setw(14) << TreeMB / WriteTime.count()
+	 << setw(14) << TreeMB / ReadTime.count()
+	 << setw(14) << FileMB
+	 << setw(10) << TreeMB / FileMB << endl;
+
+    remove(FileName.c_str());
+  }
+  cout << endl;
+
+  return 0;
+}
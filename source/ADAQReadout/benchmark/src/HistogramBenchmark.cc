@@ -0,0 +1,193 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: HistogramBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures the cost of the ADAQHistogramService live spectra.
+//       The workers of an ADAQAnalysisPool fill the spectra of eight
+//       channels from synthetic analysis results (ADAQWaveformResults
+//       columns), each into the slot given by its worker index, for a
+//       fixed time:
+//
+//         without snapshots : the fill rate alone
+//         with snapshots    : a monitoring thread takes the pulse
+//                             height, pulse area, and PSD snapshots
+//                             of one channel at the given rate
+//
+//       Reported are the fill rates [events/s], the memory of the
+//       slots, and the mean and longest time of each snapshot type
+//       (the ROOT histograms are reused). The entries of the final
+//       snapshots are checked against the number of filled events.
+//
+// 2run: $ ./bin/HistogramBenchmark [NumWorkers] [SnapshotRate]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TH1.h>
+#include <TH2.h>
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+using namespace std;
+
+// ADAQ
+#include "ADAQHistogramService.hh"
+#include "ADAQAnalysisPool.hh"
+#include "ADAQWaveformAnalyzer.hh"
+
+
+const int NumChannels = 8;
+const uint32_t BatchSize = 1000;
+const double Duration = 2.; // [s] per measurement
+
+
+struct SnapshotTimes{
+  uint64_t Count[3];
+  double Sum[3], Max[3]; // [us]
+};
+
+
+// Take the three snapshots of channel 0 at "Rate" [Hz] until "Stop"
+void Monitor(ADAQHistogramService *Service, double Rate, atomic<bool> *Stop, SnapshotTimes *T)
+{
+  const ZHistogramType Types[3] = {zPulseHeightHistogram, zPulseAreaHistogram, zPSDHistogram};
+  TH1 *H[3] = {NULL, NULL, NULL};
+
+  *T = SnapshotTimes();
+
+  chrono::steady_clock::time_point Next = chrono::steady_clock::now();
+
+  while(!*Stop){
+    for(int t=0; t<3; t++){
+      chrono::steady_clock::time_point T0 = chrono::steady_clock::now();
+      H[t] = Service->Snapshot(0, Types[t], H[t]);
+      const double Us = chrono::duration<double, micro>(chrono::steady_clock::now() - T0).count();
+
+      T->Count[t]++;
+      T->Sum[t] += Us;
+      T->Max[t] = max(T->Max[t], Us);
+    }
+    Next += chrono::microseconds((int64_t)(1e6 / Rate));
+    this_thread::sleep_until(Next);
+  }
+
+  for(int t=0; t<3; t++)
+    delete H[t];
+}
+
+
+// Fill the spectra from the pool workers for "Duration"; returns the
+// number of events filled
+uint64_t Fill(ADAQAnalysisPool &Pool, ADAQHistogramService &Service,
+	      const ADAQWaveformResults &Results, double &Time)
+{
+  uint64_t Events = 0;
+
+  chrono::steady_clock::time_point T0 = chrono::steady_clock::now();
+
+  while(chrono::duration<double>(chrono::steady_clock::now() - T0).count() < Duration){
+    for(int ch=0; ch<NumChannels; ch++){
+      Pool.Submit([&Service, &Results, ch](){
+	  Service.FillBatch(ADAQAnalysisPool::GetWorkerIndex(), ch, Results, BatchSize);
+	}, [](){;});
+      Events += BatchSize;
+    }
+    Pool.Deliver();
+  }
+  Pool.Drain();
+
+  Time = chrono::duration<double>(chrono::steady_clock::now() - T0).count();
+  return Events;
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t NumWorkers = (argc > 1) ? atoi(argv[1]) : 4;
+  double SnapshotRate = (argc > 2) ? atof(argv[2]) : 10.;
+
+  // Synthetic analysis results spread over the default binning
+
+  ADAQWaveformResults Results;
+  Results.Resize(BatchSize);
+
+  mt19937 Engine(42);
+  uniform_real_distribution<double> Height(0., 16000.), Ratio(0., 1.);
+  for(uint32_t w=0; w<BatchSize; w++){
+    Results.PulseHeight[w] = Height(Engine);
+    Results.PulseArea[w] = 50. * Results.PulseHeight[w];
+    Results.PSDTotalIntegral[w] = Results.PulseArea[w];
+    Results.PSDTailIntegral[w] = Ratio(Engine) * Results.PSDTotalIntegral[w];
+  }
+
+  ADAQAnalysisPool Pool(NumWorkers);
+  Pool.SetOrdered(false);
+
+  ADAQHistogramService Service(Pool.GetNumWorkers(), (1 << NumChannels) - 1);
+  Service.Initialize();
+
+  cout << "\nHistogramBenchmark : " << Pool.GetNumWorkers() << " workers, "
+       << NumChannels << " channels, snapshots at " << SnapshotRate << " Hz, "
+       << Service.GetMemorySize() / 1e6 << " MB of slots\n" << endl;
+
+  Pool.Start();
+
+  double Time[2];
+  uint64_t Events[2];
+
+  Events[0] = Fill(Pool, Service, Results, Time[0]);
+
+  atomic<bool> Stop(false);
+  SnapshotTimes T;
+  thread MonitorThread(Monitor, &Service, SnapshotRate, &Stop, &T);
+
+  Events[1] = Fill(Pool, Service, Results, Time[1]);
+
+  Stop = true;
+  MonitorThread.join();
+  Pool.Stop();
+
+  cout << setw(20) << "Mode" << setw(16) << "[events/s]" << endl;
+  cout << setw(20) << "Without snapshots" << setw(16) << setprecision(4) << Events[0] / Time[0] << endl;
+  cout << setw(20) << "With snapshots" << setw(16) << setprecision(4) << Events[1] / Time[1] << endl;
+
+  const char *Names[3] = {"Pulse height (1D)", "Pulse area (1D)", "PSD (2D)"};
+  cout << "\n" << setw(20) << "Snapshot" << setw(10) << "Taken"
+       << setw(14) << "Mean [us]" << setw(14) << "Max [us]" << endl;
+  for(int t=0; t<3; t++)
+    cout << setw(20) << Names[t] << setw(10) << T.Count[t]
+	 << setw(14) << setprecision(4) << T.Sum[t] / max(T.Count[t], (uint64_t)1)
+	 << setw(14) << T.Max[t] << endl;
+
+  // Every filled event must be counted once per channel
+
+  const uint64_t Expected = (Events[0] + Events[1]) / NumChannels;
+  bool Identical = true;
+  for(int ch=0; ch<NumChannels; ch++)
+    Identical &= (Service.GetEntries(ch) == Expected);
+
+  cout << "\nEntries per channel : " << (Identical ? "identical to" : "DIFFERENT from")
+       << " the filled events (" << Expected << ")\n" << endl;
+
+  return Identical ? 0 : -42;
+}
@@ -0,0 +1,284 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: PackedWaveformBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Compares the packed waveform branch layout (ADAQWaveformCodec
+//       bit-packing and delta encoding before ROOT compression) with
+//       the vector<uint16_t> layout, each with ZLIB and LZ4
+//       compression, by the write rate, the read rate through
+//       ADAQWaveformReader [MB/s of samples], the CPU time of the
+//       writing and reading, and the file size. The samples read back
+//       are checked against the samples written.
+//
+//       The waveforms are taken from an existing ADAQ file, at the
+//       bit depth of its readout information, if one is given (real
+//       V1720 and V1724 runs are the relevant cases); otherwise
+//       synthetic V1720-like (12-bit) and V1724-like (14-bit)
+//       waveforms are generated.
+//
+// 2run: $ ./bin/PackedWaveformBenchmark [ADAQFile]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TFile.h>
+#include <TTree.h>
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <sys/stat.h>
+using namespace std;
+
+// ADAQ
+#include "ADAQReadoutManager.hh"
+#include "ADAQWaveformReader.hh"
+
+
+const string FileName = "/tmp/PackedWaveformBenchmark.adaq.root";
+
+
+// The waveforms of a data set: "NumEvents" events of "NumChannels"
+// channels of "RecordLength" samples each
+struct DataSet{
+  string Name;
+  Int_t BitDepth;
+  Int_t NumChannels;
+  UInt_t RecordLength;
+  UInt_t NumEvents;
+  vector<uint16_t> Samples;
+
+  const uint16_t *Get(UInt_t Event, Int_t Channel) const
+  {
+    return &Samples[((size_t)Event * NumChannels + Channel) * RecordLength];
+  }
+};
+
+
+DataSet Generate(string Name, Int_t BitDepth, double Baseline, double Noise, double MaxAmplitude,
+		 double DecayTime)
+{
+  DataSet D;
+  D.Name = Name;
+  D.BitDepth = BitDepth;
+  D.NumChannels = 8;
+  D.RecordLength = 512;
+  D.NumEvents = 10000;
+  D.Samples.resize((size_t)D.NumEvents * D.NumChannels * D.RecordLength);
+
+  mt19937 Engine(42);
+  uniform_real_distribution<double> Amplitude(0.02 * MaxAmplitude, MaxAmplitude);
+  normal_distribution<double> Gauss(0., Noise);
+
+  const double Max = (1 << BitDepth) - 1;
+
+  for(size_t w=0; w<(size_t)D.NumEvents * D.NumChannels; w++){
+    const double A = Amplitude(Engine);
+    for(UInt_t s=0; s<D.RecordLength; s++){
+      const double t = (double)s - D.RecordLength / 4;
+      const double V = (t > 0.) ? A * (exp(-t/DecayTime) - exp(-t/2.)) : 0.;
+      D.Samples[w * D.RecordLength + s] = (uint16_t)lround(min(Max, max(0., Baseline - V + Gauss(Engine))));
+    }
+  }
+  return D;
+}
+
+
+// Read the waveforms of all channels of an ADAQ file; the records
+// are truncated or zero-padded to the first record length found
+Int_t Load(string Name, DataSet &D)
+{
+  TFile *File = new TFile(Name.c_str(), "read");
+  TTree *Tree = (TTree *)File->Get("WaveformTree");
+  ADAQReadoutInformation *RI = (ADAQReadoutInformation *)File->Get("ReadoutInformation");
+  if(!Tree or !RI){
+    delete File;
+    return -42;
+  }
+
+  D.Name = Name;
+  D.BitDepth = RI->GetDGBitDepth();
+
+  vector<ADAQWaveformReader> Readers(64);
+  vector<Int_t> Channels;
+  for(Int_t ch=0; ch<64; ch++)
+    if(Readers[ch].Attach(Tree, ch) == 0)
+      Channels.push_back(ch);
+
+  D.NumChannels = Channels.size();
+  D.NumEvents = Tree->GetEntries();
+  D.RecordLength = 0;
+
+  for(UInt_t e=0; e<D.NumEvents; e++){
+    for(Int_t c=0; c<D.NumChannels; c++){
+      ADAQWaveformReader &R = Readers[Channels[c]];
+      R.GetEntry(e);
+
+      if(D.RecordLength == 0){
+	D.RecordLength = R.GetLength();
+	D.Samples.assign((size_t)D.NumEvents * D.NumChannels * D.RecordLength, 0);
+      }
+      uint16_t *Out = &D.Samples[((size_t)e * D.NumChannels + c) * D.RecordLength];
+      memcpy(Out, R.GetSamples(), min(R.GetLength(), D.RecordLength) * sizeof(uint16_t));
+    }
+  }
+
+  File->Close();
+  delete File;
+
+  return (D.RecordLength > 0) ? 0 : -42;
+}
+
+
+Int_t Run(const DataSet &D)
+{
+  const double SampleMB = 2. * D.NumEvents * D.NumChannels * D.RecordLength / 1.e6;
+
+  cout << "\n" << D.Name << " : " << D.BitDepth << "-bit, " << D.NumChannels
+       << " channels, " << D.NumEvents << " events of " << D.RecordLength << " samples ("
+       << SampleMB << " MB)\n" << endl;
+
+  cout << setw(16) << "Layout" << setw(10) << "Setting" << setw(14) << "Write [MB/s]"
+       << setw(14) << "Write CPU [s]" << setw(14) << "Read [MB/s]" << setw(14) << "Read CPU [s]"
+       << setw(14) << "File [MB]" << setw(10) << "Ratio" << endl;
+
+  const ZWaveformBranchLayout Layouts[2] = {zWaveformVector, zWaveformPacked};
+  const char *LayoutNames[2] = {"vector<uint16_t>", "Packed"};
+  const ZCompressionAlgorithm Algorithms[2] = {zCompressionZLIB, zCompressionLZ4};
+  const char *AlgorithmNames[2] = {"ZLIB-1", "LZ4-1"};
+
+  Int_t Status = 0;
+
+  for(int l=0; l<2; l++){
+    for(int a=0; a<2; a++){
+
+      // Write
+
+      ADAQReadoutManager *Manager = new ADAQReadoutManager;
+      Manager->SetFileCompression(Algorithms[a], 1);
+      Manager->SetWaveformBranchLayout(Layouts[l]);
+      Manager->CreateFile(FileName);
+      Manager->GetReadoutInformation()->SetDGBitDepth(D.BitDepth);
+
+      vector<vector<uint16_t> > Waveforms(D.NumChannels);
+      vector<ADAQWaveformData> WaveformData(D.NumChannels);
+      for(Int_t ch=0; ch<D.NumChannels; ch++)
+	Manager->CreateWaveformTreeBranches(ch, &Waveforms[ch], &WaveformData[ch]);
+
+      chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+      clock_t CPUStart = clock();
+
+      for(UInt_t e=0; e<D.NumEvents; e++){
+	for(Int_t ch=0; ch<D.NumChannels; ch++){
+	  const uint16_t *Samples = D.Get(e, ch);
+	  if(Layouts[l] == zWaveformVector)
+	    Waveforms[ch].assign(Samples, Samples + D.RecordLength);
+	  else
+	    Manager->SetWaveform(ch, Samples, D.RecordLength);
+	}
+	Manager->FillWaveformTree();
+      }
+      Manager->WriteFile();
+
+      chrono::duration<double> WriteTime = chrono::steady_clock::now() - Start;
+      const double WriteCPU = (double)(clock() - CPUStart) / CLOCKS_PER_SEC;
+      delete Manager;
+
+      struct stat FileStat;
+      stat(FileName.c_str(), &FileStat);
+      const double FileMB = FileStat.st_size / 1.e6;
+
+      // Read and verify
+
+      Start = chrono::steady_clock::now();
+      CPUStart = clock();
+
+      TFile *File = new TFile(FileName.c_str(), "read");
+      TTree *Tree = (TTree *)File->Get("WaveformTree");
+      if(!Tree){
+	cout << "\nError! The written file has no WaveformTree!\n" << endl;
+	delete File;
+	return -42;
+      }
+
+      vector<ADAQWaveformReader> Readers(D.NumChannels);
+      for(Int_t ch=0; ch<D.NumChannels; ch++)
+	if(Readers[ch].Attach(Tree, ch) != 0 or Readers[ch].GetLayout() != Layouts[l])
+	  Status = -42;
+
+      bool Identical = true;
+      for(UInt_t e=0; e<D.NumEvents and Status == 0; e++){
+	for(Int_t ch=0; ch<D.NumChannels; ch++){
+	  Readers[ch].GetEntry(e);
+	  if(Readers[ch].GetLength() != D.RecordLength or
+	     memcmp(Readers[ch].GetSamples(), D.Get(e, ch), D.RecordLength * sizeof(uint16_t)) != 0)
+	    Identical = false;
+	}
+      }
+
+      chrono::duration<double> ReadTime = chrono::steady_clock::now() - Start;
+      const double ReadCPU = (double)(clock() - CPUStart) / CLOCKS_PER_SEC;
+      File->Close();
+      delete File;
+
+      if(!Identical)
+	Status = -42;
+
+      cout << setw(16) << LayoutNames[l] << setw(10) << AlgorithmNames[a] << setprecision(4)
+	   << setw(14) << SampleMB / WriteTime.count() << setw(14) << WriteCPU
+	   << setw(14) << SampleMB / ReadTime.count() << setw(14) << ReadCPU
+	   << setw(14) << FileMB
+	   << setw(10) << SampleMB / FileMB << endl;
+
+      remove(FileName.c_str());
+    }
+  }
+  return Status;
+}
+
+
+int main(int argc, char *argv[])
+{
+  Int_t Status = 0;
+
+  if(argc > 1){
+    DataSet D;
+    if(Load(argv[1], D) != 0){
+      cout << "\nError! Could not read the waveforms of '" << argv[1] << "'!\n" << endl;
+      return -42;
+    }
+    Status = Run(D);
+  }
+  else{
+    // V1720: 12-bit, 250 MS/s; V1724: 14-bit, 100 MS/s (shorter pulses)
+    Status |= Run(Generate("Synthetic V1720", 12, 3800., 1.5, 3000., 20.));
+    Status |= Run(Generate("Synthetic V1724", 14, 15000., 3., 12000., 8.));
+  }
+
+  if(Status != 0)
+    cout << "\nError! The waveforms read back differ from those written!" << endl;
+  cout << endl;
+
+  return Status;
+}
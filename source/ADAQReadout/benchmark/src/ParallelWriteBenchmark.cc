@@ -0,0 +1,224 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ParallelWriteBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Measures the write rate [MB/s of samples] of ADAQ files versus
+//       the number of threads with the two parallel output methods
+//       of ADAQReadoutManager:
+//
+//         Implicit MT : one thread fills the WaveformTree and ROOT
+//                       compresses the channel baskets on N threads
+//         Merger      : N producer threads fill the WaveformTrees of
+//                       their own ADAQWriterStreams, which are merged
+//                       into the file by a TBufferMerger
+//
+//       The same synthetic STD firmware waveforms of several channels
+//       (vector layout) are written each time; the entries in the
+//       written file are checked against the number of events. The
+//       merger requires ROOT 6.10 or newer.
+//
+// 2run: $ ./bin/ParallelWriteBenchmark [NumChannels] [NumEvents] [MaxThreads]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TFile.h>
+#include <TTree.h>
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+#include <sys/stat.h>
+using namespace std;
+
+// ADAQ
+#include "ADAQReadoutManager.hh"
+
+
+const uint32_t RecordLength = 512;
+const uint32_t PoolSize = 1024;
+
+int NumChannels = 8;
+uint32_t NumEvents = 50000;
+vector<uint16_t> Pool;
+
+const string FileName = "/tmp/ParallelWriteBenchmark.adaq.root";
+
+
+// Fill the events "First", "First+Step", ... into a branch set
+template<class Filler>
+void FillEvents(uint32_t First, uint32_t Step, vector<vector<uint16_t> > &Waveforms, Filler Fill)
+{
+  for(uint32_t e=First; e<NumEvents; e+=Step){
+    const uint16_t *Event = &Pool[(size_t)(e % PoolSize) * NumChannels * RecordLength];
+    for(int ch=0; ch<NumChannels; ch++){
+      const uint16_t *Samples = Event + (size_t)ch * RecordLength;
+      Waveforms[ch].assign(Samples, Samples + RecordLength);
+    }
+    Fill();
+  }
+}
+
+
+double WriteImplicitMT(int NumThreads)
+{
+  ADAQReadoutManager *Manager = new ADAQReadoutManager;
+  Manager->SetImplicitMT(NumThreads);
+  Manager->CreateFile(FileName);
+
+  vector<vector<uint16_t> > Waveforms(NumChannels);
+  vector<ADAQWaveformData> WaveformData(NumChannels);
+  for(int ch=0; ch<NumChannels; ch++)
+    Manager->CreateWaveformTreeBranches(ch, &Waveforms[ch], &WaveformData[ch]);
+
+  chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+
+  FillEvents(0, 1, Waveforms, [&]{Manager->FillWaveformTree();});
+  Manager->WriteFile();
+
+  chrono::duration<double> Time = chrono::steady_clock::now() - Start;
+
+  Manager->SetImplicitMT(0);
+  delete Manager;
+
+  return Time.count();
+}
+
+
+double WriteMerger(int NumThreads)
+{
+#ifdef __ADAQ_PARALLEL_MODE__
+  ADAQReadoutManager *Manager = new ADAQReadoutManager;
+  Manager->SetParallelMode(true);
+  Manager->CreateFile(FileName);
+
+  // One stream per producer, created before the producers start
+  vector<ADAQWriterStream *> Streams;
+  for(int t=0; t<NumThreads; t++)
+    Streams.push_back(Manager->CreateWriterStream());
+
+  chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+
+  vector<thread> Producers;
+  for(int t=0; t<NumThreads; t++)
+    Producers.push_back(thread([&, t]{
+	  vector<vector<uint16_t> > Waveforms(NumChannels);
+	  vector<ADAQWaveformData> WaveformData(NumChannels);
+	  for(int ch=0; ch<NumChannels; ch++)
+	    Streams[t]->CreateWaveformTreeBranches(ch, &Waveforms[ch], &WaveformData[ch]);
+
+	  FillEvents(t, NumThreads, Waveforms, [&]{Streams[t]->FillWaveformTree();});
+	}));
+
+  for(size_t t=0; t<Producers.size(); t++)
+    Producers[t].join();
+  Manager->WriteFile();
+
+  chrono::duration<double> Time = chrono::steady_clock::now() - Start;
+  delete Manager;
+
+  return Time.count();
+#else
+  return -1.;
+#endif
+}
+
+
+// Returns the file size [MB] or -1 if the file is incomplete
+double CheckFile()
+{
+  TFile *File = new TFile(FileName.c_str(), "read");
+  TTree *Tree = (TTree *)File->Get("WaveformTree");
+  bool Complete = (Tree and Tree->GetEntries() == NumEvents and File->Get("ReadoutInformation"));
+  File->Close();
+  delete File;
+
+  struct stat FileStat;
+  stat(FileName.c_str(), &FileStat);
+  remove(FileName.c_str());
+
+  return Complete ? FileStat.st_size / 1.e6 : -1.;
+}
+
+
+int main(int argc, char *argv[])
+{
+  NumChannels = (argc > 1) ? atoi(argv[1]) : 8;
+  NumEvents = (argc > 2) ? atoi(argv[2]) : 50000;
+  int MaxThreads = (argc > 3) ? atoi(argv[3]) : thread::hardware_concurrency();
+  if(MaxThreads < 1)
+    MaxThreads = 1;
+
+#ifndef __ADAQ_PARALLEL_MODE__
+  cout << "\nParallelWriteBenchmark : Error! The merger requires ROOT 6.10 or newer!\n" << endl;
+  return -42;
+#endif
+
+  // A pool of waveforms that the events cycle through
+
+  Pool.resize((size_t)PoolSize * NumChannels * RecordLength);
+
+  mt19937 Engine(42);
+  uniform_real_distribution<double> Amplitude(100., 4000.);
+  normal_distribution<double> Noise(0., 2.);
+
+  for(size_t w=0; w<(size_t)PoolSize * NumChannels; w++){
+    const double A = Amplitude(Engine);
+    for(uint32_t s=0; s<RecordLength; s++){
+      const double t = (double)s - RecordLength / 4;
+      const double V = (t > 0.) ? A * (exp(-t/20.) - exp(-t/2.)) : 0.;
+      Pool[w * RecordLength + s] = (uint16_t)lround(14000. - V + Noise(Engine));
+    }
+  }
+
+  const double SampleMB = 2. * RecordLength * NumChannels * NumEvents / 1.e6;
+
+  cout << "\nParallelWriteBenchmark : RecordLength = " << RecordLength
+       << ", " << NumChannels << " channels, " << NumEvents << " events ("
+       << SampleMB << " MB of samples)\n" << endl;
+
+  cout << setw(10) << "Threads" << setw(18) << "Implicit MT [MB/s]" << setw(14) << "File [MB]"
+       << setw(14) << "Merger [MB/s]" << setw(14) << "File [MB]" << endl;
+
+  int Status = 0;
+
+  for(int n=1; n<=MaxThreads; n*=2){
+    const double IMTTime = WriteImplicitMT(n);
+    const double IMTSize = CheckFile();
+
+    const double MergerTime = WriteMerger(n);
+    const double MergerSize = CheckFile();
+
+    if(IMTSize < 0. or MergerSize < 0.)
+      Status = -42;
+
+    cout << setw(10) << n << setprecision(4)
+	 << setw(18) << SampleMB / IMTTime << setw(14) << IMTSize
+	 << setw(14) << SampleMB / MergerTime << setw(14) << MergerSize << endl;
+  }
+
+  if(Status != 0)
+    cout << "\nError! A written file does not hold all events!" << endl;
+  cout << endl;
+
+  return Status;
+}
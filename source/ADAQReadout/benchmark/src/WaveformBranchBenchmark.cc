@@ -0,0 +1,197 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: WaveformBranchBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Compares the ADAQReadoutManager waveform branch layouts
+//       (vector<uint16_t>, fixed-length array, counter-sized array)
+//       by writing the same synthetic STD firmware waveforms of
+//       several channels to an ADAQ file with each layout and
+//       reading them back with ADAQWaveformReader. For the vector
+//       layout the samples are copied into the branch vectors, as
+//       done by acquisition code today; for the array layouts the
+//       branches point directly into the (arena-like) sample memory.
+//       The vector and fixed array layouts are also run in the
+//       asynchronous mode, in which a writer thread fills the tree.
+//       Reported are the fill and write rates [events/s and MB/s of
+//       samples], the longest FillWaveformTree() call on the
+//       acquisition thread (i.e. the stall when a basket is
+//       compressed and written), the file size, and the read rate;
+//       the sample sums read back are checked to be identical.
+//
+// 2run: $ ./bin/WaveformBranchBenchmark [RecordLength] [NumChannels] [NumEvents]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TFile.h>
+#include <TTree.h>
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+#include <sys/stat.h>
+using namespace std;
+
+// ADAQ
+#include "ADAQReadoutManager.hh"
+#include "ADAQWaveformReader.hh"
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t RecordLength = (argc > 1) ? atoi(argv[1]) : 512;
+  int NumChannels = (argc > 2) ? atoi(argv[2]) : 8;
+  uint32_t NumEvents = (argc > 3) ? atoi(argv[3]) : 100000;
+
+  // A pool of waveforms that the events cycle through, laid out
+  // contiguously per event and channel as in a decoder arena
+
+  const uint32_t PoolSize = 1024;
+  vector<uint16_t> Pool((size_t)PoolSize * NumChannels * RecordLength);
+
+  mt19937 Engine(42);
+  uniform_real_distribution<double> Amplitude(100., 4000.);
+  normal_distribution<double> Noise(0., 2.);
+
+  for(size_t w=0; w<(size_t)PoolSize * NumChannels; w++){
+    const double A = Amplitude(Engine);
+    for(uint32_t s=0; s<RecordLength; s++){
+      const double t = (double)s - RecordLength / 4;
+      const double V = (t > 0.) ? A * (exp(-t/20.) - exp(-t/2.)) : 0.;
+      Pool[w * RecordLength + s] = (uint16_t)lround(14000. - V + Noise(Engine));
+    }
+  }
+
+  const double SampleMB = 2. * RecordLength * NumChannels * NumEvents / 1.e6;
+
+  cout << "\nWaveformBranchBenchmark : RecordLength = " << RecordLength
+       << ", " << NumChannels << " channels, " << NumEvents << " events ("
+       << SampleMB << " MB of samples)\n" << endl;
+
+  cout << setw(16) << "Layout" << setw(14) << "Fill [ev/s]" << setw(14) << "Fill [MB/s]"
+       << setw(14) << "Max fill [ms]" << setw(14) << "File [MB]" << setw(14) << "Read [ev/s]"
+       << setw(14) << "Read [MB/s]" << endl;
+
+  const int NumLayouts = 5;
+  const char *Names[NumLayouts] = {"vector<uint16_t>", "Fixed array", "Variable array",
+				   "Async vector", "Async fixed"};
+  const ZWaveformBranchLayout Layouts[NumLayouts] = {zWaveformVector, zWaveformFixedArray,
+						     zWaveformVariableArray, zWaveformVector,
+						     zWaveformFixedArray};
+  const bool Async[NumLayouts] = {false, false, false, true, true};
+
+  int Status = 0;
+  double ReferenceSum = -1.;
+
+  for(int l=0; l<NumLayouts; l++){
+
+    string FileName = "/tmp/WaveformBranchBenchmark.adaq.root";
+
+    // Write
+
+    ADAQReadoutManager *Manager = new ADAQReadoutManager;
+    Manager->CreateFile(FileName);
+    Manager->GetReadoutInformation()->SetRecordLength(RecordLength);
+    Manager->SetWaveformBranchLayout(Layouts[l]);
+    Manager->SetAsyncMode(Async[l]);
+
+    vector<vector<uint16_t> > Waveforms(NumChannels);
+    vector<ADAQWaveformData> WaveformData(NumChannels);
+
+    for(int ch=0; ch<NumChannels; ch++)
+      Manager->CreateWaveformTreeBranches(ch, &Waveforms[ch], &WaveformData[ch]);
+
+    chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+    double MaxFill = 0.;
+
+    for(uint32_t e=0; e<NumEvents; e++){
+      const uint16_t *Event = &Pool[(size_t)(e % PoolSize) * NumChannels * RecordLength];
+
+      for(int ch=0; ch<NumChannels; ch++){
+	const uint16_t *Samples = Event + (size_t)ch * RecordLength;
+	if(Layouts[l] == zWaveformVector)
+	  Waveforms[ch].assign(Samples, Samples + RecordLength);
+	else
+	  Manager->SetWaveform(ch, Samples, RecordLength);
+      }
+
+      chrono::steady_clock::time_point FillStart = chrono::steady_clock::now();
+      Manager->FillWaveformTree();
+      chrono::duration<double> Fill = chrono::steady_clock::now() - FillStart;
+      MaxFill = max(MaxFill, Fill.count());
+    }
+    Manager->WriteFile();
+
+    chrono::duration<double> FillTime = chrono::steady_clock::now() - Start;
+    delete Manager;
+
+    struct stat FileStat;
+    stat(FileName.c_str(), &FileStat);
+
+    // Read
+
+    TFile *File = new TFile(FileName.c_str(), "read");
+    TTree *Tree = (TTree *)File->Get("WaveformTree");
+
+    vector<ADAQWaveformReader> Readers(NumChannels);
+    for(int ch=0; ch<NumChannels; ch++)
+      if(Readers[ch].Attach(Tree, ch) != 0 or Readers[ch].GetLayout() != Layouts[l])
+	Status = -42;
+
+    Start = chrono::steady_clock::now();
+
+    double Sum = 0.;
+    const Long64_t Entries = Tree->GetEntries();
+    for(Long64_t e=0; e<Entries; e++){
+      for(int ch=0; ch<NumChannels; ch++){
+	Readers[ch].GetEntry(e);
+	const uint16_t *Samples = Readers[ch].GetSamples();
+	for(UInt_t s=0; s<Readers[ch].GetLength(); s++)
+	  Sum += Samples[s];
+      }
+    }
+
+    chrono::duration<double> ReadTime = chrono::steady_clock::now() - Start;
+    File->Close();
+    delete File;
+
+    if(ReferenceSum < 0.)
+      ReferenceSum = Sum;
+    else if(Sum != ReferenceSum)
+      Status = -42;
+
+    cout << setw(16) << Names[l] << setprecision(4)
+	 << setw(14) << NumEvents / FillTime.count()
+	 << setw(14) << SampleMB / FillTime.count()
+	 << setw(14) << 1.e3 * MaxFill
+	 << setw(14) << FileStat.st_size / 1.e6
+	 << setw(14) << Entries / ReadTime.count()
+	 << setw(14) << SampleMB / ReadTime.count() << endl;
+
+    remove(FileName.c_str());
+  }
+
+  if(Status != 0)
+    cout << "\nError! The waveforms read back differ between the layouts!" << endl;
+  cout << endl;
+
+  return Status;
+}
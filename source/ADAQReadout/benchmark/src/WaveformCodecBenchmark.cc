@@ -0,0 +1,322 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: WaveformCodecBenchmark.cc
+// date: 16 Oct 26
+//
+// desc: Checks that ADAQWaveformCodec::Decode() restores every sample
+//       encoded by Encode() and measures the packed size and the
+//       encode and decode rates [MB/s of samples] without ROOT I/O.
+//
+//       The round trip is first checked on generated edge cases at
+//       bit depths 10 to 16: record lengths around the block size
+//       (including empty records), constant, ramp, full-swing, and
+//       uniformly random samples (raw blocks), samples beyond the
+//       given bit depth, and invalid bit depths. Every truncation of
+//       a stream and a too small output array must be refused (-42).
+//
+//       The size and rates are then measured on digitizer waveforms:
+//       those of the STD firmware boards of a raw dump
+//       (ADAQRawDumpWriter) if one is given, e.g. of V1720 and V1724
+//       runs, or otherwise those of emulated V1720 (12-bit) and V1724
+//       (14-bit) boards. The waveforms are round-tripped as well.
+//
+// 2run: $ ./bin/WaveformCodecBenchmark [Dump]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstring>
+using namespace std;
+
+// ADAQ
+#include "ADAQWaveformCodec.hh"
+#include "ADAQEmulatedDigitizer.hh"
+#include "ADAQRawDumpReader.hh"
+#include "ADAQEventArena.hh"
+
+
+// The waveforms of one board at its bit depth
+struct WaveformSet{
+  string Name;
+  int BitDepth;
+  vector<vector<uint16_t> > Waveforms;
+};
+
+
+// Encode and decode one waveform; returns false if the samples are
+// not restored or if a truncated stream or too small output array is
+// not refused
+bool RoundTrip(const vector<uint16_t> &W, Int_t BitDepth, bool CheckTruncation)
+{
+  vector<uint8_t> Stream;
+  const UInt_t Bytes = ADAQWaveformCodec::Encode(W.data(), W.size(), BitDepth, Stream);
+
+  if(Bytes != Stream.size() or Bytes > ADAQWaveformCodec::GetMaxEncodedSize(W.size()) or
+     ADAQWaveformCodec::GetNumSamples(Stream.data(), Bytes) != W.size())
+    return false;
+
+  vector<uint16_t> Out(W.size() + 1, 0xffff);
+  if(ADAQWaveformCodec::Decode(Stream.data(), Bytes, Out.data(), W.size()) != (Int_t)W.size() or
+     (!W.empty() and memcmp(Out.data(), W.data(), W.size() * sizeof(uint16_t)) != 0) or
+     Out[W.size()] != 0xffff)
+    return false;
+
+  if(!W.empty() and ADAQWaveformCodec::Decode(Stream.data(), Bytes, Out.data(), W.size() - 1) != -42)
+    return false;
+
+  // The last byte of a non-empty record always holds sample bits
+  if(CheckTruncation and !W.empty())
+    for(UInt_t b=0; b<Bytes; b++)
+      if(ADAQWaveformCodec::Decode(Stream.data(), b, Out.data(), W.size()) != -42)
+	return false;
+
+  return true;
+}
+
+
+// The generated edge cases; returns the number of failed cases
+int CheckEdgeCases()
+{
+  mt19937 Engine(42);
+  int Cases = 0, Failed = 0;
+
+  const UInt_t Lengths[] = {0, 1, 2, 15, 16, 17, 31, 32, 33, 255, 256, 1000};
+  const int Depths[] = {10, 12, 14, 16};
+
+  for(int d=0; d<4; d++){
+    const int Depth = Depths[d];
+    const uint16_t Max = (uint16_t)((1u << Depth) - 1);
+    uniform_int_distribution<int> Uniform(0, Max);
+    normal_distribution<double> Noise(0., 3.);
+
+    for(UInt_t l=0; l<sizeof(Lengths)/sizeof(UInt_t); l++){
+      const UInt_t N = Lengths[l];
+      vector<vector<uint16_t> > Patterns(6, vector<uint16_t>(N));
+
+      for(UInt_t s=0; s<N; s++){
+	Patterns[0][s] = Max / 2;                                     // Constant
+	Patterns[1][s] = (uint16_t)(s % (Max + 1u));                  // Ramp
+	Patterns[2][s] = (s % 2) ? Max : 0;                           // Full swing
+	Patterns[3][s] = Uniform(Engine);                             // Raw blocks
+	Patterns[4][s] = (uint16_t)min(max(Max * 0.8 + Noise(Engine), 0.), (double)Max);
+	Patterns[5][s] = (s == N/2) ? Max : 0;                        // Single spike
+      }
+
+      for(size_t p=0; p<Patterns.size(); p++){
+	Cases++;
+	Failed += !RoundTrip(Patterns[p], Depth, N <= 256);
+      }
+    }
+  }
+
+  // Samples beyond the given bit depth raise the depth of the stream;
+  // invalid bit depths are treated as 16 bits
+  vector<uint16_t> Wide(100);
+  for(UInt_t s=0; s<Wide.size(); s++)
+    Wide[s] = (s * 997) & 0xffff;
+
+  const Int_t Given[] = {10, 0, -1, 20};
+  for(int g=0; g<4; g++){
+    Cases++;
+    Failed += !RoundTrip(Wide, Given[g], true);
+  }
+
+  cout << "Edge cases : " << Cases - Failed << " of " << Cases << " round trips correct" << endl;
+  return Failed;
+}
+
+
+// Digitizer waveforms from the STD firmware frames of a raw dump
+void ReadDump(string Name, vector<WaveformSet> &Sets)
+{
+  ADAQRawDumpReader Reader;
+  if(Reader.Open(Name) != 0)
+    return;
+
+  vector<int> IDs = Reader.GetBoardIDs();
+  ADAQEventArena Arena;
+
+  for(size_t b=0; b<IDs.size(); b++){
+    ADAQEmulatedDigitizer *DG = NULL;
+    WaveformSet Set;
+
+    ADAQRawDumpFrame Frame;
+    for(uint64_t f=0; Reader.GetFrame(f, Frame); f++){
+      if(Frame.Header->BoardID != IDs[b] or Frame.Header->Firmware == ADAQRawDump::zFirmwarePSD)
+	continue;
+
+      if(!DG){
+	DG = new ADAQEmulatedDigitizer((ZBoardType)Frame.Header->BoardType, IDs[b]);
+	DG->OpenLink();
+	Set.Name = DG->GetBoardModelName() + " (dump)";
+	Set.BitDepth = DG->GetNumADCBits();
+      }
+
+      if(DG->DecodeSTDBuffer(Frame.Data, Frame.Header->Size, &Arena) != 0)
+	continue;
+
+      for(uint32_t e=0; e<Arena.GetNumEvents(); e++)
+	for(int ch=0; ch<DG->GetNumChannels(); ch++){
+	  ADAQSampleSpan Span = Arena.GetWaveform(e, ch);
+	  if(Span.Size > 0)
+	    Set.Waveforms.push_back(vector<uint16_t>(Span.begin(), Span.end()));
+	}
+    }
+
+    if(DG){
+      DG->CloseLink();
+      delete DG;
+      Sets.push_back(Set);
+    }
+  }
+}
+
+
+// Digitizer waveforms of an emulated board
+void Emulate(ZBoardType Type, vector<WaveformSet> &Sets)
+{
+  ADAQEmulatedDigitizer *DG = new ADAQEmulatedDigitizer(Type, 0);
+  DG->SetTriggerRate(0.);
+  DG->SetSeed(42);
+  DG->OpenLink();
+  DG->SetRecordLength(512);
+  DG->SetChannelEnableMask(0xff);
+  DG->SetMaxNumEventsBLT(100);
+
+  WaveformSet Set;
+  Set.Name = DG->GetBoardModelName() + " (emulated)";
+  Set.BitDepth = DG->GetNumADCBits();
+
+  char *Buffer = NULL;
+  uint32_t Size = 0;
+  DG->MallocReadoutBuffer(&Buffer, &Size);
+  DG->SWStartAcquisition();
+
+  ADAQEventArena Arena;
+  for(int t=0; t<20; t++){
+    DG->ReadData(Buffer, &Size);
+    if(DG->DecodeSTDBuffer(Buffer, Size, &Arena) != 0)
+      continue;
+    for(uint32_t e=0; e<Arena.GetNumEvents(); e++)
+      for(int ch=0; ch<8; ch++){
+	ADAQSampleSpan Span = Arena.GetWaveform(e, ch);
+	Set.Waveforms.push_back(vector<uint16_t>(Span.begin(), Span.end()));
+      }
+  }
+
+  DG->SWStopAcquisition();
+  DG->FreeReadoutBuffer(&Buffer);
+  DG->CloseLink();
+  delete DG;
+
+  Sets.push_back(Set);
+}
+
+
+// Packed size and rates of a set; returns false if a waveform is not
+// restored
+bool Measure(const WaveformSet &Set)
+{
+  const double MinTime = 0.5; // [s] per measurement
+
+  const size_t NumWaveforms = Set.Waveforms.size();
+  uint64_t Samples = 0;
+  for(size_t w=0; w<NumWaveforms; w++)
+    Samples += Set.Waveforms[w].size();
+
+  vector<vector<uint8_t> > Streams(NumWaveforms);
+  uint64_t Bytes = 0;
+  bool Identical = true;
+
+  for(size_t w=0; w<NumWaveforms; w++){
+    Identical &= RoundTrip(Set.Waveforms[w], Set.BitDepth, false);
+    Bytes += ADAQWaveformCodec::Encode(Set.Waveforms[w].data(), Set.Waveforms[w].size(),
+				       Set.BitDepth, Streams[w]);
+  }
+
+  double Rates[2] = {0., 0.};
+  vector<uint8_t> Stream;
+  vector<uint16_t> Out;
+
+  for(int m=0; m<2; m++){
+    uint64_t Done = 0;
+    chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+    chrono::duration<double> Elapsed(0.);
+
+    while(Elapsed.count() < MinTime){
+      for(size_t w=0; w<NumWaveforms; w++){
+	const vector<uint16_t> &W = Set.Waveforms[w];
+	if(m == 0)
+	  ADAQWaveformCodec::Encode(W.data(), W.size(), Set.BitDepth, Stream);
+	else{
+	  Out.resize(W.size());
+	  ADAQWaveformCodec::Decode(Streams[w].data(), Streams[w].size(), Out.data(), Out.size());
+	}
+      }
+      Done += Samples;
+      Elapsed = chrono::steady_clock::now() - Start;
+    }
+    Rates[m] = 2. * Done / Elapsed.count() / 1e6;
+  }
+
+  cout << setw(22) << Set.Name << setw(8) << Set.BitDepth << setw(12) << NumWaveforms
+       << setw(12) << setprecision(3) << 8. * Bytes / max(Samples, (uint64_t)1)
+       << setw(10) << 2. * Samples / max(Bytes, (uint64_t)1)
+       << setw(14) << setprecision(4) << Rates[0] << setw(14) << Rates[1]
+       << setw(12) << (Identical ? "identical" : "DIFFERENT") << endl;
+
+  return Identical;
+}
+
+
+int main(int argc, char *argv[])
+{
+  cout << "\nWaveformCodecBenchmark : single core\n" << endl;
+
+  int Status = (CheckEdgeCases() == 0) ? 0 : -42;
+
+  vector<WaveformSet> Sets;
+  if(argc > 1){
+    ReadDump(argv[1], Sets);
+    if(Sets.empty()){
+      cout << "\nError! The dump '" << argv[1] << "' holds no STD firmware waveforms!\n" << endl;
+      return -42;
+    }
+  }
+  else{
+    Emulate(zV1720, Sets);
+    Emulate(zV1724, Sets);
+  }
+
+  cout << "\n" << setw(22) << "Waveforms" << setw(8) << "Bits" << setw(12) << "Number"
+       << setw(12) << "Bits/sample" << setw(10) << "Ratio"
+       << setw(14) << "Enc. [MB/s]" << setw(14) << "Dec. [MB/s]" << setw(12) << "Result" << endl;
+
+  for(size_t s=0; s<Sets.size(); s++)
+    if(!Measure(Sets[s]))
+      Status = -42;
+
+  if(Status != 0)
+    cout << "\nError! A waveform was not restored by the codec!" << endl;
+  cout << endl;
+
+  return Status;
+}
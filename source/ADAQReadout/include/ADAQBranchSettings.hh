@@ -0,0 +1,89 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQBranchSettings.hh
+// date: 16 Oct 26
+//
+// desc: ADAQBranchSettings holds the storage settings of one type of
+//       branch in ADAQ files: the compression algorithm and level, the
+//       basket (buffer) size, and the split level. The branch types
+//       are the digitized waveforms (WaveformChX and its counter
+//       WaveformLengthChX) and the analyzed waveform data
+//       (WaveformDataChX). Typical choices are LZ4 for fast writing
+//       of raw waveforms during live running and ZSTD or LZMA for
+//       archiving (see ADAQRecompress).
+//
+//       The algorithm values are those of ROOT, such that the ROOT
+//       compression settings are 100 * algorithm + level; level 0
+//       disables compression.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQBranchSettings_hh__
+#define __ADAQBranchSettings_hh__ 1
+
+// ROOT
+#include <TBranch.h>
+#include <TObjArray.h>
+
+
+enum ZCompressionAlgorithm{
+  zCompressionInherit = -1, // Branches: use the file compression
+  zCompressionZLIB = 1,
+  zCompressionLZMA = 2,
+  zCompressionLZ4 = 4,
+  zCompressionZSTD = 5
+};
+
+
+enum ZBranchType{
+  zWaveformBranchType,
+  zWaveformDataBranchType,
+  zNumBranchTypes
+};
+
+
+struct ADAQBranchSettings{
+  Int_t Algorithm;   // ZCompressionAlgorithm
+  Int_t Level;       // Compression level (0-9)
+  Int_t BasketSize;  // [bytes]
+  Int_t SplitLevel;  // Object branches only
+
+  ADAQBranchSettings(Int_t A = zCompressionInherit, Int_t L = 1,
+		     Int_t B = 32000, Int_t S = 99)
+    : Algorithm(A), Level(L), BasketSize(B), SplitLevel(S)
+  {;}
+
+  // The ROOT compression settings or -1 to inherit from the file
+  Int_t GetCompression() const
+  {
+    return (Algorithm == zCompressionInherit) ? -1 : 100 * Algorithm + Level;
+  }
+
+  // Apply the compression and basket size to an existing branch and
+  // its sub-branches (e.g. after TTree::CloneTree())
+  void Apply(TBranch *Branch, Bool_t SetBasketSize = false) const
+  {
+    if(GetCompression() >= 0)
+      Branch->SetCompressionSettings(GetCompression());
+    if(SetBasketSize)
+      Branch->SetBasketSize(BasketSize);
+
+    TObjArray *SubBranches = Branch->GetListOfBranches();
+    for(Int_t b=0; b<SubBranches->GetEntriesFast(); b++)
+      Apply((TBranch *)SubBranches->At(b), SetBasketSize);
+  }
+};
+
+#endif
@@ -0,0 +1,203 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQHistogramService.hh
+// date: 16 Oct 26
+//
+// desc: ADAQHistogramService accumulates live spectra of the analyzed
+//       waveform quantities for online monitoring without writing
+//       the data to an ADAQ file. For each channel it keeps:
+//
+//         Pulse height spectrum   : 1D, PulseHeight [ADC]
+//         Pulse area spectrum     : 1D, PulseArea [ADC]
+//         PSD spectrum            : 2D, PSDTotalIntegral (x) versus
+//                                   PSDTailIntegral/PSDTotalIntegral (y)
+//
+//       Every thread that fills the spectra has its own slot of
+//       fixed-bin 64-bit integer histograms, allocated for the
+//       enabled channels only. A slot has a single writer and is never
+//       locked; the counts are atomic such that Snapshot() may read
+//       them from any thread at any time. The slots are cache line
+//       aligned to avoid false sharing. The number of slots is set at
+//       construction and should be the number of filling threads:
+//
+//         ADAQAnalysisPool workers : GetNumWorkers() slots; an analyze
+//                                    function fills the slot given by
+//                                    ADAQAnalysisPool::GetWorkerIndex()
+//         Other threads            : each calls RegisterThread() once
+//                                    to obtain a free slot
+//
+//       With the default binning a channel takes 1.1 MB per slot, e.g.
+//       70 MB for 8 enabled channels and 8 workers.
+//
+//       Snapshot() sums the slots into a ROOT TH1D or TH2D with the
+//       ROOT bin layout (including under- and overflow bins). The
+//       cost is independent of the event rate and scales with the
+//       number of bins times slots; HistogramBenchmark measures it
+//       while worker threads fill. Reset() does not touch the slots;
+//       the counts at the time of the reset are subtracted from later
+//       snapshots instead.
+//
+//       The binning must be configured with the Set*Binning() methods
+//       before Initialize() and may not be changed while filling.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQHistogramService_hh__
+#define __ADAQHistogramService_hh__ 1
+
+// ROOT
+#include <TH1.h>
+#include <TH2.h>
+
+// C++
+#include <vector>
+#include <atomic>
+using namespace std;
+
+// Boost
+#ifndef __CINT__
+#include <boost/cstdint.hpp>
+#endif
+
+
+enum ZHistogramType{
+  zPulseHeightHistogram,
+  zPulseAreaHistogram,
+  zPSDHistogram
+};
+
+
+class ADAQHistogramService
+{
+public:
+  // The number of slots (filling threads) and the channel enable
+  // mask of the digitizer
+  ADAQHistogramService(Int_t, uint32_t);
+  ~ADAQHistogramService();
+
+  // Binning [bins, min, max] of the three histogram types
+  void SetPulseHeightBinning(Int_t N, Double_t Min, Double_t Max) {SetBinning(0, N, Min, Max);}
+  void SetPulseAreaBinning(Int_t N, Double_t Min, Double_t Max) {SetBinning(1, N, Min, Max);}
+  void SetPSDTotalBinning(Int_t N, Double_t Min, Double_t Max) {SetBinning(2, N, Min, Max);}
+  void SetPSDRatioBinning(Int_t N, Double_t Min, Double_t Max) {SetBinning(3, N, Min, Max);}
+
+  // Allocate the histograms of all slots; must be called after the
+  // binning is set and before the first RegisterThread()
+  void Initialize();
+
+  // Obtain a free slot for the calling thread; lock-free and called
+  // once per thread. Returns -42 if all slots are taken. Not to be
+  // mixed with filling the slots by ADAQAnalysisPool worker index.
+  Int_t RegisterThread();
+
+  // Fill the spectra of "Channel" from "Slot" (only ever from the
+  // thread that owns the slot); disabled and out-of-range channels
+  // are ignored
+  inline void Fill(Int_t Slot, Int_t Channel, Double_t PulseHeight, Double_t PulseArea,
+		   Double_t PSDTotal, Double_t PSDTail)
+  {
+    if(Channel < 0 or Channel >= MaxChannels)
+      return;
+
+    const Int_t Index = ChannelIndex[Channel];
+    if(Index < 0)
+      return;
+
+    atomic<uint64_t> *Counts = SlotCounts[Slot] + Index * ChannelStride;
+    Increment(Counts + FindBin(0, PulseHeight));
+    Increment(Counts + PulseAreaOffset + FindBin(1, PulseArea));
+
+    Double_t Ratio = (PSDTotal != 0.) ? PSDTail / PSDTotal : 0.;
+    Increment(Counts + PSDOffset + FindBin(2, PSDTotal) + (NumBins[2]+2) * FindBin(3, Ratio));
+  }
+
+  // Fill "N" results, e.g. the column arrays of ADAQWaveformResults
+  // (or any class with the same columns)
+  template<class T> void FillBatch(Int_t Slot, Int_t Channel, const T &Results, uint32_t N)
+  {
+    for(uint32_t w=0; w<N; w++)
+      Fill(Slot, Channel,
+	   Results.PulseHeight[w], Results.PulseArea[w],
+	   Results.PSDTotalIntegral[w], Results.PSDTailIntegral[w]);
+  }
+
+  // Snapshot() and Reset() must be called from a single (monitoring)
+  // thread, which may differ from the filling threads.
+
+  // Sum all slots into a histogram of the given type; a TH1D (TH2D
+  // for the PSD) with the configured binning is created if "H" is
+  // NULL and is owned by the caller. Reusing "H" avoids allocation.
+  TH1 *Snapshot(Int_t, ZHistogramType, TH1 * = NULL);
+
+  // Total entries of a channel since the last reset
+  uint64_t GetEntries(Int_t);
+
+  void Reset();
+
+  Bool_t GetChannelEnabled(Int_t Channel)
+  {return (Channel >= 0 and Channel < MaxChannels and ChannelIndex[Channel] >= 0);}
+  Int_t GetNumEnabledChannels() {return NumEnabledChannels;}
+  Int_t GetNumSlots() {return NumSlots;}
+  Int_t GetNumRegisteredThreads() {return NextSlot.load();}
+
+  // Memory taken by the counts of all slots [bytes]
+  size_t GetMemorySize() {return SlotCounts.size() * SlotSize * sizeof(uint64_t);}
+
+private:
+  void SetBinning(Int_t, Int_t, Double_t, Double_t);
+  void SumSlots(Int_t, ZHistogramType, vector<uint64_t> &);
+
+  // Index of the ROOT bin (0 underflow, N+1 overflow) of axis "A"
+  inline Int_t FindBin(Int_t A, Double_t X)
+  {
+    if(!(X >= Min[A]))
+      return 0;
+    if(X >= Max[A])
+      return NumBins[A] + 1;
+    Int_t Bin = 1 + (Int_t)((X - Min[A]) * InvWidth[A]);
+    return (Bin > NumBins[A]) ? NumBins[A] : Bin;
+  }
+
+  // A slot has a single writer, such that the increment need not be
+  // an atomic read-modify-write; the atomic load and store only make
+  // the concurrent reads by Snapshot() well defined
+  static inline void Increment(atomic<uint64_t> *C)
+  {
+    C->store(C->load(memory_order_relaxed) + 1, memory_order_relaxed);
+  }
+
+  static const Int_t MaxChannels = 32;
+
+  // Index of each enabled channel within a slot; -1 if disabled
+  Int_t ChannelIndex[MaxChannels];
+  Int_t NumEnabledChannels, NumSlots;
+
+  // Axes: 0 pulse height, 1 pulse area, 2 PSD total, 3 PSD ratio
+  Int_t NumBins[4];
+  Double_t Min[4], Max[4], InvWidth[4];
+
+  // Offsets [counts] of the histograms within a channel and the
+  // size of a channel's histograms
+  Int_t PulseAreaOffset, PSDOffset, ChannelStride;
+  size_t SlotSize;
+
+  vector<atomic<uint64_t> *> SlotCounts;
+  atomic<Int_t> NextSlot;
+
+  // Summed counts at the last Reset()
+  vector<uint64_t> ResetCounts;
+};
+
+#endif
@@ -178,6 +178,12 @@ public:
   
   void SetStorePSDData(bool SPP) {StorePSDData = SPP;}
   bool GetStorePSDData() {return StorePSDData;}
+
+  // In data reduction mode, 1-in-N raw waveforms are stored per
+  // channel for QA, where N is the channel's prescale factor (0 to
+  // store no raw waveforms for that channel)
+  void SetRawWaveformPrescale(vector<Int_t> RWP) {RawWaveformPrescale = RWP;}
+  vector<Int_t> GetRawWaveformPrescale() {return RawWaveformPrescale;}
   
 
 private:
@@ -252,13 +258,16 @@ private:
   Bool_t StoreRawWaveforms;
   Bool_t StoreEnergyData;
   Bool_t StorePSDData;
+
+  // Raw waveform prescale factors per channel in data reduction mode
+  vector<Int_t> RawWaveformPrescale;
   
 
   ////////////////////////////
   // ROOT class declaration //
   ////////////////////////////
 
-  ClassDef(ADAQReadoutInformation, 1);
+  ClassDef(ADAQReadoutInformation, 2);
 };
 
 #endif
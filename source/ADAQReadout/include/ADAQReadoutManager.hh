@@ -14,9 +14,57 @@
 #endif
 
 #include <vector>
+#ifndef __CINT__
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
 
 #include "ADAQReadoutInformation.hh"
 #include "ADAQWaveformData.hh"
+#include "ADAQBranchSettings.hh"
+#include "ADAQWaveformCodec.hh"
+#include "ADAQWriterStream.hh"
+#include "ADAQRunIndex.hh"
+
+
+// Layouts of the WaveformChX branches: a vector<uint16_t> object
+// (default), a fixed-length uint16_t leaf array of RecordLength
+// samples (STD firmware), a uint16_t leaf array sized by a counter
+// leaf "WaveformLengthChX" (DPP or ZLE with variable lengths), or a
+// uint8_t leaf array of the ADAQWaveformCodec stream of the waveform,
+// sized by the counter leaf "WaveformLengthChX" [bytes]
+
+enum ZWaveformBranchLayout{
+  zWaveformVector,
+  zWaveformFixedArray,
+  zWaveformVariableArray,
+  zWaveformPacked
+};
+
+
+// Policies of the asynchronous writing when the event queue is full:
+// the acquisition thread waits for the writer thread, or the event
+// is dropped (and counted)
+
+enum ZAsyncFullPolicy{
+  zAsyncBlock,
+  zAsyncDrop
+};
+
+
+// A snapshot of the asynchronous writer counters
+
+struct ADAQAsyncWriterStats{
+  UInt_t QueueSize;        // Maximum events in the queue
+  UInt_t QueueDepth;       // Events presently in the queue
+  UInt_t MaxQueueDepth;    // Largest queue depth seen
+  ULong64_t Queued;        // Events queued by FillWaveformTree()
+  ULong64_t Written;       // Events filled into the tree by the writer
+  ULong64_t Dropped;       // Events dropped because the queue was full
+  Double_t BlockedTime;    // Time FillWaveformTree() waited for space [s]
+};
 
 
 class ADAQReadoutManager : public TObject
@@ -28,7 +76,7 @@ public:
   // Action methods for metadata objects
 
   void PopulateMetadata();
-  void WriteMetadata();
+  void WriteMetadata(Int_t Option = 0);
 
   // Action methods for the ADAQ file
   
@@ -43,6 +91,133 @@ public:
 #endif
   TTree *GetWaveformTree() {return WaveformTree;}
 
+  // The layout of the waveform branches created from here on; for
+  // the fixed array layout the RecordLength of the readout
+  // information is used. The vector argument of the branch creation
+  // is ignored (and may be NULL) for the array and packed layouts.
+  void SetWaveformBranchLayout(ZWaveformBranchLayout L) {WaveformBranchLayout = L;}
+  ZWaveformBranchLayout GetWaveformBranchLayout() {return WaveformBranchLayout;}
+
+  // The compression of the ADAQ file (set before CreateFile()) and
+  // the storage settings of each branch type (set before the
+  // branches are created). By default the file uses the ROOT default
+  // (ZLIB, level 1), the waveform branches inherit it with 32 kB
+  // baskets, and the waveform data branches inherit it with 128 kB
+  // baskets and no splitting.
+  void SetFileCompression(ZCompressionAlgorithm A, Int_t L) {FileCompression = 100 * A + L;}
+  Int_t GetFileCompression() {return FileCompression;}
+
+  void SetBranchSettings(ZBranchType T, ADAQBranchSettings S) {BranchSettings[T] = S;}
+  ADAQBranchSettings GetBranchSettings(ZBranchType T) {return BranchSettings[T];}
+
+  // Copy all objects of ADAQ file "In" to "Out", recompressing the
+  // trees with the file compression and branch settings above. The
+  // split level of existing branches is kept. Returns -42 if "In"
+  // cannot be read.
+  Int_t RecompressFile(std::string, std::string);
+
+#ifndef __CINT__
+  // Point the array waveform branch of "Channel" at "Length" samples
+  // (e.g. directly into a decoder arena) for the next fill; the
+  // samples are not copied and must remain valid until the fill.
+  // For the packed layout the samples are encoded (copied) instead.
+  // Returns -42 if the length does not match the fixed array layout.
+  Int_t SetWaveform(Int_t, const uint16_t *, UInt_t);
+#endif
+
+  // Fill the waveform tree and, in data reduction mode, the prescaled
+  // raw waveform trees of all channels: each event counts towards the
+  // raw waveform prescale of every prescaled channel, whose first and
+  // then every Nth raw waveform is stored
+  void FillWaveformTree();
+  TTree *GetPrescaledWaveformTree(Int_t);
+
+  // The asynchronous mode moves the tree filling, and thus the basket
+  // compression and disk writes, off the acquisition thread:
+  // FillWaveformTree() copies the event from the branch sources into
+  // a bounded queue and a writer thread, which owns the TFile and
+  // TTree until WriteFile(), fills the tree. WriteFile() drains the
+  // queue before writing. The mode, queue size, and policy must be
+  // set before the branches are created.
+  void SetAsyncMode(Bool_t A) {AsyncMode = A;}
+  Bool_t GetAsyncMode() {return AsyncMode;}
+
+  void SetAsyncQueueSize(UInt_t S) {AsyncQueueSize = (S > 0) ? S : 1;}
+  void SetAsyncFullPolicy(ZAsyncFullPolicy P) {AsyncFullPolicy = P;}
+
+  ADAQAsyncWriterStats GetAsyncWriterStats();
+
+  // Parallel output. SetImplicitMT() enables ROOT implicit
+  // multithreading on "N" threads (0 disables it), with which the
+  // baskets of the branches, i.e. of the channels, are compressed in
+  // parallel whenever the tree is flushed. In the parallel mode, set
+  // before CreateFile(), the ADAQ file is written by a ROOT
+  // TBufferMerger instead: every producer thread (e.g. one per
+  // digitizer board) fills and compresses the WaveformTree of its
+  // own ADAQWriterStream, and the streams are merged into the file
+  // in the background. WriteFile() must be called after all
+  // producers have finished. The asynchronous mode and the
+  // manager's own WaveformTree are not used in the parallel mode.
+  // The parallel mode requires ROOT 6.10 or newer (TBufferMerger);
+  // with an older ROOT it stays disabled.
+  void SetImplicitMT(UInt_t);
+#ifdef __ADAQ_PARALLEL_MODE__
+  void SetParallelMode(Bool_t P) {ParallelMode = P;}
+#else
+  void SetParallelMode(Bool_t) {ParallelMode = false;}
+#endif
+  Bool_t GetParallelMode() {return ParallelMode;}
+
+  // Create a stream (owned by the manager) for one producer thread.
+  // The streams do not write the prescaled raw waveforms of the data
+  // reduction mode, such that NULL is returned if the readout
+  // information requests them (as well as without an open file in
+  // the parallel mode)
+  ADAQWriterStream *CreateWriterStream();
+
+  // File rollover. With any limit set (0: no limit) before
+  // CreateFile("Run.adaq.root"), the run is written into a series
+  // of complete ADAQ files ("chunks") Run_0000.adaq.root,
+  // Run_0001.adaq.root, ... Before an event is filled, the chunk is
+  // closed and the next one continued if the chunk has reached the
+  // file size on disk [bytes], the number of entries, or the
+  // wall-clock time [s]. Each chunk holds the metadata and the
+  // readout information; each closed chunk is added to the run index
+  // Run.adaq.index (see ADAQRunIndex). The index and the chunks of a
+  // previous run of the same name are deleted by CreateFile(). The
+  // next chunk file is opened in the background ahead of time and
+  // deleted if the run ends before it is used. The branches are
+  // recreated in every chunk, such that pointers returned by
+  // GetWaveformTree() and GetPrescaledWaveformTree() are valid for
+  // one chunk only. In the asynchronous mode the rollover runs on the
+  // writer thread; the parallel mode does not roll over.
+  void SetRolloverLimits(Long64_t, Long64_t, Double_t);
+  Bool_t GetRolloverMode();
+  Int_t GetChunkNumber() {return ChunkNumber;}
+  std::string GetChunkFileName(Int_t);
+  std::string GetRunIndexFileName();
+
+  // Checkpoints. With an interval set (0: none) in entries and/or
+  // wall-clock seconds, the trees are AutoSave()d (their baskets
+  // flushed and headers written) and the metadata and readout
+  // information written every interval. A file that is never closed,
+  // e.g. after a crash or a hung driver, can then be recovered up to
+  // the last checkpoint with RecoverFile() (or ADAQRecover). The
+  // checkpoints are made where the trees are filled, i.e. on the
+  // writer thread in the asynchronous mode, such that the
+  // acquisition thread does not wait for them.
+  void SetCheckpointInterval(Long64_t, Double_t);
+  Bool_t GetCheckpointMode();
+
+  // Copy the objects of a partially written (or complete) ADAQ file
+  // "In" to a closed file "Out"; the trees are copied up to their
+  // last checkpoint without recompression. Returns the number of
+  // WaveformTree entries recovered or -42 if "In" cannot be read.
+  // Keys whose object cannot be read (e.g. written only in part when
+  // the acquisition stopped) are skipped and counted as lost.
+  Long64_t RecoverFile(std::string, std::string);
+  Int_t GetLostKeys() {return LostKeys;}
+
   void SetWaveformBranchStatus(Int_t, Bool_t);
   Bool_t GetWaveformBranchStatus(Int_t);
 
@@ -67,6 +242,39 @@ public:
   TString GetFileComment() {return FileComment->GetString();}
   
 private:
+
+  Long64_t CopyFile(std::string, std::string, Bool_t);
+  void ApplyBranchSettings(TTree *);
+
+#ifndef __CINT__
+  void CreateChannelBranches(Int_t, vector<uint16_t> *, ADAQWaveformData *);
+  void CreateWaveformBranch(TTree *, Int_t, vector<uint16_t> *);
+  void SetWaveformAddress(Int_t, const uint16_t *, UInt_t);
+  void FillTrees();
+  Bool_t StorePrescaledWaveform(Int_t);
+
+  struct AsyncEvent{
+    vector<vector<uint16_t> > Samples;
+    vector<ADAQWaveformData> Data;
+  };
+
+  void QueueEvent();
+  void StartWriter();
+  void StopWriter();
+  void RunWriter();
+#endif
+
+  void WriteParallelFile();
+
+  void WriteChunk();
+  void SplitFileName(std::string &, std::string &);
+  Bool_t RolloverDue();
+  void Rollover();
+  void OpenNextChunk();
+  TFile *TakeNextChunk();
+
+  Bool_t CheckpointDue();
+  void Checkpoint();
   
   // ADAQ file objects
 
@@ -84,6 +292,99 @@ private:
   // Objects for event-level information
 
   TTree *WaveformTree;
+
+  // Objects for the prescaled raw waveforms in data reduction mode:
+  // one tree per channel holding 1-in-N raw waveforms of the channel
+  // together with the analyzed data and the WaveformTree entry
+
+  vector<Int_t> PrescaleChannel; //!
+  vector<Int_t> PrescaleFactor; //!
+  vector<Long64_t> PrescaleCounter; //!
+  vector<TTree *> PrescaledWaveformTrees; //!
+  Long64_t PrescaleEntry; //!
+
+  // Objects for the array waveform branch layouts: per channel, the
+  // sample counters, the array branches (in the WaveformTree and the
+  // prescaled tree), storage for the fixed array until the first
+  // SetWaveform(), and the packed stream. The vectors are sized once
+  // to MaxChannels such that the counter addresses given to the
+  // branches remain valid.
+
+  static const Int_t MaxChannels = 64;
+  ZWaveformBranchLayout WaveformBranchLayout; //!
+  vector<UInt_t> WaveformLength; //!
+  vector<vector<TBranch *> > WaveformBranches; //!
+  vector<vector<uint16_t> > WaveformStorage; //!
+  vector<vector<uint8_t> > PackedStorage; //!
+
+  // Objects for the storage settings
+
+  Int_t FileCompression; //!
+  vector<ADAQBranchSettings> BranchSettings; //!
+
+  // Objects for the asynchronous mode. The branches point to the
+  // writer objects; the caller's objects given at branch creation
+  // (and to SetWaveform()) are the sources copied into the queue.
+
+  Bool_t AsyncMode; //!
+  UInt_t AsyncQueueSize; //!
+  ZAsyncFullPolicy AsyncFullPolicy; //!
+
+#ifndef __CINT__
+  vector<Int_t> AsyncChannels; //!
+  vector<vector<uint16_t> *> SourceWaveform; //!
+  vector<ADAQWaveformData *> SourceData; //!
+  vector<const uint16_t *> SourceSamples; //!
+  vector<UInt_t> SourceLength; //!
+  vector<vector<uint16_t> > WriterWaveform; //!
+  vector<ADAQWaveformData> WriterData; //!
+
+  std::thread *WriterThread; //!
+  std::mutex QueueMutex; //!
+  std::condition_variable QueueNotEmpty, QueueNotFull; //!
+  std::deque<AsyncEvent *> Queue; //!
+  vector<AsyncEvent *> FreeEvents; //!
+  Bool_t WriterStop; //!
+
+  ADAQAsyncWriterStats AsyncStats; //!
+#endif
+
+  // Objects for the parallel mode
+
+  Bool_t ParallelMode; //!
+  ROOT::TBufferMerger *Merger; //!
+  vector<ADAQWriterStream *> WriterStreams; //!
+
+  // Objects for the file rollover. The branches created for the run
+  // (with the writer objects in the asynchronous mode) are recreated
+  // in each chunk.
+
+  Long64_t RolloverBytes, RolloverEntries; //!
+  Double_t RolloverSeconds; //!
+  Int_t ChunkNumber; //!
+  Long64_t ChunkFirstEntry, ChunkStartTime; //!
+  TFile *NextChunk; //!
+
+#ifndef __CINT__
+  struct ChannelBranches{
+    Int_t Channel;
+    vector<uint16_t> *Waveform;
+    ADAQWaveformData *Data;
+  };
+
+  vector<ChannelBranches> RunBranches; //!
+  std::thread *NextChunkThread; //!
+#endif
+
+  // Objects for the checkpoints: the interval and the WaveformTree
+  // entries and time of the last checkpoint of the present file
+
+  Long64_t CheckpointEntries; //!
+  Double_t CheckpointSeconds; //!
+  Long64_t CheckpointEntry, CheckpointTime; //!
+
+  // Keys that could not be read by the last copy of a file
+  Int_t LostKeys; //!
   
   // Objects for run-level information
 
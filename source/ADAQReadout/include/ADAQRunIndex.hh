@@ -0,0 +1,92 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRunIndex.hh
+// date: 16 Oct 26
+//
+// desc: ADAQRunIndex reads and writes the index of a run that
+//       ADAQReadoutManager has split into several ADAQ files
+//       ("chunks") with its file rollover. Each chunk is a complete
+//       ADAQ file with its own metadata and readout information; the
+//       index lists, per chunk, the file name, the range of the run's
+//       WaveformTree entries, and the wall-clock time range (UNIX
+//       time [s]) over which the chunk was written. A chunk is added
+//       to the index as soon as it is closed, such that the closed
+//       chunks of a run may be analyzed while the run continues.
+//
+//       The index is a plain text file of one line per chunk:
+//
+//         # ADAQ run index: <file> <first entry> <entries> <start> <stop>
+//         Run_0000.adaq.root 0 250000 1792152000 1792152600
+//
+//       The file names are relative to the directory of the index.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQRunIndex_hh__
+#define __ADAQRunIndex_hh__ 1
+
+// ROOT
+#include <Rtypes.h>
+#include <TChain.h>
+
+// C++
+#include <vector>
+#include <string>
+using namespace std;
+
+
+struct ADAQRunChunk{
+  std::string FileName;
+  Long64_t FirstEntry;  // Run entry of the chunk's first entry
+  Long64_t NumEntries;
+  Long64_t StartTime;   // [s]
+  Long64_t StopTime;    // [s]
+};
+
+
+class ADAQRunIndex
+{
+public:
+  ADAQRunIndex() {;}
+
+  // Read the index file; returns -42 if it cannot be read
+  Int_t Load(std::string);
+
+  Int_t GetNumChunks() {return Chunks.size();}
+  const ADAQRunChunk &GetChunk(Int_t i) {return Chunks[i];}
+
+  // The chunk file name including the directory of the index
+  std::string GetChunkPath(Int_t);
+
+  // The chunk that holds run entry "Entry", or that was being written
+  // at UNIX time "Time"; -42 if there is none
+  Int_t FindChunkByEntry(Long64_t);
+  Int_t FindChunkByTime(Long64_t);
+
+  // A chain (owned by the caller) of the tree "Name" of all chunks,
+  // whose entry numbers are the run entries of the WaveformTree
+  TChain *CreateChain(TString Name = "WaveformTree");
+
+  // Append a closed chunk to the index file "Name", which is created
+  // if needed; returns -42 if it cannot be written
+  static Int_t AppendChunk(std::string, const ADAQRunChunk &);
+
+private:
+  std::string Directory;
+  vector<ADAQRunChunk> Chunks;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQWaveformCodec.hh
+// date: 16 Oct 26
+//
+// desc: ADAQWaveformCodec packs digitized waveforms into a compact bit
+//       stream before they are compressed by ROOT (the packed
+//       waveform branch layout of ADAQReadoutManager). Digitizer
+//       samples have 10 to 14 significant bits (the board's
+//       NumADCBits) but are stored in 16-bit words, and neighboring
+//       samples, e.g. on the baseline, differ by a few ADC only. The
+//       codec therefore stores the differences between neighboring
+//       samples, zigzag encoded (0, -1, 1, -2, ... to 0, 1, 2, 3,
+//       ...), in blocks of BlockSize samples with the smallest bit
+//       width that holds all differences of the block. A block whose
+//       width would exceed the bit depth is stored as raw samples at
+//       the bit depth, such that a waveform never takes more than
+//       bit depth bits per sample plus the block headers.
+//
+//       The stream is (little-endian, bits filled from the least
+//       significant bit of each byte):
+//
+//         Header : 32 bits number of samples, 8 bits bit depth,
+//                  16 bits first sample
+//         Blocks : 5 bits width W (RawWidth: raw samples) followed by
+//                  the W-bit differences (bit depth-bit samples)
+//
+//       The stream is self-describing; the bit depth given to
+//       Encode() is raised if a sample does not fit into it.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQWaveformCodec_hh__
+#define __ADAQWaveformCodec_hh__ 1
+
+// ROOT
+#include <Rtypes.h>
+
+// C++
+#include <vector>
+using namespace std;
+
+// Boost
+#ifndef __CINT__
+#include <boost/cstdint.hpp>
+#endif
+
+
+class ADAQWaveformCodec
+{
+public:
+  static const UInt_t BlockSize = 16;
+  static const UInt_t HeaderSize = 7; // [bytes]
+  static const UInt_t RawWidth = 31;
+
+#ifndef __CINT__
+  // Encode "N" samples of "BitDepth" significant bits into "Out",
+  // which is resized to the stream; returns the stream size [bytes]
+  static UInt_t Encode(const uint16_t *, UInt_t, Int_t, vector<uint8_t> &);
+
+  // The number of samples of a stream of "Bytes" bytes (0 if the
+  // stream is too short)
+  static UInt_t GetNumSamples(const uint8_t *, UInt_t);
+
+  // Decode a stream of "Bytes" bytes into "Out", which must hold
+  // GetNumSamples() samples; returns the number of samples or -42 if
+  // the stream is truncated or does not fit into "MaxSamples"
+  static Int_t Decode(const uint8_t *, UInt_t, uint16_t *, UInt_t);
+#endif
+
+  // The largest stream size [bytes] of "N" samples
+  static UInt_t GetMaxEncodedSize(UInt_t N)
+  {
+    const UInt_t NumBlocks = (N + BlockSize - 1) / BlockSize;
+    return HeaderSize + (NumBlocks * 5 + N * 16 + 7) / 8 + 1;
+  }
+};
+
+#endif
@@ -30,6 +30,15 @@ public:
   
   void SetTimeStamp(ULong64_t TS) {TimeStamp = TS;}
   ULong64_t GetTimeStamp() {return TimeStamp;}
+
+  void SetFineTime(Double_t FT) {FineTime = FT;}
+  Double_t GetFineTime() {return FineTime;}
+
+  void SetPileUpFlag(Bool_t PUF) {PileUpFlag = PUF;}
+  Bool_t GetPileUpFlag() {return PileUpFlag;}
+
+  void SetPileUpCount(Int_t PUC) {PileUpCount = PUC;}
+  Int_t GetPileUpCount() {return PileUpCount;}
   
   void SetChannelID(Int_t CID) {ChannelID = CID;}
   Int_t GetChannelID() {return ChannelID;}
@@ -44,12 +53,28 @@ private:
   Double_t PulseHeight, PulseArea, Baseline;
   Double_t PSDTotalIntegral, PSDTailIntegral;
   
-  // Standard waveform data
+  // Standard waveform data. The time stamp is the digitizer trigger
+  // time tag unwrapped into a 64-bit time stamp [ns] by ADAQTimeSorter
+  // as ADAQRawConvert and ADAQReplay fill it; files written by other
+  // code may hold the raw time tag
   
   ULong64_t TimeStamp;
   Int_t ChannelID, BoardID;
+
+  // Sub-sample time [ns] of the pulse from the start of the record,
+  // as found by the ADAQWaveformAnalyzer CFD or leading-edge timing;
+  // the pulse time is TimeStamp + FineTime. Negative if not found.
+
+  Double_t FineTime;
+
+  // Pile-up found by the ADAQWaveformAnalyzer software detection in
+  // STD firmware waveforms: the flag and the number of pulses beyond
+  // the first in the record
+
+  Bool_t PileUpFlag;
+  Int_t PileUpCount;
   
-  ClassDef(ADAQWaveformData, 1);
+  ClassDef(ADAQWaveformData, 3);
 };
 
 #endif
@@ -0,0 +1,111 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQWaveformReader.hh
+// date: 16 Oct 26
+//
+// desc: ADAQWaveformReader reads the digitized waveforms of one
+//       channel from the WaveformTree (or a prescaled waveform tree)
+//       of an ADAQ file independent of the layout with which the
+//       WaveformChX branch was written by ADAQReadoutManager:
+//
+//         vector<uint16_t> object        (zWaveformVector)
+//         fixed-length uint16_t array    (zWaveformFixedArray)
+//         counter-sized uint16_t array   (zWaveformVariableArray)
+//         ADAQWaveformCodec byte stream  (zWaveformPacked)
+//
+//       The layout is detected from the branch when the reader is
+//       attached to a tree. Only the waveform branch (and its
+//       counter) is read by GetEntry(), such that the other branches
+//       are not decompressed. Packed waveforms are decoded by
+//       GetEntry(). The samples are available as a pointer and length
+//       or, for existing analysis code, as a vector.
+//
+//       The tree may be a TChain: GetEntry() loads the tree of the
+//       entry and, whenever that is another tree of the chain, looks
+//       up the branches again and detects their layout anew.
+//
+//       The reader owns the memory that the branch addresses point
+//       to; the tree must not be read through its own GetEntry()
+//       after the reader is destroyed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQWaveformReader_hh__
+#define __ADAQWaveformReader_hh__ 1
+
+// ROOT
+#include <TTree.h>
+#include <TBranch.h>
+
+// C++
+#include <vector>
+using namespace std;
+
+// Boost
+#ifndef __CINT__
+#include <boost/cstdint.hpp>
+#endif
+
+// ADAQ
+#include "ADAQReadoutManager.hh"
+
+
+class ADAQWaveformReader
+{
+public:
+  ADAQWaveformReader();
+  ~ADAQWaveformReader();
+
+  // Attach to the WaveformChX branch of "Channel" in "Tree"; returns
+  // -42 if the tree has no waveform branch for the channel
+  Int_t Attach(TTree *, Int_t);
+  
+  ZWaveformBranchLayout GetLayout() {return Layout;}
+
+  // Read the waveform of an entry (of the chain if the tree is a
+  // TChain); returns the number of bytes read (0 if the entry does
+  // not exist)
+  Int_t GetEntry(Long64_t);
+
+#ifndef __CINT__
+  const uint16_t *GetSamples() {return Samples;}
+  UInt_t GetLength() {return Length;}
+
+  // The waveform of the last entry as a vector (copied for the array
+  // layouts)
+  vector<uint16_t> *GetWaveform();
+#endif
+
+private:
+  // Detect the layout of the branch in the present tree and set the
+  // branch addresses
+  Int_t SetupBranches();
+
+  TTree *Tree;
+  TString BranchName;
+  Int_t TreeNumber;
+  ZWaveformBranchLayout Layout;
+  TBranch *WaveformBranch, *LengthBranch;
+
+#ifndef __CINT__
+  vector<uint16_t> *Vector;
+  vector<uint16_t> Buffer, Copy;
+  vector<uint8_t> Packed;
+  const uint16_t *Samples;
+#endif
+  UInt_t Length, PackedLength;
+};
+
+#endif
@@ -0,0 +1,122 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQWriterStream.hh
+// date: 16 Oct 26
+//
+// desc: ADAQWriterStream is one producer of an ADAQ file written in the
+//       parallel mode of ADAQReadoutManager. Each stream is used by a
+//       single producer thread (e.g. one per digitizer board) and
+//       fills its own WaveformTree, with the same branches as the
+//       ADAQReadoutManager WaveformTree, in an in-memory file of a
+//       ROOT TBufferMerger. The baskets are thus compressed on the
+//       producer thread; every FlushEntries entries the compressed
+//       buffer is queued to the TBufferMerger, which appends it to
+//       the WaveformTree of the ADAQ file in the background.
+//
+//       The entries of different streams are interleaved by flush
+//       rather than by trigger; the ADAQWaveformData time stamps give
+//       the time order. The waveform branches use the vector layout.
+//
+//       TBufferMerger requires ROOT 6.10 or newer. With an older ROOT
+//       the stream is not compiled (__ADAQ_PARALLEL_MODE__ is not
+//       defined) and the parallel mode cannot be enabled.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ADAQWriterStream_hh__
+#define __ADAQWriterStream_hh__ 1
+
+// ROOT
+#include <TTree.h>
+#include <RVersion.h>
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+#define __ADAQ_PARALLEL_MODE__ 1
+#include <ROOT/TBufferMerger.hxx>
+#endif
+
+// C++
+#include <vector>
+#include <memory>
+using namespace std;
+
+// Boost
+#ifndef __CINT__
+#include <boost/cstdint.hpp>
+#endif
+
+// ADAQ
+#include "ADAQReadoutInformation.hh"
+#include "ADAQWaveformData.hh"
+#include "ADAQBranchSettings.hh"
+
+#ifdef __ADAQ_PARALLEL_MODE__
+
+// TBufferMerger left the experimental namespace in ROOT 6.26
+#if ROOT_VERSION_CODE < ROOT_VERSION(6,26,0)
+namespace ROOT{
+  using Experimental::TBufferMerger;
+  using Experimental::TBufferMergerFile;
+}
+#endif
+
+
+class ADAQWriterStream
+{
+public:
+  // Streams are created by ADAQReadoutManager::CreateWriterStream()
+  ADAQWriterStream(ROOT::TBufferMerger *, ADAQReadoutInformation *,
+		   const vector<ADAQBranchSettings> &);
+  ~ADAQWriterStream();
+
+  // Create the branches of "Channel" as in ADAQReadoutManager
+  // (including the data reduction mode without raw waveforms and
+  // the branch settings)
+#ifndef __CINT__
+  void CreateWaveformTreeBranches(Int_t, vector<uint16_t> *, ADAQWaveformData *);
+#endif
+
+  // Entries filled between the queueing of buffers to the merger
+  void SetFlushEntries(Long64_t F) {FlushEntries = (F > 0) ? F : 1;}
+
+  void FillWaveformTree();
+
+  // Queue the remaining entries to the merger; called by
+  // ADAQReadoutManager::WriteFile() after the producer has finished.
+  // The WaveformTree is deleted and further entries are ignored
+  void Close();
+
+  TTree *GetWaveformTree() {return WaveformTree;}
+  Long64_t GetEntries() {return Entries;}
+
+private:
+  shared_ptr<ROOT::TBufferMergerFile> File;
+  ADAQReadoutInformation *ReadoutInformation;
+  vector<ADAQBranchSettings> BranchSettings;
+  TTree *WaveformTree;
+
+  Long64_t FlushEntries, Entries;
+};
+
+#else
+
+namespace ROOT{
+  class TBufferMerger;
+}
+class ADAQWriterStream;
+
+#endif
+
+#endif
@@ -0,0 +1,196 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQHistogramService.cc
+// date: 16 Oct 26
+//
+// desc: ADAQHistogramService accumulates lock-free per-thread live
+//       spectra and merges them into ROOT histograms on demand. See
+//       the header file for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <sstream>
+
+// ADAQ
+#include "ADAQHistogramService.hh"
+
+
+// Counts per 64-byte cache line; each slot is padded by a line on
+// either side such that no two slots share a line
+static const size_t CountsPerLine = 64 / sizeof(uint64_t);
+
+
+ADAQHistogramService::ADAQHistogramService(Int_t NS, uint32_t ChannelEnableMask)
+  : NumEnabledChannels(0), NumSlots((NS > 0) ? NS : 1),
+    PulseAreaOffset(0), PSDOffset(0), ChannelStride(0), SlotSize(0),
+    NextSlot(0)
+{
+  for(Int_t ch=0; ch<MaxChannels; ch++)
+    ChannelIndex[ch] = ((ChannelEnableMask >> ch) & 1) ? NumEnabledChannels++ : -1;
+
+  SetPulseHeightBinning(4096, 0., 16384.);
+  SetPulseAreaBinning(4096, 0., 1000000.);
+  SetPSDTotalBinning(512, 0., 1000000.);
+  SetPSDRatioBinning(256, 0., 1.);
+}
+
+
+ADAQHistogramService::~ADAQHistogramService()
+{
+  for(size_t s=0; s<SlotCounts.size(); s++)
+    delete [] (SlotCounts[s] - CountsPerLine);
+}
+
+
+void ADAQHistogramService::SetBinning(Int_t A, Int_t N, Double_t Mn, Double_t Mx)
+{
+  if(N < 1) N = 1;
+  if(Mx <= Mn) Mx = Mn + 1.;
+
+  NumBins[A] = N;
+  Min[A] = Mn;
+  Max[A] = Mx;
+  InvWidth[A] = N / (Mx - Mn);
+}
+
+
+void ADAQHistogramService::Initialize()
+{
+  for(size_t s=0; s<SlotCounts.size(); s++)
+    delete [] (SlotCounts[s] - CountsPerLine);
+  SlotCounts.clear();
+
+  PulseAreaOffset = NumBins[0] + 2;
+  PSDOffset = PulseAreaOffset + NumBins[1] + 2;
+  ChannelStride = PSDOffset + (NumBins[2] + 2) * (NumBins[3] + 2);
+  SlotSize = (size_t)ChannelStride * NumEnabledChannels;
+
+  const size_t Padded = (SlotSize + CountsPerLine - 1) / CountsPerLine * CountsPerLine;
+
+  for(Int_t s=0; s<NumSlots; s++){
+    atomic<uint64_t> *Counts = new atomic<uint64_t>[Padded + 2*CountsPerLine];
+    for(size_t i=0; i<Padded + 2*CountsPerLine; i++)
+      Counts[i].store(0, memory_order_relaxed);
+    SlotCounts.push_back(Counts + CountsPerLine);
+  }
+  
+  ResetCounts.assign(SlotSize, 0);
+  NextSlot = 0;
+}
+
+
+Int_t ADAQHistogramService::RegisterThread()
+{
+  Int_t Slot = NextSlot.fetch_add(1);
+  if(Slot >= NumSlots or Slot >= (Int_t)SlotCounts.size())
+    return -42;
+  return Slot;
+}
+
+
+void ADAQHistogramService::SumSlots(Int_t Channel, ZHistogramType Type, vector<uint64_t> &Sum)
+{
+  Int_t Offset = 0, Size = PulseAreaOffset;
+  if(Type == zPulseAreaHistogram){
+    Offset = PulseAreaOffset;
+    Size = PSDOffset - PulseAreaOffset;
+  }
+  else if(Type == zPSDHistogram){
+    Offset = PSDOffset;
+    Size = ChannelStride - PSDOffset;
+  }
+  Offset += ChannelIndex[Channel] * ChannelStride;
+
+  Sum.assign(Size, 0);
+  for(size_t s=0; s<SlotCounts.size(); s++){
+    const atomic<uint64_t> *Counts = SlotCounts[s] + Offset;
+    for(Int_t b=0; b<Size; b++)
+      Sum[b] += Counts[b].load(memory_order_relaxed);
+  }
+  
+  // Counts are only ever incremented, such that the counts at the
+  // last reset never exceed the present counts
+  for(Int_t b=0; b<Size; b++)
+    Sum[b] -= ResetCounts[Offset + b];
+}
+
+
+TH1 *ADAQHistogramService::Snapshot(Int_t Channel, ZHistogramType Type, TH1 *H)
+{
+  if(!GetChannelEnabled(Channel) or SlotCounts.empty())
+    return H;
+  
+  if(!H){
+    std::stringstream SS;
+    if(Type == zPulseHeightHistogram){
+      SS << "PulseHeightCh" << Channel;
+      H = new TH1D(SS.str().c_str(), "Pulse height spectrum;Pulse height [ADC];Counts",
+		   NumBins[0], Min[0], Max[0]);
+    }
+    else if(Type == zPulseAreaHistogram){
+      SS << "PulseAreaCh" << Channel;
+      H = new TH1D(SS.str().c_str(), "Pulse area spectrum;Pulse area [ADC];Counts",
+		   NumBins[1], Min[1], Max[1]);
+    }
+    else{
+      SS << "PSDCh" << Channel;
+      H = new TH2D(SS.str().c_str(), "PSD spectrum;Total integral [ADC];Tail / total",
+		   NumBins[2], Min[2], Max[2],
+		   NumBins[3], Min[3], Max[3]);
+    }
+    H->SetDirectory(0);
+  }
+
+  // The summed counts are laid out in the ROOT global bin order, such
+  // that they are set by global bin for both 1D and 2D histograms
+  
+  vector<uint64_t> Sum;
+  SumSlots(Channel, Type, Sum);
+  
+  uint64_t Entries = 0;
+  for(size_t b=0; b<Sum.size(); b++){
+    H->SetBinContent(b, Sum[b]);
+    Entries += Sum[b];
+  }
+  H->SetEntries(Entries);
+  
+  return H;
+}
+
+
+uint64_t ADAQHistogramService::GetEntries(Int_t Channel)
+{
+  if(!GetChannelEnabled(Channel) or SlotCounts.empty())
+    return 0;
+
+  // Every event fills exactly one pulse height bin
+  vector<uint64_t> Sum;
+  SumSlots(Channel, zPulseHeightHistogram, Sum);
+  
+  uint64_t Entries = 0;
+  for(size_t b=0; b<Sum.size(); b++)
+    Entries += Sum[b];
+  return Entries;
+}
+
+
+void ADAQHistogramService::Reset()
+{
+  ResetCounts.assign(SlotSize, 0);
+  for(size_t s=0; s<SlotCounts.size(); s++)
+    for(size_t i=0; i<SlotSize; i++)
+      ResetCounts[i] += SlotCounts[s][i].load(memory_order_relaxed);
+}
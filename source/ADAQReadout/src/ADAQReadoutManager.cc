@@ -1,16 +1,56 @@
+#include <TROOT.h>
+#include <TKey.h>
+
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
 
 #include "ADAQReadoutManager.hh"
 
 ADAQReadoutManager::ADAQReadoutManager()
   : ADAQFile(new TFile), ADAQFileName(""), ADAQFileOpen(false),
-    WaveformTree(new TTree), ReadoutInformation(new ADAQReadoutInformation)
-{;}
+    WaveformTree(new TTree), PrescaleEntry(0),
+    WaveformBranchLayout(zWaveformVector),
+    WaveformLength(MaxChannels, 0), WaveformBranches(MaxChannels),
+    WaveformStorage(MaxChannels), PackedStorage(MaxChannels),
+    FileCompression(101), BranchSettings(zNumBranchTypes),
+    AsyncMode(false), AsyncQueueSize(1024), AsyncFullPolicy(zAsyncBlock),
+    SourceWaveform(MaxChannels, NULL), SourceData(MaxChannels, NULL),
+    SourceSamples(MaxChannels, NULL), SourceLength(MaxChannels, 0),
+    WriterWaveform(MaxChannels), WriterData(MaxChannels),
+    WriterThread(NULL), WriterStop(false),
+    ParallelMode(false), Merger(NULL),
+    RolloverBytes(0), RolloverEntries(0), RolloverSeconds(0.),
+    ChunkNumber(0), ChunkFirstEntry(0), ChunkStartTime(0),
+    NextChunk(NULL), NextChunkThread(NULL),
+    CheckpointEntries(0), CheckpointSeconds(0.), CheckpointEntry(0), CheckpointTime(0),
+    LostKeys(0),
+    ReadoutInformation(new ADAQReadoutInformation)
+{
+  BranchSettings[zWaveformDataBranchType] = ADAQBranchSettings(zCompressionInherit, 1, 128000, 0);
+  
+  AsyncStats = ADAQAsyncWriterStats();
+}
 
 
 ADAQReadoutManager::~ADAQReadoutManager()
-{;}
+{
+  StopWriter();
+
+  // The chunk opened ahead holds no entries of the run
+  TFile *Next = TakeNextChunk();
+  if(Next){
+    Next->Close();
+    delete Next;
+    remove(GetChunkFileName(ChunkNumber + 1).c_str());
+  }
+
+  for(size_t i=0; i<FreeEvents.size(); i++)
+    delete FreeEvents[i];
+}
 
 
 void ADAQReadoutManager::PopulateMetadata()
@@ -30,13 +70,13 @@ void ADAQReadoutManager::PopulateMetadata()
 }
 
 
-void ADAQReadoutManager::WriteMetadata()
+void ADAQReadoutManager::WriteMetadata(Int_t Option)
 {
-  MachineName->Write("MachineName");
-  MachineUser->Write("MachineUser");
-  FileDate->Write("FileDate");
-  FileVersion->Write("FileVersion");
-  FileComment->Write("FileComment");
+  MachineName->Write("MachineName", Option);
+  MachineUser->Write("MachineUser", Option);
+  FileDate->Write("FileDate", Option);
+  FileVersion->Write("FileVersion", Option);
+  FileComment->Write("FileComment", Option);
 }
 
 
@@ -45,8 +85,39 @@ void ADAQReadoutManager::CreateFile(std::string Name)
   if(ADAQFileOpen)
     return;
   
+  // The producer threads of the parallel mode require ROOT to
+  // protect its global state
+#ifdef __ADAQ_PARALLEL_MODE__
+  if(ParallelMode){
+    ROOT::EnableThreadSafety();
+    Merger = new ROOT::TBufferMerger(Name.c_str(), "recreate", FileCompression);
+    ADAQFileOpen = true;
+
+    PopulateMetadata();
+    CreateReadoutInformation();
+    return;
+  }
+#endif
+
+  ADAQFileName = Name;
+
+  // The chunks are written in place of the named file; the next chunk
+  // is opened on a helper thread. An index of a previous run of the
+  // same name is replaced together with its chunks, which are
+  // numbered without gaps; chunks beyond those of the new run would
+  // otherwise be left behind.
+  if(GetRolloverMode()){
+    remove(GetRunIndexFileName().c_str());
+    for(Int_t n=0; remove(GetChunkFileName(n).c_str()) == 0; n++){;}
+
+    ChunkNumber = 0;
+    ChunkFirstEntry = 0;
+    ChunkStartTime = time(NULL);
+    Name = GetChunkFileName(0);
+  }
+
   if(ADAQFile) delete ADAQFile;
-  ADAQFile = new TFile(Name.c_str(), "recreate");
+  ADAQFile = new TFile(Name.c_str(), "recreate", "", FileCompression);
   ADAQFileOpen = true;
   
   PopulateMetadata();
@@ -54,6 +125,13 @@ void ADAQReadoutManager::CreateFile(std::string Name)
   CreateWaveformTree();
   
   CreateReadoutInformation();
+
+  RunBranches.clear();
+  AsyncChannels.clear();
+  AsyncStats = ADAQAsyncWriterStats();
+
+  if(GetRolloverMode())
+    OpenNextChunk();
 }
 
 
@@ -66,17 +144,122 @@ void ADAQReadoutManager::WriteFile()
   if(!ADAQFileOpen)
     return;
 
-  // Write necessary data to disk
+  if(ParallelMode){
+    WriteParallelFile();
+    return;
+  }
+
+  // In the asynchronous mode, fill the queued events and return the
+  // file and trees to this thread
+  StopWriter();
+
+  const Long64_t Entries = WaveformTree->GetEntries();
+
+  WriteChunk();
+  ADAQFileOpen = false;
+
+  // Index the last chunk and discard the chunk opened ahead
+  if(GetRolloverMode()){
+    ADAQRunChunk Chunk = {GetChunkFileName(ChunkNumber), ChunkFirstEntry, Entries,
+			  ChunkStartTime, (Long64_t)time(NULL)};
+    ADAQRunIndex::AppendChunk(GetRunIndexFileName(), Chunk);
+    
+    TFile *Next = TakeNextChunk();
+    if(Next){
+      Next->Close();
+      delete Next;
+      remove(GetChunkFileName(ChunkNumber + 1).c_str());
+    }
+  }
+
+  AsyncChannels.clear();
+}
+
+
+void ADAQReadoutManager::WriteChunk()
+{
+  // Write necessary data to disk, replacing those of checkpoints
+  ADAQFile->cd();
+  WriteMetadata(TObject::kOverwrite);
+  WaveformTree->Write("", TObject::kOverwrite);
+  for(size_t i=0; i<PrescaledWaveformTrees.size(); i++)
+    PrescaledWaveformTrees[i]->Write("", TObject::kOverwrite);
+  ReadoutInformation->Write("ReadoutInformation", TObject::kOverwrite);
+
+  // Close the TFile
+  ADAQFile->Close();
+
+  // The prescaled trees were freed with the TFile
+  PrescaleChannel.clear();
+  PrescaleFactor.clear();
+  PrescaleCounter.clear();
+  PrescaledWaveformTrees.clear();
+
+  for(Int_t ch=0; ch<MaxChannels; ch++)
+    WaveformBranches[ch].clear();
+}
+
+
+void ADAQReadoutManager::WriteParallelFile()
+{
+  // Queue the remaining entries of all streams, then write the
+  // metadata and readout information through one more memory file.
+  // These objects are not mergeable and exist only in this file, such
+  // that they are written once. Deleting the TBufferMerger merges the
+  // queued buffers and closes the ADAQ file.
+
+#ifdef __ADAQ_PARALLEL_MODE__
+  for(size_t i=0; i<WriterStreams.size(); i++){
+    WriterStreams[i]->Close();
+    delete WriterStreams[i];
+  }
+  WriterStreams.clear();
+
+  shared_ptr<ROOT::TBufferMergerFile> File = Merger->GetFile();
+  File->cd();
   WriteMetadata();
-  WaveformTree->Write();
   ReadoutInformation->Write("ReadoutInformation");
+  File->Write();
+  File.reset();
 
-  // Close the TFile and set boolean accordingly
-  ADAQFile->Close();
+  delete Merger;
+  Merger = NULL;
+#endif
   ADAQFileOpen = false;
 }
 
 
+ADAQWriterStream *ADAQReadoutManager::CreateWriterStream()
+{
+  if(!ADAQFileOpen or !ParallelMode)
+    return NULL;
+
+  if(ReadoutInformation->GetDataReductionMode() and ReadoutInformation->GetStoreRawWaveforms()){
+    vector<Int_t> Prescale = ReadoutInformation->GetRawWaveformPrescale();
+    for(size_t ch=0; ch<Prescale.size(); ch++)
+      if(Prescale[ch] > 0)
+	return NULL;
+  }
+
+#ifdef __ADAQ_PARALLEL_MODE__
+  ADAQWriterStream *Stream = new ADAQWriterStream(Merger, ReadoutInformation, BranchSettings);
+  WriterStreams.push_back(Stream);
+  return Stream;
+#else
+  return NULL;
+#endif
+}
+
+
+void ADAQReadoutManager::SetImplicitMT(UInt_t NumThreads)
+{
+  if(NumThreads > 0)
+    ROOT::EnableImplicitMT(NumThreads);
+  else
+    ROOT::DisableImplicitMT();
+}
+
+
 void ADAQReadoutManager::CreateWaveformTree()
 {
   // The method creates a TTree that will be used to hold the
@@ -92,6 +275,17 @@ void ADAQReadoutManager::CreateWaveformTree()
   WaveformTree = new TTree("WaveformTree", 
 			   "TTree to hold digitized waveform data in ADAQ files");
 
+  PrescaleChannel.clear();
+  PrescaleFactor.clear();
+  PrescaleCounter.clear();
+  PrescaledWaveformTrees.clear();
+  PrescaleEntry = 0;
+
+  CheckpointEntry = 0;
+  CheckpointTime = time(NULL);
+
+  for(Int_t ch=0; ch<MaxChannels; ch++)
+    WaveformBranches[ch].clear();
 }  
 
 
@@ -111,25 +305,758 @@ void ADAQReadoutManager::CreateWaveformTreeBranches(Int_t Channel,
   //    analyzed waveform data for the specified channel's
   //    waveform. The branch is automatically named "WaveformDataChX",
   //    where X is the channel number.
+  //
+  // If the data reduction mode is enabled in the readout information
+  // then only the analyzed waveform data branch is created in the
+  // WaveformTree. If raw waveforms are to be stored and the channel's
+  // prescale factor N is nonzero, then 1-in-N raw waveforms are
+  // stored for QA in a separate tree "PrescaledWaveformTreeChX" with
+  // the branches "WaveformChX", "WaveformDataChX", and "Entry" (the
+  // corresponding WaveformTree entry). The prescale factors are
+  // written to the file with the readout information such that the
+  // analysis may renormalize. The readout information must therefore
+  // be set before the branches are created.
+  //
+  // The layout of the WaveformChX branches is set with
+  // SetWaveformBranchLayout(); see CreateWaveformBranch().
+  //
+  // In the asynchronous mode the caller's objects are only read by
+  // FillWaveformTree(), which copies them into the queue; the
+  // branches hold the writer thread's objects instead.
 
-  if(!ADAQFileOpen)
+  if(!ADAQFileOpen or ParallelMode or Channel < 0 or Channel >= MaxChannels)
     return;
 
-  // First create a branch to hold the digitized waveform 
+  if(AsyncMode){
+    SourceWaveform[Channel] = Waveform;
+    SourceData[Channel] = WaveformData;
+    SourceSamples[Channel] = NULL;
+    SourceLength[Channel] = 0;
+    AsyncChannels.push_back(Channel);
+
+    Waveform = &WriterWaveform[Channel];
+    WaveformData = &WriterData[Channel];
+  }
+
+  ChannelBranches Branches = {Channel, Waveform, WaveformData};
+  RunBranches.push_back(Branches);
+
+  CreateChannelBranches(Channel, Waveform, WaveformData);
+}
+
+
+void ADAQReadoutManager::CreateChannelBranches(Int_t Channel,
+					       vector<uint16_t> *Waveform,
+					       ADAQWaveformData *WaveformData)
+{
   std::stringstream SS;
   SS << "WaveformCh" << Channel;
   TString WaveformBranchName = SS.str();
-  WaveformTree->Branch(WaveformBranchName, Waveform);
-  
-  // Then create a branch to hold the analyzed waveform data
+
   SS.str("");
   SS << "WaveformDataCh" << Channel;
   TString WaveformDataBranchName = SS.str();
+
+  const ADAQBranchSettings &DataSettings = BranchSettings[zWaveformDataBranchType];
+
+  if(ReadoutInformation->GetDataReductionMode()){
+
+    // Only the analyzed waveform data is stored in the WaveformTree
+    WaveformTree->Branch(WaveformDataBranchName, 
+			 "ADAQWaveformData",
+			 WaveformData,
+			 DataSettings.BasketSize,
+			 DataSettings.SplitLevel);
+    DataSettings.Apply(WaveformTree->GetBranch(WaveformDataBranchName));
+    
+    vector<Int_t> Prescale = ReadoutInformation->GetRawWaveformPrescale();
+    if(!ReadoutInformation->GetStoreRawWaveforms() or
+       Channel >= (Int_t)Prescale.size() or
+       Prescale[Channel] <= 0)
+      return;
+
+    SS.str("");
+    SS << "PrescaledWaveformTreeCh" << Channel;
+    TString TreeName = SS.str();
+
+    SS.str("");
+    SS << "TTree to hold 1-in-" << Prescale[Channel]
+       << " digitized waveforms of channel " << Channel << " in ADAQ files";
+    TString TreeTitle = SS.str();
+
+    TTree *PrescaledTree = new TTree(TreeName, TreeTitle);
+    CreateWaveformBranch(PrescaledTree, Channel, Waveform);
+    PrescaledTree->Branch(WaveformDataBranchName,
+			  "ADAQWaveformData",
+			  WaveformData,
+			  DataSettings.BasketSize,
+			  DataSettings.SplitLevel);
+    DataSettings.Apply(PrescaledTree->GetBranch(WaveformDataBranchName));
+    PrescaledTree->Branch("Entry", &PrescaleEntry, "Entry/L");
+    
+    PrescaleChannel.push_back(Channel);
+    PrescaleFactor.push_back(Prescale[Channel]);
+    PrescaleCounter.push_back(0);
+    PrescaledWaveformTrees.push_back(PrescaledTree);
+    
+    return;
+  }
+
+  // First create a branch to hold the digitized waveform 
+  CreateWaveformBranch(WaveformTree, Channel, Waveform);
+  
+  // Then create a branch to hold the analyzed waveform data
   WaveformTree->Branch(WaveformDataBranchName, 
 		       "ADAQWaveformData",
 		       WaveformData,
-		       128000, // Buffer size [bytes]
-		       0);     // Maximum TTree splitting
+		       DataSettings.BasketSize,
+		       DataSettings.SplitLevel);
+  DataSettings.Apply(WaveformTree->GetBranch(WaveformDataBranchName));
+}
+
+
+void ADAQReadoutManager::CreateWaveformBranch(TTree *Tree,
+					      Int_t Channel,
+					      vector<uint16_t> *Waveform)
+{
+  // The vector layout streams a vector<uint16_t> object per entry,
+  // i.e. the STL collection streamer runs and a size word is written
+  // for every event. The array layouts write plain uint16_t leaf
+  // arrays that are filled straight from the caller's memory (see
+  // SetWaveform()): the fixed array has a length of RecordLength
+  // samples for the whole run, while the variable array is sized by
+  // the counter leaf "WaveformLengthChX". The packed layout stores
+  // the bit-packed, delta-encoded stream of ADAQWaveformCodec (at the
+  // DGBitDepth of the readout information) in a byte array sized by
+  // "WaveformLengthChX", which ROOT then compresses further; the
+  // samples are encoded when they are set. ADAQWaveformReader
+  // detects the layout of a file automatically.
+
+  std::stringstream SS;
+  SS << "WaveformCh" << Channel;
+  TString BranchName = SS.str();
+
+  const ADAQBranchSettings &Settings = BranchSettings[zWaveformBranchType];
+
+  if(WaveformBranchLayout == zWaveformVector){
+    Settings.Apply(Tree->Branch(BranchName, Waveform, Settings.BasketSize, Settings.SplitLevel));
+    return;
+  }
+
+  if(WaveformBranchLayout == zWaveformFixedArray){
+    Int_t RecordLength = ReadoutInformation->GetRecordLength();
+    if(RecordLength < 1)
+      RecordLength = 1;
+    WaveformStorage[Channel].assign(RecordLength, 0);
+
+    SS << "[" << RecordLength << "]/s";
+    TString LeafList = SS.str();
+    
+    WaveformBranches[Channel].push_back(Tree->Branch(BranchName,
+						     WaveformStorage[Channel].data(),
+						     LeafList,
+						     Settings.BasketSize));
+  }
+  else{
+    SS.str("");
+    SS << "WaveformLengthCh" << Channel;
+    TString LengthName = SS.str();
+
+    SS << "/i";
+    TString LengthLeafList = SS.str();
+    
+    Settings.Apply(Tree->Branch(LengthName, &WaveformLength[Channel], LengthLeafList,
+				Settings.BasketSize));
+
+    SS.str("");
+    SS << BranchName << "[" << LengthName << "]"
+       << ((WaveformBranchLayout == zWaveformPacked) ? "/b" : "/s");
+    TString LeafList = SS.str();
+
+    WaveformLength[Channel] = 0;
+    WaveformStorage[Channel].assign(1, 0);
+    PackedStorage[Channel].assign(1, 0);
+    
+    void *Address = WaveformStorage[Channel].data();
+    if(WaveformBranchLayout == zWaveformPacked)
+      Address = PackedStorage[Channel].data();
+    
+    WaveformBranches[Channel].push_back(Tree->Branch(BranchName,
+						     Address,
+						     LeafList,
+						     Settings.BasketSize));
+  }
+  Settings.Apply(WaveformBranches[Channel].back());
+}
+
+
+Int_t ADAQReadoutManager::SetWaveform(Int_t Channel, const uint16_t *Samples, UInt_t Length)
+{
+  if(Channel < 0 or Channel >= MaxChannels or WaveformBranchLayout == zWaveformVector)
+    return -42;
+
+  if(WaveformBranchLayout == zWaveformFixedArray and
+     Length != WaveformStorage[Channel].size())
+    return -42;
+
+  // The samples are copied by the next FillWaveformTree()
+  if(AsyncMode){
+    SourceSamples[Channel] = Samples;
+    SourceLength[Channel] = Length;
+    return 0;
+  }
+
+  SetWaveformAddress(Channel, Samples, Length);
+
+  return 0;
+}
+
+
+void ADAQReadoutManager::SetWaveformAddress(Int_t Channel, const uint16_t *Samples, UInt_t Length)
+{
+  WaveformLength[Channel] = Length;
+
+  // ROOT only reads from the address when the tree is filled
+  void *Address = const_cast<uint16_t *>(Samples);
+
+  if(WaveformBranchLayout == zWaveformPacked){
+    WaveformLength[Channel] = ADAQWaveformCodec::Encode(Samples, Length,
+							ReadoutInformation->GetDGBitDepth(),
+							PackedStorage[Channel]);
+    Address = PackedStorage[Channel].data();
+  }
+  for(size_t b=0; b<WaveformBranches[Channel].size(); b++)
+    WaveformBranches[Channel][b]->SetAddress(Address);
+}
+
+
+void ADAQReadoutManager::FillWaveformTree()
+{
+  if(ParallelMode)
+    return;
+  
+  if(AsyncMode)
+    QueueEvent();
+  else
+    FillTrees();
+}
+
+
+void ADAQReadoutManager::FillTrees()
+{
+  // The chunk is rolled over before the event is filled, such that an
+  // entry and its prescaled waveforms are always in the same chunk
+  if(GetRolloverMode() and RolloverDue())
+    Rollover();
+
+  WaveformTree->Fill();
+
+  for(size_t i=0; i<PrescaleChannel.size(); i++)
+    StorePrescaledWaveform(PrescaleChannel[i]);
+
+  if(GetCheckpointMode() and CheckpointDue())
+    Checkpoint();
+}
+
+
+Bool_t ADAQReadoutManager::StorePrescaledWaveform(Int_t Channel)
+{
+  for(size_t i=0; i<PrescaleChannel.size(); i++){
+    if(PrescaleChannel[i] != Channel)
+      continue;
+
+    // The stored waveform refers to the last filled WaveformTree entry
+    PrescaleEntry = WaveformTree->GetEntries() - 1;
+    
+    // Store the first and then every Nth waveform of the channel
+    Bool_t Store = (PrescaleCounter[i] % PrescaleFactor[i] == 0);
+    PrescaleCounter[i]++;
+    
+    if(Store)
+      PrescaledWaveformTrees[i]->Fill();
+
+    return Store;
+  }
+  return false;
+}
+
+
+void ADAQReadoutManager::QueueEvent()
+{
+  // Runs on the acquisition thread: wait for (or drop the event if
+  // there is no) space in the queue, copy the event from the sources
+  // into a recycled event, and hand it to the writer thread. There is
+  // a single producer, such that the space found remains available
+  // while the event is copied outside of the lock.
+
+  if(!ADAQFileOpen)
+    return;
+
+  if(!WriterThread)
+    StartWriter();
+
+  AsyncEvent *Event = NULL;
+  {
+    std::unique_lock<std::mutex> Lock(QueueMutex);
+
+    if(Queue.size() >= AsyncQueueSize){
+      if(AsyncFullPolicy == zAsyncDrop){
+	AsyncStats.Dropped++;
+	return;
+      }
+      
+      std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+      QueueNotFull.wait(Lock, [this]{return Queue.size() < AsyncQueueSize;});
+      std::chrono::duration<double> Blocked = std::chrono::steady_clock::now() - Start;
+      AsyncStats.BlockedTime += Blocked.count();
+    }
+
+    if(!FreeEvents.empty()){
+      Event = FreeEvents.back();
+      FreeEvents.pop_back();
+    }
+  }
+
+  if(!Event){
+    Event = new AsyncEvent;
+    Event->Samples.resize(MaxChannels);
+    Event->Data.resize(MaxChannels);
+  }
+
+  for(size_t i=0; i<AsyncChannels.size(); i++){
+    Int_t ch = AsyncChannels[i];
+
+    if(WaveformBranchLayout == zWaveformVector){
+      if(SourceWaveform[ch])
+	Event->Samples[ch].assign(SourceWaveform[ch]->begin(), SourceWaveform[ch]->end());
+    }
+    else if(SourceSamples[ch])
+      Event->Samples[ch].assign(SourceSamples[ch], SourceSamples[ch] + SourceLength[ch]);
+    else
+      Event->Samples[ch].clear();
+
+    if(SourceData[ch])
+      Event->Data[ch] = *SourceData[ch];
+  }
+
+  {
+    std::lock_guard<std::mutex> Lock(QueueMutex);
+    Queue.push_back(Event);
+    AsyncStats.Queued++;
+    if(Queue.size() > AsyncStats.MaxQueueDepth)
+      AsyncStats.MaxQueueDepth = Queue.size();
+  }
+  QueueNotEmpty.notify_one();
+}
+
+
+void ADAQReadoutManager::StartWriter()
+{
+  // ROOT must protect its global state (e.g. the type system and
+  // gDirectory) now that a second thread uses it
+  ROOT::EnableThreadSafety();
+
+  WriterStop = false;
+  WriterThread = new std::thread(&ADAQReadoutManager::RunWriter, this);
+}
+
+
+void ADAQReadoutManager::StopWriter()
+{
+  if(!WriterThread)
+    return;
+
+  {
+    std::lock_guard<std::mutex> Lock(QueueMutex);
+    WriterStop = true;
+  }
+  QueueNotEmpty.notify_one();
+
+  WriterThread->join();
+  delete WriterThread;
+  WriterThread = NULL;
+}
+
+
+void ADAQReadoutManager::RunWriter()
+{
+  // Runs on the writer thread until StopWriter(), after the queue
+  // has been emptied. The vector layout swaps the event's samples
+  // into the branch vectors; the array layouts point the branches to
+  // them. The event is recycled only after the trees are filled.
+
+  while(true){
+    AsyncEvent *Event = NULL;
+    {
+      std::unique_lock<std::mutex> Lock(QueueMutex);
+      QueueNotEmpty.wait(Lock, [this]{return WriterStop or !Queue.empty();});
+
+      if(Queue.empty())
+	break;
+      
+      Event = Queue.front();
+      Queue.pop_front();
+    }
+    QueueNotFull.notify_one();
+
+    for(size_t i=0; i<AsyncChannels.size(); i++){
+      Int_t ch = AsyncChannels[i];
+
+      if(WaveformBranchLayout == zWaveformVector)
+	WriterWaveform[ch].swap(Event->Samples[ch]);
+      else if(!Event->Samples[ch].empty())
+	SetWaveformAddress(ch, Event->Samples[ch].data(), Event->Samples[ch].size());
+      else
+	SetWaveformAddress(ch, WaveformStorage[ch].data(), 0);
+
+      WriterData[ch] = Event->Data[ch];
+    }
+
+    FillTrees();
+
+    {
+      std::lock_guard<std::mutex> Lock(QueueMutex);
+      FreeEvents.push_back(Event);
+      AsyncStats.Written++;
+    }
+  }
+}
+
+
+void ADAQReadoutManager::SetRolloverLimits(Long64_t Bytes, Long64_t Entries, Double_t Seconds)
+{
+  RolloverBytes = (Bytes > 0) ? Bytes : 0;
+  RolloverEntries = (Entries > 0) ? Entries : 0;
+  RolloverSeconds = (Seconds > 0.) ? Seconds : 0.;
+}
+
+
+Bool_t ADAQReadoutManager::GetRolloverMode()
+{
+  return (RolloverBytes > 0 or RolloverEntries > 0 or RolloverSeconds > 0.);
+}
+
+
+void ADAQReadoutManager::SplitFileName(std::string &Stem, std::string &Suffix)
+{
+  // "Run.adaq.root" -> "Run" and ".adaq.root"; likewise for ".root"
+  Stem = ADAQFileName.Data();
+  Suffix = "";
+
+  const char *Suffixes[2] = {".adaq.root", ".root"};
+  for(int i=0; i<2; i++){
+    const std::string S = Suffixes[i];
+    if(Stem.size() > S.size() and Stem.compare(Stem.size() - S.size(), S.size(), S) == 0){
+      Suffix = S;
+      Stem.erase(Stem.size() - S.size());
+      return;
+    }
+  }
+}
+
+
+std::string ADAQReadoutManager::GetChunkFileName(Int_t Chunk)
+{
+  std::string Stem, Suffix;
+  SplitFileName(Stem, Suffix);
+
+  char Number[16];
+  snprintf(Number, sizeof Number, "_%04d", Chunk);
+
+  return Stem + Number + Suffix;
+}
+
+
+std::string ADAQReadoutManager::GetRunIndexFileName()
+{
+  std::string Stem, Suffix;
+  SplitFileName(Stem, Suffix);
+
+  return Stem + ".adaq.index";
+}
+
+
+Bool_t ADAQReadoutManager::RolloverDue()
+{
+  const Long64_t Entries = WaveformTree->GetEntries();
+  if(Entries == 0)
+    return false;
+
+  if(RolloverEntries > 0 and Entries >= RolloverEntries)
+    return true;
+
+  // The baskets still in memory are not counted
+  if(RolloverBytes > 0 and ADAQFile->GetEND() >= RolloverBytes)
+    return true;
+
+  if(RolloverSeconds > 0. and difftime(time(NULL), ChunkStartTime) >= RolloverSeconds)
+    return true;
+
+  return false;
+}
+
+
+void ADAQReadoutManager::Rollover()
+{
+  // The waveforms of the event about to be filled have already been
+  // set: the array branch addresses, the sample counters, and the
+  // packed streams are carried over to the branches of the new chunk
+
+  vector<char *> Addresses(MaxChannels, (char *)NULL);
+  for(Int_t ch=0; ch<MaxChannels; ch++)
+    if(!WaveformBranches[ch].empty())
+      Addresses[ch] = WaveformBranches[ch][0]->GetAddress();
+
+  vector<UInt_t> Lengths = WaveformLength;
+  vector<vector<uint8_t> > Packed(MaxChannels);
+  Packed.swap(PackedStorage);
+
+  // Close and index the chunk
+
+  const Long64_t Entries = WaveformTree->GetEntries();
+  WriteChunk();
+
+  ADAQRunChunk Chunk = {GetChunkFileName(ChunkNumber), ChunkFirstEntry, Entries,
+			ChunkStartTime, (Long64_t)time(NULL)};
+  ADAQRunIndex::AppendChunk(GetRunIndexFileName(), Chunk);
+
+  // Continue in the chunk opened ahead
+
+  delete ADAQFile;
+  ADAQFile = TakeNextChunk();
+  if(!ADAQFile)
+    ADAQFile = new TFile(GetChunkFileName(ChunkNumber + 1).c_str(), "recreate", "", FileCompression);
+
+  ChunkNumber++;
+  ChunkFirstEntry += Entries;
+  ChunkStartTime = time(NULL);
+
+  ADAQFile->cd();
+  CreateWaveformTree();
+  for(size_t i=0; i<RunBranches.size(); i++)
+    CreateChannelBranches(RunBranches[i].Channel, RunBranches[i].Waveform, RunBranches[i].Data);
+
+  PackedStorage.swap(Packed);
+  std::copy(Lengths.begin(), Lengths.end(), WaveformLength.begin());
+  for(Int_t ch=0; ch<MaxChannels; ch++)
+    if(Addresses[ch])
+      for(size_t b=0; b<WaveformBranches[ch].size(); b++)
+	WaveformBranches[ch][b]->SetAddress(Addresses[ch]);
+
+  OpenNextChunk();
+}
+
+
+void ADAQReadoutManager::OpenNextChunk()
+{
+  // Creating the TFile (and its first disk write) on a helper thread
+  // keeps it out of the fill that rolls the chunk over
+  const std::string Name = GetChunkFileName(ChunkNumber + 1);
+  const Int_t Compression = FileCompression;
+
+  // ROOT must protect its global state (e.g. the list of files and
+  // gDirectory) before the helper thread creates the TFile
+  ROOT::EnableThreadSafety();
+
+  NextChunkThread = new std::thread([this, Name, Compression]{
+      NextChunk = new TFile(Name.c_str(), "recreate", "", Compression);
+    });
+}
+
+
+TFile *ADAQReadoutManager::TakeNextChunk()
+{
+  if(!NextChunkThread)
+    return NULL;
+
+  NextChunkThread->join();
+  delete NextChunkThread;
+  NextChunkThread = NULL;
+
+  TFile *File = NextChunk;
+  NextChunk = NULL;
+  return File;
+}
+
+
+void ADAQReadoutManager::SetCheckpointInterval(Long64_t Entries, Double_t Seconds)
+{
+  CheckpointEntries = (Entries > 0) ? Entries : 0;
+  CheckpointSeconds = (Seconds > 0.) ? Seconds : 0.;
+}
+
+
+Bool_t ADAQReadoutManager::GetCheckpointMode()
+{
+  return (CheckpointEntries > 0 or CheckpointSeconds > 0.);
+}
+
+
+Bool_t ADAQReadoutManager::CheckpointDue()
+{
+  if(CheckpointEntries > 0 and WaveformTree->GetEntries() - CheckpointEntry >= CheckpointEntries)
+    return true;
+
+  if(CheckpointSeconds > 0. and difftime(time(NULL), CheckpointTime) >= CheckpointSeconds)
+    return true;
+
+  return false;
+}
+
+
+void ADAQReadoutManager::Checkpoint()
+{
+  // The run-level objects are written first; AutoSave() then flushes
+  // the baskets, writes the tree header in place of the previous one,
+  // and (with "SaveSelf") the directory, such that ROOT's recovery of
+  // an unclosed file finds all objects up to here. The prescaled
+  // trees are saved before the WaveformTree that their entries refer
+  // to. The file is then synced to disk.
+
+  ADAQFile->cd();
+  WriteMetadata(TObject::kOverwrite);
+  ReadoutInformation->Write("ReadoutInformation", TObject::kOverwrite);
+
+  for(size_t i=0; i<PrescaledWaveformTrees.size(); i++)
+    PrescaledWaveformTrees[i]->AutoSave();
+  WaveformTree->AutoSave("SaveSelf");
+
+  ADAQFile->Flush();
+
+  CheckpointEntry = WaveformTree->GetEntries();
+  CheckpointTime = time(NULL);
+}
+
+
+ADAQAsyncWriterStats ADAQReadoutManager::GetAsyncWriterStats()
+{
+  std::lock_guard<std::mutex> Lock(QueueMutex);
+  ADAQAsyncWriterStats Stats = AsyncStats;
+  Stats.QueueSize = AsyncQueueSize;
+  Stats.QueueDepth = Queue.size();
+  return Stats;
+}
+
+
+Int_t ADAQReadoutManager::RecompressFile(std::string InName, std::string OutName)
+{
+  return (CopyFile(InName, OutName, true) < 0) ? -42 : 0;
+}
+
+
+Long64_t ADAQReadoutManager::RecoverFile(std::string InName, std::string OutName)
+{
+  // ROOT recovers the keys of an unclosed file when it is opened;
+  // each tree is found with the header of its last AutoSave()
+  return CopyFile(InName, OutName, false);
+}
+
+
+Long64_t ADAQReadoutManager::CopyFile(std::string InName, std::string OutName, Bool_t Recompress)
+{
+  // When recompressing, trees are cloned without entries, given the
+  // branch settings, and refilled, such that every basket is
+  // decompressed and compressed again; otherwise the baskets are
+  // copied as they are into a file of the input's compression. All
+  // other objects are copied as they are. Only the last cycle of
+  // each key is copied; keys whose object cannot be read are skipped
+  // and counted as lost.
+
+  LostKeys = 0;
+
+  TFile *In = new TFile(InName.c_str(), "read");
+  if(In->IsZombie()){
+    delete In;
+    return -42;
+  }
+
+  const Int_t Compression = Recompress ? FileCompression : In->GetCompressionSettings();
+  TFile *Out = new TFile(OutName.c_str(), "recreate", "", Compression);
+
+  Long64_t Entries = 0;
+  vector<TString> Copied;
+  TIter Next(In->GetListOfKeys());
+  TKey *Key;
+
+  while((Key = (TKey *)Next())){
+    TString Name = Key->GetName();
+    if(find(Copied.begin(), Copied.end(), Name) != Copied.end())
+      continue;
+    Copied.push_back(Name);
+
+    TObject *Object = In->Get(Name);
+    if(!Object){
+      LostKeys++;
+      continue;
+    }
+    Out->cd();
+
+    if(Object->InheritsFrom(TTree::Class())){
+      TTree *InTree = (TTree *)Object;
+      TTree *OutTree = NULL;
+      if(Recompress){
+	OutTree = InTree->CloneTree(0);
+	ApplyBranchSettings(OutTree);
+	OutTree->CopyEntries(InTree);
+      }
+      else
+	OutTree = InTree->CloneTree(-1, "fast");
+      OutTree->Write();
+      
+      if(Name == "WaveformTree")
+	Entries = OutTree->GetEntries();
+    }
+    else
+      Object->Write(Name);
+  }
+
+  Out->Close();
+  delete Out;
+
+  In->Close();
+  delete In;
+
+  return Entries;
+}
+
+
+void ADAQReadoutManager::ApplyBranchSettings(TTree *Tree)
+{
+  // The branch type follows from the name: WaveformDataChX are the
+  // waveform data, WaveformChX and WaveformLengthChX the waveforms.
+  // Cloned branches keep the compression of the input file, such
+  // that the branches inheriting the file compression are given it
+  // explicitly; all other branches are set to the file compression.
+
+  vector<ADAQBranchSettings> Settings = BranchSettings;
+  for(size_t t=0; t<Settings.size(); t++){
+    if(Settings[t].Algorithm == zCompressionInherit){
+      Settings[t].Algorithm = FileCompression / 100;
+      Settings[t].Level = FileCompression % 100;
+    }
+  }
+
+  TObjArray *Branches = Tree->GetListOfBranches();
+  for(Int_t b=0; b<Branches->GetEntriesFast(); b++){
+    TBranch *Branch = (TBranch *)Branches->At(b);
+    TString Name = Branch->GetName();
+
+    if(Name.BeginsWith("WaveformDataCh"))
+      Settings[zWaveformDataBranchType].Apply(Branch, true);
+    else if(Name.BeginsWith("WaveformCh") or Name.BeginsWith("WaveformLengthCh"))
+      Settings[zWaveformBranchType].Apply(Branch, true);
+    else
+      ADAQBranchSettings(FileCompression / 100, FileCompression % 100).Apply(Branch);
+  }
+}
+
+
+TTree *ADAQReadoutManager::GetPrescaledWaveformTree(Int_t Channel)
+{
+  for(size_t i=0; i<PrescaleChannel.size(); i++)
+    if(PrescaleChannel[i] == Channel)
+      return PrescaledWaveformTrees[i];
+  return NULL;
 }
 
 
@@ -139,6 +1066,14 @@ void ADAQReadoutManager::SetWaveformBranchStatus(Int_t Channel, Bool_t Status)
   SS << "WaveformCh" << Channel;
   TString BranchName = SS.str();
   WaveformTree->SetBranchStatus(BranchName, Status);
+
+  if(WaveformBranchLayout == zWaveformVariableArray or
+     WaveformBranchLayout == zWaveformPacked){
+    SS.str("");
+    SS << "WaveformLengthCh" << Channel;
+    TString LengthName = SS.str();
+    WaveformTree->SetBranchStatus(LengthName, Status);
+  }
 }
 
 
@@ -0,0 +1,111 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRunIndex.cc
+// date: 16 Oct 26
+//
+// desc: ADAQRunIndex reads and writes the index of chunked ADAQ runs.
+//       See the header file for a full description and the format.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <fstream>
+#include <sstream>
+
+// ADAQ
+#include "ADAQRunIndex.hh"
+
+
+Int_t ADAQRunIndex::Load(std::string Name)
+{
+  std::ifstream In(Name.c_str());
+  if(!In.good())
+    return -42;
+
+  size_t Slash = Name.rfind('/');
+  Directory = (Slash == std::string::npos) ? "" : Name.substr(0, Slash + 1);
+
+  Chunks.clear();
+
+  std::string Line;
+  while(std::getline(In, Line)){
+    if(Line.empty() or Line[0] == '#')
+      continue;
+
+    std::istringstream SS(Line);
+    ADAQRunChunk Chunk;
+    if(SS >> Chunk.FileName >> Chunk.FirstEntry >> Chunk.NumEntries
+       >> Chunk.StartTime >> Chunk.StopTime)
+      Chunks.push_back(Chunk);
+  }
+  return 0;
+}
+
+
+std::string ADAQRunIndex::GetChunkPath(Int_t i)
+{
+  return Directory + Chunks[i].FileName;
+}
+
+
+Int_t ADAQRunIndex::FindChunkByEntry(Long64_t Entry)
+{
+  for(size_t i=0; i<Chunks.size(); i++)
+    if(Entry >= Chunks[i].FirstEntry and Entry < Chunks[i].FirstEntry + Chunks[i].NumEntries)
+      return i;
+  return -42;
+}
+
+
+Int_t ADAQRunIndex::FindChunkByTime(Long64_t Time)
+{
+  for(size_t i=0; i<Chunks.size(); i++)
+    if(Time >= Chunks[i].StartTime and Time <= Chunks[i].StopTime)
+      return i;
+  return -42;
+}
+
+
+TChain *ADAQRunIndex::CreateChain(TString Name)
+{
+  TChain *Chain = new TChain(Name);
+  for(size_t i=0; i<Chunks.size(); i++)
+    Chain->Add(GetChunkPath(i).c_str());
+  return Chain;
+}
+
+
+Int_t ADAQRunIndex::AppendChunk(std::string Name, const ADAQRunChunk &Chunk)
+{
+  std::ifstream Test(Name.c_str());
+  const bool Exists = Test.good();
+  Test.close();
+
+  std::ofstream Out(Name.c_str(), std::ios::app);
+  if(!Out.good())
+    return -42;
+
+  if(!Exists)
+    Out << "# ADAQ run index: <file> <first entry> <entries> <start> <stop>\n";
+
+  // Only the file name is stored; the chunks live next to the index
+  size_t Slash = Chunk.FileName.rfind('/');
+  Out << ((Slash == std::string::npos) ? Chunk.FileName : Chunk.FileName.substr(Slash + 1))
+      << " " << Chunk.FirstEntry << " " << Chunk.NumEntries
+      << " " << Chunk.StartTime << " " << Chunk.StopTime << std::endl;
+
+  return Out.good() ? 0 : -42;
+}
@@ -0,0 +1,222 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQWaveformCodec.cc
+// date: 16 Oct 26
+//
+// desc: ADAQWaveformCodec packs waveforms into delta-encoded bit
+//       streams and unpacks them. See the header file for a full
+//       description and the stream format.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <cstring>
+
+// ADAQ
+#include "ADAQWaveformCodec.hh"
+
+
+namespace{
+
+  // Bits are collected in a 64-bit accumulator and written out in
+  // whole bytes; at most 31 bits are added at a time, such that the
+  // accumulator never overflows
+
+  class BitWriter
+  {
+  public:
+    BitWriter(uint8_t *O) : Out(O), Accumulator(0), Bits(0) {;}
+
+    inline void Put(uint32_t Value, uint32_t Width)
+    {
+      Accumulator |= (uint64_t)Value << Bits;
+      Bits += Width;
+      while(Bits >= 8){
+	*Out++ = (uint8_t)Accumulator;
+	Accumulator >>= 8;
+	Bits -= 8;
+      }
+    }
+
+    // Write the last partial byte; returns the end of the stream
+    uint8_t *Finish()
+    {
+      if(Bits > 0)
+	*Out++ = (uint8_t)Accumulator;
+      return Out;
+    }
+
+  private:
+    uint8_t *Out;
+    uint64_t Accumulator;
+    uint32_t Bits;
+  };
+
+
+  class BitReader
+  {
+  public:
+    BitReader(const uint8_t *I, const uint8_t *E) : In(I), End(E), Accumulator(0), Bits(0) {;}
+
+    // Returns false if the stream ends before "Width" bits
+    inline bool Get(uint32_t Width, uint32_t &Value)
+    {
+      while(Bits < Width){
+	if(In == End)
+	  return false;
+	Accumulator |= (uint64_t)(*In++) << Bits;
+	Bits += 8;
+      }
+      Value = (uint32_t)Accumulator & ((1u << Width) - 1);
+      Accumulator >>= Width;
+      Bits -= Width;
+      return true;
+    }
+
+  private:
+    const uint8_t *In, *End;
+    uint64_t Accumulator;
+    uint32_t Bits;
+  };
+
+
+  inline uint32_t ZigZag(int32_t D) {return ((uint32_t)D << 1) ^ (uint32_t)(D >> 31);}
+  inline int32_t UnZigZag(uint32_t Z) {return (int32_t)(Z >> 1) ^ -(int32_t)(Z & 1);}
+
+  inline uint32_t BitWidth(uint32_t V)
+  {
+    return (V == 0) ? 0 : 32 - __builtin_clz(V);
+  }
+}
+
+
+UInt_t ADAQWaveformCodec::Encode(const uint16_t *In, UInt_t N, Int_t BitDepth,
+				 vector<uint8_t> &Out)
+{
+  // Raise the bit depth to the largest sample if needed
+
+  uint32_t Or = 0;
+  for(UInt_t i=0; i<N; i++)
+    Or |= In[i];
+
+  uint32_t Depth = (BitDepth > 0 and BitDepth <= 16) ? BitDepth : 16;
+  if(BitWidth(Or) > Depth)
+    Depth = BitWidth(Or);
+  if(Depth == 0)
+    Depth = 1;
+
+  Out.resize(GetMaxEncodedSize(N));
+
+  uint8_t *Header = Out.data();
+  const uint16_t First = (N > 0) ? In[0] : 0;
+  Header[0] = (uint8_t)N;
+  Header[1] = (uint8_t)(N >> 8);
+  Header[2] = (uint8_t)(N >> 16);
+  Header[3] = (uint8_t)(N >> 24);
+  Header[4] = (uint8_t)Depth;
+  Header[5] = (uint8_t)First;
+  Header[6] = (uint8_t)(First >> 8);
+
+  BitWriter Writer(Header + HeaderSize);
+
+  uint32_t Deltas[BlockSize];
+  int32_t Previous = First;
+
+  for(UInt_t Begin=0; Begin<N; Begin+=BlockSize){
+    const UInt_t Size = (N - Begin < BlockSize) ? N - Begin : BlockSize;
+
+    // The width of the block is the width of the largest difference
+    uint32_t Max = 0;
+    for(UInt_t i=0; i<Size; i++){
+      const int32_t Sample = In[Begin + i];
+      Deltas[i] = ZigZag(Sample - Previous);
+      Max |= Deltas[i];
+      Previous = Sample;
+    }
+    const uint32_t Width = BitWidth(Max);
+
+    if(Width < Depth){
+      Writer.Put(Width, 5);
+      if(Width > 0)
+	for(UInt_t i=0; i<Size; i++)
+	  Writer.Put(Deltas[i], Width);
+    }
+    else{
+      Writer.Put(RawWidth, 5);
+      for(UInt_t i=0; i<Size; i++)
+	Writer.Put(In[Begin + i], Depth);
+    }
+  }
+
+  const UInt_t Bytes = Writer.Finish() - Out.data();
+  Out.resize(Bytes);
+  return Bytes;
+}
+
+
+UInt_t ADAQWaveformCodec::GetNumSamples(const uint8_t *In, UInt_t Bytes)
+{
+  if(Bytes < HeaderSize)
+    return 0;
+  return In[0] | (In[1] << 8) | (In[2] << 16) | ((uint32_t)In[3] << 24);
+}
+
+
+Int_t ADAQWaveformCodec::Decode(const uint8_t *In, UInt_t Bytes, uint16_t *Out,
+				UInt_t MaxSamples)
+{
+  if(Bytes < HeaderSize)
+    return -42;
+
+  const UInt_t N = GetNumSamples(In, Bytes);
+  const uint32_t Depth = In[4];
+  if(N > MaxSamples or Depth == 0 or Depth > 16)
+    return -42;
+
+  int32_t Previous = In[5] | (In[6] << 8);
+
+  BitReader Reader(In + HeaderSize, In + Bytes);
+
+  for(UInt_t Begin=0; Begin<N; Begin+=BlockSize){
+    const UInt_t Size = (N - Begin < BlockSize) ? N - Begin : BlockSize;
+
+    uint32_t Width, Value;
+    if(!Reader.Get(5, Width))
+      return -42;
+
+    if(Width == RawWidth){
+      for(UInt_t i=0; i<Size; i++){
+	if(!Reader.Get(Depth, Value))
+	  return -42;
+	Out[Begin + i] = (uint16_t)Value;
+      }
+      Previous = Out[Begin + Size - 1];
+    }
+    else if(Width == 0){
+      for(UInt_t i=0; i<Size; i++)
+	Out[Begin + i] = (uint16_t)Previous;
+    }
+    else{
+      for(UInt_t i=0; i<Size; i++){
+	if(!Reader.Get(Width, Value))
+	  return -42;
+	Previous += UnZigZag(Value);
+	Out[Begin + i] = (uint16_t)Previous;
+      }
+    }
+  }
+
+  return N;
+}
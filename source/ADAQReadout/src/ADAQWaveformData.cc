@@ -4,7 +4,8 @@
 ADAQWaveformData::ADAQWaveformData()
   : PulseHeight(0.), PulseArea(0.), Baseline(0.),
     PSDTotalIntegral(0.), PSDTailIntegral(0.),
-    TimeStamp(0), ChannelID(0), BoardID(0)
+    TimeStamp(0), ChannelID(0), BoardID(0), FineTime(-1.),
+    PileUpFlag(false), PileUpCount(0)
 {;}
 
 
@@ -17,4 +18,7 @@ void ADAQWaveformData::Initialize()
   PulseHeight = PulseArea = Baseline = 0.;
   PSDTotalIntegral = PSDTailIntegral = 0.;
   TimeStamp = ChannelID = BoardID = 0;
+  FineTime = -1.;
+  PileUpFlag = false;
+  PileUpCount = 0;
 }
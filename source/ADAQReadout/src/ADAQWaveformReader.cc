@@ -0,0 +1,213 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQWaveformReader.cc
+// date: 16 Oct 26
+//
+// desc: ADAQWaveformReader reads the waveforms of one channel from an
+//       ADAQ file for any waveform branch layout. See the header file
+//       for a full description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TLeaf.h>
+
+// C++
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+// ADAQ
+#include "ADAQWaveformReader.hh"
+#include "ADAQWaveformCodec.hh"
+
+
+ADAQWaveformReader::ADAQWaveformReader()
+  : Tree(NULL), TreeNumber(-1), Layout(zWaveformVector),
+    WaveformBranch(NULL), LengthBranch(NULL),
+    Vector(NULL), Samples(NULL), Length(0), PackedLength(0)
+{;}
+
+
+ADAQWaveformReader::~ADAQWaveformReader()
+{
+  delete Vector;
+}
+
+
+Int_t ADAQWaveformReader::Attach(TTree *T, Int_t Channel)
+{
+  std::stringstream SS;
+  SS << "WaveformCh" << Channel;
+
+  if(!T or !T->GetBranch(SS.str().c_str()))
+    return -42;
+
+  Tree = T;
+  BranchName = SS.str();
+
+  // For a TChain, GetBranch() has loaded the first tree
+  const Int_t Status = SetupBranches();
+  TreeNumber = Tree->GetTreeNumber();
+  return Status;
+}
+
+
+Int_t ADAQWaveformReader::SetupBranches()
+{
+  WaveformBranch = Tree->GetBranch(BranchName);
+  LengthBranch = NULL;
+  Samples = NULL;
+  Length = 0;
+
+  if(!WaveformBranch)
+    return -42;
+
+  // A vector branch is a TBranchElement of the vector class; an
+  // array branch has a single uint16_t leaf, which has a counter leaf
+  // if the array length is variable; a packed branch has a single
+  // uint8_t leaf with a counter leaf. The addresses are set through
+  // the tree such that a TChain keeps them for its other trees
+  
+  TString ClassName = WaveformBranch->GetClassName();
+  if(ClassName.BeginsWith("vector")){
+    Layout = zWaveformVector;
+    if(!Vector)
+      Vector = new vector<uint16_t>;
+    Tree->SetBranchAddress(BranchName, &Vector);
+    return 0;
+  }
+
+  TLeaf *Leaf = (TLeaf *)WaveformBranch->GetListOfLeaves()->At(0);
+  if(!Leaf)
+    return -42;
+
+  TLeaf *Counter = Leaf->GetLeafCount();
+  TString TypeName = Leaf->GetTypeName();
+
+  if(Counter and TypeName == "UChar_t"){
+    Layout = zWaveformPacked;
+    LengthBranch = Counter->GetBranch();
+
+    const UInt_t MaxLength = (Counter->GetMaximum() > 0) ? Counter->GetMaximum() : 1;
+    if(Packed.size() < MaxLength)
+      Packed.resize(MaxLength);
+    Tree->SetBranchAddress(LengthBranch->GetName(), &PackedLength);
+    Tree->SetBranchAddress(BranchName, Packed.data());
+
+    if(Buffer.empty())
+      Buffer.assign(1, 0);
+    Samples = Buffer.data();
+    return 0;
+  }
+  else if(Counter){
+    Layout = zWaveformVariableArray;
+    LengthBranch = Counter->GetBranch();
+
+    // The largest counter value written is the required buffer size
+    const UInt_t MaxLength = (Counter->GetMaximum() > 0) ? Counter->GetMaximum() : 1;
+    if(Buffer.size() < MaxLength)
+      Buffer.resize(MaxLength);
+    Tree->SetBranchAddress(LengthBranch->GetName(), &Length);
+  }
+  else{
+    Layout = zWaveformFixedArray;
+    Length = Leaf->GetLenStatic();
+    if(Buffer.size() < max(Length, 1u))
+      Buffer.resize(max(Length, 1u));
+  }
+
+  Tree->SetBranchAddress(BranchName, Buffer.data());
+  Samples = Buffer.data();
+
+  return 0;
+}
+
+
+Int_t ADAQWaveformReader::GetEntry(Long64_t Entry)
+{
+  if(!Tree)
+    return 0;
+
+  // The entry number within the present tree of a TChain; the
+  // branches (and their layout) are those of that tree
+  const Long64_t Local = Tree->LoadTree(Entry);
+  if(Local < 0)
+    return 0;
+
+  if(Tree->GetTreeNumber() != TreeNumber){
+    TreeNumber = Tree->GetTreeNumber();
+    if(SetupBranches() != 0){
+      WaveformBranch = NULL;
+      return 0;
+    }
+  }
+
+  if(!WaveformBranch)
+    return 0;
+
+  Int_t Bytes = 0;
+  
+  if(Layout == zWaveformVector){
+    Bytes = WaveformBranch->GetEntry(Local);
+    Samples = Vector->data();
+    Length = Vector->size();
+    return Bytes;
+  }
+
+  if(Layout == zWaveformPacked){
+    Bytes += LengthBranch->GetEntry(Local);
+    if(PackedLength > Packed.size()){
+      Packed.resize(PackedLength);
+      Tree->SetBranchAddress(BranchName, Packed.data());
+    }
+    Bytes += WaveformBranch->GetEntry(Local);
+
+    const UInt_t N = ADAQWaveformCodec::GetNumSamples(Packed.data(), PackedLength);
+    if(N > Buffer.size())
+      Buffer.resize(N);
+    Samples = Buffer.data();
+    
+    Int_t Decoded = ADAQWaveformCodec::Decode(Packed.data(), PackedLength, Buffer.data(), Buffer.size());
+    Length = (Decoded > 0) ? Decoded : 0;
+    return Bytes;
+  }
+  
+  // The counter is read first such that the array is read with the
+  // correct length
+  if(LengthBranch){
+    Bytes += LengthBranch->GetEntry(Local);
+    if(Length > Buffer.size()){
+      Buffer.resize(Length);
+      Tree->SetBranchAddress(BranchName, Buffer.data());
+      Samples = Buffer.data();
+    }
+  }
+  Bytes += WaveformBranch->GetEntry(Local);
+
+  return Bytes;
+}
+
+
+vector<uint16_t> *ADAQWaveformReader::GetWaveform()
+{
+  if(Layout == zWaveformVector)
+    return Vector;
+
+  Copy.resize(Length);
+  if(Length > 0)
+    memcpy(Copy.data(), Samples, Length * sizeof(uint16_t));
+  return &Copy;
+}
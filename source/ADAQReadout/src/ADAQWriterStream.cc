@@ -0,0 +1,108 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQWriterStream.cc
+// date: 16 Oct 26
+//
+// desc: ADAQWriterStream fills the WaveformTree of one producer thread
+//       of a parallel ADAQ file. See the header file for a full
+//       description.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <sstream>
+
+// ADAQ
+#include "ADAQWriterStream.hh"
+
+#ifdef __ADAQ_PARALLEL_MODE__
+
+
+ADAQWriterStream::ADAQWriterStream(ROOT::TBufferMerger *Merger,
+				   ADAQReadoutInformation *RI,
+				   const vector<ADAQBranchSettings> &BS)
+  : File(Merger->GetFile()), ReadoutInformation(RI), BranchSettings(BS),
+    WaveformTree(NULL),
+    FlushEntries(2000), Entries(0)
+{
+  // The tree lives in (and is freed with) the stream's memory file
+  File->cd();
+  WaveformTree = new TTree("WaveformTree",
+			   "TTree to hold digitized waveform data in ADAQ files");
+  WaveformTree->SetDirectory(File.get());
+}
+
+
+ADAQWriterStream::~ADAQWriterStream()
+{;}
+
+
+void ADAQWriterStream::CreateWaveformTreeBranches(Int_t Channel,
+						  vector<uint16_t> *Waveform,
+						  ADAQWaveformData *WaveformData)
+{
+  std::stringstream SS;
+  SS << "WaveformCh" << Channel;
+  TString WaveformBranchName = SS.str();
+
+  SS.str("");
+  SS << "WaveformDataCh" << Channel;
+  TString WaveformDataBranchName = SS.str();
+
+  const ADAQBranchSettings &Settings = BranchSettings[zWaveformBranchType];
+  const ADAQBranchSettings &DataSettings = BranchSettings[zWaveformDataBranchType];
+
+  if(!ReadoutInformation->GetDataReductionMode())
+    Settings.Apply(WaveformTree->Branch(WaveformBranchName, Waveform,
+					Settings.BasketSize, Settings.SplitLevel));
+
+  WaveformTree->Branch(WaveformDataBranchName,
+		       "ADAQWaveformData",
+		       WaveformData,
+		       DataSettings.BasketSize,
+		       DataSettings.SplitLevel);
+  DataSettings.Apply(WaveformTree->GetBranch(WaveformDataBranchName));
+}
+
+
+void ADAQWriterStream::FillWaveformTree()
+{
+  if(!WaveformTree)
+    return;
+
+  WaveformTree->Fill();
+  Entries++;
+
+  // Compress the remaining baskets on this thread and queue the
+  // buffer; the memory file is reset for the next entries
+  if(Entries % FlushEntries == 0)
+    File->Write();
+}
+
+
+void ADAQWriterStream::Close()
+{
+  if(!File)
+    return;
+
+  if(Entries % FlushEntries != 0)
+    File->Write();
+
+  // The memory file deletes the tree it holds
+  File.reset();
+  WaveformTree = NULL;
+}
+
+#endif
@@ -0,0 +1,102 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRecompress.cc
+// date: 16 Oct 26
+//
+// desc: Recompresses an existing ADAQ file with another compression
+//       algorithm and level, e.g. to archive a file written with LZ4
+//       during live running with ZSTD or LZMA. The waveform branches
+//       and the waveform data branches may be given different
+//       settings; the basket size of the waveform branches may be
+//       changed. The input file is not modified.
+//
+// 2run: $ ./bin/ADAQRecompress <In> <Out> <Algorithm> <Level>
+//                              [<DataAlgorithm> <DataLevel>] [<BasketSize>]
+//
+//       with the algorithms zlib, lzma, lz4, zstd
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <string>
+#include <cstdlib>
+using namespace std;
+
+// ADAQ
+#include "ADAQReadoutManager.hh"
+
+
+// Returns the ZCompressionAlgorithm of "Name" or -42 if unknown
+int GetAlgorithm(string Name)
+{
+  if(Name == "zlib") return zCompressionZLIB;
+  if(Name == "lzma") return zCompressionLZMA;
+  if(Name == "lz4") return zCompressionLZ4;
+  if(Name == "zstd") return zCompressionZSTD;
+  return -42;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if(argc != 5 and argc != 6 and argc != 7 and argc != 8){
+    cout << "\nUsage: ADAQRecompress <In> <Out> <Algorithm> <Level> "
+	 << "[<DataAlgorithm> <DataLevel>] [<BasketSize>]\n"
+	 << "       Algorithms: zlib, lzma, lz4, zstd\n" << endl;
+    return -42;
+  }
+
+  int Algorithm = GetAlgorithm(argv[3]);
+  int Level = atoi(argv[4]);
+
+  int DataAlgorithm = Algorithm;
+  int DataLevel = Level;
+  if(argc >= 7){
+    DataAlgorithm = GetAlgorithm(argv[5]);
+    DataLevel = atoi(argv[6]);
+  }
+
+  if(Algorithm < 0 or DataAlgorithm < 0){
+    cout << "\nADAQRecompress : Error! Unknown compression algorithm!\n" << endl;
+    return -42;
+  }
+
+  ADAQReadoutManager *Manager = new ADAQReadoutManager;
+  Manager->SetFileCompression((ZCompressionAlgorithm)Algorithm, Level);
+
+  ADAQBranchSettings Settings = Manager->GetBranchSettings(zWaveformBranchType);
+  Settings.Algorithm = Algorithm;
+  Settings.Level = Level;
+  if(argc == 6 or argc == 8)
+    Settings.BasketSize = atoi(argv[argc - 1]);
+  Manager->SetBranchSettings(zWaveformBranchType, Settings);
+
+  ADAQBranchSettings DataSettings = Manager->GetBranchSettings(zWaveformDataBranchType);
+  DataSettings.Algorithm = DataAlgorithm;
+  DataSettings.Level = DataLevel;
+  Manager->SetBranchSettings(zWaveformDataBranchType, DataSettings);
+
+  if(Manager->RecompressFile(argv[1], argv[2]) != 0){
+    cout << "\nADAQRecompress : Error! Could not read '" << argv[1] << "'!\n" << endl;
+    delete Manager;
+    return -42;
+  }
+
+  cout << "\nADAQRecompress : Wrote '" << argv[2] << "'\n" << endl;
+
+  delete Manager;
+  return 0;
+}
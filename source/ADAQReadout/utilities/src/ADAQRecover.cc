@@ -0,0 +1,64 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2015                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQ libraries source code is licensed under the GNU GPL v3.0.     //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQ/License.md.                 //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRecover.cc
+// date: 16 Oct 26
+//
+// desc: Recovers an ADAQ file that was never closed, e.g. after the
+//       acquisition crashed or the digitizer driver hung, into a new,
+//       properly closed ADAQ file. The file must have been written
+//       with checkpoints (ADAQReadoutManager::SetCheckpointInterval()):
+//       the trees, the metadata, and the readout information are
+//       restored as of the last checkpoint. The baskets are copied
+//       without recompression and the input file is not modified.
+//
+// 2run: $ ./bin/ADAQRecover <In> <Out>
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <string>
+using namespace std;
+
+// ADAQ
+#include "ADAQReadoutManager.hh"
+
+
+int main(int argc, char *argv[])
+{
+  if(argc != 3){
+    cout << "\nUsage: ADAQRecover <In> <Out>\n" << endl;
+    return -42;
+  }
+
+  ADAQReadoutManager *Manager = new ADAQReadoutManager;
+  Long64_t Entries = Manager->RecoverFile(argv[1], argv[2]);
+  Int_t LostKeys = Manager->GetLostKeys();
+  delete Manager;
+
+  if(Entries < 0){
+    cout << "\nADAQRecover : Error! Could not read '" << argv[1] << "'!\n" << endl;
+    return -42;
+  }
+
+  cout << "\nADAQRecover : Wrote '" << argv[2] << "' with " << Entries
+       << " WaveformTree entries\n" << endl;
+
+  if(LostKeys > 0)
+    cout << "ADAQRecover : " << LostKeys << " unreadable objects were not recovered\n" << endl;
+
+  return 0;
+}
@@ -40,6 +40,8 @@ using namespace std;
 
 // ADAQ
 #include "ADAQDigitizer.hh"
+#include "ADAQReadoutPipeline.hh"
+#include "ADAQTimeSorter.hh"
 
 class AcquisitionManager
 {
@@ -112,21 +114,33 @@ private:
   // PC. Different firmware require different variables for readout to
   // the differences in FPGA operations and data structures.
 
+  // The readout pipeline moves block transfers from the digitizer
+  // into a pool of PC buffers in its own thread while the acquisition
+  // thread decodes the previously filled buffers
+  ADAQReadoutPipeline *ReadoutPipeline;
+
+  // Retunes the events per transfer during the run (starting from
+  // EventsBeforeReadout) to balance latency and transfer efficiency
+  ADAQBLTController *BLTController;
+  uint32_t ReadoutBuffers;
   char *Buffer = NULL;
   uint32_t BufferSize;
-  vector<bool> BufferFull;
 
   // Standard (STD) firmware
+  // Events in each readout buffer are decoded by the native ADAQ
+  // decoder into an arena that is reused for every buffer
   uint32_t FPGAEvents, PCEvents;
-  char *EventPointer = NULL;
-  CAEN_DGTZ_EventInfo_t EventInfo;
-  CAEN_DGTZ_UINT16_EVENT_t *EventWaveform = NULL;
+  ADAQEventArena EventArena;
   
   // Pulse Shape Discrimination (PSD) firmware
   uint32_t PSDEventSize, PSDWaveformSize;
   CAEN_DGTZ_DPP_PSD_Event_t *PSDEvents[2];
   uint32_t NumPSDEvents[2];
   CAEN_DGTZ_DPP_PSD_Waveforms_t *PSDWaveforms = NULL;
+
+  // Unwraps the time tags into 64-bit timestamps [ns] and merges the
+  // PSD events of all channels into time order
+  ADAQTimeSorter TimeSorter;
   
   // A double-vector for readout of digitizer channels
   vector< vector<uint16_t> > Waveforms;
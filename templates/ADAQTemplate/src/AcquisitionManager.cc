@@ -39,7 +39,7 @@ using namespace boost::assign;
 
 AcquisitionManager::AcquisitionManager()
   : DGLinkOpen(false), Debug(false),
-    BufferSize(0), FPGAEvents(0), PCEvents(0),
+    ReadoutPipeline(NULL), BLTController(NULL), ReadoutBuffers(8), BufferSize(0), FPGAEvents(0), PCEvents(0),
     PSDEventSize(0), PSDWaveformSize(0)
 {
   // Instantiate an ADAQDigitizer class to facilitate programming and
@@ -52,11 +52,29 @@ AcquisitionManager::AcquisitionManager()
 				0);         // CONET node number
 
   DGManager->SetVerbose(true);
+
+  // Instantiate the readout pipeline for the digitizer. The readout
+  // buffers are allocated once the digitizer has been programmed.
+
+  ReadoutPipeline = new ADAQReadoutPipeline(DGManager, ReadoutBuffers);
+  ReadoutPipeline->SetVerbose(true);
+
+  // Instantiate the block transfer controller, which keeps events in
+  // the digitizer for no more than ~100 ms while using transfers of
+  // between 1 and 1000 events
+
+  BLTController = new ADAQBLTController(DGManager);
+  BLTController->SetLimits(1, 1000);
+  BLTController->SetTargetLatency(0.1);
+  BLTController->SetVerbose(true);
+  ReadoutPipeline->SetBLTController(BLTController);
 }
 
 
 AcquisitionManager::~AcquisitionManager()
 {
+  delete ReadoutPipeline;
+  delete BLTController;
   delete DGManager;
 }
 
@@ -127,6 +145,8 @@ void AcquisitionManager::InitializeParameters()
   ChannelEnableMask = DGManager->CalculateChannelEnableMask(ChEnabled);
   
   // Number of events aggregated before triggering readout to the PC
+  // at the start of the run; this is subsequently adapted to the
+  // trigger rate by the block transfer controller
   EventsBeforeReadout = 10;
     
   //////////////////////////////////
@@ -144,8 +164,7 @@ void AcquisitionManager::InitializeParameters()
     Buffer = NULL;
     BufferSize = 0;
     
-    EventPointer = NULL;
-    EventWaveform = NULL;
+    EventArena.Reserve(EventsBeforeReadout, DGNumChannels * RecordLength);
    
     Waveforms.resize(DGManager->GetNumChannels());
     for(int ch=0; ch<DGManager->GetNumChannels(); ch++)
@@ -217,6 +236,11 @@ void AcquisitionManager::ProgramDigitizer()
   // Initialize the digitizer to a clean state
   DGManager->Initialize();
   DGManager->Reset();
+
+  // Register edits made while programming are merged in the shadow
+  // register cache and written to the digitizer in a single pass
+  DGManager->SetRegisterCache(true);
+  DGManager->BeginRegisterBatch();
   
   /////////////////////////////////////////
   // Program the STD firmware digitizers //
@@ -229,7 +253,13 @@ void AcquisitionManager::ProgramDigitizer()
     DGManager->SetPostTriggerSize(PostTriggerSize);
     DGManager->SetAcquisitionControl("Software");
     DGManager->SetZSMode("None");
-    DGManager->SetMaxNumEventsBLT(EventsBeforeReadout);
+    BLTController->Apply(EventsBeforeReadout);
+
+    // Rather than continuously polling the digitizer, the readout
+    // thread sleeps until the digitizer raises an interrupt once
+    // EventsBeforeReadout events are stored (links that do not
+    // support interrupts automatically fall back to polling)
+    ReadoutPipeline->SetWaitMode(zWaitInterrupt, EventsBeforeReadout);
     
     DGManager->SetChannelSelfTrigger(CAEN_DGTZ_TRGMODE_ACQ_ONLY,ChannelEnableMask);
     DGManager->EnableAutoTrigger(ChannelEnableMask);
@@ -242,8 +272,13 @@ void AcquisitionManager::ProgramDigitizer()
       DGManager->SetChannelPulsePolarity(ch, ChPulsePolarity[ch]);
       DGManager->SetTriggerEdge(ch, "Falling");
     }
-    DGManager->AllocateEvent(&EventWaveform);
-    DGManager->MallocReadoutBuffer(&Buffer, &BufferSize);
+    DGManager->CommitRegisters();
+
+    // The cache is single-threaded; the readout and control threads
+    // both access registers during acquisition
+    DGManager->SetRegisterCache(false);
+    
+    ReadoutPipeline->AllocateBuffers();
   }
   
   /////////////////////////////////////////
@@ -274,11 +309,13 @@ void AcquisitionManager::ProgramDigitizer()
     DGManager->SetDPPAcquisitionMode(CAEN_DGTZ_DPP_ACQ_MODE_Mixed, CAEN_DGTZ_DPP_SAVE_PARAM_EnergyAndTime);
     DGManager->SetDPPTriggerMode(CAEN_DGTZ_DPP_TriggerMode_Normal);
     DGManager->SetDPPParameters(ChannelEnableMask, &PSDParameters);
-    DGManager->SetDPPEventAggregation(EventsBeforeReadout,0);
+    BLTController->Apply(EventsBeforeReadout);
+    DGManager->CommitRegisters();
+    DGManager->SetRegisterCache(false);
 
     // Allocation of memory must be done AFTER digitizer programming
 
-    DGManager->MallocReadoutBuffer(&Buffer, &BufferSize);
+    ReadoutPipeline->AllocateBuffers();
     DGManager->MallocDPPEvents(PSDEvents, &PSDEventSize);
     DGManager->MallocDPPWaveforms(&PSDWaveforms, &PSDWaveformSize); 
   }
@@ -309,6 +346,16 @@ void AcquisitionManager::RunAcquisitionLoop()
   
   DGManager->SWStartAcquisition();
 
+  // Start the readout thread; this thread now only decodes the
+  // buffers that have been filled by the readout pipeline
+  ReadoutPipeline->Start();
+
+  // Time tags restart from zero with every acquisition
+  TimeSorter.Reset();
+  TimeSorter.AddDigitizer(DGManager);
+
+  ADAQReadoutBuffer *ReadoutBuffer = NULL;
+
   if(DGFirmwareType == "STD"){
 
     int TotalEvents = 0;
@@ -318,29 +365,29 @@ void AcquisitionManager::RunAcquisitionLoop()
       // Determine if the user has intervened via the control thread
       boost::this_thread::interruption_point();
       
-      DGManager->GetNumFPGAEvents(&FPGAEvents);
+      // Wait up to 10 ms for the next filled readout buffer
+      ReadoutBuffer = ReadoutPipeline->WaitForFilledBuffer(10000);
       
-      if(FPGAEvents < EventsBeforeReadout)
+      if(ReadoutBuffer==NULL)
 	continue;
+
+      Buffer = ReadoutBuffer->Data;
+      BufferSize = ReadoutBuffer->Size;
       
-      DGManager->ReadData(Buffer, &BufferSize);
-      DGManager->GetNumEvents(Buffer, BufferSize, &PCEvents);
+      // Decode all events in the buffer in a single pass
+      DGManager->DecodeSTDBuffer(Buffer, BufferSize, &EventArena);
+      PCEvents = EventArena.GetNumEvents();
       
-      if(PCEvents==0)
+      if(PCEvents==0){
+	ReadoutPipeline->ReleaseBuffer(ReadoutBuffer);
 	continue;
+      }
       
       // For each event in the PC memory buffer...
       for(uint32_t evt=0; evt<PCEvents; evt++){
-	
-	// Get the event information
-	EventPointer = NULL;
-	DGManager->GetEventInfo(Buffer, BufferSize, evt, &EventInfo, &EventPointer);
-	
-	// Decode the event and obtain the waveform (voltage as a function of time)
-	DGManager->DecodeEvent(EventPointer, &EventWaveform);
-	
-	if(EventWaveform==NULL)
-	  continue;
+
+	// The trigger time tag is common to all channels of the event
+	uint64_t TimeStamp = TimeSorter.Unwrap(DGManager->GetBoardID(), -1, EventArena.GetTriggerTimeTag(evt));
 	
 	// For each channel...
 	for(int ch=0; ch<DGManager->GetNumChannels(); ch++){
@@ -349,17 +396,23 @@ void AcquisitionManager::RunAcquisitionLoop()
 	  if(!ChEnabled[ch])
 	    continue;
 	  
-	  cout << "\n\nWAVEFORM: " << TotalEvents << endl;
-	  for(uint32_t sample=0; sample<RecordLength; sample++){
-	    cout << EventWaveform->DataChannel[ch][sample] << " ";
+	  // Get the waveform (voltage as a function of time) as a
+	  // view into the event arena; no samples are copied
+	  ADAQSampleSpan Waveform = EventArena.GetWaveform(evt, ch);
+	  
+	  cout << "\n\nWAVEFORM: " << TotalEvents << " (t = " << TimeStamp << " ns)" << endl;
+	  for(uint32_t sample=0; sample<Waveform.Size; sample++){
+	    cout << Waveform[sample] << " ";
 	    // Get the digitized voltage in units of analog-to-digital conversion bits
-	    //Voltage[sample] = EventWaveform->DataChannel[ch][sample]; // [ADC]
+	    //Voltage[sample] = Waveform[sample]; // [ADC]
 
 	  }
 	}
-	DGManager->FreeEvent(&EventWaveform);
 	TotalEvents++;
       }
+
+      // Return the decoded buffer to the readout pipeline
+      ReadoutPipeline->ReleaseBuffer(ReadoutBuffer);
     }
   }
   
@@ -370,13 +423,16 @@ void AcquisitionManager::RunAcquisitionLoop()
       // Determine if the user has intervened via the control thread
       boost::this_thread::interruption_point();
 
-      // Read data from the digitizer; get the data and data size
-      DGManager->ReadData(Buffer, &BufferSize);
+      // Wait up to 10 ms for the next filled readout buffer
+      ReadoutBuffer = ReadoutPipeline->WaitForFilledBuffer(10000);
 
       // Loop until the readout buffer contains data to process
-      if(BufferSize==0)
+      if(ReadoutBuffer==NULL)
       	continue;
 
+      Buffer = ReadoutBuffer->Data;
+      BufferSize = ReadoutBuffer->Size;
+
       // Get all the data (events) from the buffer
       DGManager->GetDPPEvents(Buffer, BufferSize, PSDEvents, NumPSDEvents);
 
@@ -392,13 +448,16 @@ void AcquisitionManager::RunAcquisitionLoop()
 
 	  // Get the event-level data and print it
 	  
-	  uint32_t Time = PSDEvents[ch][evt].TimeTag;
+	  // Push the event into the time sorter, which returns its
+	  // unwrapped 64-bit timestamp; the event index within the
+	  // buffer is kept as the tag
+	  uint64_t Time = TimeSorter.Push(DGManager->GetBoardID(), ch, PSDEvents[ch][evt].TimeTag, evt);
 	  int16_t Short = PSDEvents[ch][evt].ChargeShort;
 	  int16_t Long = PSDEvents[ch][evt].ChargeLong;
 	  int16_t Base = PSDEvents[ch][evt].Baseline;
 	  
 	  cout << "EVENT[" << evt << "] DATA:\n"
-	       << "  Time tag : " << Time << "\n"
+	       << "  Time     : " << Time << " ns\n"
 	       << "  Charge S : " << Short << " ADC\n"
 	       << "  Charge L : " << Long << " ADC\n"
 	       << "  Baseline : " << Base << " ADC\n"
@@ -416,6 +475,17 @@ void AcquisitionManager::RunAcquisitionLoop()
 	    cout << "  " << i << " " << Voltage[i] << endl;
 	}
       }
+
+      // Print the events of all channels in time order as far as
+      // they can be released; events still held by the sorter are
+      // released once the other channels have caught up
+      ADAQTimeOrderedEvent SortedEvent;
+      while(TimeSorter.Pop(SortedEvent))
+	cout << "TIME-ORDERED EVENT: channel " << SortedEvent.ChannelID
+	     << " at " << SortedEvent.TimeStamp << " ns" << endl;
+
+      // Return the decoded buffer to the readout pipeline
+      ReadoutPipeline->ReleaseBuffer(ReadoutBuffer);
     }
   }
 }
@@ -474,12 +544,13 @@ void AcquisitionManager::Disarm()
   // This method safely closes the digitizer, first freeing all of the
   // allocated memory and then safely closing the digitizer link.
   
-  DGManager->FreeReadoutBuffer(&Buffer);
+  // Stop the readout thread before freeing the readout buffers
+  ReadoutPipeline->Stop();
+  ReadoutPipeline->PrintStats();
+  BLTController->PrintAdjustments();
+  ReadoutPipeline->FreeBuffers();
   
-  if(DGFirmwareType == "STD"){
-    DGManager->FreeEvent(&EventWaveform);
-  }
-  else if(DGFirmwareType == "PSD"){
+  if(DGFirmwareType == "PSD"){
     DGManager->FreeDPPEvents((void**)PSDEvents);
     DGManager->FreeDPPWaveforms(PSDWaveforms);
   }